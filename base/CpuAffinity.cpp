@@ -0,0 +1,91 @@
+#include "base/include/CpuAffinity.h"
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace faliks {
+    namespace CpuAffinity {
+
+        int numCpus() {
+            long n = ::sysconf(_SC_NPROCESSORS_CONF);
+            return n > 0 ? static_cast<int>(n) : 1;
+        }
+
+        bool pinCurrentThread(const std::vector<int> &cpus) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu: cpus) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                    CPU_SET(cpu, &set);
+                }
+            }
+            if (CPU_COUNT(&set) == 0) {
+                return false;
+            }
+            return ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set) == 0;
+        }
+
+        int currentCpu() {
+            return ::sched_getcpu();
+        }
+
+        int nodeOfCpu(int cpu) {
+            char path[64];
+            for (int node = 0; node < 1024; ++node) {
+                snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+                if (::access(path, F_OK) == 0) {
+                    return node;
+                }
+                snprintf(path, sizeof path, "/sys/devices/system/node/node%d", node);
+                if (::access(path, F_OK) != 0) {
+                    break;
+                }
+            }
+            return -1;
+        }
+
+        std::vector<int> cpusOfNode(int node) {
+            std::vector<int> cpus;
+            char path[64];
+            snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+            FILE *fp = ::fopen(path, "r");
+            if (fp == nullptr) {
+                return cpus;
+            }
+            char list[4096] = "";
+            if (::fgets(list, sizeof list, fp) != nullptr) {
+                // format: "0-3,8-11"
+                char *saveptr = nullptr;
+                for (char *range = ::strtok_r(list, ",\n", &saveptr); range != nullptr;
+                     range = ::strtok_r(nullptr, ",\n", &saveptr)) {
+                    int first = 0;
+                    int last = 0;
+                    int n = ::sscanf(range, "%d-%d", &first, &last);
+                    if (n == 1) {
+                        last = first;
+                    }
+                    for (int cpu = first; n >= 1 && cpu <= last; ++cpu) {
+                        cpus.push_back(cpu);
+                    }
+                }
+            }
+            ::fclose(fp);
+            return cpus;
+        }
+
+        bool preferMemoryNode(int node) {
+            if (node < 0 || node >= static_cast<int>(sizeof(unsigned long) * 8)) {
+                return false;
+            }
+            unsigned long nodeMask = 1UL << node;
+            return ::syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8) == 0;
+        }
+    }
+}
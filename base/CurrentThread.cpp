@@ -14,15 +14,24 @@ namespace faliks {
         __thread const char *m_threadName = "unknown";
 
         string stackTrace(bool demangle) {
-            string stack;
             const int max_frames = 200;
             void *frame[max_frames];
             int nptrs = ::backtrace(frame, max_frames);
-            char **strings = ::backtrace_symbols(frame, nptrs);
+            // skip the frame of stackTrace itself
+            return stackTrace(frame + 1, nptrs - 1, demangle);
+        }
+
+        string stackTrace(void *const *frames, int numFrames, bool demangle) {
+            string stack;
+            if (numFrames <= 0) {
+                return stack;
+            }
+            char **strings = ::backtrace_symbols(frames, numFrames);
             if (strings) {
                 size_t len = 256;
                 char *demangled = demangle ? static_cast<char *>(::malloc(len)) : nullptr;
-                for (int i = 1; i < nptrs; ++i) {
+                for (int i = 0; i < numFrames; ++i) {
+                    bool appended = false;
                     if (demangle) {
                         char *left_par = nullptr;
                         char *plus = nullptr;
@@ -44,14 +53,16 @@ namespace faliks {
                                     stack.append(demangled);
                                     stack.append(plus);
                                     stack.push_back('\n');
-                                    continue;
+                                    appended = true;
                                 }
+                                break;
                             }
                         }
+                    }
+                    if (!appended) {
                         stack.append(strings[i]);
                         stack.push_back('\n');
                     }
-
                 }
                 free(demangled);
                 free(strings);
@@ -0,0 +1,91 @@
+#include "base/include/Histogram.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace faliks {
+
+    HistogramSnapshot::HistogramSnapshot()
+            : m_counts(Histogram::kNumBuckets, 0),
+              m_count(0),
+              m_sum(0),
+              m_max(0) {
+    }
+
+    double HistogramSnapshot::mean() const {
+        return m_count == 0 ? 0.0 : static_cast<double>(m_sum) / static_cast<double>(m_count);
+    }
+
+    uint64_t HistogramSnapshot::percentile(double percentile) const {
+        if (m_count == 0) {
+            return 0;
+        }
+        auto target = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(m_count) + 0.5);
+        if (target == 0) {
+            target = 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            seen += m_counts[i];
+            if (seen >= target) {
+                uint64_t value = Histogram::bucketHighestValue(i);
+                return value < m_max ? value : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    void HistogramSnapshot::merge(const HistogramSnapshot &other) {
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        if (other.m_max > m_max) {
+            m_max = other.m_max;
+        }
+    }
+
+    std::string HistogramSnapshot::toString() const {
+        char buf[256];
+        snprintf(buf, sizeof buf,
+                 "count=%" PRIu64 " mean=%.1f p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64 " p999=%" PRIu64
+                 " max=%" PRIu64,
+                 m_count, mean(), percentile(50), percentile(90), percentile(99), percentile(99.9), m_max);
+        return buf;
+    }
+
+    Histogram::Histogram()
+            : m_count(0),
+              m_sum(0),
+              m_max(0) {
+        for (auto &count: m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    HistogramSnapshot Histogram::snapshot() const {
+        HistogramSnapshot snapshot;
+        uint64_t total = 0;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            snapshot.m_counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            total += snapshot.m_counts[i];
+        }
+        // Summing the buckets keeps the total consistent with them while the writer records.
+        snapshot.m_count = total;
+        snapshot.m_sum = m_sum.load(std::memory_order_relaxed);
+        snapshot.m_max = m_max.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    uint64_t Histogram::bucketHighestValue(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        uint64_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+        uint64_t sub = index % kSubBuckets;
+        uint64_t shift = exponent - kSubBucketBits;
+        uint64_t lowest = ((kSubBuckets + sub) << shift);
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+}
@@ -0,0 +1,183 @@
+#include "base/include/WorkStealingPool.h"
+#include "base/include/Thread.h"
+
+#include <cassert>
+
+namespace faliks {
+
+    namespace {
+        // Identifies the pool and worker the calling thread belongs to.
+        thread_local const WorkStealingPool *t_pool = nullptr;
+        thread_local size_t t_workerIndex = 0;
+
+        uint64_t mix(uint64_t x) {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdULL;
+            x ^= x >> 33;
+            return x;
+        }
+    }
+
+    WorkStealingPool::WorkStealingPool(const std::string &name)
+            : m_name(name),
+              m_numThreads(0),
+              m_maxQueueSize(0),
+              m_running(false),
+              m_pending(0),
+              m_sleepers(0),
+              m_shed(0),
+              m_next(0) {
+    }
+
+    WorkStealingPool::~WorkStealingPool() {
+        if (m_running) {
+            stop();
+        }
+    }
+
+    void WorkStealingPool::start() {
+        assert(!m_running);
+        assert(m_workers.empty());
+        int numThreads = m_numThreads > 0 ? m_numThreads : 1;
+        for (int i = 0; i < numThreads; ++i) {
+            m_workers.emplace_back(new Worker);
+        }
+        m_running = true;
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            m_workers[i]->thread.reset(new Thread([this, i] { workerFunc(i); }, m_name + std::to_string(i)));
+            m_workers[i]->thread->start();
+        }
+    }
+
+    void WorkStealingPool::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_idleMutex);
+            m_running = false;
+        }
+        m_idleCondition.notify_all();
+        for (auto &worker: m_workers) {
+            worker->thread->join();
+        }
+    }
+
+    bool WorkStealingPool::trySubmit(Task task) {
+        if (!m_running) {
+            return false;
+        }
+        size_t index = t_pool == this ? t_workerIndex : pickWorker();
+        // Counted before the push and paired with the sleepers/pending check in
+        // workerFunc: either the worker sees the task or we see the sleeper.
+        m_pending.fetch_add(1);
+        if (!push(*m_workers[index], std::move(task))) {
+            m_pending.fetch_sub(1);
+            m_shed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (m_sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_idleMutex);
+            m_idleCondition.notify_one();
+        }
+        return true;
+    }
+
+    uint64_t WorkStealingPool::executed() const {
+        uint64_t total = 0;
+        for (auto &worker: m_workers) {
+            total += worker->executed.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    uint64_t WorkStealingPool::stolen() const {
+        uint64_t total = 0;
+        for (auto &worker: m_workers) {
+            total += worker->stolen.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    size_t WorkStealingPool::pickWorker() {
+        size_t n = m_workers.size();
+        if (n == 1) {
+            return 0;
+        }
+        uint64_t r = mix(m_next.fetch_add(1, std::memory_order_relaxed));
+        size_t first = r % n;
+        size_t second = (first + 1 + (r >> 32) % (n - 1)) % n;
+        return m_workers[first]->size.load(std::memory_order_relaxed) <=
+               m_workers[second]->size.load(std::memory_order_relaxed) ? first : second;
+    }
+
+    bool WorkStealingPool::push(Worker &worker, Task &&task) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (m_maxQueueSize > 0 && worker.tasks.size() >= m_maxQueueSize) {
+            return false;
+        }
+        worker.tasks.push_back(std::move(task));
+        worker.size.store(worker.tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool WorkStealingPool::popOwn(Worker &worker, Task *task) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            return false;
+        }
+        *task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+        worker.size.store(worker.tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool WorkStealingPool::steal(size_t thief, Task *task) {
+        size_t n = m_workers.size();
+        size_t start = mix(m_next.fetch_add(1, std::memory_order_relaxed)) % n;
+        for (size_t i = 0; i < n; ++i) {
+            size_t victim = (start + i) % n;
+            if (victim == thief) {
+                continue;
+            }
+            Worker &worker = *m_workers[victim];
+            if (worker.size.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty()) {
+                continue;
+            }
+            *task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            worker.size.store(worker.tasks.size(), std::memory_order_relaxed);
+            m_workers[thief]->stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void WorkStealingPool::workerFunc(size_t index) {
+        t_pool = this;
+        t_workerIndex = index;
+        Worker &self = *m_workers[index];
+        Task task;
+        while (true) {
+            if (popOwn(self, &task) || steal(index, &task)) {
+                m_pending.fetch_sub(1);
+                task();
+                task = nullptr;
+                self.executed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_idleMutex);
+            m_sleepers.fetch_add(1);
+            if (m_pending.load() == 0) {
+                if (!m_running) {
+                    m_sleepers.fetch_sub(1);
+                    break;
+                }
+                m_idleCondition.wait(lock);
+            }
+            m_sleepers.fetch_sub(1);
+        }
+        t_pool = nullptr;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef MUDUO_LEARN_CPUAFFINITY_H
+#define MUDUO_LEARN_CPUAFFINITY_H
+
+#include <vector>
+
+namespace faliks {
+    namespace CpuAffinity {
+        int numCpus();
+
+        bool pinCurrentThread(const std::vector<int> &cpus);
+
+        int currentCpu();
+
+        // NUMA node of a cpu, -1 when the topology is unknown.
+        int nodeOfCpu(int cpu);
+
+        std::vector<int> cpusOfNode(int node);
+
+        // Makes the kernel allocate the memory of the calling thread on the node,
+        // falling back to other nodes when it is full.
+        bool preferMemoryNode(int node);
+    }
+}
+
+
+#endif //MUDUO_LEARN_CPUAFFINITY_H
@@ -37,6 +37,9 @@ namespace faliks {
         void sleepUs(int64_t us);
 
         std::string stackTrace(bool demangle);
+
+        // Symbolizes frames captured elsewhere, e.g. by ::backtrace in a signal handler.
+        std::string stackTrace(void *const *frames, int numFrames, bool demangle);
     }
 }
 
@@ -0,0 +1,88 @@
+#ifndef MUDUO_LEARN_HISTOGRAM_H
+#define MUDUO_LEARN_HISTOGRAM_H
+
+#include "base/include/Copyable.h"
+#include "base/include/NoneCopyable.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace faliks {
+
+    class HistogramSnapshot : public Copyable {
+    private:
+        std::vector<uint64_t> m_counts;
+        uint64_t m_count;
+        uint64_t m_sum;
+        uint64_t m_max;
+
+        friend class Histogram;
+
+    public:
+        HistogramSnapshot();
+
+        [[nodiscard]] uint64_t count() const { return m_count; }
+
+        [[nodiscard]] uint64_t max() const { return m_max; }
+
+        [[nodiscard]] double mean() const;
+
+        // Highest value equivalent to the given percentile, 0 < percentile <= 100.
+        [[nodiscard]] uint64_t percentile(double percentile) const;
+
+        void merge(const HistogramSnapshot &other);
+
+        [[nodiscard]] std::string toString() const;
+    };
+
+    // Log-linear buckets in the style of HdrHistogram: every power of two is split
+    // into 16 sub-buckets, so a recorded value is kept within ~6% of its real value.
+    // record() must be called by a single writer thread, snapshot() from any thread.
+    class Histogram : NoneCopyable {
+    private:
+        static constexpr int kSubBucketBits = 4;
+        static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+
+        std::atomic<uint64_t> m_counts[kSubBuckets * (65 - kSubBucketBits)];
+        std::atomic<uint64_t> m_count;
+        std::atomic<uint64_t> m_sum;
+        std::atomic<uint64_t> m_max;
+
+    public:
+        static constexpr size_t kNumBuckets = kSubBuckets * (65 - kSubBucketBits);
+
+        Histogram();
+
+        void record(int64_t value) {
+            uint64_t v = value > 0 ? static_cast<uint64_t>(value) : 0;
+            auto &bucket = m_counts[bucketIndex(v)];
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_sum.store(m_sum.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+            if (v > m_max.load(std::memory_order_relaxed)) {
+                m_max.store(v, std::memory_order_relaxed);
+            }
+            m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] HistogramSnapshot snapshot() const;
+
+        [[nodiscard]] uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+        static size_t bucketIndex(uint64_t value) {
+            if (value < kSubBuckets) {
+                return static_cast<size_t>(value);
+            }
+            int exponent = 63 - __builtin_clzll(value);
+            uint64_t sub = (value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+            return static_cast<size_t>((exponent - kSubBucketBits + 1) * kSubBuckets + sub);
+        }
+
+        static uint64_t bucketHighestValue(size_t index);
+    };
+}
+
+
+#endif //MUDUO_LEARN_HISTOGRAM_H
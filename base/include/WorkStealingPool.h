@@ -0,0 +1,94 @@
+#ifndef MUDUO_LEARN_WORKSTEALINGPOOL_H
+#define MUDUO_LEARN_WORKSTEALINGPOOL_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/ThreadSaftyCheck.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace faliks {
+
+    class Thread;
+
+    // Executor for CPU-bound tasks. Every worker owns a bounded deque: it runs
+    // its own tasks from the front and, when empty, steals from the back of
+    // the others. Submissions from outside go to the shorter of two randomly
+    // chosen deques, tasks submitted by a worker to its own deque. A task that
+    // finds its deque full is shed instead of queued.
+    class WorkStealingPool : NoneCopyable {
+    public:
+        using Task = std::function<void()>;
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks GUARDED_BY(mutex);
+            std::atomic<size_t> size{0};
+            std::atomic<uint64_t> executed{0};
+            std::atomic<uint64_t> stolen{0};
+            std::unique_ptr<Thread> thread;
+        };
+
+        const std::string m_name;
+        int m_numThreads;
+        size_t m_maxQueueSize;
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::atomic<bool> m_running;
+        std::atomic<size_t> m_pending;
+        std::atomic<int> m_sleepers;
+        std::atomic<uint64_t> m_shed;
+        std::atomic<uint64_t> m_next;
+        std::mutex m_idleMutex;
+        std::condition_variable m_idleCondition;
+
+        void workerFunc(size_t index);
+
+        bool push(Worker &worker, Task &&task);
+
+        bool popOwn(Worker &worker, Task *task);
+
+        bool steal(size_t thief, Task *task);
+
+        size_t pickWorker();
+
+    public:
+        explicit WorkStealingPool(const std::string &name = "WorkStealingPool");
+
+        ~WorkStealingPool();
+
+        void setThreadNum(int numThreads) { m_numThreads = numThreads; }
+
+        // Per-worker bound, 0 means unbounded.
+        void setMaxQueueSize(size_t maxSize) { m_maxQueueSize = maxSize; }
+
+        void start();
+
+        // Runs the tasks already queued, then joins the workers.
+        void stop();
+
+        // false when the task was shed or the pool is not running.
+        bool trySubmit(Task task);
+
+        [[nodiscard]] const std::string &name() const { return m_name; }
+
+        [[nodiscard]] int numThreads() const { return static_cast<int>(m_workers.size()); }
+
+        [[nodiscard]] size_t queueSize() const { return m_pending.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] uint64_t shed() const { return m_shed.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] uint64_t executed() const;
+
+        [[nodiscard]] uint64_t stolen() const;
+    };
+}
+
+
+#endif //MUDUO_LEARN_WORKSTEALINGPOOL_H
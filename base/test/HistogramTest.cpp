@@ -0,0 +1,67 @@
+#include "base/include/Histogram.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <cstdint>
+#include <string>
+
+using namespace faliks;
+
+void checkNear(uint64_t value, uint64_t expected, const char *what) {
+    uint64_t diff = value > expected ? value - expected : expected - value;
+    logi("checkNear: {} {} ~ {}", what, value, expected);
+    check(diff * 100 <= expected * 7, std::string("checkNear ") + what);
+}
+
+void testBuckets() {
+    const uint64_t values[] = {0, 1, 15, 16, 17, 1000, 123456789, UINT64_MAX};
+    for (uint64_t v: values) {
+        size_t index = Histogram::bucketIndex(v);
+        uint64_t highest = Histogram::bucketHighestValue(index);
+        check(index < Histogram::kNumBuckets && highest >= v && Histogram::bucketIndex(highest) == index,
+              "bucket of " + std::to_string(v));
+    }
+}
+
+void testPercentiles() {
+    Histogram histogram;
+    for (int64_t v = 1; v <= 10000; ++v) {
+        histogram.record(v);
+    }
+    HistogramSnapshot snapshot = histogram.snapshot();
+    checkNear(snapshot.count(), 10000, "count");
+    checkNear(snapshot.percentile(50), 5000, "p50");
+    checkNear(snapshot.percentile(99), 9900, "p99");
+    checkNear(snapshot.max(), 10000, "max");
+    checkNear(static_cast<uint64_t>(snapshot.mean()), 5000, "mean");
+    logi("{}", snapshot.toString());
+}
+
+void testConcurrentSnapshot() {
+    Histogram histogram;
+    Thread writer([&histogram] {
+        for (int i = 0; i < 1000000; ++i) {
+            histogram.record(i % 1000);
+        }
+    });
+    writer.start();
+    uint64_t last = 0;
+    while (last < 1000000) {
+        uint64_t count = histogram.snapshot().count();
+        check(count >= last, "snapshot count never goes backwards");
+        last = count;
+    }
+    writer.join();
+    checkNear(histogram.snapshot().percentile(50), 500, "concurrent p50");
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testBuckets();
+    testPercentiles();
+    testConcurrentSnapshot();
+    logi("HistogramTest passed: {}", passed);
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
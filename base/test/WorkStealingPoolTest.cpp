@@ -0,0 +1,92 @@
+#include "base/include/WorkStealingPool.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+
+void testEveryTaskRunsOnce() {
+    const int kTasks = 100000;
+    WorkStealingPool pool("runOnce");
+    pool.setThreadNum(4);
+    pool.start();
+    std::vector<std::atomic<int>> runs(kTasks);
+    CountDownLatch latch(kTasks);
+    for (int i = 0; i < kTasks; ++i) {
+        while (!pool.trySubmit([&runs, &latch, i] {
+            runs[i].fetch_add(1);
+            latch.countDown();
+        })) {
+        }
+    }
+    latch.wait();
+    pool.stop();
+    bool once = true;
+    for (auto &r: runs) {
+        once = once && r.load() == 1;
+    }
+    check(once && pool.executed() == kTasks, "every task runs once");
+}
+
+// A single producer worker spawns all the subtasks onto its own deque, the
+// other workers only get work by stealing.
+void testStealing() {
+    const int kTasks = 2000;
+    WorkStealingPool pool("steal");
+    pool.setThreadNum(4);
+    pool.start();
+    CountDownLatch latch(kTasks);
+    pool.trySubmit([&pool, &latch] {
+        for (int i = 0; i < kTasks; ++i) {
+            pool.trySubmit([&latch] {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                latch.countDown();
+            });
+        }
+    });
+    latch.wait();
+    logi("stolen = {} of {}", pool.stolen(), kTasks);
+    check(pool.stolen() > 0, "idle workers steal");
+    pool.stop();
+}
+
+void testShedding() {
+    WorkStealingPool pool("shed");
+    pool.setThreadNum(2);
+    pool.setMaxQueueSize(8);
+    pool.start();
+    CountDownLatch blocked(1);
+    std::atomic<int> ran(0);
+    for (int i = 0; i < 2; ++i) {
+        pool.trySubmit([&blocked] { blocked.wait(); });
+    }
+    while (pool.queueSize() > 0) {
+        std::this_thread::yield();
+    }
+    int accepted = 0;
+    for (int i = 0; i < 100; ++i) {
+        if (pool.trySubmit([&ran] { ++ran; })) {
+            ++accepted;
+        }
+    }
+    blocked.countDown();
+    pool.stop();
+    logi("accepted = {} shed = {}", accepted, pool.shed());
+    check(accepted <= 16 && pool.shed() == static_cast<uint64_t>(100 - accepted) && ran == accepted,
+          "bounded queues shed load");
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testEveryTaskRunsOnce();
+    testStealing();
+    testShedding();
+    logi("WorkStealingPoolTest passed: {}", passed);
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
@@ -6,6 +6,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <cassert>
+#include <cstring>
 
 using namespace faliks;
 
@@ -17,7 +19,7 @@ namespace faliks {
     }
 
     inline int createNonblockingOrDie(sa_family_t family) {
-        int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, family == AF_UNIX ? 0 : IPPROTO_TCP);
         if (sockfd < 0) {
             loge("createNonblockingOrDie error: {}", strerror(errno));
         }
@@ -28,16 +30,23 @@ namespace faliks {
 void Acceptor::handleRead() {
     m_loop->assertInLoopThread();
 
-    InetAddress peerAddr;
-
-    int connfd = m_acceptSocket.accept(&peerAddr);
-    if (connfd > 0) {
-        if (m_newConnectionCallback) {
-            m_newConnectionCallback(connfd, peerAddr);
-        } else {
-            close(connfd);
+    for (int i = 0; i < m_maxAcceptsPerEvent; ++i) {
+        InetAddress peerAddr;
+        int connfd = m_acceptSocket.accept(&peerAddr);
+        if (connfd >= 0) {
+            if (m_newConnectionCallback) {
+                m_newConnectionCallback(connfd, peerAddr);
+            } else {
+                close(connfd);
+            }
+            continue;
+        }
+        if (errno == EAGAIN) {
+            break;
+        }
+        if (errno == ECONNABORTED || errno == EINTR) {
+            continue;
         }
-    } else {
         loge("accept error: {}", strerror(errno));
         if (errno == EMFILE) {
             close(m_idleFd);
@@ -45,6 +54,7 @@ void Acceptor::handleRead() {
             close(m_idleFd);
             m_idleFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
         }
+        break;
     }
 }
 
@@ -53,11 +63,40 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
           m_acceptSocket(createNonblockingOrDie(listenAddr.family())),
           m_acceptChannel(loop, m_acceptSocket.fd()),
           m_listening(false),
-          m_idleFd(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {
+          m_idleFd(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+          m_maxAcceptsPerEvent(32) {
     assert(m_idleFd >= 0);
-    m_acceptSocket.setReuseAddr(true);
-    m_acceptSocket.setReusePort(reuseport);
+    if (listenAddr.isUnix()) {
+        // A socket file left by an earlier run would fail the bind.
+        std::string path = listenAddr.unixName();
+        if (!path.empty() && path[0] != '@') {
+            ::unlink(path.c_str());
+        }
+    } else {
+        m_acceptSocket.setReuseAddr(true);
+        m_acceptSocket.setReusePort(reuseport);
+    }
     m_acceptSocket.bindAddress(listenAddr);
+    setupChannel();
+}
+
+Acceptor::Acceptor(EventLoop *loop, int listenFd)
+        : m_loop(loop),
+          m_acceptSocket(listenFd),
+          m_acceptChannel(loop, listenFd),
+          m_listening(false),
+          m_idleFd(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+          m_maxAcceptsPerEvent(32) {
+    assert(m_idleFd >= 0);
+    // An inherited socket may come without the flags we create ours with.
+    int flags = ::fcntl(listenFd, F_GETFL);
+    ::fcntl(listenFd, F_SETFL, flags | O_NONBLOCK);
+    ::fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+    setupChannel();
+}
+
+void Acceptor::setupChannel() {
+    m_acceptChannel.setType(Channel::Type::kAcceptor);
     m_acceptChannel.setReadCallback([this](Timestamp) {
         handleRead();
     });
@@ -15,6 +15,8 @@ namespace faliks {
               m_revents(0),
               m_index(-1),
               m_logHup(true),
+              m_highPriority(false),
+              m_type(Type::kOther),
               m_tied(false),
               m_eventHandling(false),
               m_addedToLoop(false) {
@@ -168,11 +170,30 @@ namespace faliks {
         return oss.str();
     }
 
+    const char *Channel::typeToString(Type type) {
+        static const char *types[] = {
+                "Other",
+                "Wakeup",
+                "Timer",
+                "Acceptor",
+                "Connection"
+        };
+        static_assert(sizeof(types) / sizeof(types[0]) == static_cast<size_t>(Type::kNumTypes));
+        auto index = static_cast<size_t>(type);
+        return index < static_cast<size_t>(Type::kNumTypes) ? types[index] : "Unknown";
+    }
+
     void Channel::doNotLogHup() {
         m_logHup = false;
     }
 
 
+    void Channel::setOwnerLoop(EventLoop *loop) {
+        assert(!m_addedToLoop);
+        assert(!m_eventHandling);
+        m_loop = loop;
+    }
+
     void Channel::remove() {
         assert(isNoneEvent());
         m_addedToLoop = false;
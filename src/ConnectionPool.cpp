@@ -0,0 +1,146 @@
+#include "src/include/ConnectionPool.h"
+#include "src/include/EventLoop.h"
+#include "src/include/TcpClient.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/fmtlog.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace faliks;
+
+ConnectionPool::ConnectionPool(EventLoop *loop, const InetAddress &backendAddr, const std::string &nameArg,
+                               size_t maxConnections)
+        : m_loop(loop),
+          m_backendAddr(backendAddr),
+          m_name(nameArg),
+          m_maxConnections(maxConnections > 0 ? maxConnections : 1),
+          m_initialRetryDelay(0.5),
+          m_maxRetryDelay(30),
+          m_messageCallback(defaultMessageCallback),
+          m_numConnected(0) {
+}
+
+ConnectionPool::~ConnectionPool() {
+    m_loop->assertInLoopThread();
+    // The clients close their connections, whose last callbacks must not
+    // come back here.
+    for (auto &client: m_clients) {
+        if (TcpConnectionPtr conn = client->connection()) {
+            conn->setConnectionCallback(defaultConnectionCallback);
+            conn->setMessageCallback(defaultMessageCallback);
+        }
+    }
+    m_clients.clear();
+}
+
+void ConnectionPool::acquire(AcquireCallback cb) {
+    m_loop->assertInLoopThread();
+    if (!m_idle.empty()) {
+        TcpConnectionPtr conn = std::move(m_idle.back());
+        m_idle.pop_back();
+        cb(conn);
+        return;
+    }
+    m_waiters.push_back(std::move(cb));
+    // Every waiter beyond the connections already on their way gets a new
+    // one, as far as the limit allows.
+    size_t opening = m_clients.size() - m_numConnected;
+    if (m_waiters.size() > opening && m_clients.size() < m_maxConnections) {
+        openConnection();
+    }
+}
+
+void ConnectionPool::release(const TcpConnectionPtr &conn) {
+    m_loop->assertInLoopThread();
+    assert(conn->getLoop() == m_loop);
+    if (!conn->connected()) {
+        return;
+    }
+    conn->setMessageCallback(m_messageCallback);
+    m_idle.push_back(conn);
+    serveWaiters();
+}
+
+void ConnectionPool::openConnection() {
+    auto client = std::make_unique<TcpClient>(m_loop, m_backendAddr, m_name);
+    client->setRetryDelays(m_initialRetryDelay, m_maxRetryDelay);
+    client->setConnectionCallback([this](const TcpConnectionPtr &conn) { onConnection(conn); });
+    client->setMessageCallback(m_messageCallback);
+    client->enableRetry();
+    client->connect();
+    m_clients.push_back(std::move(client));
+    logd("ConnectionPool [{}] - opening connection {} of {} to {}", m_name, m_clients.size(), m_maxConnections,
+         m_backendAddr.toIpPort());
+}
+
+// Runs in the loop: the clients belong to it.
+void ConnectionPool::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        ++m_numConnected;
+        conn->setTcpNoDelay(true);
+        m_idle.push_back(conn);
+        serveWaiters();
+    } else {
+        // The client reconnects by itself; a leased connection is dropped
+        // when it comes back.
+        --m_numConnected;
+        m_idle.erase(std::remove(m_idle.begin(), m_idle.end(), conn), m_idle.end());
+    }
+}
+
+// A waiter may acquire or release again from its callback.
+void ConnectionPool::serveWaiters() {
+    while (!m_waiters.empty() && !m_idle.empty()) {
+        AcquireCallback cb = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        TcpConnectionPtr conn = std::move(m_idle.back());
+        m_idle.pop_back();
+        cb(conn);
+    }
+}
+
+LoopConnectionPools::LoopConnectionPools(const std::vector<EventLoop *> &loops, const InetAddress &backendAddr,
+                                         const std::string &nameArg, size_t maxConnectionsPerLoop) {
+    for (EventLoop *loop: loops) {
+        m_pools.emplace(loop, std::make_unique<ConnectionPool>(loop, backendAddr, nameArg, maxConnectionsPerLoop));
+    }
+}
+
+LoopConnectionPools::~LoopConnectionPools() {
+    for (auto &entry: m_pools) {
+        EventLoop *loop = entry.first;
+        std::unique_ptr<ConnectionPool> &pool = entry.second;
+        if (loop->isInLoopThread()) {
+            pool.reset();
+        } else {
+            CountDownLatch latch(1);
+            loop->runInLoop([&pool, &latch] {
+                pool.reset();
+                latch.countDown();
+            });
+            latch.wait();
+        }
+    }
+}
+
+void LoopConnectionPools::setMessageCallback(const ConnectionPool::MessageCallback &cb) {
+    for (auto &entry: m_pools) {
+        entry.second->setMessageCallback(cb);
+    }
+}
+
+void LoopConnectionPools::setRetryDelays(double initialDelay, double maxDelay) {
+    for (auto &entry: m_pools) {
+        entry.second->setRetryDelays(initialDelay, maxDelay);
+    }
+}
+
+ConnectionPool *LoopConnectionPools::poolOf(EventLoop *loop) const {
+    auto it = m_pools.find(loop);
+    return it == m_pools.end() ? nullptr : it->second.get();
+}
+
+ConnectionPool *LoopConnectionPools::local() const {
+    return poolOf(EventLoop::getEventLoopOfCurrentThread());
+}
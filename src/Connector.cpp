@@ -0,0 +1,239 @@
+#include "src/include/Connector.h"
+#include "src/include/Channel.h"
+#include "src/include/EventLoop.h"
+#include "base/include/Timestamp.h"
+#include "base/include/fmtlog.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+using namespace faliks;
+
+namespace {
+    int socketError(int sockfd) {
+        int optval = 0;
+        auto optlen = static_cast<socklen_t>(sizeof optval);
+        if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
+            return errno;
+        }
+        return optval;
+    }
+
+    // A TCP connect to a local port nobody listens on can pick that very
+    // port as its source and connect to itself.
+    bool isSelfConnect(int sockfd) {
+        struct sockaddr_storage local{};
+        struct sockaddr_storage peer{};
+        socklen_t localLen = sizeof local;
+        socklen_t peerLen = sizeof peer;
+        if (::getsockname(sockfd, reinterpret_cast<struct sockaddr *>(&local), &localLen) < 0 ||
+            ::getpeername(sockfd, reinterpret_cast<struct sockaddr *>(&peer), &peerLen) < 0) {
+            return false;
+        }
+        if (local.ss_family == AF_INET) {
+            const auto *l = reinterpret_cast<const struct sockaddr_in *>(&local);
+            const auto *p = reinterpret_cast<const struct sockaddr_in *>(&peer);
+            return l->sin_port == p->sin_port && l->sin_addr.s_addr == p->sin_addr.s_addr;
+        }
+        if (local.ss_family == AF_INET6) {
+            const auto *l = reinterpret_cast<const struct sockaddr_in6 *>(&local);
+            const auto *p = reinterpret_cast<const struct sockaddr_in6 *>(&peer);
+            return l->sin6_port == p->sin6_port && memcmp(&l->sin6_addr, &p->sin6_addr, sizeof l->sin6_addr) == 0;
+        }
+        return false;
+    }
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+        : m_loop(loop),
+          m_serverAddr(serverAddr),
+          m_connect(false),
+          m_state(State::kDisconnected),
+          m_initialRetryDelay(0.5),
+          m_maxRetryDelay(30),
+          m_retryDelay(0.5),
+          m_retries(0),
+          m_jitterState(reinterpret_cast<uintptr_t>(this) ^ static_cast<uint64_t>(
+                  Timestamp::now().microSecondsSinceEpoch())),
+          m_retryPending(false) {
+    if (m_jitterState == 0) {
+        m_jitterState = 1;
+    }
+}
+
+Connector::~Connector() {
+    assert(!m_channel);
+}
+
+void Connector::start() {
+    m_connect = true;
+    m_loop->runInLoop([self = shared_from_this()] { self->startInLoop(); });
+}
+
+void Connector::startInLoop() {
+    m_loop->assertInLoopThread();
+    if (m_connect && m_state == State::kDisconnected && !m_retryPending) {
+        connect();
+    }
+}
+
+void Connector::restart() {
+    m_loop->assertInLoopThread();
+    m_state = State::kDisconnected;
+    m_retryDelay = m_initialRetryDelay;
+    m_retries = 0;
+    m_connect = true;
+    startInLoop();
+}
+
+void Connector::stop() {
+    m_connect = false;
+    m_loop->runInLoop([self = shared_from_this()] { self->stopInLoop(); });
+}
+
+void Connector::stopInLoop() {
+    m_loop->assertInLoopThread();
+    if (m_retryPending) {
+        m_loop->cancel(m_retryTimer);
+        m_retryPending = false;
+    }
+    if (m_state == State::kConnecting) {
+        m_state = State::kDisconnected;
+        ::close(removeAndResetChannel());
+    }
+}
+
+void Connector::connect() {
+    if (!m_serverAddr.valid()) {
+        // Retrying cannot help a name that did not fit.
+        loge("Connector::connect - invalid address");
+        m_state = State::kDisconnected;
+        return;
+    }
+    sa_family_t family = m_serverAddr.family();
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, family == AF_UNIX ? 0 : IPPROTO_TCP);
+    if (sockfd < 0) {
+        loge("Connector::connect - socket: {}", strerror(errno));
+        retry(-1);
+        return;
+    }
+    int ret = ::connect(sockfd, m_serverAddr.getSockAddr(), m_serverAddr.getSockLen());
+    int savedErrno = ret == 0 ? 0 : errno;
+    switch (savedErrno) {
+        case 0:
+        case EINPROGRESS:
+        case EINTR:
+        case EISCONN:
+            connecting(sockfd);
+            break;
+        // Worth another try: nobody listening yet, a full unix backlog, or
+        // local ports running out.
+        case EAGAIN:
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+        case ECONNREFUSED:
+        case ENETUNREACH:
+        case ENOENT:
+        case ETIMEDOUT:
+            retry(sockfd);
+            break;
+        default:
+            loge("Connector::connect {} - {}", m_serverAddr.toIpPort(), strerror(savedErrno));
+            ::close(sockfd);
+            m_state = State::kDisconnected;
+            break;
+    }
+}
+
+void Connector::connecting(int sockfd) {
+    m_state = State::kConnecting;
+    assert(!m_channel);
+    m_channel = std::make_unique<Channel>(m_loop, sockfd);
+    m_channel->setWriteCallback([this] { handleWrite(); });
+    m_channel->setErrorCallback([this] { handleError(); });
+    // The channel calls back into this, which must outlive the attempt.
+    m_channel->tie(shared_from_this());
+    m_channel->enableWriting();
+}
+
+// The channel is being handled, so it is destroyed later.
+int Connector::removeAndResetChannel() {
+    m_channel->disableAll();
+    m_channel->remove();
+    int sockfd = m_channel->getFd();
+    std::shared_ptr<Channel> channel(std::move(m_channel));
+    m_loop->queueInLoop([channel] {});
+    return sockfd;
+}
+
+void Connector::handleWrite() {
+    if (m_state != State::kConnecting) {
+        return;
+    }
+    int sockfd = removeAndResetChannel();
+    int err = socketError(sockfd);
+    if (err != 0) {
+        logd("Connector::handleWrite {} - {}", m_serverAddr.toIpPort(), strerror(err));
+        retry(sockfd);
+    } else if (isSelfConnect(sockfd)) {
+        logw("Connector::handleWrite {} - self connect", m_serverAddr.toIpPort());
+        retry(sockfd);
+    } else if (m_connect) {
+        m_state = State::kConnected;
+        m_retries = 0;
+        m_retryDelay = m_initialRetryDelay;
+        if (m_newConnectionCallback) {
+            m_newConnectionCallback(sockfd);
+        } else {
+            ::close(sockfd);
+        }
+    } else {
+        m_state = State::kDisconnected;
+        ::close(sockfd);
+    }
+}
+
+void Connector::handleError() {
+    if (m_state != State::kConnecting) {
+        return;
+    }
+    int sockfd = removeAndResetChannel();
+    logd("Connector::handleError {} - {}", m_serverAddr.toIpPort(), strerror(socketError(sockfd)));
+    retry(sockfd);
+}
+
+void Connector::retry(int sockfd) {
+    if (sockfd >= 0) {
+        ::close(sockfd);
+    }
+    m_state = State::kDisconnected;
+    if (!m_connect) {
+        return;
+    }
+    ++m_retries;
+    double delay = nextRetryDelay();
+    logd("Connector::retry {} in {:.3f}s, attempt {}", m_serverAddr.toIpPort(), delay, m_retries);
+    std::weak_ptr<Connector> weak(shared_from_this());
+    m_retryPending = true;
+    m_retryTimer = m_loop->runAfter(delay, [weak] {
+        if (auto self = weak.lock()) {
+            self->m_retryPending = false;
+            self->startInLoop();
+        }
+    });
+}
+
+double Connector::nextRetryDelay() {
+    m_jitterState ^= m_jitterState << 13;
+    m_jitterState ^= m_jitterState >> 7;
+    m_jitterState ^= m_jitterState << 17;
+    double unit = static_cast<double>(m_jitterState >> 11) / static_cast<double>(1ULL << 53);
+    double delay = m_retryDelay * (0.5 + 0.5 * unit);
+    m_retryDelay = std::min(m_retryDelay * 2, m_maxRetryDelay);
+    return delay;
+}
@@ -2,12 +2,15 @@
 #include "src/include/Channel.h"
 #include "src/include/Poller.h"
 #include "src/include/TimerQueue.h"
+#include "src/include/LoopMetrics.h"
+#include "src/include/LoopLoad.h"
 #include "base/include/fmtlog.h"
 
 #include "base/include/CurrentThread.h"
 
 #include <sys/eventfd.h>
 #include <cassert>
+#include <algorithm>
 
 namespace faliks {
 
@@ -37,7 +40,18 @@ namespace faliks {
               m_timerQueue(new TimerQueue(this)),
               m_wakeupFd(createEventFd()),
               m_wakeupChannel(new Channel(this, m_wakeupFd)),
-              m_currentActiveChannel(nullptr) {
+              m_currentActiveChannel(nullptr),
+              m_carriedCount(0),
+              m_maxFunctorsPerIteration(0),
+              m_ioBudgetUs(0),
+              m_taskBudgetUs(0),
+              m_metrics(new LoopMetrics),
+              m_metricsEnabled(true),
+              m_load(new LoopLoad),
+              m_watched(false),
+              m_activityStartUs(0),
+              m_activityFd(-1),
+              m_activityType(-1) {
         logd("EventLoop created in thread {}", m_threadId);
         if (t_loopInThisThread) {
             loge("Another EventLoop exists in this thread {}", m_threadId);
@@ -45,6 +59,8 @@ namespace faliks {
             t_loopInThisThread = this;
         }
         m_wakeupChannel->setReadCallback([this](Timestamp) { handleRead(); });
+        m_wakeupChannel->setHighPriority(true);
+        m_wakeupChannel->setType(Channel::Type::kWakeup);
         m_wakeupChannel->enableReading();
     }
 
@@ -54,6 +70,9 @@ namespace faliks {
         m_wakeupChannel->remove();
         ::close(m_wakeupFd);
         m_currentActiveChannel = nullptr;
+        if (t_loopInThisThread == this) {
+            t_loopInThisThread = nullptr;
+        }
     }
 
     void EventLoop::loop() {
@@ -63,25 +82,41 @@ namespace faliks {
         m_quit = false;
 
         logi("EventLoop start looping");
-        {
-            std::scoped_lock<std::mutex> lock(m_quitMutex);
-            while (!m_quit) {
-                m_activeChannels.clear();
-                m_pollReturnTime = m_poller->poll(kPollTimeMs, &m_activeChannels);
-                ++m_iteration;
-                m_eventHandling = true;
-                printActiveChannels();
-                for (auto *channel: m_activeChannels) {
-                    m_currentActiveChannel = channel;
-                    m_currentActiveChannel->handleEvent(m_pollReturnTime);
-                }
-                m_currentActiveChannel = nullptr;
-                m_eventHandling = false;
-                doPendingFunctors();
+        while (!m_quit) {
+            m_activeChannels.clear();
+            const bool metricsEnabled = m_metricsEnabled;
+            Timestamp pollStart(metricsEnabled ? Timestamp::now() : Timestamp::invalid());
+            m_pollReturnTime = m_poller->poll(hasCarriedWork() ? 0 : kPollTimeMs, &m_activeChannels);
+            m_iteration.store(m_iteration.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (metricsEnabled) {
+                m_metrics->recordPoll(m_pollReturnTime.microSecondsSinceEpoch() - pollStart.microSecondsSinceEpoch(),
+                                      m_activeChannels.size());
+            }
+            m_eventHandling = true;
+            printActiveChannels();
+            handleActiveChannels();
+            m_currentActiveChannel = nullptr;
+            m_eventHandling = false;
+            doPendingFunctors();
+            int64_t endUs = Timestamp::now().microSecondsSinceEpoch();
+            int64_t busyUs = endUs - m_pollReturnTime.microSecondsSinceEpoch();
+            if (metricsEnabled) {
+                m_metrics->recordBusy(busyUs);
             }
-            logi("EventLoop stop looping");
-            m_looping = false;
+            m_load->recordIteration(busyUs, endUs);
         }
+        // Functors held back by the budgets were queued before quit(), and
+        // without budgets they would have run, e.g. connectDestroyed.
+        m_callingPendingFunctors = true;
+        while (!m_carriedFunctors.empty()) {
+            std::function<void()> functor(std::move(m_carriedFunctors.front()));
+            m_carriedFunctors.pop_front();
+            runFunctor(functor);
+        }
+        m_carriedCount = 0;
+        m_callingPendingFunctors = false;
+        logi("EventLoop stop looping");
+        m_looping = false;
     }
 
     void EventLoop::assertInLoopThread() {
@@ -99,25 +134,151 @@ namespace faliks {
         return m_threadId == CurrentThread::tid();
     }
 
+    void EventLoop::handleActiveChannels() {
+        const bool timed = m_ioBudgetUs > 0 || m_metricsEnabled || m_watched;
+        m_lastHandlerEnd = m_pollReturnTime;
+        for (auto *channel: m_activeChannels) {
+            if (channel->highPriority()) {
+                handleChannel(channel, timed);
+            }
+        }
+
+        if (m_ioBudgetUs <= 0) {
+            for (auto *channel: m_activeChannels) {
+                if (!channel->highPriority()) {
+                    handleChannel(channel, timed);
+                }
+            }
+            return;
+        }
+
+        // Channels skipped last iteration are only compared by address, the level
+        // triggered poller reports them again if they are still alive and ready.
+        ChannelList deferred;
+        deferred.swap(m_deferredChannels);
+        std::sort(deferred.begin(), deferred.end());
+
+        bool exhausted = false;
+        for (bool deferredPass: {true, false}) {
+            for (auto *channel: m_activeChannels) {
+                if (channel->highPriority() ||
+                    std::binary_search(deferred.begin(), deferred.end(), channel) != deferredPass) {
+                    continue;
+                }
+                if (exhausted) {
+                    m_deferredChannels.push_back(channel);
+                    continue;
+                }
+                handleChannel(channel, true);
+                exhausted = m_lastHandlerEnd.microSecondsSinceEpoch() - m_pollReturnTime.microSecondsSinceEpoch() >=
+                            m_ioBudgetUs;
+            }
+        }
+    }
+
+    void EventLoop::handleChannel(Channel *channel, bool timed) {
+        // The channel may be destroyed by its own handler.
+        Channel::Type type = channel->type();
+        const bool watched = m_watched;
+        if (watched) {
+            m_activityFd.store(channel->getFd(), std::memory_order_release);
+            m_activityType.store(static_cast<int>(type), std::memory_order_release);
+        }
+        m_currentActiveChannel = channel;
+        // Started here, so the budget and deferral bookkeeping between
+        // handlers is not charged to them.
+        Timestamp start;
+        if (timed) {
+            start = Timestamp::now();
+            if (watched) {
+                m_activityStartUs.store(start.microSecondsSinceEpoch(), std::memory_order_release);
+            }
+        }
+        m_currentActiveChannel->handleEvent(m_pollReturnTime);
+        if (watched) {
+            m_activityStartUs.store(0, std::memory_order_release);
+        }
+        if (timed) {
+            Timestamp now(Timestamp::now());
+            if (m_metricsEnabled) {
+                m_metrics->recordHandler(type, now.microSecondsSinceEpoch() - start.microSecondsSinceEpoch());
+            }
+            m_lastHandlerEnd = now;
+        }
+    }
+
     void EventLoop::doPendingFunctors() {
+        std::vector<std::function<void()>> urgent;
         std::vector<std::function<void()>> functors;
+        Timestamp pendingSince;
         m_callingPendingFunctors = true;
         {
             std::scoped_lock<std::mutex> lock(m_pendingMutex);
+            urgent.swap(m_urgentFunctors);
             functors.swap(m_pendingFunctors);
+            pendingSince.swap(m_pendingSince);
         }
 
-        for (const auto &functor: functors) {
-            functor();
+        if (m_metricsEnabled && pendingSince.valid()) {
+            m_metrics->recordQueue(urgent.size() + functors.size() + m_carriedFunctors.size(),
+                                   Timestamp::now().microSecondsSinceEpoch() - pendingSince.microSecondsSinceEpoch());
+        }
+
+        for (const auto &functor: urgent) {
+            runFunctor(functor);
+        }
+
+        if (m_maxFunctorsPerIteration == 0 && m_taskBudgetUs <= 0 && m_carriedFunctors.empty()) {
+            for (const auto &functor: functors) {
+                runFunctor(functor);
+            }
+        } else {
+            for (auto &functor: functors) {
+                m_carriedFunctors.emplace_back(std::move(functor));
+            }
+            runCarriedFunctors();
         }
         m_callingPendingFunctors = false;
     }
 
-    void EventLoop::quit() {
-        {
-            std::scoped_lock<std::mutex> lock(m_quitMutex);
-            m_quit = true;
+    void EventLoop::runCarriedFunctors() {
+        Timestamp start(m_taskBudgetUs > 0 ? Timestamp::now() : Timestamp::invalid());
+        size_t ran = 0;
+        while (!m_carriedFunctors.empty()) {
+            if (m_maxFunctorsPerIteration > 0 && ran >= m_maxFunctorsPerIteration) {
+                break;
+            }
+            if (m_taskBudgetUs > 0 && ran > 0 &&
+                Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch() >= m_taskBudgetUs) {
+                break;
+            }
+            std::function<void()> functor(std::move(m_carriedFunctors.front()));
+            m_carriedFunctors.pop_front();
+            runFunctor(functor);
+            ++ran;
+        }
+        m_carriedCount = m_carriedFunctors.size();
+    }
+
+    void EventLoop::runFunctor(const std::function<void()> &functor) {
+        if (m_watched) {
+            m_activityFd.store(-1, std::memory_order_release);
+            m_activityType.store(-1, std::memory_order_release);
+            m_activityStartUs.store(Timestamp::now().microSecondsSinceEpoch(), std::memory_order_release);
+            functor();
+            m_activityStartUs.store(0, std::memory_order_release);
+        } else {
+            functor();
         }
+    }
+
+    bool EventLoop::hasCarriedWork() const {
+        return !m_carriedFunctors.empty() || !m_deferredChannels.empty();
+    }
+
+    // m_quit is atomic, so another thread sets it and wakes the poll at once.
+    void EventLoop::quit() {
+        m_quit = true;
         if (!isInLoopThread()) {
             wakeup();
         }
@@ -136,21 +297,40 @@ namespace faliks {
     }
 
     int64_t EventLoop::iteration() const {
-        return m_iteration;
+        return m_iteration.load(std::memory_order_relaxed);
+    }
+
+    EventLoop::Activity EventLoop::activity() const {
+        Activity activity{};
+        // Re-read the start time so that the tags belong to the same callback.
+        do {
+            activity.startUs = m_activityStartUs.load(std::memory_order_acquire);
+            activity.fd = m_activityFd.load(std::memory_order_acquire);
+            activity.channelType = m_activityType.load(std::memory_order_acquire);
+        } while (activity.startUs != m_activityStartUs.load(std::memory_order_relaxed));
+        activity.iteration = m_iteration.load(std::memory_order_relaxed);
+        return activity;
     }
 
-    void EventLoop::runInLoop(std::function<void()> cb) {
+    void EventLoop::runInLoop(std::function<void()> cb, Priority priority) {
         if (isInLoopThread()) {
             cb();
         } else {
-            queueInLoop(std::move(cb));
+            queueInLoop(std::move(cb), priority);
         }
     }
 
-    void EventLoop::queueInLoop(std::function<void()> cb) {
+    void EventLoop::queueInLoop(std::function<void()> cb, Priority priority) {
         {
             std::scoped_lock<std::mutex> lock(m_pendingMutex);
-            m_pendingFunctors.emplace_back(std::move(cb));
+            if (m_metricsEnabled && !m_pendingSince.valid()) {
+                m_pendingSince = Timestamp::now();
+            }
+            if (priority == Priority::kHigh) {
+                m_urgentFunctors.emplace_back(std::move(cb));
+            } else {
+                m_pendingFunctors.emplace_back(std::move(cb));
+            }
         }
         if (!isInLoopThread() || m_callingPendingFunctors) {
             wakeup();
@@ -159,7 +339,19 @@ namespace faliks {
 
     size_t EventLoop::queueSize() {
         std::scoped_lock<std::mutex> lock(m_pendingMutex);
-        return m_pendingFunctors.size();
+        return m_pendingFunctors.size() + m_urgentFunctors.size() + m_carriedCount;
+    }
+
+    void EventLoop::setMaxFunctorsPerIteration(size_t maxFunctors) {
+        m_maxFunctorsPerIteration = maxFunctors;
+    }
+
+    void EventLoop::setIoTimeBudget(double seconds) {
+        m_ioBudgetUs = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    }
+
+    void EventLoop::setTaskTimeBudget(double seconds) {
+        m_taskBudgetUs = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
     }
 
     void EventLoop::updateChannel(Channel *channel) {
@@ -179,6 +371,8 @@ namespace faliks {
             assert(m_currentActiveChannel == channel ||
                    std::find(m_activeChannels.begin(), m_activeChannels.end(), channel) == m_activeChannels.end());
         }
+        m_deferredChannels.erase(std::remove(m_deferredChannels.begin(), m_deferredChannels.end(), channel),
+                                 m_deferredChannels.end());
         m_poller->removeChannel(channel);
     }
 
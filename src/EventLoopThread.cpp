@@ -1,5 +1,7 @@
 #include "src/include/EventLoopThread.h"
 #include "src/include/EventLoop.h"
+#include "base/include/CpuAffinity.h"
+#include "base/include/fmtlog.h"
 
 using namespace faliks;
 using namespace std;
@@ -10,10 +12,21 @@ EventLoopThread::EventLoopThread(const EventLoopThread::ThreadInitCallback &cb,
           m_thread([this] { threadFunc(); }, name),
           m_mutex(),
           m_cond(),
-          m_callback(cb) {
+          m_callback(cb),
+          m_localMemory(false) {
 }
 
 void EventLoopThread::threadFunc() {
+    if (!m_cpus.empty()) {
+        if (!CpuAffinity::pinCurrentThread(m_cpus)) {
+            loge("EventLoopThread {} failed to set cpu affinity", m_thread.name());
+        } else if (m_localMemory) {
+            int node = CpuAffinity::nodeOfCpu(CpuAffinity::currentCpu());
+            if (node >= 0 && !CpuAffinity::preferMemoryNode(node)) {
+                loge("EventLoopThread {} failed to prefer memory node {}", m_thread.name(), node);
+            }
+        }
+    }
     EventLoop loop;
     if (m_callback) {
         m_callback(&loop);
@@ -37,6 +50,12 @@ EventLoopThread::~EventLoopThread() {
     }
 }
 
+void EventLoopThread::setCpuAffinity(const std::vector<int> &cpus, bool localMemory) {
+    assert(!m_thread.started());
+    m_cpus = cpus;
+    m_localMemory = localMemory;
+}
+
 EventLoop *EventLoopThread::startLoop() {
     assert(!m_thread.started());
     m_thread.start();
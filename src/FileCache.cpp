@@ -0,0 +1,299 @@
+#include "src/include/FileCache.h"
+#include "src/include/Channel.h"
+#include "src/include/EventLoop.h"
+#include "base/include/fmtlog.h"
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cassert>
+#include <cstring>
+
+using namespace faliks;
+
+namespace {
+    const uint32_t kWatchMask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+    // Relative, without empty, "." or ".." components.
+    bool isSafePath(std::string_view path) {
+        if (path.empty() || path.front() == '/' || path.find('\0') != std::string_view::npos) {
+            return false;
+        }
+        while (true) {
+            size_t slash = path.find('/');
+            std::string_view part = path.substr(0, slash);
+            if (part.empty() || part == "." || part == "..") {
+                return false;
+            }
+            if (slash == std::string_view::npos) {
+                return true;
+            }
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    std::string dirOf(const std::string &path) {
+        size_t slash = path.rfind('/');
+        return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+}
+
+FileCache::File::File(int fd, size_t size, time_t mtime, const char *data)
+        : m_fd(fd),
+          m_size(size),
+          m_mtime(mtime),
+          m_data(data) {
+}
+
+FileCache::File::~File() {
+    if (m_data != nullptr) {
+        ::munmap(const_cast<char *>(m_data), m_size);
+    }
+    ::close(m_fd);
+}
+
+FileCache::FileCache(EventLoop *loop, const std::string &root, size_t maxEntries)
+        : m_loop(loop),
+          m_root(root),
+          m_rootFd(::open(root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC)),
+          m_inotifyFd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+          m_maxEntries(maxEntries),
+          m_mmapMaxFileBytes(0),
+          m_mmapMaxTotalBytes(0),
+          m_mappedBytes(0),
+          m_hits(0),
+          m_misses(0),
+          m_invalidations(0) {
+    m_loop->assertInLoopThread();
+    if (m_rootFd < 0) {
+        loge("FileCache::FileCache - cannot open {}: {}", root, strerror(errno));
+    }
+    if (m_inotifyFd < 0) {
+        loge("FileCache::FileCache - inotify_init1: {}", strerror(errno));
+        return;
+    }
+    m_channel = std::make_unique<Channel>(m_loop, m_inotifyFd);
+    m_channel->setReadCallback([this](Timestamp) {
+        handleRead();
+    });
+    m_channel->enableReading();
+}
+
+FileCache::~FileCache() {
+    m_loop->assertInLoopThread();
+    if (m_channel) {
+        m_channel->disableAll();
+        m_channel->remove();
+    }
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+    }
+    if (m_rootFd >= 0) {
+        ::close(m_rootFd);
+    }
+}
+
+FileCache::FilePtr FileCache::get(std::string_view path) {
+    // Reused for the lookup: C++17 maps cannot be searched by string_view.
+    thread_local std::string key;
+    key.assign(path.data(), path.size());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_entries.find(key);
+        if (found != m_entries.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, found->second);
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return found->second->file;
+        }
+    }
+    if (m_rootFd < 0 || !isSafePath(path)) {
+        return nullptr;
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+
+    // The directory is watched before the file is opened, so a change in
+    // between cannot go unnoticed.
+    std::string dir = dirOf(key);
+    int wd;
+    uint64_t generation = 0;
+    bool mayMap;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        wd = watchDirLocked(dir);
+        if (wd >= 0) {
+            generation = m_watches[wd].generation;
+        }
+        mayMap = m_mappedBytes < m_mmapMaxTotalBytes;
+    }
+    FilePtr file = load(key, mayMap);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto watch = m_watches.find(wd);
+    if (!file || watch == m_watches.end() || watch->second.generation != generation) {
+        if (watch != m_watches.end()) {
+            unwatchIfUnusedLocked(wd);
+        }
+        return file;
+    }
+    auto found = m_entries.find(key);
+    if (found != m_entries.end()) {
+        // Loaded by another thread meanwhile.
+        m_lru.splice(m_lru.begin(), m_lru, found->second);
+        return found->second->file;
+    }
+    m_lru.push_front({key, file, wd});
+    m_entries.emplace(key, m_lru.begin());
+    ++watch->second.entries;
+    if (file->data() != nullptr) {
+        m_mappedBytes += file->size();
+    }
+    while (m_lru.size() > m_maxEntries) {
+        eraseLocked(std::prev(m_lru.end()));
+    }
+    return file;
+}
+
+FileCache::FilePtr FileCache::load(const std::string &path, bool mayMap) {
+    int fd = ::openat(m_rootFd, path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return nullptr;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    const char *data = nullptr;
+    if (mayMap && size > 0 && size <= m_mmapMaxFileBytes) {
+        void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data = static_cast<const char *>(mapped);
+        }
+    }
+    return std::make_shared<const File>(fd, size, st.st_mtime, data);
+}
+
+int FileCache::watchDirLocked(const std::string &dir) {
+    auto found = m_watchOfDir.find(dir);
+    if (found != m_watchOfDir.end()) {
+        return found->second;
+    }
+    if (m_inotifyFd < 0) {
+        return -1;
+    }
+    std::string fullPath = dir.empty() ? m_root : m_root + "/" + dir;
+    int wd = ::inotify_add_watch(m_inotifyFd, fullPath.c_str(), kWatchMask);
+    if (wd < 0) {
+        // Not watched means not cached: it could go stale.
+        logw("FileCache::watchDirLocked - {}: {}", fullPath, strerror(errno));
+        return -1;
+    }
+    m_watchOfDir.emplace(dir, wd);
+    m_watches.emplace(wd, Watch{dir, 0, 0});
+    return wd;
+}
+
+void FileCache::unwatchIfUnusedLocked(int wd) {
+    auto found = m_watches.find(wd);
+    if (found != m_watches.end() && found->second.entries == 0) {
+        ::inotify_rm_watch(m_inotifyFd, wd);
+        m_watchOfDir.erase(found->second.dir);
+        m_watches.erase(found);
+    }
+}
+
+void FileCache::eraseLocked(EntryList::iterator it) {
+    int wd = it->wd;
+    if (it->file->data() != nullptr) {
+        m_mappedBytes -= it->file->size();
+    }
+    m_entries.erase(it->path);
+    m_lru.erase(it);
+    auto found = m_watches.find(wd);
+    if (found != m_watches.end()) {
+        --found->second.entries;
+        unwatchIfUnusedLocked(wd);
+    }
+}
+
+// The directory itself went away: everything cached from it is stale.
+void FileCache::eraseWatchLocked(int wd) {
+    if (m_watches.find(wd) == m_watches.end()) {
+        return;
+    }
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        auto next = std::next(it);
+        if (it->wd == wd) {
+            eraseLocked(it);
+            m_invalidations.fetch_add(1, std::memory_order_relaxed);
+        }
+        it = next;
+    }
+    auto found = m_watches.find(wd);
+    if (found != m_watches.end()) {
+        m_watchOfDir.erase(found->second.dir);
+        m_watches.erase(found);
+    }
+}
+
+void FileCache::handleRead() {
+    m_loop->assertInLoopThread();
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t n;
+    while ((n = ::read(m_inotifyFd, buf, sizeof buf)) > 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (char *p = buf; p < buf + n;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                logw("FileCache::handleRead - inotify queue overflow, dropping {} entries", m_lru.size());
+                m_invalidations.fetch_add(m_lru.size(), std::memory_order_relaxed);
+                while (!m_lru.empty()) {
+                    eraseLocked(m_lru.begin());
+                }
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                eraseWatchLocked(event->wd);
+                continue;
+            }
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end()) {
+                continue;
+            }
+            ++watch->second.generation;
+            if (event->len == 0) {
+                continue;
+            }
+            std::string path = watch->second.dir.empty() ? std::string(event->name)
+                                                          : watch->second.dir + "/" + event->name;
+            auto found = m_entries.find(path);
+            if (found != m_entries.end()) {
+                logd("FileCache::handleRead - {} changed", path);
+                eraseLocked(found->second);
+                m_invalidations.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void FileCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (!m_lru.empty()) {
+        eraseLocked(m_lru.begin());
+    }
+}
+
+size_t FileCache::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lru.size();
+}
+
+size_t FileCache::mappedBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_mappedBytes;
+}
@@ -0,0 +1,226 @@
+#include "src/include/HotRestart.h"
+#include "src/include/Channel.h"
+#include "src/include/EventLoop.h"
+#include "base/include/fmtlog.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace faliks;
+
+namespace {
+    const char kListenTag = 'L';
+    const char kConnectionTag = 'C';
+    const char kEndTag = 'E';
+
+    bool makeAddress(const std::string &path, struct sockaddr_un *addr) {
+        memset(addr, 0, sizeof *addr);
+        addr->sun_family = AF_UNIX;
+        if (path.size() >= sizeof addr->sun_path) {
+            loge("HotRestart path too long: {}", path);
+            return false;
+        }
+        memcpy(addr->sun_path, path.data(), path.size());
+        return true;
+    }
+
+    bool sendAll(int sockfd, char tag, const std::vector<int> &fds) {
+        size_t sent = 0;
+        do {
+            size_t count = std::min(fds.size() - sent, HotRestart::kMaxFdsPerMessage);
+            if (!HotRestart::sendFds(sockfd, tag, fds.data() + sent, count)) {
+                return false;
+            }
+            sent += count;
+        } while (sent < fds.size());
+        return true;
+    }
+}
+
+HotRestart::HotRestart(EventLoop *loop, TcpServer *server, const std::string &path)
+        : m_loop(loop),
+          m_server(server),
+          m_path(path),
+          m_listenFd(-1),
+          m_handOffConnections(false),
+          m_allowedUid(::geteuid()),
+          m_drainTimeout(5),
+          m_closeTimeout(1) {
+}
+
+HotRestart::~HotRestart() {
+    stopListening();
+}
+
+void HotRestart::listen() {
+    m_loop->assertInLoopThread();
+    struct sockaddr_un addr{};
+    if (!makeAddress(m_path, &addr)) {
+        return;
+    }
+    m_listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    // A path left by the predecessor belongs to a socket nobody listens on now.
+    ::unlink(m_path.c_str());
+    // Nobody can connect before listen(), so the mode is set in time.
+    if (::bind(m_listenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0 ||
+        ::chmod(m_path.c_str(), 0600) < 0 ||
+        ::listen(m_listenFd, 1) < 0) {
+        loge("HotRestart::listen {}: {}", m_path, strerror(errno));
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        return;
+    }
+    m_channel = std::make_unique<Channel>(m_loop, m_listenFd);
+    m_channel->setReadCallback([this](Timestamp) {
+        handleRead();
+    });
+    m_channel->enableReading();
+}
+
+void HotRestart::stopListening() {
+    if (m_channel) {
+        m_channel->disableAll();
+        m_channel->remove();
+        m_channel.reset();
+    }
+    if (m_listenFd >= 0) {
+        ::close(m_listenFd);
+        m_listenFd = -1;
+    }
+}
+
+// The successor reads everything before it starts serving, so blocking
+// writes here are short.
+void HotRestart::handleRead() {
+    m_loop->assertInLoopThread();
+    int peer = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (peer < 0) {
+        return;
+    }
+    struct ucred cred{};
+    socklen_t credLen = sizeof cred;
+    if (::getsockopt(peer, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) < 0 || cred.uid != m_allowedUid) {
+        logw("HotRestart::handleRead - refused pid {} uid {} on {}", cred.pid, cred.uid, m_path);
+        ::close(peer);
+        return;
+    }
+    logi("HotRestart::handleRead - handing sockets to the successor on {}", m_path);
+    // The path now belongs to the successor, which listens on it next. The
+    // channel is being handled, so it goes away later.
+    m_channel->disableAll();
+    m_loop->queueInLoop([this] { stopListening(); });
+
+    std::vector<int> listening = m_server->listenFds();
+    std::vector<int> connections;
+    if (m_handOffConnections) {
+        connections = m_server->detachIdleConnections();
+    }
+    bool ok = sendAll(peer, kListenTag, listening) &&
+              (connections.empty() || sendAll(peer, kConnectionTag, connections)) &&
+              sendFds(peer, kEndTag, nullptr, 0);
+    if (!ok) {
+        loge("HotRestart::handleRead - handing over failed: {}", strerror(errno));
+    }
+    for (int fd: connections) {
+        ::close(fd);
+    }
+    ::close(peer);
+    logi("HotRestart::handleRead - handed over {} listening sockets and {} connections, draining",
+         listening.size(), connections.size());
+    m_server->shutdown(m_drainTimeout, m_closeTimeout, m_drainedCallback);
+}
+
+bool HotRestart::takeOver(const std::string &path, std::vector<int> *listenFds, std::vector<int> *connectionFds) {
+    struct sockaddr_un addr{};
+    if (!makeAddress(path, &addr)) {
+        return false;
+    }
+    int sockfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(sockfd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(sockfd);
+        return false;
+    }
+    char tag = 0;
+    std::vector<int> fds;
+    bool ended = false;
+    while (!ended && recvFds(sockfd, &tag, &fds)) {
+        switch (tag) {
+            case kListenTag:
+                listenFds->insert(listenFds->end(), fds.begin(), fds.end());
+                break;
+            case kConnectionTag:
+                connectionFds->insert(connectionFds->end(), fds.begin(), fds.end());
+                break;
+            case kEndTag:
+                ended = true;
+                break;
+            default:
+                for (int fd: fds) {
+                    ::close(fd);
+                }
+                break;
+        }
+    }
+    ::close(sockfd);
+    if (!ended) {
+        loge("HotRestart::takeOver - predecessor on {} stopped early", path);
+    }
+    return ended && !listenFds->empty();
+}
+
+bool HotRestart::sendFds(int sockfd, char tag, const int *fds, size_t count) {
+    assert(count <= kMaxFdsPerMessage);
+    struct iovec vec{&tag, 1};
+    struct msghdr msg{};
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxFdsPerMessage)];
+    if (count > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    }
+    ssize_t n;
+    do {
+        n = ::sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == 1;
+}
+
+bool HotRestart::recvFds(int sockfd, char *tag, std::vector<int> *fds) {
+    fds->clear();
+    struct iovec vec{tag, 1};
+    struct msghdr msg{};
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxFdsPerMessage)];
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    ssize_t n;
+    do {
+        n = ::recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1) {
+        return false;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const auto *data = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+            fds->insert(fds->end(), data, data + count);
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        loge("HotRestart::recvFds - descriptors truncated");
+    }
+    return true;
+}
@@ -0,0 +1,314 @@
+#include "src/include/HttpParser.h"
+#include "src/include/Buffer.h"
+
+#include <cassert>
+#include <cstring>
+#include <string_view>
+
+using namespace faliks;
+
+namespace {
+    struct MethodName {
+        std::string_view name;
+        HttpRequest::Method method;
+    };
+
+    const MethodName kMethods[] = {
+            {"GET",     HttpRequest::Method::kGet},
+            {"POST",    HttpRequest::Method::kPost},
+            {"HEAD",    HttpRequest::Method::kHead},
+            {"PUT",     HttpRequest::Method::kPut},
+            {"DELETE",  HttpRequest::Method::kDelete},
+            {"OPTIONS", HttpRequest::Method::kOptions},
+            {"PATCH",   HttpRequest::Method::kPatch},
+    };
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+}
+
+HttpParser::HttpParser(size_t maxHeaderBytes, size_t maxBodyBytes)
+        : m_state(State::kRequestLine),
+          m_offset(0),
+          m_remaining(0),
+          m_trailerOffset(0),
+          m_maxHeaderBytes(maxHeaderBytes),
+          m_maxBodyBytes(maxBodyBytes),
+          m_errorStatus(0) {
+    // Spans are 32-bit offsets.
+    assert(maxHeaderBytes + 2 * maxBodyBytes < UINT32_MAX);
+}
+
+void HttpParser::reset() {
+    m_state = State::kRequestLine;
+    m_offset = 0;
+    m_remaining = 0;
+    m_trailerOffset = 0;
+    m_errorStatus = 0;
+    m_request.reset();
+}
+
+void HttpParser::consume(Buffer *buf) {
+    assert(m_state == State::kComplete);
+    buf->retrieve(m_offset);
+    reset();
+}
+
+HttpParser::Result HttpParser::fail(int status) {
+    m_state = State::kError;
+    m_errorStatus = status;
+    return Result::kError;
+}
+
+const char *HttpParser::nextLine(const char *base, const char *end, const char **lineEnd) {
+    const char *begin = base + m_offset;
+    const auto *lf = static_cast<const char *>(memchr(begin, '\n', end - begin));
+    if (lf == nullptr || lf == begin || lf[-1] != '\r') {
+        // A bare LF is rejected by the caller through the missing CR.
+        *lineEnd = lf;
+        return nullptr;
+    }
+    *lineEnd = lf - 1;
+    m_offset = lf + 1 - base;
+    return begin;
+}
+
+HttpParser::Result HttpParser::parse(Buffer *buf, Timestamp receiveTime) {
+    const char *base = buf->peek();
+    const char *end = base + buf->readableBytes();
+    m_request.m_base = base;
+    while (true) {
+        switch (m_state) {
+            case State::kRequestLine:
+            case State::kHeaders:
+            case State::kChunkSize:
+            case State::kTrailers: {
+                // The head and the trailers are bounded as a whole, a chunk-size line on its own.
+                size_t from = m_state == State::kChunkSize ? m_offset :
+                              m_state == State::kTrailers ? m_trailerOffset : 0;
+                const char *lineEnd;
+                const char *line = nextLine(base, end, &lineEnd);
+                if (line == nullptr) {
+                    if (lineEnd != nullptr) {
+                        return fail(400);
+                    }
+                    if (static_cast<size_t>(end - base) - from > m_maxHeaderBytes) {
+                        return fail(431);
+                    }
+                    return Result::kNeedMore;
+                }
+                if (m_offset - from > m_maxHeaderBytes) {
+                    return fail(431);
+                }
+                if (m_state == State::kRequestLine) {
+                    // Empty lines before a request are allowed.
+                    if (line != lineEnd && !parseRequestLine(base, line, lineEnd)) {
+                        return Result::kError;
+                    }
+                } else if (m_state == State::kHeaders) {
+                    if (line == lineEnd) {
+                        if (!startBody()) {
+                            return Result::kError;
+                        }
+                    } else if (!parseHeader(base, line, lineEnd)) {
+                        return Result::kError;
+                    }
+                } else if (m_state == State::kChunkSize) {
+                    if (!parseChunkSize(line, lineEnd)) {
+                        return Result::kError;
+                    }
+                } else if (line == lineEnd) {
+                    // Trailer fields are read and dropped.
+                    m_state = State::kComplete;
+                }
+                break;
+            }
+            case State::kBody: {
+                if (static_cast<uint64_t>(end - base) - m_offset < m_remaining) {
+                    return Result::kNeedMore;
+                }
+                m_request.m_body = {static_cast<uint32_t>(m_offset), static_cast<uint32_t>(m_remaining)};
+                m_offset += m_remaining;
+                m_state = State::kComplete;
+                break;
+            }
+            case State::kChunkData: {
+                if (static_cast<uint64_t>(end - base) - m_offset < m_remaining + 2) {
+                    return Result::kNeedMore;
+                }
+                const char *data = base + m_offset;
+                if (data[m_remaining] != '\r' || data[m_remaining + 1] != '\n') {
+                    return fail(400);
+                }
+                m_request.m_chunkedBody.append(data, m_remaining);
+                m_offset += m_remaining + 2;
+                m_state = State::kChunkSize;
+                break;
+            }
+            case State::kComplete:
+                m_request.m_receiveTime = receiveTime;
+                return Result::kComplete;
+            case State::kError:
+                return Result::kError;
+        }
+    }
+}
+
+bool HttpParser::parseRequestLine(const char *base, const char *begin, const char *end) {
+    const auto *space = static_cast<const char *>(memchr(begin, ' ', end - begin));
+    if (space == nullptr) {
+        fail(400);
+        return false;
+    }
+    std::string_view name(begin, space - begin);
+    for (const auto &method: kMethods) {
+        if (method.name == name) {
+            m_request.m_method = method.method;
+            break;
+        }
+    }
+    if (m_request.m_method == HttpRequest::Method::kInvalid) {
+        fail(501);
+        return false;
+    }
+
+    const char *target = space + 1;
+    const auto *targetEnd = static_cast<const char *>(memchr(target, ' ', end - target));
+    if (targetEnd == nullptr || targetEnd == target) {
+        fail(400);
+        return false;
+    }
+    const auto *question = static_cast<const char *>(memchr(target, '?', targetEnd - target));
+    const char *pathEnd = question ? question : targetEnd;
+    m_request.m_path = {static_cast<uint32_t>(target - base), static_cast<uint32_t>(pathEnd - target)};
+    if (question) {
+        m_request.m_query = {static_cast<uint32_t>(question + 1 - base),
+                             static_cast<uint32_t>(targetEnd - question - 1)};
+    }
+
+    std::string_view version(targetEnd + 1, end - targetEnd - 1);
+    if (version == "HTTP/1.1") {
+        m_request.m_version = HttpRequest::Version::kHttp11;
+    } else if (version == "HTTP/1.0") {
+        m_request.m_version = HttpRequest::Version::kHttp10;
+    } else {
+        fail(version.substr(0, 5) == "HTTP/" ? 505 : 400);
+        return false;
+    }
+    m_state = State::kHeaders;
+    return true;
+}
+
+bool HttpParser::parseHeader(const char *base, const char *begin, const char *end) {
+    // Folded continuation lines are obsolete and a smuggling vector.
+    const auto *colon = static_cast<const char *>(memchr(begin, ':', end - begin));
+    if (isSpace(*begin) || colon == nullptr || colon == begin || isSpace(colon[-1])) {
+        fail(400);
+        return false;
+    }
+    const char *value = colon + 1;
+    const char *valueEnd = end;
+    while (value < valueEnd && isSpace(*value)) {
+        ++value;
+    }
+    while (valueEnd > value && isSpace(valueEnd[-1])) {
+        --valueEnd;
+    }
+    m_request.m_headers.emplace_back(
+            HttpRequest::Span{static_cast<uint32_t>(begin - base), static_cast<uint32_t>(colon - begin)},
+            HttpRequest::Span{static_cast<uint32_t>(value - base), static_cast<uint32_t>(valueEnd - value)});
+    return true;
+}
+
+bool HttpParser::startBody() {
+    bool hasLength = m_request.hasHeader("Content-Length");
+    if (m_request.hasHeader("Transfer-Encoding")) {
+        // Both framings at once is how requests get smuggled.
+        if (hasLength) {
+            fail(400);
+            return false;
+        }
+        if (!headerListsToken(m_request.header("Transfer-Encoding"), "chunked")) {
+            fail(501);
+            return false;
+        }
+        m_request.m_chunked = true;
+        m_state = State::kChunkSize;
+        return true;
+    }
+    m_request.m_body = {static_cast<uint32_t>(m_offset), 0};
+    if (!hasLength) {
+        m_state = State::kComplete;
+        return true;
+    }
+    std::string_view length;
+    for (size_t i = 0; i < m_request.numHeaders(); ++i) {
+        if (equalsIgnoreCase(m_request.headerName(i), "Content-Length")) {
+            if (!length.empty() && m_request.headerValue(i) != length) {
+                fail(400);
+                return false;
+            }
+            length = m_request.headerValue(i);
+        }
+    }
+    if (length.empty() || length.size() > 19) {
+        fail(length.empty() ? 400 : 413);
+        return false;
+    }
+    uint64_t value = 0;
+    for (char c: length) {
+        if (c < '0' || c > '9') {
+            fail(400);
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    if (value > m_maxBodyBytes) {
+        fail(413);
+        return false;
+    }
+    m_remaining = value;
+    m_state = value > 0 ? State::kBody : State::kComplete;
+    return true;
+}
+
+bool HttpParser::parseChunkSize(const char *begin, const char *end) {
+    uint64_t size = 0;
+    const char *p = begin;
+    for (; p < end && *p != ';'; ++p) {
+        int digit = hexValue(*p);
+        if (digit < 0 || size > (m_maxBodyBytes >> 4) + 1) {
+            // Whitespace before an extension is tolerated.
+            if (isSpace(*p)) {
+                continue;
+            }
+            fail(digit < 0 ? 400 : 413);
+            return false;
+        }
+        size = (size << 4) | static_cast<uint64_t>(digit);
+    }
+    if (p == begin) {
+        fail(400);
+        return false;
+    }
+    if (m_request.m_chunkedBody.size() + size > m_maxBodyBytes) {
+        fail(413);
+        return false;
+    }
+    m_remaining = size;
+    m_trailerOffset = m_offset;
+    m_state = size > 0 ? State::kChunkData : State::kTrailers;
+    return true;
+}
@@ -0,0 +1,111 @@
+#include "src/include/HttpRequest.h"
+
+using namespace faliks;
+
+namespace {
+    char toLower(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+}
+
+bool faliks::headerListsToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+            item.remove_suffix(1);
+        }
+        if (equalsIgnoreCase(item, token)) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool faliks::equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (toLower(a[i]) != toLower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HttpRequest::HttpRequest()
+        : m_base(""),
+          m_method(Method::kInvalid),
+          m_version(Version::kUnknown),
+          m_path{0, 0},
+          m_query{0, 0},
+          m_body{0, 0},
+          m_chunked(false) {
+}
+
+void HttpRequest::reset() {
+    m_base = "";
+    m_method = Method::kInvalid;
+    m_version = Version::kUnknown;
+    m_path = {0, 0};
+    m_query = {0, 0};
+    m_headers.clear();
+    m_body = {0, 0};
+    m_chunked = false;
+    m_chunkedBody.clear();
+}
+
+const char *HttpRequest::methodString() const {
+    switch (m_method) {
+        case Method::kGet:
+            return "GET";
+        case Method::kHead:
+            return "HEAD";
+        case Method::kPost:
+            return "POST";
+        case Method::kPut:
+            return "PUT";
+        case Method::kDelete:
+            return "DELETE";
+        case Method::kOptions:
+            return "OPTIONS";
+        case Method::kPatch:
+            return "PATCH";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+std::string_view HttpRequest::header(std::string_view field) const {
+    for (const auto &entry: m_headers) {
+        if (equalsIgnoreCase(view(entry.first), field)) {
+            return view(entry.second);
+        }
+    }
+    return {};
+}
+
+bool HttpRequest::hasHeader(std::string_view field) const {
+    for (const auto &entry: m_headers) {
+        if (equalsIgnoreCase(view(entry.first), field)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpRequest::keepAlive() const {
+    std::string_view connection = header("Connection");
+    if (m_version == Version::kHttp11) {
+        return !headerListsToken(connection, "close");
+    }
+    return headerListsToken(connection, "keep-alive");
+}
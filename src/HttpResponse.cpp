@@ -0,0 +1,178 @@
+#include "src/include/HttpResponse.h"
+#include "src/include/Buffer.h"
+
+#include <cassert>
+#include <charconv>
+
+using namespace faliks;
+
+namespace {
+    void appendView(Buffer *buf, std::string_view data) {
+        buf->append(data.data(), data.size());
+    }
+
+    void appendNumber(Buffer *buf, uint64_t value, int base = 10) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof digits, value, base);
+        buf->append(digits, result.ptr - digits);
+    }
+}
+
+const char *faliks::httpStatusMessage(int code) {
+    switch (code) {
+        case 100:
+            return "Continue";
+        case 101:
+            return "Switching Protocols";
+        case 200:
+            return "OK";
+        case 201:
+            return "Created";
+        case 204:
+            return "No Content";
+        case 206:
+            return "Partial Content";
+        case 301:
+            return "Moved Permanently";
+        case 302:
+            return "Found";
+        case 304:
+            return "Not Modified";
+        case 400:
+            return "Bad Request";
+        case 403:
+            return "Forbidden";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 408:
+            return "Request Timeout";
+        case 413:
+            return "Content Too Large";
+        case 416:
+            return "Range Not Satisfiable";
+        case 426:
+            return "Upgrade Required";
+        case 431:
+            return "Request Header Fields Too Large";
+        case 500:
+            return "Internal Server Error";
+        case 501:
+            return "Not Implemented";
+        case 503:
+            return "Service Unavailable";
+        case 505:
+            return "HTTP Version Not Supported";
+        default:
+            return "Unknown";
+    }
+}
+
+HttpResponse::HttpResponse()
+        : m_statusCode(200),
+          m_numHeaders(0),
+          m_closeConnection(false),
+          m_chunked(false),
+          m_http10(false),
+          m_bodyReference{nullptr, -1, 0, 0, nullptr} {
+}
+
+void HttpResponse::reset() {
+    m_statusCode = 200;
+    m_statusMessage.clear();
+    m_numHeaders = 0;
+    m_body.clear();
+    m_closeConnection = false;
+    m_chunked = false;
+    m_http10 = false;
+    m_chunkSizes.clear();
+    m_bodyReference = {nullptr, -1, 0, 0, nullptr};
+}
+
+void HttpResponse::setStatus(int code, std::string_view message) {
+    assert(code >= 100 && code <= 999);
+    m_statusCode = code;
+    m_statusMessage.assign(message.data(), message.size());
+}
+
+void HttpResponse::addHeader(std::string_view field, std::string_view value) {
+    if (m_numHeaders == m_headers.size()) {
+        m_headers.emplace_back();
+    }
+    auto &header = m_headers[m_numHeaders++];
+    header.first.assign(field.data(), field.size());
+    header.second.assign(value.data(), value.size());
+}
+
+void HttpResponse::appendChunk(std::string_view data) {
+    m_chunked = true;
+    if (!data.empty()) {
+        m_body.append(data.data(), data.size());
+        m_chunkSizes.push_back(static_cast<uint32_t>(data.size()));
+    }
+}
+
+void HttpResponse::appendToBuffer(Buffer *buf, std::string_view dateHeader, bool includeBody) const {
+    char status[] = "HTTP/1.1 000 ";
+    status[9] = static_cast<char>('0' + m_statusCode / 100);
+    status[10] = static_cast<char>('0' + m_statusCode / 10 % 10);
+    status[11] = static_cast<char>('0' + m_statusCode % 10);
+    buf->append(status, sizeof status - 1);
+    if (m_statusMessage.empty()) {
+        appendView(buf, httpStatusMessage(m_statusCode));
+    } else {
+        buf->append(m_statusMessage);
+    }
+    appendView(buf, "\r\n");
+
+    bool referenced = m_bodyReference.owner != nullptr;
+    assert(!referenced || (m_body.empty() && !m_chunked));
+    // These never carry a body, nor a length for one.
+    bool bodiless = m_statusCode < 200 || m_statusCode == 204 || m_statusCode == 304;
+    bool chunked = m_chunked && !m_http10 && !bodiless;
+    if (chunked) {
+        appendView(buf, "Transfer-Encoding: chunked\r\n");
+    } else if (!bodiless) {
+        appendView(buf, "Content-Length: ");
+        appendNumber(buf, referenced ? m_bodyReference.len : m_body.size());
+        appendView(buf, "\r\n");
+    }
+    if (m_closeConnection) {
+        appendView(buf, "Connection: close\r\n");
+    } else if (m_http10) {
+        appendView(buf, "Connection: keep-alive\r\n");
+    }
+    appendView(buf, dateHeader);
+    for (size_t i = 0; i < m_numHeaders; ++i) {
+        buf->append(m_headers[i].first);
+        appendView(buf, ": ");
+        buf->append(m_headers[i].second);
+        appendView(buf, "\r\n");
+    }
+    appendView(buf, "\r\n");
+
+    if (!includeBody || bodiless) {
+        return;
+    }
+    if (!chunked) {
+        buf->append(m_body);
+        return;
+    }
+    // A body set with setBody() goes out as one chunk.
+    size_t offset = 0;
+    auto appendOne = [&](size_t len) {
+        appendNumber(buf, len, 16);
+        appendView(buf, "\r\n");
+        buf->append(m_body.data() + offset, len);
+        appendView(buf, "\r\n");
+        offset += len;
+    };
+    for (uint32_t len: m_chunkSizes) {
+        appendOne(len);
+    }
+    if (offset < m_body.size()) {
+        appendOne(m_body.size() - offset);
+    }
+    appendView(buf, "0\r\n\r\n");
+}
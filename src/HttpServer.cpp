@@ -0,0 +1,147 @@
+#include "src/include/HttpServer.h"
+#include "src/include/HttpParser.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/fmtlog.h"
+
+#include <ctime>
+
+using namespace faliks;
+
+namespace {
+    struct HttpContext {
+        HttpParser parser;
+        HttpResponse response;
+        // After an error or Connection: close nothing more is read.
+        bool closing;
+        // Switched protocols: input goes to the upgraded message callback.
+        bool upgraded;
+
+        HttpContext(size_t maxHeaderBytes, size_t maxBodyBytes)
+                : parser(maxHeaderBytes, maxBodyBytes),
+                  closing(false),
+                  upgraded(false) {
+        }
+    };
+
+    // Past this a long pipeline is sent in parts.
+    const size_t kMaxOutputBytes = 256 * 1024;
+
+    void defaultHttpCallback(const HttpRequest &, HttpResponse *response) {
+        response->setStatus(404);
+    }
+}
+
+HttpServer::HttpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                       TcpServer::Option option)
+        : m_server(loop, listenAddr, name, option),
+          m_httpCallback(defaultHttpCallback),
+          m_maxHeaderBytes(64 * 1024),
+          m_maxBodyBytes(16 * 1024 * 1024) {
+    m_server.setConnectionCallback([this](const TcpConnectionPtr &conn) {
+        onConnection(conn);
+    });
+    m_server.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+        onMessage(conn, buf, receiveTime);
+    });
+}
+
+std::string_view HttpServer::dateHeader(Timestamp now) {
+    thread_local time_t cachedSecond = -1;
+    thread_local char cached[64];
+    thread_local size_t cachedLen = 0;
+    time_t second = now.secondsSinceEpoch();
+    if (second != cachedSecond) {
+        struct tm tm{};
+        gmtime_r(&second, &tm);
+        cachedLen = strftime(cached, sizeof cached, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        cachedSecond = second;
+    }
+    return {cached, cachedLen};
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        conn->setContext(std::make_shared<HttpContext>(m_maxHeaderBytes, m_maxBodyBytes));
+    } else if (m_upgradedCloseCallback) {
+        auto *holder = std::any_cast<std::shared_ptr<HttpContext>>(conn->getMutableContext());
+        if (holder == nullptr || (*holder)->upgraded) {
+            m_upgradedCloseCallback(conn);
+        }
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+    auto *holder = std::any_cast<std::shared_ptr<HttpContext>>(conn->getMutableContext());
+    if ((holder == nullptr || (*holder)->upgraded) && m_upgradedMessageCallback) {
+        m_upgradedMessageCallback(conn, buf, receiveTime);
+        return;
+    }
+    if (holder == nullptr || (*holder)->closing) {
+        buf->retrieveAll();
+        return;
+    }
+    // The upgrade callback may replace the connection's context.
+    std::shared_ptr<HttpContext> guard = *holder;
+    HttpContext &context = *guard;
+    thread_local Buffer output;
+    std::string_view date = dateHeader(receiveTime);
+    while (true) {
+        HttpParser::Result result = context.parser.parse(buf, receiveTime);
+        if (result == HttpParser::Result::kNeedMore) {
+            break;
+        }
+        HttpResponse &response = context.response;
+        response.reset();
+        if (result == HttpParser::Result::kError) {
+            logd("HttpServer::onMessage - {} answered {}", conn->getName(), context.parser.errorStatus());
+            response.setStatus(context.parser.errorStatus());
+            response.setCloseConnection(true);
+            response.appendToBuffer(&output, date);
+            context.closing = true;
+            break;
+        }
+        const HttpRequest &request = context.parser.request();
+        response.setHttp10(request.version() == HttpRequest::Version::kHttp10);
+        response.setCloseConnection(!request.keepAlive());
+        if (m_upgradeCallback && request.hasHeader("Upgrade")) {
+            m_upgradeCallback(conn, request, &response);
+            if (response.statusCode() == 101) {
+                response.appendToBuffer(&output, date);
+                context.parser.consume(buf);
+                context.upgraded = true;
+                conn->send(&output);
+                if (buf->readableBytes() > 0) {
+                    m_upgradedMessageCallback(conn, buf, receiveTime);
+                }
+                return;
+            }
+        } else {
+            m_httpCallback(request, &response);
+        }
+        bool includeBody = request.method() != HttpRequest::Method::kHead;
+        response.appendToBuffer(&output, date, includeBody);
+        const HttpResponse::BodyReference &reference = response.bodyReference();
+        if (includeBody && reference.owner) {
+            if (reference.fd >= 0) {
+                conn->sendFile(&output, reference.fd, reference.offset, reference.len, reference.owner);
+            } else {
+                conn->sendReferenced(&output, reference.data, reference.len, reference.owner);
+            }
+        }
+        context.parser.consume(buf);
+        if (response.closeConnection()) {
+            context.closing = true;
+            break;
+        }
+        if (output.readableBytes() >= kMaxOutputBytes) {
+            conn->send(&output);
+        }
+    }
+    if (output.readableBytes() > 0) {
+        conn->send(&output);
+    }
+    if (context.closing) {
+        buf->retrieveAll();
+        conn->shutdown();
+    }
+}
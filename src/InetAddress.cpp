@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <algorithm>
 #include <cassert>
 #include <netdb.h>
 
@@ -18,7 +19,7 @@ namespace faliks {
     static __thread char t_resolveBuffer[64 * 1024];
 
 
-    InetAddress::InetAddress(uint16_t port, bool localhost, bool ipv6) {
+    InetAddress::InetAddress(uint16_t port, bool localhost, bool ipv6) : m_unixLen(0) {
         static_assert(offsetof(InetAddress, m_sockaddrIn6) == 0, "m_sockaddrIn6 offset 0");
         static_assert(offsetof(InetAddress, m_sockaddrIn) == 0, "m_sockaddrIn offset 0");
         if (ipv6) {
@@ -36,7 +37,7 @@ namespace faliks {
         }
     }
 
-    InetAddress::InetAddress(const char *ip, uint16_t port, bool ipv6) {
+    InetAddress::InetAddress(const char *ip, uint16_t port, bool ipv6) : m_unixLen(0) {
         if (ipv6 || strchr(ip, ':')) {
             memset(&m_sockaddrIn6, 0, sizeof m_sockaddrIn6);
             m_sockaddrIn6.sin6_family = AF_INET6;
@@ -54,7 +55,78 @@ namespace faliks {
         }
     }
 
+    InetAddress::InetAddress(const struct sockaddr *addr, socklen_t len) : m_unixLen(0) {
+        memset(&m_sockaddrUn, 0, sizeof m_sockaddrUn);
+        if (addr->sa_family == AF_UNIX) {
+            m_unixLen = std::min<socklen_t>(len, sizeof m_sockaddrUn);
+            memcpy(&m_sockaddrUn, addr, m_unixLen);
+        } else if (addr->sa_family == AF_INET6) {
+            memcpy(&m_sockaddrIn6, addr, std::min<socklen_t>(len, sizeof m_sockaddrIn6));
+        } else {
+            memcpy(&m_sockaddrIn, addr, std::min<socklen_t>(len, sizeof m_sockaddrIn));
+        }
+    }
+
+    InetAddress InetAddress::invalidUnix() {
+        struct sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        InetAddress result(reinterpret_cast<struct sockaddr *>(&addr), sizeof addr.sun_family);
+        result.m_unixLen = 0;
+        return result;
+    }
+
+    InetAddress InetAddress::unixPath(const std::string &path) {
+        struct sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof addr.sun_path) {
+            loge("unix socket path too long: {}", path);
+            return invalidUnix();
+        }
+        size_t len = path.size();
+        memcpy(addr.sun_path, path.data(), len);
+        return InetAddress(reinterpret_cast<struct sockaddr *>(&addr),
+                           static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + len + 1));
+    }
+
+    InetAddress InetAddress::unixAbstract(const std::string &name) {
+        struct sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (name.size() >= sizeof addr.sun_path) {
+            loge("unix socket name too long: {}", name);
+            return invalidUnix();
+        }
+        size_t len = name.size();
+        memcpy(addr.sun_path + 1, name.data(), len);
+        return InetAddress(reinterpret_cast<struct sockaddr *>(&addr),
+                           static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + 1 + len));
+    }
+
+    std::string InetAddress::unixName() const {
+        if (family() != AF_UNIX || m_unixLen <= offsetof(struct sockaddr_un, sun_path)) {
+            return "";
+        }
+        size_t len = m_unixLen - offsetof(struct sockaddr_un, sun_path);
+        if (m_sockaddrUn.sun_path[0] == '\0') {
+            return "@" + std::string(m_sockaddrUn.sun_path + 1, len - 1);
+        }
+        return std::string(m_sockaddrUn.sun_path, strnlen(m_sockaddrUn.sun_path, len));
+    }
+
+    socklen_t InetAddress::getSockLen() const {
+        switch (family()) {
+            case AF_UNIX:
+                return m_unixLen;
+            case AF_INET6:
+                return sizeof m_sockaddrIn6;
+            default:
+                return sizeof m_sockaddrIn;
+        }
+    }
+
     std::string InetAddress::toIp() const {
+        if (family() == AF_UNIX) {
+            return "unix:" + unixName();
+        }
         char buf[64] = "";
         if (m_sockaddrIn.sin_family == AF_INET) {
             ::inet_ntop(AF_INET, &m_sockaddrIn.sin_addr, buf, sizeof buf);
@@ -65,6 +137,9 @@ namespace faliks {
     }
 
     std::string InetAddress::toIpPort() const {
+        if (family() == AF_UNIX) {
+            return toIp();
+        }
         char buf[64] = "";
         if (m_sockaddrIn.sin_family == AF_INET) {
             ::inet_ntop(AF_INET, &m_sockaddrIn.sin_addr, buf, sizeof buf);
@@ -82,6 +157,9 @@ namespace faliks {
     }
 
     uint16_t InetAddress::port() const {
+        if (family() == AF_UNIX) {
+            return 0;
+        }
         return be16toh(m_sockaddrIn.sin_port);
     }
 
@@ -94,6 +172,16 @@ namespace faliks {
         return m_sockaddrIn.sin_addr.s_addr;
     }
 
+    bool InetAddress::isAnyAddress() const {
+        if (family() == AF_UNIX) {
+            return false;
+        }
+        if (family() == AF_INET6) {
+            return IN6_IS_ADDR_UNSPECIFIED(&m_sockaddrIn6.sin6_addr);
+        }
+        return m_sockaddrIn.sin_addr.s_addr == htobe32(kInaddrAny);
+    }
+
     bool InetAddress::resolve(const char *hostname, InetAddress *result) {
         assert(result != nullptr);
         struct hostent h;
@@ -0,0 +1,683 @@
+#include "src/include/KvServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/RespCodec.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/fmtlog.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <deque>
+
+using namespace faliks;
+
+namespace {
+    enum class OpCode : uint8_t {
+        kGet, kSet, kDel, kExists, kIncrBy, kAppend, kStrlen, kDbSize, kFlush
+    };
+
+    // Conditions of kSet, in Op::arg.
+    const int64_t kSetAlways = 0;
+    const int64_t kSetIfAbsent = 1;
+    const int64_t kSetIfPresent = 2;
+
+    // How a command's reply is made from the replies of its ops.
+    enum class Aggregate : uint8_t {
+        // The one op's reply.
+        kSingle,
+        // An array of the ops' replies, as MGET.
+        kArray,
+        // The sum of the ops' integers, as DEL or DBSIZE.
+        kSum,
+        // OK, as MSET or FLUSHALL.
+        kOk,
+    };
+
+    // One shard's part of a command.
+    struct Op {
+        OpCode code;
+        uint8_t protocol;
+        size_t shard;
+        uint64_t hash;
+        std::string_view key;
+        std::string_view value;
+        int64_t arg;
+    };
+
+    // Past this a long pipeline is sent in parts.
+    const size_t kMaxOutputBytes = 256 * 1024;
+
+    bool parseInt(std::string_view text, int64_t *value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), *value);
+        return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    // Stores value as text and replies with it.
+    void storeInteger(Buffer *out, int64_t value, std::string *text) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof digits, value);
+        text->assign(digits, result.ptr);
+        RespWriter::appendInteger(out, value);
+    }
+
+    void execute(KvTable &table, const Op &op, Buffer *out) {
+        switch (op.code) {
+            case OpCode::kGet: {
+                std::string *value = table.find(op.key, op.hash);
+                if (value == nullptr) {
+                    RespWriter::appendNull(out, op.protocol);
+                } else {
+                    RespWriter::appendBulkString(out, *value);
+                }
+                return;
+            }
+            case OpCode::kSet: {
+                if (op.arg != kSetAlways) {
+                    bool present = table.find(op.key, op.hash) != nullptr;
+                    if (present != (op.arg == kSetIfPresent)) {
+                        RespWriter::appendNull(out, op.protocol);
+                        return;
+                    }
+                }
+                table.emplace(op.key, op.hash).first->assign(op.value);
+                out->append("+OK\r\n", 5);
+                return;
+            }
+            case OpCode::kDel:
+                RespWriter::appendInteger(out, table.erase(op.key, op.hash) ? 1 : 0);
+                return;
+            case OpCode::kExists:
+                RespWriter::appendInteger(out, table.find(op.key, op.hash) != nullptr ? 1 : 0);
+                return;
+            case OpCode::kIncrBy: {
+                auto [value, inserted] = table.emplace(op.key, op.hash);
+                int64_t current = 0;
+                if (!inserted && !parseInt(*value, &current)) {
+                    RespWriter::appendError(out, "ERR value is not an integer or out of range");
+                    return;
+                }
+                int64_t next;
+                if (__builtin_add_overflow(current, op.arg, &next)) {
+                    RespWriter::appendError(out, "ERR increment or decrement would overflow");
+                    if (inserted) {
+                        table.erase(op.key, op.hash);
+                    }
+                    return;
+                }
+                storeInteger(out, next, value);
+                return;
+            }
+            case OpCode::kAppend: {
+                std::string *value = table.emplace(op.key, op.hash).first;
+                value->append(op.value);
+                RespWriter::appendInteger(out, static_cast<int64_t>(value->size()));
+                return;
+            }
+            case OpCode::kStrlen: {
+                std::string *value = table.find(op.key, op.hash);
+                RespWriter::appendInteger(out, value == nullptr ? 0 : static_cast<int64_t>(value->size()));
+                return;
+            }
+            case OpCode::kDbSize:
+                RespWriter::appendInteger(out, static_cast<int64_t>(table.size()));
+                return;
+            case OpCode::kFlush:
+                table.clear();
+                out->append("+OK\r\n", 5);
+                return;
+        }
+    }
+
+    void aggregate(Aggregate kind, const std::vector<std::string_view> &replies, Buffer *out) {
+        switch (kind) {
+            case Aggregate::kSingle:
+                out->append(replies.front().data(), replies.front().size());
+                return;
+            case Aggregate::kArray:
+                RespWriter::appendArrayHeader(out, replies.size());
+                for (std::string_view reply: replies) {
+                    out->append(reply.data(), reply.size());
+                }
+                return;
+            case Aggregate::kSum: {
+                int64_t sum = 0;
+                for (std::string_view reply: replies) {
+                    int64_t value = 0;
+                    // ":<n>\r\n"
+                    parseInt(reply.substr(1, reply.size() - 3), &value);
+                    sum += value;
+                }
+                RespWriter::appendInteger(out, sum);
+                return;
+            }
+            case Aggregate::kOk:
+                for (std::string_view reply: replies) {
+                    if (reply[0] == '-') {
+                        out->append(reply.data(), reply.size());
+                        return;
+                    }
+                }
+                out->append("+OK\r\n", 5);
+                return;
+        }
+    }
+
+    void assignLowercase(std::string_view text, std::string *result) {
+        result->assign(text);
+        for (char &c: *result) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+}
+
+struct KvServer::Context {
+    RespParser parser;
+    int protocol;
+    // After QUIT or a protocol error nothing more is read.
+    bool closing;
+    // Batches in command order, sent once complete.
+    std::deque<std::shared_ptr<Batch>> waiting;
+
+    explicit Context(size_t maxBulkBytes)
+            : parser(maxBulkBytes),
+              protocol(2),
+              closing(false) {
+    }
+};
+
+struct KvServer::Batch {
+    // The ops of one shard, copied out of the input buffer, and their
+    // replies one after the other.
+    struct Part {
+        struct Stored {
+            Op op;
+            size_t keyOffset;
+            size_t valueOffset;
+        };
+        std::string bytes;
+        std::vector<Stored> ops;
+        Buffer output;
+        std::vector<size_t> ends;
+    };
+
+    struct Reply {
+        Aggregate aggregate;
+        size_t firstOp;
+        size_t numOps;
+    };
+
+    struct OpRef {
+        size_t part;
+        size_t index;
+    };
+
+    TcpConnectionPtr conn;
+    // One per shard, and last the part run at once in the connection's
+    // loop: ops of its own shard and replies that need no shard.
+    std::vector<Part> parts;
+    std::vector<Reply> replies;
+    std::vector<OpRef> ops;
+    std::atomic<size_t> remaining{0};
+    // In the connection's loop.
+    bool done = false;
+
+    Batch(TcpConnectionPtr c, size_t numShards) : conn(std::move(c)), parts(numShards + 1) {}
+
+    Part &here() { return parts.back(); }
+
+    void addReady(Aggregate kind, size_t numOps) {
+        replies.push_back({kind, ops.size() - numOps, numOps});
+    }
+
+    void noteHere() {
+        Part &part = here();
+        part.ends.push_back(part.output.readableBytes());
+        ops.push_back({parts.size() - 1, part.ends.size() - 1});
+    }
+};
+
+namespace {
+    // Turns a command into ops. False if it is answered at once, in *reply.
+    bool planCommand(const KvServer &server, const std::vector<std::string_view> &args, int *protocol,
+                     bool *closing, uint64_t connId, std::vector<Op> *ops, Aggregate *kind, Buffer *reply) {
+        thread_local std::string name;
+        assignLowercase(args[0], &name);
+        size_t argc = args.size();
+        auto addOp = [&](OpCode code, std::string_view key, std::string_view value, int64_t arg) {
+            uint64_t hash = KvTable::hash(key);
+            ops->push_back({code, static_cast<uint8_t>(*protocol), server.shardOf(hash), hash, key, value, arg});
+        };
+        auto addEveryShard = [&](OpCode code) {
+            for (size_t shard = 0; shard < server.numShards(); ++shard) {
+                ops->push_back({code, static_cast<uint8_t>(*protocol), shard, 0, {}, {}, 0});
+            }
+        };
+        auto wrongArity = [&] {
+            RespWriter::appendError(reply, "ERR wrong number of arguments for '" + name + "' command");
+            return false;
+        };
+        *kind = Aggregate::kSingle;
+        if (name == "get") {
+            if (argc != 2) {
+                return wrongArity();
+            }
+            addOp(OpCode::kGet, args[1], {}, 0);
+        } else if (name == "set") {
+            if (argc < 3) {
+                return wrongArity();
+            }
+            int64_t condition = kSetAlways;
+            for (size_t i = 3; i < argc; ++i) {
+                if (equalsIgnoreCase(args[i], "nx") && condition == kSetAlways) {
+                    condition = kSetIfAbsent;
+                } else if (equalsIgnoreCase(args[i], "xx") && condition == kSetAlways) {
+                    condition = kSetIfPresent;
+                } else {
+                    RespWriter::appendError(reply, "ERR syntax error");
+                    return false;
+                }
+            }
+            addOp(OpCode::kSet, args[1], args[2], condition);
+        } else if (name == "mget") {
+            if (argc < 2) {
+                return wrongArity();
+            }
+            for (size_t i = 1; i < argc; ++i) {
+                addOp(OpCode::kGet, args[i], {}, 0);
+            }
+            *kind = Aggregate::kArray;
+        } else if (name == "mset") {
+            if (argc < 3 || argc % 2 == 0) {
+                return wrongArity();
+            }
+            for (size_t i = 1; i < argc; i += 2) {
+                addOp(OpCode::kSet, args[i], args[i + 1], kSetAlways);
+            }
+            *kind = Aggregate::kOk;
+        } else if (name == "del" || name == "unlink" || name == "exists") {
+            if (argc < 2) {
+                return wrongArity();
+            }
+            for (size_t i = 1; i < argc; ++i) {
+                addOp(name == "exists" ? OpCode::kExists : OpCode::kDel, args[i], {}, 0);
+            }
+            *kind = Aggregate::kSum;
+        } else if (name == "incr" || name == "decr") {
+            if (argc != 2) {
+                return wrongArity();
+            }
+            addOp(OpCode::kIncrBy, args[1], {}, name == "incr" ? 1 : -1);
+        } else if (name == "incrby" || name == "decrby") {
+            if (argc != 3) {
+                return wrongArity();
+            }
+            int64_t delta;
+            if (!parseInt(args[2], &delta) || (name == "decrby" && delta == INT64_MIN)) {
+                RespWriter::appendError(reply, "ERR value is not an integer or out of range");
+                return false;
+            }
+            addOp(OpCode::kIncrBy, args[1], {}, name == "incrby" ? delta : -delta);
+        } else if (name == "append") {
+            if (argc != 3) {
+                return wrongArity();
+            }
+            addOp(OpCode::kAppend, args[1], args[2], 0);
+        } else if (name == "strlen") {
+            if (argc != 2) {
+                return wrongArity();
+            }
+            addOp(OpCode::kStrlen, args[1], {}, 0);
+        } else if (name == "dbsize") {
+            if (argc != 1) {
+                return wrongArity();
+            }
+            addEveryShard(OpCode::kDbSize);
+            *kind = Aggregate::kSum;
+        } else if (name == "flushall" || name == "flushdb") {
+            if (argc > 2) {
+                return wrongArity();
+            }
+            addEveryShard(OpCode::kFlush);
+            *kind = Aggregate::kOk;
+        } else if (name == "ping") {
+            if (argc > 2) {
+                return wrongArity();
+            }
+            if (argc == 2) {
+                RespWriter::appendBulkString(reply, args[1]);
+            } else {
+                RespWriter::appendSimpleString(reply, "PONG");
+            }
+            return false;
+        } else if (name == "echo") {
+            if (argc != 2) {
+                return wrongArity();
+            }
+            RespWriter::appendBulkString(reply, args[1]);
+            return false;
+        } else if (name == "hello") {
+            if (argc >= 2) {
+                int64_t version;
+                if (!parseInt(args[1], &version) || version < 2 || version > 3) {
+                    RespWriter::appendError(reply, "NOPROTO unsupported protocol version");
+                    return false;
+                }
+                *protocol = static_cast<int>(version);
+            }
+            RespWriter::appendMapHeader(reply, 7, *protocol);
+            RespWriter::appendBulkString(reply, "server");
+            RespWriter::appendBulkString(reply, "redis");
+            RespWriter::appendBulkString(reply, "version");
+            RespWriter::appendBulkString(reply, "7.0.0");
+            RespWriter::appendBulkString(reply, "proto");
+            RespWriter::appendInteger(reply, *protocol);
+            RespWriter::appendBulkString(reply, "id");
+            RespWriter::appendInteger(reply, static_cast<int64_t>(connId));
+            RespWriter::appendBulkString(reply, "mode");
+            RespWriter::appendBulkString(reply, "standalone");
+            RespWriter::appendBulkString(reply, "role");
+            RespWriter::appendBulkString(reply, "master");
+            RespWriter::appendBulkString(reply, "modules");
+            RespWriter::appendArrayHeader(reply, 0);
+            return false;
+        } else if (name == "select") {
+            if (argc != 2) {
+                return wrongArity();
+            }
+            if (args[1] == "0") {
+                RespWriter::appendSimpleString(reply, "OK");
+            } else {
+                RespWriter::appendError(reply, "ERR DB index is out of range");
+            }
+            return false;
+        } else if (name == "config") {
+            // Clients such as redis-benchmark ask for settings on connect.
+            if (argc >= 2 && equalsIgnoreCase(args[1], "get")) {
+                RespWriter::appendMapHeader(reply, 0, *protocol);
+            } else {
+                RespWriter::appendError(reply, "ERR unsupported CONFIG subcommand");
+            }
+            return false;
+        } else if (name == "command") {
+            RespWriter::appendArrayHeader(reply, 0);
+            return false;
+        } else if (name == "quit") {
+            RespWriter::appendSimpleString(reply, "OK");
+            *closing = true;
+            return false;
+        } else {
+            RespWriter::appendError(reply, "ERR unknown command '" + std::string(args[0]) + "'");
+            return false;
+        }
+        return true;
+    }
+}
+
+KvServer::KvServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                   TcpServer::Option option)
+        : m_server(loop, listenAddr, name, option),
+          m_numThreads(0),
+          m_nextShard(0),
+          m_maxBulkBytes(512 * 1024 * 1024) {
+    m_server.setConnectionCallback([this](const TcpConnectionPtr &conn) {
+        onConnection(conn);
+    });
+    m_server.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+        onMessage(conn, buf, receiveTime);
+    });
+}
+
+void KvServer::start() {
+    if (!m_shards.empty()) {
+        return;
+    }
+    size_t numShards = std::max(m_numThreads, 1);
+    for (size_t i = 0; i < numShards; ++i) {
+        m_shards.emplace_back(new Shard);
+    }
+    // Every loop claims a shard before it takes a connection, so the
+    // shards are complete wherever the first command arrives.
+    m_server.setThreadInitCallback([this](EventLoop *loop) {
+        m_shards[m_nextShard.fetch_add(1)]->loop = loop;
+    });
+    m_server.start();
+}
+
+size_t KvServer::shardOfLoop(const EventLoop *loop) const {
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        if (m_shards[i]->loop == loop) {
+            return i;
+        }
+    }
+    return m_shards.size();
+}
+
+void KvServer::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        // Replies held back for other shards go out in a later send.
+        conn->setTcpNoDelay(true);
+        conn->setContext(std::make_shared<Context>(m_maxBulkBytes));
+        return;
+    }
+    auto *holder = std::any_cast<std::shared_ptr<Context>>(conn->getMutableContext());
+    if (holder != nullptr) {
+        // Batches still running hold the connection until they finish.
+        (*holder)->waiting.clear();
+    }
+}
+
+void KvServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+    auto *holder = std::any_cast<std::shared_ptr<Context>>(conn->getMutableContext());
+    if (holder == nullptr || (*holder)->closing) {
+        buf->retrieveAll();
+        return;
+    }
+    Context *context = holder->get();
+    thread_local Buffer output;
+    thread_local std::vector<std::string_view> args;
+    size_t local = shardOfLoop(conn->getLoop());
+    std::shared_ptr<Batch> batch;
+    // Replies may not overtake those still out.
+    if (!context->waiting.empty()) {
+        batch = std::make_shared<Batch>(conn, m_shards.size());
+    }
+    while (true) {
+        RespParser::Result result = context->parser.parse(buf);
+        if (result == RespParser::Result::kNeedMore) {
+            break;
+        }
+        bool valid = result == RespParser::Result::kComplete && context->parser.command(&args);
+        if (!valid) {
+            std::string message = result == RespParser::Result::kError
+                                  ? "ERR " + context->parser.error()
+                                  : "ERR Protocol error: expected an array of strings";
+            logd("KvServer::onMessage - {} {}", conn->getName(), message);
+            thread_local Buffer error;
+            error.retrieveAll();
+            RespWriter::appendError(&error, message);
+            replyAtOnce(batch.get(), error, &output);
+            context->closing = true;
+            break;
+        }
+        if (!args.empty()) {
+            runCommand(conn, context, args, local, &batch, &output);
+        }
+        context->parser.consume(buf);
+        if (context->closing) {
+            break;
+        }
+        if (output.readableBytes() >= kMaxOutputBytes) {
+            conn->send(&output);
+        }
+    }
+    if (output.readableBytes() > 0) {
+        conn->send(&output);
+    }
+    if (batch) {
+        dispatch(conn, context, batch);
+    }
+    if (context->closing) {
+        buf->retrieveAll();
+        if (context->waiting.empty()) {
+            conn->shutdown();
+        }
+    }
+}
+
+void KvServer::runCommand(const TcpConnectionPtr &conn, Context *context, const std::vector<std::string_view> &args,
+                          size_t local, std::shared_ptr<Batch> *batch, Buffer *output) {
+    thread_local std::vector<Op> ops;
+    thread_local Buffer reply;
+    ops.clear();
+    reply.retrieveAll();
+    Aggregate kind;
+    bool closing = context->closing;
+    bool planned = planCommand(*this, args, &context->protocol, &closing, conn->id(), &ops, &kind, &reply);
+    context->closing = closing;
+    if (!planned) {
+        replyAtOnce(batch->get(), reply, output);
+        return;
+    }
+    bool allLocal = std::all_of(ops.begin(), ops.end(), [local](const Op &op) { return op.shard == local; });
+    if (!*batch && allLocal) {
+        KvTable &table = m_shards[local]->table;
+        if (kind == Aggregate::kSingle) {
+            execute(table, ops.front(), output);
+            return;
+        }
+        thread_local std::vector<size_t> ends;
+        thread_local std::vector<std::string_view> replies;
+        ends.clear();
+        replies.clear();
+        for (const Op &op: ops) {
+            execute(table, op, &reply);
+            ends.push_back(reply.readableBytes());
+        }
+        size_t begin = 0;
+        for (size_t end: ends) {
+            replies.emplace_back(reply.peek() + begin, end - begin);
+            begin = end;
+        }
+        aggregate(kind, replies, output);
+        return;
+    }
+    if (!*batch) {
+        *batch = std::make_shared<Batch>(conn, m_shards.size());
+    }
+    Batch &b = **batch;
+    for (const Op &op: ops) {
+        if (op.shard == local) {
+            execute(m_shards[local]->table, op, &b.here().output);
+            b.noteHere();
+            continue;
+        }
+        Batch::Part &part = b.parts[op.shard];
+        Batch::Part::Stored stored{op, part.bytes.size(), part.bytes.size() + op.key.size()};
+        part.bytes.append(op.key);
+        part.bytes.append(op.value);
+        part.ops.push_back(stored);
+        b.ops.push_back({op.shard, part.ops.size() - 1});
+    }
+    b.addReady(kind, ops.size());
+}
+
+void KvServer::replyAtOnce(Batch *batch, const Buffer &reply, Buffer *output) {
+    if (batch == nullptr) {
+        output->append(reply.peek(), reply.readableBytes());
+        return;
+    }
+    batch->here().output.append(reply.peek(), reply.readableBytes());
+    batch->noteHere();
+    batch->addReady(Aggregate::kSingle, 1);
+}
+
+void KvServer::dispatch(const TcpConnectionPtr &conn, Context *context, const std::shared_ptr<Batch> &batch) {
+    std::vector<size_t> targets;
+    for (size_t shard = 0; shard < m_shards.size(); ++shard) {
+        if (!batch->parts[shard].ops.empty()) {
+            targets.push_back(shard);
+        }
+    }
+    context->waiting.push_back(batch);
+    if (targets.empty()) {
+        batch->done = true;
+        flushWaiting(conn, context);
+        return;
+    }
+    batch->remaining.store(targets.size(), std::memory_order_relaxed);
+    for (size_t shard: targets) {
+        m_shards[shard]->loop->queueInLoop([this, batch, shard] {
+            runPart(batch, shard);
+        });
+    }
+}
+
+void KvServer::runPart(const std::shared_ptr<Batch> &batch, size_t shard) {
+    Batch::Part &part = batch->parts[shard];
+    KvTable &table = m_shards[shard]->table;
+    part.ends.reserve(part.ops.size());
+    for (Batch::Part::Stored &stored: part.ops) {
+        Op op = stored.op;
+        op.key = std::string_view(part.bytes.data() + stored.keyOffset, op.key.size());
+        op.value = std::string_view(part.bytes.data() + stored.valueOffset, op.value.size());
+        execute(table, op, &part.output);
+        part.ends.push_back(part.output.readableBytes());
+    }
+    if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        batch->conn->getLoop()->runInLoop([this, batch] {
+            finishBatch(batch);
+        });
+    }
+}
+
+void KvServer::finishBatch(const std::shared_ptr<Batch> &batch) {
+    const TcpConnectionPtr &conn = batch->conn;
+    EventLoop *owner = conn->getLoop();
+    if (!owner->isInLoopThread()) {
+        // Migrated on the way.
+        owner->runInLoop([this, batch] {
+            finishBatch(batch);
+        });
+        return;
+    }
+    batch->done = true;
+    auto *holder = std::any_cast<std::shared_ptr<Context>>(conn->getMutableContext());
+    if (holder == nullptr || !conn->connected()) {
+        return;
+    }
+    flushWaiting(conn, holder->get());
+}
+
+void KvServer::flushWaiting(const TcpConnectionPtr &conn, Context *context) {
+    thread_local Buffer output;
+    thread_local std::vector<std::string_view> replies;
+    while (!context->waiting.empty() && context->waiting.front()->done) {
+        std::shared_ptr<Batch> batch = std::move(context->waiting.front());
+        context->waiting.pop_front();
+        for (const Batch::Reply &reply: batch->replies) {
+            replies.clear();
+            for (size_t i = reply.firstOp; i < reply.firstOp + reply.numOps; ++i) {
+                const Batch::OpRef &ref = batch->ops[i];
+                const Batch::Part &part = batch->parts[ref.part];
+                size_t begin = ref.index == 0 ? 0 : part.ends[ref.index - 1];
+                replies.emplace_back(part.output.peek() + begin, part.ends[ref.index] - begin);
+            }
+            aggregate(reply.aggregate, replies, &output);
+        }
+        if (output.readableBytes() >= kMaxOutputBytes) {
+            conn->send(&output);
+        }
+    }
+    if (output.readableBytes() > 0) {
+        conn->send(&output);
+    }
+    if (context->closing && context->waiting.empty()) {
+        conn->shutdown();
+    }
+}
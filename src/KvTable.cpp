@@ -0,0 +1,111 @@
+#include "src/include/KvTable.h"
+
+#include <functional>
+
+using namespace faliks;
+
+namespace {
+    // Rehashed beyond this share of live and erased slots.
+    const size_t kMaxLoadPercent = 70;
+}
+
+KvTable::KvTable(size_t initialCapacity)
+        : m_size(0),
+          m_used(0) {
+    size_t capacity = 16;
+    while (capacity < initialCapacity) {
+        capacity <<= 1;
+    }
+    m_hashes.assign(capacity, kEmpty);
+    m_entries.resize(capacity);
+}
+
+uint64_t KvTable::hash(std::string_view key) {
+    uint64_t h = std::hash<std::string_view>()(key);
+    // Mixed so the low bits index the table and the high bits can route.
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h > kErased ? h : h + 2;
+}
+
+size_t KvTable::findSlot(std::string_view key, uint64_t hash) const {
+    for (size_t i = hash & mask();; i = (i + 1) & mask()) {
+        uint64_t slot = m_hashes[i];
+        if (slot == kEmpty) {
+            return m_hashes.size();
+        }
+        if (slot == hash && m_entries[i].key == key) {
+            return i;
+        }
+    }
+}
+
+std::string *KvTable::find(std::string_view key, uint64_t hash) {
+    size_t i = findSlot(key, hash);
+    return i == m_hashes.size() ? nullptr : &m_entries[i].value;
+}
+
+std::pair<std::string *, bool> KvTable::emplace(std::string_view key, uint64_t hash) {
+    size_t i = findSlot(key, hash);
+    if (i != m_hashes.size()) {
+        return {&m_entries[i].value, false};
+    }
+    if ((m_used + 1) * 100 > m_hashes.size() * kMaxLoadPercent) {
+        // Doubled only if live entries fill it, else erased slots are dropped.
+        rehash((m_size + 1) * 100 > m_hashes.size() * kMaxLoadPercent / 2 ? 2 * m_hashes.size() : m_hashes.size());
+    }
+    // Reuses the first erased slot on the way.
+    for (i = hash & mask(); m_hashes[i] > kErased; i = (i + 1) & mask()) {
+    }
+    if (m_hashes[i] == kEmpty) {
+        ++m_used;
+    }
+    m_hashes[i] = hash;
+    m_entries[i].key.assign(key);
+    m_entries[i].value.clear();
+    ++m_size;
+    return {&m_entries[i].value, true};
+}
+
+bool KvTable::erase(std::string_view key, uint64_t hash) {
+    size_t i = findSlot(key, hash);
+    if (i == m_hashes.size()) {
+        return false;
+    }
+    m_hashes[i] = kErased;
+    // Release the memory, not just the length.
+    std::string().swap(m_entries[i].key);
+    std::string().swap(m_entries[i].value);
+    --m_size;
+    return true;
+}
+
+void KvTable::clear() {
+    size_t capacity = 16;
+    m_hashes.assign(capacity, kEmpty);
+    m_entries.clear();
+    m_entries.resize(capacity);
+    m_size = 0;
+    m_used = 0;
+}
+
+void KvTable::rehash(size_t capacity) {
+    std::vector<uint64_t> hashes(capacity, kEmpty);
+    std::vector<Entry> entries(capacity);
+    size_t newMask = capacity - 1;
+    for (size_t i = 0; i < m_hashes.size(); ++i) {
+        if (m_hashes[i] <= kErased) {
+            continue;
+        }
+        size_t j = m_hashes[i] & newMask;
+        while (hashes[j] != kEmpty) {
+            j = (j + 1) & newMask;
+        }
+        hashes[j] = m_hashes[i];
+        entries[j] = std::move(m_entries[i]);
+    }
+    m_hashes.swap(hashes);
+    m_entries.swap(entries);
+    m_used = m_size;
+}
@@ -0,0 +1,140 @@
+#include "src/include/LengthHeaderCodec.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/fmtlog.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace faliks;
+
+LengthHeaderCodec::LengthHeaderCodec(size_t headerBytes, ByteOrder byteOrder, size_t maxFrameBytes)
+        : m_headerBytes(headerBytes),
+          m_byteOrder(byteOrder),
+          m_maxFrameBytes(maxFrameBytes) {
+    assert(headerBytes == 1 || headerBytes == 2 || headerBytes == 4 || headerBytes == 8);
+    static_assert(Buffer::CHEAP_PREPEND >= 8, "the widest header must fit in front of a payload");
+}
+
+uint64_t LengthHeaderCodec::decodeLength(const char *header) const {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(header);
+    uint64_t length = 0;
+    if (m_byteOrder == ByteOrder::kBigEndian) {
+        for (size_t i = 0; i < m_headerBytes; ++i) {
+            length = (length << 8) | bytes[i];
+        }
+    } else {
+        for (size_t i = m_headerBytes; i > 0; --i) {
+            length = (length << 8) | bytes[i - 1];
+        }
+    }
+    return length;
+}
+
+void LengthHeaderCodec::encodeLength(uint64_t length, char *header) const {
+    for (size_t i = 0; i < m_headerBytes; ++i) {
+        size_t index = m_byteOrder == ByteOrder::kBigEndian ? m_headerBytes - 1 - i : i;
+        header[index] = static_cast<char>(length & 0xff);
+        length >>= 8;
+    }
+}
+
+size_t LengthHeaderCodec::maxPayloadBytes() const {
+    if (m_headerBytes >= sizeof(uint64_t)) {
+        return m_maxFrameBytes;
+    }
+    uint64_t headerLimit = (uint64_t(1) << (8 * m_headerBytes)) - 1;
+    return static_cast<size_t>(std::min<uint64_t>(headerLimit, m_maxFrameBytes));
+}
+
+// Frames are only looked at until the callbacks return; the buffer is
+// retrieved once for all of them.
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+    thread_local std::vector<std::string_view> frames;
+    frames.clear();
+    const char *data = buf->peek();
+    size_t readable = buf->readableBytes();
+    size_t consumed = 0;
+    while (readable - consumed >= m_headerBytes) {
+        uint64_t length = decodeLength(data + consumed);
+        if (length > m_maxFrameBytes) {
+            loge("LengthHeaderCodec::onMessage [{}] - frame of {} bytes exceeds {}", conn->getName(), length,
+                 m_maxFrameBytes);
+            buf->retrieveAll();
+            conn->forceClose();
+            return;
+        }
+        if (readable - consumed - m_headerBytes < length) {
+            break;
+        }
+        frames.emplace_back(data + consumed + m_headerBytes, static_cast<size_t>(length));
+        consumed += m_headerBytes + static_cast<size_t>(length);
+    }
+    if (frames.empty()) {
+        return;
+    }
+    if (m_frameBatchCallback) {
+        m_frameBatchCallback(conn, frames, receiveTime);
+    } else if (m_frameCallback) {
+        for (std::string_view frame: frames) {
+            m_frameCallback(conn, frame, receiveTime);
+        }
+    }
+    buf->retrieve(consumed);
+}
+
+bool LengthHeaderCodec::encode(Buffer *buf) const {
+    size_t length = buf->readableBytes();
+    if (length > maxPayloadBytes()) {
+        loge("LengthHeaderCodec::encode - payload of {} bytes exceeds {}", length, maxPayloadBytes());
+        return false;
+    }
+    char header[8];
+    encodeLength(length, header);
+    buf->prepend(header, m_headerBytes);
+    return true;
+}
+
+bool LengthHeaderCodec::appendFrame(Buffer *buf, std::string_view payload) const {
+    if (payload.size() > maxPayloadBytes()) {
+        loge("LengthHeaderCodec::appendFrame - payload of {} bytes exceeds {}", payload.size(), maxPayloadBytes());
+        return false;
+    }
+    char header[8];
+    encodeLength(payload.size(), header);
+    buf->ensureWritableBytes(m_headerBytes + payload.size());
+    buf->append(header, m_headerBytes);
+    buf->append(payload.data(), payload.size());
+    return true;
+}
+
+bool LengthHeaderCodec::appendFrame(Buffer *buf, std::initializer_list<std::string_view> parts) const {
+    size_t length = 0;
+    for (std::string_view part: parts) {
+        length += part.size();
+    }
+    if (length > maxPayloadBytes()) {
+        loge("LengthHeaderCodec::appendFrame - payload of {} bytes exceeds {}", length, maxPayloadBytes());
+        return false;
+    }
+    char header[8];
+    encodeLength(length, header);
+    buf->ensureWritableBytes(m_headerBytes + length);
+    buf->append(header, m_headerBytes);
+    for (std::string_view part: parts) {
+        buf->append(part.data(), part.size());
+    }
+    return true;
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *buf) const {
+    if (encode(buf)) {
+        conn->send(buf);
+    }
+    buf->retrieveAll();
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, std::string_view payload) const {
+    Buffer buf(payload.size());
+    buf.append(payload.data(), payload.size());
+    send(conn, &buf);
+}
@@ -0,0 +1,42 @@
+#include "src/include/LoopLoad.h"
+
+#include <cmath>
+
+namespace faliks {
+
+    LoopLoad::LoopLoad()
+            : m_connections(0),
+              m_utilization(0.0),
+              m_updatedUs(0),
+              m_windowStartUs(0),
+              m_windowBusyUs(0) {
+    }
+
+    void LoopLoad::recordIteration(int64_t busyUs, int64_t endUs) {
+        if (m_windowStartUs == 0) {
+            m_windowStartUs = endUs - busyUs;
+        }
+        m_windowBusyUs += busyUs;
+        int64_t elapsed = endUs - m_windowStartUs;
+        if (elapsed < kWindowUs) {
+            return;
+        }
+        double sample = std::min(1.0, static_cast<double>(m_windowBusyUs) / static_cast<double>(elapsed));
+        // A window stretched by a long poll counts as several idle windows.
+        double weight = 1.0 - std::pow(1.0 - kAlpha, static_cast<double>(elapsed) / kWindowUs);
+        double previous = m_utilization.load(std::memory_order_relaxed);
+        m_utilization.store(previous + weight * (sample - previous), std::memory_order_relaxed);
+        m_updatedUs.store(endUs, std::memory_order_relaxed);
+        m_windowStartUs = endUs;
+        m_windowBusyUs = 0;
+    }
+
+    double LoopLoad::utilization(int64_t nowUs) const {
+        double value = m_utilization.load(std::memory_order_relaxed);
+        int64_t stale = nowUs - m_updatedUs.load(std::memory_order_relaxed) - kWindowUs;
+        if (stale > 0) {
+            value *= std::pow(1.0 - kAlpha, static_cast<double>(stale) / kWindowUs);
+        }
+        return value;
+    }
+}
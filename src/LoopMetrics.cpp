@@ -0,0 +1,63 @@
+#include "src/include/LoopMetrics.h"
+
+namespace faliks {
+
+    double LoopMetricsSnapshot::utilization() const {
+        double blocked = pollBlocked.mean() * static_cast<double>(pollBlocked.count());
+        double working = busy.mean() * static_cast<double>(busy.count());
+        return blocked + working > 0 ? working / (blocked + working) : 0.0;
+    }
+
+    std::string LoopMetricsSnapshot::toString() const {
+        std::string result;
+        result.append("iterations=").append(std::to_string(iterations));
+        result.append(" utilization=").append(std::to_string(utilization()));
+        result.append("\n  pollBlocked: ").append(pollBlocked.toString());
+        result.append("\n  busy: ").append(busy.toString());
+        result.append("\n  eventsPerIteration: ").append(eventsPerIteration.toString());
+        for (size_t i = 0; i < handler.size(); ++i) {
+            if (handler[i].count() > 0) {
+                result.append("\n  handler[").append(Channel::typeToString(static_cast<Channel::Type>(i)));
+                result.append("]: ").append(handler[i].toString());
+            }
+        }
+        result.append("\n  queueDepth: ").append(queueDepth.toString());
+        result.append("\n  queueWait: ").append(queueWait.toString());
+        result.append("\n  timerLateness: ").append(timerLateness.toString());
+        return result;
+    }
+
+    LoopMetrics::LoopMetrics()
+            : m_iterations(0) {
+    }
+
+    void LoopMetrics::recordPoll(int64_t blockedUs, size_t numEvents) {
+        m_iterations.store(m_iterations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_pollBlocked.record(blockedUs);
+        m_eventsPerIteration.record(static_cast<int64_t>(numEvents));
+    }
+
+    void LoopMetrics::recordBusy(int64_t busyUs) {
+        m_busy.record(busyUs);
+    }
+
+    void LoopMetrics::recordQueue(size_t depth, int64_t waitUs) {
+        m_queueDepth.record(static_cast<int64_t>(depth));
+        m_queueWait.record(waitUs);
+    }
+
+    LoopMetricsSnapshot LoopMetrics::snapshot() const {
+        LoopMetricsSnapshot snapshot;
+        snapshot.iterations = m_iterations.load(std::memory_order_relaxed);
+        snapshot.pollBlocked = m_pollBlocked.snapshot();
+        snapshot.busy = m_busy.snapshot();
+        snapshot.eventsPerIteration = m_eventsPerIteration.snapshot();
+        for (size_t i = 0; i < m_handler.size(); ++i) {
+            snapshot.handler[i] = m_handler[i].snapshot();
+        }
+        snapshot.queueDepth = m_queueDepth.snapshot();
+        snapshot.queueWait = m_queueWait.snapshot();
+        snapshot.timerLateness = m_timerLateness.snapshot();
+        return snapshot;
+    }
+}
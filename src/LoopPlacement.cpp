@@ -0,0 +1,136 @@
+#include "src/include/LoopPlacement.h"
+#include "src/include/LoopLoad.h"
+#include "src/include/InetAddress.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace faliks {
+
+    namespace {
+        uint64_t mix(uint64_t x) {
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            x ^= x >> 31;
+            return x;
+        }
+
+        uint64_t hashBytes(const void *data, size_t len, uint64_t hash) {
+            const auto *p = static_cast<const unsigned char *>(data);
+            for (size_t i = 0; i < len; ++i) {
+                hash ^= p[i];
+                hash *= 0x100000001b3ULL;
+            }
+            return hash;
+        }
+
+        uint64_t hashPeer(const InetAddress &peerAddr, bool withPort) {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            const struct sockaddr *addr = peerAddr.getSockAddr();
+            if (addr->sa_family == AF_INET6) {
+                const auto *addr6 = reinterpret_cast<const struct sockaddr_in6 *>(addr);
+                hash = hashBytes(&addr6->sin6_addr, sizeof addr6->sin6_addr, hash);
+            } else {
+                const auto *addr4 = reinterpret_cast<const struct sockaddr_in *>(addr);
+                hash = hashBytes(&addr4->sin_addr, sizeof addr4->sin_addr, hash);
+            }
+            if (withPort) {
+                uint16_t port = peerAddr.portNetEndian();
+                hash = hashBytes(&port, sizeof port, hash);
+            }
+            return mix(hash);
+        }
+    }
+
+    size_t RoundRobinPlacement::select(const std::vector<const LoopLoad *> &loads, const InetAddress &,
+                                       int64_t) {
+        assert(!loads.empty());
+        size_t index = m_next % loads.size();
+        m_next = index + 1;
+        return index;
+    }
+
+    size_t LeastConnectionsPlacement::select(const std::vector<const LoopLoad *> &loads, const InetAddress &,
+                                             int64_t) {
+        assert(!loads.empty());
+        size_t n = loads.size();
+        size_t best = m_next % n;
+        int64_t bestConnections = loads[best]->connections();
+        for (size_t i = 1; i < n && bestConnections > 0; ++i) {
+            size_t index = (m_next + i) % n;
+            int64_t connections = loads[index]->connections();
+            if (connections < bestConnections) {
+                best = index;
+                bestConnections = connections;
+            }
+        }
+        m_next = best + 1;
+        return best;
+    }
+
+    PowerOfTwoChoicesPlacement::PowerOfTwoChoicesPlacement(uint64_t seed)
+            : m_state(seed ? seed : 1) {
+    }
+
+    size_t PowerOfTwoChoicesPlacement::random(size_t bound) {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return static_cast<size_t>(m_state % bound);
+    }
+
+    size_t PowerOfTwoChoicesPlacement::select(const std::vector<const LoopLoad *> &loads, const InetAddress &,
+                                              int64_t nowUs) {
+        assert(!loads.empty());
+        size_t n = loads.size();
+        if (n == 1) {
+            return 0;
+        }
+        size_t first = random(n);
+        size_t second = random(n - 1);
+        if (second >= first) {
+            ++second;
+        }
+        double firstUtilization = loads[first]->utilization(nowUs);
+        double secondUtilization = loads[second]->utilization(nowUs);
+        if (std::fabs(firstUtilization - secondUtilization) < kTieUtilization) {
+            return loads[first]->connections() <= loads[second]->connections() ? first : second;
+        }
+        return firstUtilization < secondUtilization ? first : second;
+    }
+
+    ConsistentHashPlacement::ConsistentHashPlacement(int virtualNodes, bool withPort)
+            : m_virtualNodes(std::max(1, virtualNodes)),
+              m_withPort(withPort),
+              m_ringLoops(0) {
+    }
+
+    void ConsistentHashPlacement::buildRing(size_t numLoops) {
+        m_ring.clear();
+        m_ring.reserve(numLoops * m_virtualNodes);
+        for (size_t loop = 0; loop < numLoops; ++loop) {
+            for (int v = 0; v < m_virtualNodes; ++v) {
+                m_ring.emplace_back(mix((static_cast<uint64_t>(loop) << 32) | static_cast<uint32_t>(v)), loop);
+            }
+        }
+        std::sort(m_ring.begin(), m_ring.end());
+        m_ringLoops = numLoops;
+    }
+
+    size_t ConsistentHashPlacement::select(const std::vector<const LoopLoad *> &loads, const InetAddress &peerAddr,
+                                           int64_t) {
+        assert(!loads.empty());
+        if (m_ringLoops != loads.size()) {
+            buildRing(loads.size());
+        }
+        uint64_t hash = hashPeer(peerAddr, m_withPort);
+        auto it = std::lower_bound(m_ring.begin(), m_ring.end(), std::make_pair(hash, size_t(0)));
+        if (it == m_ring.end()) {
+            it = m_ring.begin();
+        }
+        return it->second;
+    }
+}
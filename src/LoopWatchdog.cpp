@@ -0,0 +1,193 @@
+#include "src/include/LoopWatchdog.h"
+#include "src/include/EventLoop.h"
+#include "src/include/Channel.h"
+#include "base/include/CurrentThread.h"
+#include "base/include/fmtlog.h"
+
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace faliks {
+
+    namespace {
+        constexpr int kMaxFrames = 64;
+        constexpr int kCaptureTimeoutMs = 100;
+
+        // The low bits of s_capture are the state of the capture whose
+        // sequence number is in the rest; 0 when none is in flight.
+        constexpr uint64_t kRequested = 1;
+        constexpr uint64_t kWriting = 2;
+        constexpr uint64_t kDone = 3;
+        constexpr int kStateBits = 2;
+
+        void *s_frames[kMaxFrames];
+        int s_numFrames;
+        std::atomic<uint64_t> s_capture(0);
+        uint64_t s_lastSequence;
+        std::mutex s_captureMutex;
+
+        // ::backtrace only touches the stack once libgcc is loaded, which
+        // LoopWatchdog::start makes sure of before any signal is sent. A
+        // handler running late, after its capture timed out, fails to claim
+        // the frames and leaves them to the next one.
+        void captureStackHandler(int, siginfo_t *info, void *) {
+            auto sequence = reinterpret_cast<uintptr_t>(info->si_value.sival_ptr);
+            uint64_t expected = (sequence << kStateBits) | kRequested;
+            if (!s_capture.compare_exchange_strong(expected, (sequence << kStateBits) | kWriting,
+                                                   std::memory_order_acquire)) {
+                return;
+            }
+            int savedErrno = errno;
+            s_numFrames = ::backtrace(s_frames, kMaxFrames);
+            s_capture.store((sequence << kStateBits) | kDone, std::memory_order_release);
+            errno = savedErrno;
+        }
+
+        std::string activityToString(const EventLoop::Activity &activity) {
+            if (activity.fd < 0) {
+                return "pending functor";
+            }
+            return std::string(Channel::typeToString(static_cast<Channel::Type>(activity.channelType))) +
+                   " channel fd " + std::to_string(activity.fd);
+        }
+    }
+
+    LoopWatchdog::LoopWatchdog(double thresholdSeconds, double checkIntervalSeconds, int signal)
+            : m_thresholdUs(static_cast<int64_t>(thresholdSeconds * Timestamp::kMicroSecondsPerSecond)),
+              m_checkIntervalMs(std::max(1, static_cast<int>(checkIntervalSeconds * 1000))),
+              m_signal(signal),
+              m_running(false),
+              m_thread([this] { threadFunc(); }, "LoopWatchdog") {
+    }
+
+    LoopWatchdog::~LoopWatchdog() {
+        stop();
+    }
+
+    void LoopWatchdog::start() {
+        void *frame[1];
+        ::backtrace(frame, 1);
+
+        struct sigaction action{};
+        action.sa_sigaction = captureStackHandler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART | SA_SIGINFO;
+        if (::sigaction(m_signal, &action, nullptr) < 0) {
+            loge("LoopWatchdog sigaction error: {}", strerror(errno));
+        }
+
+        {
+            std::scoped_lock<std::mutex> lock(m_mutex);
+            assert(!m_running);
+            m_running = true;
+        }
+        m_thread.start();
+    }
+
+    void LoopWatchdog::stop() {
+        {
+            std::scoped_lock<std::mutex> lock(m_mutex);
+            if (!m_running) {
+                return;
+            }
+            m_running = false;
+            m_cond.notify_all();
+        }
+        m_thread.join();
+    }
+
+    void LoopWatchdog::watch(EventLoop *loop) {
+        loop->setWatched(true);
+        std::scoped_lock<std::mutex> lock(m_mutex);
+        m_loops.push_back({loop, 0});
+    }
+
+    void LoopWatchdog::unwatch(EventLoop *loop) {
+        std::scoped_lock<std::mutex> lock(m_mutex);
+        m_loops.erase(std::remove_if(m_loops.begin(), m_loops.end(),
+                                     [loop](const Watched &watched) { return watched.loop == loop; }),
+                      m_loops.end());
+        loop->setWatched(false);
+    }
+
+    void LoopWatchdog::threadFunc() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running) {
+            m_cond.wait_for(lock, std::chrono::milliseconds(m_checkIntervalMs));
+            int64_t nowUs = Timestamp::now().microSecondsSinceEpoch();
+            for (auto &watched: m_loops) {
+                check(watched, nowUs);
+            }
+        }
+    }
+
+    void LoopWatchdog::check(Watched &watched, int64_t nowUs) {
+        EventLoop::Activity activity = watched.loop->activity();
+        if (activity.startUs == 0 || activity.startUs == watched.reportedStartUs ||
+            nowUs - activity.startUs < m_thresholdUs) {
+            return;
+        }
+        watched.reportedStartUs = activity.startUs;
+
+        StallReport report;
+        report.loop = watched.loop;
+        report.tid = watched.loop->threadId();
+        report.iteration = activity.iteration;
+        report.stalledSeconds = static_cast<double>(nowUs - activity.startUs) / Timestamp::kMicroSecondsPerSecond;
+        report.fd = activity.fd;
+        report.activity = activityToString(activity);
+        report.stack = captureStack(report.tid);
+
+        if (m_stallCallback) {
+            m_stallCallback(report);
+        } else {
+            logw("EventLoop of thread {} stalled for {:.3f}s in {} at iteration {}\n{}",
+                 report.tid, report.stalledSeconds, report.activity, report.iteration, report.stack);
+        }
+    }
+
+    std::string LoopWatchdog::captureStack(pid_t tid) const {
+        std::scoped_lock<std::mutex> lock(s_captureMutex);
+        uint64_t sequence = ++s_lastSequence;
+        s_capture.store((sequence << kStateBits) | kRequested, std::memory_order_relaxed);
+        // The sequence number rides along, so the handler knows which capture it serves.
+        siginfo_t info{};
+        info.si_signo = m_signal;
+        info.si_code = SI_QUEUE;
+        info.si_pid = ::getpid();
+        info.si_uid = ::getuid();
+        info.si_value.sival_ptr = reinterpret_cast<void *>(static_cast<uintptr_t>(sequence));
+        if (::syscall(SYS_rt_tgsigqueueinfo, ::getpid(), tid, m_signal, &info) < 0) {
+            loge("LoopWatchdog rt_tgsigqueueinfo error: {}", strerror(errno));
+            s_capture.store(0, std::memory_order_relaxed);
+            return {};
+        }
+        bool done = false;
+        for (int waited = 0; waited < kCaptureTimeoutMs; ++waited) {
+            if (s_capture.load(std::memory_order_acquire) == ((sequence << kStateBits) | kDone)) {
+                done = true;
+                break;
+            }
+            ::usleep(1000);
+        }
+        if (!done) {
+            uint64_t expected = (sequence << kStateBits) | kRequested;
+            if (s_capture.compare_exchange_strong(expected, 0, std::memory_order_relaxed)) {
+                return "<stack capture timed out>";
+            }
+            // The handler got in just now; ::backtrace does not block, so wait it out.
+            while (s_capture.load(std::memory_order_acquire) != ((sequence << kStateBits) | kDone)) {
+                ::usleep(100);
+            }
+        }
+        int numFrames = s_numFrames;
+        s_capture.store(0, std::memory_order_relaxed);
+        // The first frames belong to the signal handler and the signal trampoline.
+        int skip = std::min(numFrames, 2);
+        return CurrentThread::stackTrace(s_frames + skip, numFrames - skip, true);
+    }
+}
@@ -0,0 +1,737 @@
+#include "src/include/MemcacheServer.h"
+#include "src/include/Buffer.h"
+#include "src/include/KvTable.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/fmtlog.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+using namespace faliks;
+
+namespace {
+    const char kVersionText[] = "1.6.21";
+
+    // A longer text command line closes the connection.
+    const size_t kMaxLineBytes = 64 * 1024;
+
+    // Past this the replies to a long pipeline are sent in parts.
+    const size_t kMaxOutputBytes = 256 * 1024;
+
+    // Values this large cannot fit a slab chunk anyway.
+    const size_t kMaxValueBytes = SlabAllocator::kPageBytes;
+
+    const size_t kBinaryHeaderBytes = 24;
+    const uint8_t kBinaryRequest = 0x80;
+    const uint8_t kBinaryResponse = 0x81;
+
+    enum BinaryOpcode : uint8_t {
+        kGet = 0x00, kSet = 0x01, kAdd = 0x02, kReplace = 0x03, kDelete = 0x04, kIncrement = 0x05,
+        kDecrement = 0x06, kQuit = 0x07, kFlush = 0x08, kGetQ = 0x09, kNoop = 0x0a, kVersion = 0x0b,
+        kGetK = 0x0c, kGetKQ = 0x0d, kAppend = 0x0e, kPrepend = 0x0f, kSetQ = 0x11, kAddQ = 0x12,
+        kReplaceQ = 0x13, kDeleteQ = 0x14, kIncrementQ = 0x15, kDecrementQ = 0x16, kQuitQ = 0x17,
+        kFlushQ = 0x18, kAppendQ = 0x19, kPrependQ = 0x1a, kTouch = 0x1c,
+    };
+
+    enum BinaryStatus : uint16_t {
+        kOk = 0x0000, kNotFound = 0x0001, kExists = 0x0002, kTooLarge = 0x0003, kInvalid = 0x0004,
+        kNotStored = 0x0005, kNonNumeric = 0x0006, kUnknownCommand = 0x0081, kOutOfMemory = 0x0082,
+    };
+
+    uint64_t readBigEndian(const char *data, size_t bytes) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value = value << 8 | static_cast<uint8_t>(data[i]);
+        }
+        return value;
+    }
+
+    void writeBigEndian(char *data, uint64_t value, size_t bytes) {
+        for (size_t i = bytes; i > 0; --i) {
+            data[i - 1] = static_cast<char>(value & 0xff);
+            value >>= 8;
+        }
+    }
+
+    template<typename T>
+    bool parseNumber(std::string_view text, T *value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), *value);
+        return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    // Keeps the items a reply points at acquired until it is sent.
+    struct HeldReply {
+        std::shared_ptr<MemcacheStore> store;
+        std::string text;
+        std::vector<const MemcacheItem *> items;
+
+        HeldReply(std::shared_ptr<MemcacheStore> s, std::string t, std::vector<const MemcacheItem *> i)
+                : store(std::move(s)),
+                  text(std::move(t)),
+                  items(std::move(i)) {
+        }
+
+        ~HeldReply() {
+            store->release(items.data(), items.size());
+        }
+    };
+
+    // The replies to one read: text copied into one string, values as
+    // slices of the acquired items they live in.
+    class ReplyBuilder {
+    private:
+        // A slice of the text if data is nullptr.
+        struct Slice {
+            const char *data;
+            size_t offset;
+            size_t len;
+        };
+
+        std::string m_text;
+        std::vector<Slice> m_slices;
+        std::vector<const MemcacheItem *> m_items;
+        size_t m_bytes = 0;
+
+    public:
+        void append(std::string_view text) {
+            if (!m_slices.empty() && m_slices.back().data == nullptr) {
+                m_slices.back().len += text.size();
+            } else {
+                m_slices.push_back({nullptr, m_text.size(), text.size()});
+            }
+            m_text.append(text);
+            m_bytes += text.size();
+        }
+
+        void appendNumber(uint64_t value) {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof digits, value);
+            append({digits, static_cast<size_t>(result.ptr - digits)});
+        }
+
+        // Takes over the reference acquired on item.
+        void appendItem(const MemcacheItem *item, const char *data, size_t len) {
+            m_slices.push_back({data, 0, len});
+            m_items.push_back(item);
+            m_bytes += len;
+        }
+
+        [[nodiscard]] size_t bytes() const { return m_bytes; }
+
+        void flush(const MemcacheServer::TcpConnectionPtr &conn, const std::shared_ptr<MemcacheStore> &store) {
+            if (m_slices.empty()) {
+                return;
+            }
+            if (m_items.empty()) {
+                conn->send(m_text.data(), static_cast<int>(m_text.size()));
+                m_text.clear();
+            } else {
+                auto held = std::make_shared<HeldReply>(store, std::move(m_text), std::move(m_items));
+                thread_local std::vector<struct iovec> slices;
+                slices.clear();
+                for (const Slice &slice: m_slices) {
+                    const char *data = slice.data != nullptr ? slice.data : held->text.data() + slice.offset;
+                    slices.push_back({const_cast<char *>(data), slice.len});
+                }
+                conn->sendReferenced(slices.data(), slices.size(), held);
+                m_text.clear();
+                m_items.clear();
+            }
+            m_slices.clear();
+            m_bytes = 0;
+        }
+    };
+
+    void appendBinaryHeader(ReplyBuilder *reply, uint8_t opcode, uint16_t status, size_t keyBytes,
+                            size_t extrasBytes, size_t bodyBytes, const char *opaque, uint64_t cas) {
+        char header[kBinaryHeaderBytes] = {};
+        header[0] = static_cast<char>(kBinaryResponse);
+        header[1] = static_cast<char>(opcode);
+        writeBigEndian(header + 2, keyBytes, 2);
+        header[4] = static_cast<char>(extrasBytes);
+        writeBigEndian(header + 6, status, 2);
+        writeBigEndian(header + 8, bodyBytes, 4);
+        std::memcpy(header + 12, opaque, 4);
+        writeBigEndian(header + 16, cas, 8);
+        reply->append({header, sizeof header});
+    }
+
+    void appendBinaryError(ReplyBuilder *reply, uint8_t opcode, uint16_t status, const char *opaque) {
+        std::string_view message;
+        switch (status) {
+            case kNotFound:
+                message = "Not found";
+                break;
+            case kExists:
+                message = "Data exists for key.";
+                break;
+            case kTooLarge:
+                message = "Too large.";
+                break;
+            case kInvalid:
+                message = "Invalid arguments";
+                break;
+            case kNotStored:
+                message = "Not stored.";
+                break;
+            case kNonNumeric:
+                message = "Non-numeric server-side value for incr or decr";
+                break;
+            case kOutOfMemory:
+                message = "Out of memory";
+                break;
+            default:
+                message = "Unknown command";
+        }
+        appendBinaryHeader(reply, opcode, status, 0, 0, message.size(), opaque, 0);
+        reply->append(message);
+    }
+
+    uint16_t binaryStatusOf(MemcacheStore::Result result) {
+        switch (result) {
+            case MemcacheStore::Result::kStored:
+                return kOk;
+            case MemcacheStore::Result::kNotStored:
+                return kNotStored;
+            case MemcacheStore::Result::kExists:
+                return kExists;
+            case MemcacheStore::Result::kNotFound:
+                return kNotFound;
+            case MemcacheStore::Result::kNonNumeric:
+                return kNonNumeric;
+            case MemcacheStore::Result::kTooLarge:
+                return kTooLarge;
+            case MemcacheStore::Result::kOutOfMemory:
+                return kOutOfMemory;
+        }
+        return kInvalid;
+    }
+
+    std::string_view textReplyOf(MemcacheStore::Result result) {
+        switch (result) {
+            case MemcacheStore::Result::kStored:
+                return "STORED\r\n";
+            case MemcacheStore::Result::kNotStored:
+                return "NOT_STORED\r\n";
+            case MemcacheStore::Result::kExists:
+                return "EXISTS\r\n";
+            case MemcacheStore::Result::kNotFound:
+                return "NOT_FOUND\r\n";
+            case MemcacheStore::Result::kNonNumeric:
+                return "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n";
+            case MemcacheStore::Result::kTooLarge:
+                return "SERVER_ERROR object too large for cache\r\n";
+            case MemcacheStore::Result::kOutOfMemory:
+                return "SERVER_ERROR out of memory storing object\r\n";
+        }
+        return "ERROR\r\n";
+    }
+
+    // Parsing a command either waits for more input, or consumes it.
+    enum class Parsed {
+        kNeedMore, kDone, kClose
+    };
+
+    void appendStats(MemcacheStore *store, size_t memoryLimit, int numThreads, ReplyBuilder *reply) {
+        MemcacheStore::Stats stats = store->stats();
+        auto stat = [reply](std::string_view name, uint64_t value) {
+            reply->append("STAT ");
+            reply->append(name);
+            reply->append(" ");
+            reply->appendNumber(value);
+            reply->append("\r\n");
+        };
+        stat("pid", static_cast<uint64_t>(::getpid()));
+        reply->append("STAT version ");
+        reply->append(kVersionText);
+        reply->append("\r\n");
+        stat("threads", static_cast<uint64_t>(std::max(numThreads, 1)));
+        stat("curr_items", stats.items);
+        stat("bytes", stats.bytes);
+        stat("limit_maxbytes", memoryLimit);
+        stat("total_malloced", stats.reservedBytes);
+        stat("evictions", stats.evictions);
+        stat("stripes", store->numStripes());
+        reply->append("END\r\n");
+    }
+
+    Parsed parseText(MemcacheStore *store, Buffer *buf, size_t *swallow, size_t memoryLimit, int numThreads,
+                     ReplyBuilder *reply) {
+        size_t readable = buf->readableBytes();
+        const char *begin = buf->peek();
+        const auto *eol = static_cast<const char *>(std::memchr(begin, '\n', std::min(readable, kMaxLineBytes)));
+        if (eol == nullptr) {
+            if (readable < kMaxLineBytes) {
+                return Parsed::kNeedMore;
+            }
+            reply->append("CLIENT_ERROR line too long\r\n");
+            return Parsed::kClose;
+        }
+        size_t lineBytes = eol + 1 - begin;
+        std::string_view line(begin, eol > begin && eol[-1] == '\r' ? eol - 1 - begin : eol - begin);
+        thread_local std::vector<std::string_view> tokens;
+        tokens.clear();
+        for (size_t pos = 0; pos < line.size();) {
+            size_t end = line.find(' ', pos);
+            if (end == std::string_view::npos) {
+                end = line.size();
+            }
+            if (end > pos) {
+                tokens.push_back(line.substr(pos, end - pos));
+            }
+            pos = end + 1;
+        }
+        if (tokens.empty()) {
+            buf->retrieve(lineBytes);
+            reply->append("ERROR\r\n");
+            return Parsed::kDone;
+        }
+        std::string_view command = tokens[0];
+        size_t argc = tokens.size();
+        bool noreply = argc > 1 && tokens.back() == "noreply";
+        auto answer = [&](std::string_view text) {
+            if (!noreply) {
+                reply->append(text);
+            }
+        };
+        const std::string_view kBadFormat = "CLIENT_ERROR bad command line format\r\n";
+
+        if (command == "get" || command == "gets") {
+            buf->retrieve(lineBytes);
+            if (argc < 2) {
+                reply->append("ERROR\r\n");
+                return Parsed::kDone;
+            }
+            bool withCas = command == "gets";
+            for (size_t i = 1; i < argc; ++i) {
+                std::string_view key = tokens[i];
+                if (key.size() > MemcacheStore::kMaxKeyBytes) {
+                    reply->append(kBadFormat);
+                    return Parsed::kDone;
+                }
+                const MemcacheItem *item = store->acquire(key, KvTable::hash(key));
+                if (item == nullptr) {
+                    continue;
+                }
+                reply->append("VALUE ");
+                reply->append(key);
+                reply->append(" ");
+                reply->appendNumber(item->flags);
+                reply->append(" ");
+                reply->appendNumber(item->valueBytes);
+                if (withCas) {
+                    reply->append(" ");
+                    reply->appendNumber(item->cas);
+                }
+                reply->append("\r\n");
+                // The value and its "\r\n" straight from the chunk.
+                reply->appendItem(item, item->valueData(), item->valueBytes + 2);
+            }
+            reply->append("END\r\n");
+            return Parsed::kDone;
+        }
+
+        MemcacheStore::StoreMode mode;
+        bool storage = true;
+        if (command == "set") {
+            mode = MemcacheStore::StoreMode::kSet;
+        } else if (command == "add") {
+            mode = MemcacheStore::StoreMode::kAdd;
+        } else if (command == "replace") {
+            mode = MemcacheStore::StoreMode::kReplace;
+        } else if (command == "append") {
+            mode = MemcacheStore::StoreMode::kAppend;
+        } else if (command == "prepend") {
+            mode = MemcacheStore::StoreMode::kPrepend;
+        } else if (command == "cas") {
+            mode = MemcacheStore::StoreMode::kCas;
+        } else {
+            storage = false;
+        }
+        if (storage) {
+            // <command> <key> <flags> <exptime> <bytes> [<cas unique>] [noreply]
+            size_t fixed = mode == MemcacheStore::StoreMode::kCas ? 6 : 5;
+            uint32_t flags;
+            int64_t exptime;
+            size_t bytes;
+            uint64_t cas = 0;
+            if (argc != fixed + (noreply ? 1 : 0) || tokens[1].size() > MemcacheStore::kMaxKeyBytes ||
+                !parseNumber(tokens[2], &flags) || !parseNumber(tokens[3], &exptime) ||
+                !parseNumber(tokens[4], &bytes) || (fixed == 6 && !parseNumber(tokens[5], &cas))) {
+                buf->retrieve(lineBytes);
+                reply->append(kBadFormat);
+                return Parsed::kDone;
+            }
+            if (bytes > kMaxValueBytes) {
+                buf->retrieve(lineBytes);
+                *swallow = bytes + 2;
+                reply->append("SERVER_ERROR object too large for cache\r\n");
+                return Parsed::kDone;
+            }
+            if (readable < lineBytes + bytes + 2) {
+                return Parsed::kNeedMore;
+            }
+            std::string_view key = tokens[1];
+            const char *data = begin + lineBytes;
+            if (data[bytes] != '\r' || data[bytes + 1] != '\n') {
+                buf->retrieve(lineBytes + bytes + 2);
+                reply->append("CLIENT_ERROR bad data chunk\r\n");
+                return Parsed::kDone;
+            }
+            MemcacheStore::Result result = store->store(mode, key, KvTable::hash(key), flags, exptime,
+                                                        {data, bytes}, &cas);
+            // The key points into the input, used up only now.
+            buf->retrieve(lineBytes + bytes + 2);
+            answer(textReplyOf(result));
+            return Parsed::kDone;
+        }
+
+        buf->retrieve(lineBytes);
+        if (command == "delete") {
+            // A legacy time of 0 is allowed.
+            if (argc < 2 || argc > 3 + (noreply ? 1 : 0) || (argc == 3 + (noreply ? 1 : 0) && tokens[2] != "0") ||
+                tokens[1].size() > MemcacheStore::kMaxKeyBytes) {
+                reply->append(kBadFormat);
+                return Parsed::kDone;
+            }
+            answer(store->remove(tokens[1], KvTable::hash(tokens[1])) ? "DELETED\r\n" : "NOT_FOUND\r\n");
+        } else if (command == "incr" || command == "decr") {
+            uint64_t delta;
+            if (argc != 3 + (noreply ? 1 : 0)) {
+                reply->append("ERROR\r\n");
+                return Parsed::kDone;
+            }
+            if (!parseNumber(tokens[2], &delta)) {
+                reply->append("CLIENT_ERROR invalid numeric delta argument\r\n");
+                return Parsed::kDone;
+            }
+            uint64_t value;
+            uint64_t cas;
+            MemcacheStore::Result result = store->incrDecr(tokens[1], KvTable::hash(tokens[1]), command == "incr",
+                                                           delta, nullptr, 0, &value, &cas);
+            if (noreply) {
+                return Parsed::kDone;
+            }
+            if (result == MemcacheStore::Result::kStored) {
+                reply->appendNumber(value);
+                reply->append("\r\n");
+            } else {
+                reply->append(textReplyOf(result));
+            }
+        } else if (command == "touch") {
+            int64_t exptime;
+            if (argc != 3 + (noreply ? 1 : 0) || !parseNumber(tokens[2], &exptime)) {
+                reply->append(kBadFormat);
+                return Parsed::kDone;
+            }
+            answer(store->touch(tokens[1], KvTable::hash(tokens[1]), exptime) ? "TOUCHED\r\n" : "NOT_FOUND\r\n");
+        } else if (command == "flush_all") {
+            int64_t delay = 0;
+            if (argc > 2 + (noreply ? 1 : 0) || (argc == 2 + (noreply ? 1 : 0) && !parseNumber(tokens[1], &delay))) {
+                reply->append(kBadFormat);
+                return Parsed::kDone;
+            }
+            store->flush(delay);
+            answer("OK\r\n");
+        } else if (command == "version") {
+            reply->append("VERSION ");
+            reply->append(kVersionText);
+            reply->append("\r\n");
+        } else if (command == "stats") {
+            if (argc > 1) {
+                // Only the general statistics.
+                reply->append("END\r\n");
+            } else {
+                appendStats(store, memoryLimit, numThreads, reply);
+            }
+        } else if (command == "verbosity") {
+            answer("OK\r\n");
+        } else if (command == "quit") {
+            return Parsed::kClose;
+        } else {
+            reply->append("ERROR\r\n");
+        }
+        return Parsed::kDone;
+    }
+
+    Parsed parseBinary(MemcacheStore *store, Buffer *buf, size_t *swallow, ReplyBuilder *reply) {
+        size_t readable = buf->readableBytes();
+        if (readable < kBinaryHeaderBytes) {
+            return Parsed::kNeedMore;
+        }
+        const char *header = buf->peek();
+        if (static_cast<uint8_t>(header[0]) != kBinaryRequest) {
+            logd("MemcacheServer - bad magic {}", static_cast<uint8_t>(header[0]));
+            return Parsed::kClose;
+        }
+        auto opcode = static_cast<uint8_t>(header[1]);
+        auto keyBytes = static_cast<size_t>(readBigEndian(header + 2, 2));
+        auto extrasBytes = static_cast<size_t>(static_cast<uint8_t>(header[4]));
+        auto bodyBytes = static_cast<size_t>(readBigEndian(header + 8, 4));
+        const char *opaque = header + 12;
+        uint64_t cas = readBigEndian(header + 16, 8);
+        if (keyBytes + extrasBytes > bodyBytes) {
+            appendBinaryError(reply, opcode, kInvalid, opaque);
+            return Parsed::kClose;
+        }
+        if (bodyBytes > kMaxValueBytes + kMaxLineBytes) {
+            appendBinaryError(reply, opcode, kTooLarge, opaque);
+            buf->retrieve(kBinaryHeaderBytes);
+            *swallow = bodyBytes;
+            return Parsed::kDone;
+        }
+        if (readable < kBinaryHeaderBytes + bodyBytes) {
+            return Parsed::kNeedMore;
+        }
+        const char *extras = header + kBinaryHeaderBytes;
+        std::string_view key(extras + extrasBytes, keyBytes);
+        std::string_view value(key.data() + keyBytes, bodyBytes - extrasBytes - keyBytes);
+        uint64_t hash = KvTable::hash(key);
+        Parsed parsed = Parsed::kDone;
+        // Quiet variants leave out the replies of success, quiet gets those of
+        // misses.
+        auto succeed = [&](bool quiet, size_t extraBytes, uint64_t newCas) {
+            if (!quiet) {
+                appendBinaryHeader(reply, opcode, kOk, 0, extraBytes, extraBytes, opaque, newCas);
+            }
+        };
+        auto invalid = [&] { appendBinaryError(reply, opcode, kInvalid, opaque); };
+
+        switch (opcode) {
+            case kGet:
+            case kGetQ:
+            case kGetK:
+            case kGetKQ: {
+                bool withKey = opcode == kGetK || opcode == kGetKQ;
+                if (extrasBytes != 0 || keyBytes == 0 || !value.empty()) {
+                    invalid();
+                    break;
+                }
+                const MemcacheItem *item = store->acquire(key, hash);
+                if (item == nullptr) {
+                    if (opcode == kGet || opcode == kGetK) {
+                        appendBinaryError(reply, opcode, kNotFound, opaque);
+                    }
+                    break;
+                }
+                size_t sentKeyBytes = withKey ? item->keyBytes : 0;
+                appendBinaryHeader(reply, opcode, kOk, sentKeyBytes, 4, 4 + sentKeyBytes + item->valueBytes, opaque,
+                                   item->cas);
+                char flags[4];
+                writeBigEndian(flags, item->flags, 4);
+                reply->append({flags, sizeof flags});
+                // Key and value lie next to each other in the chunk.
+                reply->appendItem(item, item->valueData() - sentKeyBytes, sentKeyBytes + item->valueBytes);
+                break;
+            }
+            case kSet:
+            case kSetQ:
+            case kAdd:
+            case kAddQ:
+            case kReplace:
+            case kReplaceQ:
+            case kAppend:
+            case kAppendQ:
+            case kPrepend:
+            case kPrependQ: {
+                bool extend = opcode == kAppend || opcode == kAppendQ || opcode == kPrepend || opcode == kPrependQ;
+                if (keyBytes == 0 || extrasBytes != (extend ? 0 : 8)) {
+                    invalid();
+                    break;
+                }
+                MemcacheStore::StoreMode mode;
+                switch (opcode) {
+                    case kAdd:
+                    case kAddQ:
+                        mode = MemcacheStore::StoreMode::kAdd;
+                        break;
+                    case kReplace:
+                    case kReplaceQ:
+                        mode = MemcacheStore::StoreMode::kReplace;
+                        break;
+                    case kAppend:
+                    case kAppendQ:
+                        mode = MemcacheStore::StoreMode::kAppend;
+                        break;
+                    case kPrepend:
+                    case kPrependQ:
+                        mode = MemcacheStore::StoreMode::kPrepend;
+                        break;
+                    default:
+                        mode = MemcacheStore::StoreMode::kSet;
+                }
+                // A set or replace with a cas is a compare and swap.
+                if (cas != 0 && (mode == MemcacheStore::StoreMode::kSet ||
+                                 mode == MemcacheStore::StoreMode::kReplace)) {
+                    mode = MemcacheStore::StoreMode::kCas;
+                }
+                uint32_t flags = extend ? 0 : static_cast<uint32_t>(readBigEndian(extras, 4));
+                auto exptime = extend ? 0 : static_cast<int64_t>(static_cast<int32_t>(readBigEndian(extras + 4, 4)));
+                MemcacheStore::Result result = store->store(mode, key, hash, flags, exptime, value, &cas);
+                if (result == MemcacheStore::Result::kStored) {
+                    // The quiet store opcodes are 0x11 and up.
+                    succeed(opcode >= kSetQ, 0, cas);
+                } else {
+                    appendBinaryError(reply, opcode, binaryStatusOf(result), opaque);
+                }
+                break;
+            }
+            case kDelete:
+            case kDeleteQ:
+                if (keyBytes == 0 || extrasBytes != 0 || !value.empty()) {
+                    invalid();
+                } else if (store->remove(key, hash)) {
+                    succeed(opcode == kDeleteQ, 0, 0);
+                } else {
+                    appendBinaryError(reply, opcode, kNotFound, opaque);
+                }
+                break;
+            case kIncrement:
+            case kIncrementQ:
+            case kDecrement:
+            case kDecrementQ: {
+                if (keyBytes == 0 || extrasBytes != 20 || !value.empty()) {
+                    invalid();
+                    break;
+                }
+                uint64_t delta = readBigEndian(extras, 8);
+                uint64_t initial = readBigEndian(extras + 8, 8);
+                auto exptime = static_cast<uint32_t>(readBigEndian(extras + 16, 4));
+                uint64_t result;
+                MemcacheStore::Result stored = store->incrDecr(
+                        key, hash, opcode == kIncrement || opcode == kIncrementQ, delta,
+                        exptime == 0xffffffff ? nullptr : &initial, exptime, &result, &cas);
+                if (stored != MemcacheStore::Result::kStored) {
+                    appendBinaryError(reply, opcode, binaryStatusOf(stored), opaque);
+                } else if (opcode == kIncrement || opcode == kDecrement) {
+                    appendBinaryHeader(reply, opcode, kOk, 0, 0, 8, opaque, cas);
+                    char bytes[8];
+                    writeBigEndian(bytes, result, 8);
+                    reply->append({bytes, sizeof bytes});
+                }
+                break;
+            }
+            case kTouch:
+                if (keyBytes == 0 || extrasBytes != 4 || !value.empty()) {
+                    invalid();
+                } else if (store->touch(key, hash, static_cast<int32_t>(readBigEndian(extras, 4)))) {
+                    succeed(false, 0, 0);
+                } else {
+                    appendBinaryError(reply, opcode, kNotFound, opaque);
+                }
+                break;
+            case kFlush:
+            case kFlushQ:
+                if (keyBytes != 0 || (extrasBytes != 0 && extrasBytes != 4) || !value.empty()) {
+                    invalid();
+                    break;
+                }
+                store->flush(extrasBytes == 4 ? static_cast<int32_t>(readBigEndian(extras, 4)) : 0);
+                succeed(opcode == kFlushQ, 0, 0);
+                break;
+            case kNoop:
+                succeed(false, 0, 0);
+                break;
+            case kVersion:
+                appendBinaryHeader(reply, opcode, kOk, 0, 0, sizeof kVersionText - 1, opaque, 0);
+                reply->append(kVersionText);
+                break;
+            case kQuit:
+            case kQuitQ:
+                succeed(opcode == kQuitQ, 0, 0);
+                parsed = Parsed::kClose;
+                break;
+            default:
+                appendBinaryError(reply, opcode, kUnknownCommand, opaque);
+        }
+        buf->retrieve(kBinaryHeaderBytes + bodyBytes);
+        return parsed;
+    }
+}
+
+struct MemcacheServer::Context {
+    enum class Protocol {
+        kUnknown, kText, kBinary
+    };
+
+    Protocol protocol = Protocol::kUnknown;
+    size_t swallow = 0;
+    bool closing = false;
+};
+
+MemcacheServer::MemcacheServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                               TcpServer::Option option)
+        : m_server(loop, listenAddr, name, option),
+          m_numThreads(0),
+          m_memoryLimit(64 * 1024 * 1024),
+          m_numStripes(0) {
+    m_server.setConnectionCallback([this](const TcpConnectionPtr &conn) {
+        onConnection(conn);
+    });
+    m_server.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+        onMessage(conn, buf, receiveTime);
+    });
+}
+
+void MemcacheServer::start() {
+    if (m_store) {
+        return;
+    }
+    size_t numStripes = m_numStripes > 0 ? m_numStripes : 4 * static_cast<size_t>(std::max(m_numThreads, 1));
+    m_store = std::make_shared<MemcacheStore>(m_memoryLimit, numStripes);
+    m_server.start();
+}
+
+void MemcacheServer::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        // Every read is answered in one send.
+        conn->setTcpNoDelay(true);
+        conn->setContext(std::make_shared<Context>());
+    }
+}
+
+void MemcacheServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+    auto *holder = std::any_cast<std::shared_ptr<Context>>(conn->getMutableContext());
+    if (holder == nullptr || (*holder)->closing) {
+        buf->retrieveAll();
+        return;
+    }
+    Context *context = holder->get();
+    thread_local ReplyBuilder reply;
+    while (buf->readableBytes() > 0) {
+        if (context->swallow > 0) {
+            size_t n = std::min(context->swallow, buf->readableBytes());
+            buf->retrieve(n);
+            context->swallow -= n;
+            continue;
+        }
+        if (context->protocol == Context::Protocol::kUnknown) {
+            context->protocol = static_cast<uint8_t>(*buf->peek()) == kBinaryRequest ? Context::Protocol::kBinary
+                                                                                     : Context::Protocol::kText;
+        }
+        Parsed parsed = context->protocol == Context::Protocol::kBinary
+                        ? parseBinary(m_store.get(), buf, &context->swallow, &reply)
+                        : parseText(m_store.get(), buf, &context->swallow, m_memoryLimit, m_numThreads, &reply);
+        if (parsed == Parsed::kNeedMore) {
+            break;
+        }
+        if (parsed == Parsed::kClose) {
+            context->closing = true;
+            break;
+        }
+        if (reply.bytes() >= kMaxOutputBytes) {
+            reply.flush(conn, m_store);
+        }
+    }
+    // Also when closed: the items are released all the same.
+    reply.flush(conn, m_store);
+    if (context->closing) {
+        buf->retrieveAll();
+        conn->shutdown();
+    }
+}
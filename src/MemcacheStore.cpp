@@ -0,0 +1,391 @@
+#include "src/include/MemcacheStore.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+using namespace faliks;
+
+namespace {
+    // Relative expiry times go up to this, larger ones are unix times.
+    const int64_t kMaxRelativeExptime = 60 * 60 * 24 * 30;
+
+    // A table grows past this many items per bucket.
+    const size_t kMaxLoadPercent = 150;
+
+    // A deadline already past whatever the clock says.
+    const int64_t kExpired = -1;
+
+    int64_t nowSeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool expired(const MemcacheItem *item, int64_t now) {
+        return item->deadline != 0 && item->deadline <= now;
+    }
+
+    size_t bucketOf(uint64_t hash, size_t numBuckets) {
+        return hash & (numBuckets - 1);
+    }
+
+    void copyValue(MemcacheItem *item, std::string_view first, std::string_view second) {
+        char *value = const_cast<char *>(item->valueData());
+        std::memcpy(value, first.data(), first.size());
+        std::memcpy(value + first.size(), second.data(), second.size());
+        std::memcpy(value + first.size() + second.size(), "\r\n", 2);
+    }
+}
+
+MemcacheStore::Stripe::Stripe(size_t index, size_t memoryLimit)
+        : index(index),
+          slabs(memoryLimit, sizeof(MemcacheItem) + 32),
+          buckets(1024, nullptr),
+          size(0),
+          bytes(0),
+          hands(slabs.numClasses(), 0),
+          nextCas(1),
+          evictions(0) {
+}
+
+MemcacheStore::MemcacheStore(size_t memoryLimit, size_t numStripes)
+        : m_flushAt(0) {
+    numStripes = std::max<size_t>(numStripes, 1);
+    for (size_t i = 0; i < numStripes; ++i) {
+        m_stripes.emplace_back(new Stripe(i, memoryLimit / numStripes));
+    }
+}
+
+MemcacheStore::~MemcacheStore() = default;
+
+int64_t MemcacheStore::deadlineOf(int64_t exptime) {
+    if (exptime == 0) {
+        return 0;
+    }
+    if (exptime < 0) {
+        return kExpired;
+    }
+    int64_t now = nowSeconds();
+    if (exptime <= kMaxRelativeExptime) {
+        return now + exptime;
+    }
+    int64_t left = exptime - static_cast<int64_t>(::time(nullptr));
+    return left > 0 ? now + left : kExpired;
+}
+
+void MemcacheStore::checkFlush() {
+    int64_t at = m_flushAt.load(std::memory_order_relaxed);
+    if (at == 0 || nowSeconds() < at || !m_flushAt.compare_exchange_strong(at, 0)) {
+        return;
+    }
+    for (auto &stripe: m_stripes) {
+        std::lock_guard<std::mutex> lock(stripe->mutex);
+        flushStripe(*stripe);
+    }
+}
+
+MemcacheItem *MemcacheStore::find(Stripe &stripe, std::string_view key, uint64_t hash) {
+    MemcacheItem *item = stripe.buckets[bucketOf(hash, stripe.buckets.size())];
+    while (item != nullptr && (item->hash != hash || item->key() != key)) {
+        item = item->next;
+    }
+    if (item != nullptr && item->deadline != 0 && expired(item, nowSeconds())) {
+        unlink(stripe, item);
+        return nullptr;
+    }
+    return item;
+}
+
+void MemcacheStore::link(Stripe &stripe, MemcacheItem *item) {
+    if ((stripe.size + 1) * 100 > stripe.buckets.size() * kMaxLoadPercent) {
+        std::vector<MemcacheItem *> buckets(stripe.buckets.size() * 2, nullptr);
+        for (MemcacheItem *head: stripe.buckets) {
+            while (head != nullptr) {
+                MemcacheItem *next = head->next;
+                MemcacheItem *&bucket = buckets[bucketOf(head->hash, buckets.size())];
+                head->next = bucket;
+                bucket = head;
+                head = next;
+            }
+        }
+        stripe.buckets.swap(buckets);
+    }
+    MemcacheItem *&bucket = stripe.buckets[bucketOf(item->hash, stripe.buckets.size())];
+    item->next = bucket;
+    bucket = item;
+    item->linked = true;
+    ++stripe.size;
+    stripe.bytes += item->keyBytes + item->valueBytes;
+}
+
+void MemcacheStore::unlink(Stripe &stripe, MemcacheItem *item) {
+    MemcacheItem **slot = &stripe.buckets[bucketOf(item->hash, stripe.buckets.size())];
+    while (*slot != item) {
+        slot = &(*slot)->next;
+    }
+    *slot = item->next;
+    item->linked = false;
+    --stripe.size;
+    stripe.bytes -= item->keyBytes + item->valueBytes;
+    if (item->refs == 0) {
+        stripe.slabs.deallocate(item, item->slabClass);
+    }
+}
+
+void MemcacheStore::unref(Stripe &stripe, MemcacheItem *item) {
+    if (--item->refs == 0 && !item->linked) {
+        stripe.slabs.deallocate(item, item->slabClass);
+    }
+}
+
+MemcacheItem *MemcacheStore::allocate(Stripe &stripe, std::string_view key, uint64_t hash, size_t valueBytes,
+                                      Result *error) {
+    size_t cls = stripe.slabs.classOf(sizeof(MemcacheItem) + key.size() + valueBytes + 2);
+    if (cls == stripe.slabs.numClasses()) {
+        *error = Result::kTooLarge;
+        return nullptr;
+    }
+    void *chunk = stripe.slabs.allocate(cls);
+    size_t numChunks = stripe.slabs.numChunks(cls);
+    int64_t now = 0;
+    // Two rounds clear every bit set before the sweep began.
+    for (size_t step = 0; chunk == nullptr && step < 2 * numChunks; ++step) {
+        size_t &hand = stripe.hands[cls];
+        auto *victim = static_cast<MemcacheItem *>(stripe.slabs.chunkAt(cls, hand));
+        hand = hand + 1 == numChunks ? 0 : hand + 1;
+        if (!victim->linked || victim->refs > 0) {
+            continue;
+        }
+        if (victim->deadline != 0 && now == 0) {
+            now = nowSeconds();
+        }
+        if (victim->referenced && !expired(victim, now)) {
+            victim->referenced = false;
+            continue;
+        }
+        if (!expired(victim, now)) {
+            ++stripe.evictions;
+        }
+        unlink(stripe, victim);
+        chunk = stripe.slabs.allocate(cls);
+    }
+    if (chunk == nullptr) {
+        *error = Result::kOutOfMemory;
+        return nullptr;
+    }
+    auto *item = static_cast<MemcacheItem *>(chunk);
+    item->next = nullptr;
+    item->hash = hash;
+    // Unique across stripes.
+    item->cas = stripe.nextCas++ * m_stripes.size() + stripe.index;
+    item->deadline = 0;
+    item->flags = 0;
+    item->valueBytes = static_cast<uint32_t>(valueBytes);
+    item->refs = 0;
+    item->keyBytes = static_cast<uint16_t>(key.size());
+    item->slabClass = static_cast<uint8_t>(cls);
+    item->linked = false;
+    item->referenced = false;
+    std::memcpy(const_cast<char *>(item->keyData()), key.data(), key.size());
+    return item;
+}
+
+void MemcacheStore::flushStripe(Stripe &stripe) {
+    for (MemcacheItem *&head: stripe.buckets) {
+        while (head != nullptr) {
+            unlink(stripe, head);
+        }
+    }
+}
+
+const MemcacheItem *MemcacheStore::acquire(std::string_view key, uint64_t hash) {
+    checkFlush();
+    Stripe &stripe = stripeOf(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    MemcacheItem *item = find(stripe, key, hash);
+    if (item != nullptr) {
+        ++item->refs;
+        item->referenced = true;
+    }
+    return item;
+}
+
+void MemcacheStore::release(const MemcacheItem *const *items, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        // Items of the same stripe in a row share a lock.
+        Stripe &stripe = stripeOf(items[i]->hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        do {
+            unref(stripe, const_cast<MemcacheItem *>(items[i]));
+            ++i;
+        } while (i < count && &stripeOf(items[i]->hash) == &stripe);
+    }
+}
+
+MemcacheStore::Result MemcacheStore::store(StoreMode mode, std::string_view key, uint64_t hash, uint32_t flags,
+                                           int64_t exptime, std::string_view value, uint64_t *cas) {
+    if (key.size() > kMaxKeyBytes) {
+        return Result::kNotStored;
+    }
+    checkFlush();
+    Stripe &stripe = stripeOf(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    MemcacheItem *old = find(stripe, key, hash);
+    switch (mode) {
+        case StoreMode::kSet:
+            break;
+        case StoreMode::kAdd:
+            if (old != nullptr) {
+                // As memcached, a failed add still counts as a use.
+                old->referenced = true;
+                return Result::kNotStored;
+            }
+            break;
+        case StoreMode::kReplace:
+        case StoreMode::kAppend:
+        case StoreMode::kPrepend:
+            if (old == nullptr) {
+                return Result::kNotStored;
+            }
+            break;
+        case StoreMode::kCas:
+            if (old == nullptr) {
+                return Result::kNotFound;
+            }
+            if (old->cas != *cas) {
+                return Result::kExists;
+            }
+            break;
+    }
+    bool extend = mode == StoreMode::kAppend || mode == StoreMode::kPrepend;
+    size_t valueBytes = value.size() + (extend ? old->valueBytes : 0);
+    // Held so eviction cannot reuse it while it is still copied from.
+    if (old != nullptr) {
+        ++old->refs;
+    }
+    Result error = Result::kStored;
+    MemcacheItem *item = allocate(stripe, key, hash, valueBytes, &error);
+    if (item != nullptr) {
+        if (mode == StoreMode::kAppend) {
+            copyValue(item, old->value(), value);
+        } else if (mode == StoreMode::kPrepend) {
+            copyValue(item, value, old->value());
+        } else {
+            copyValue(item, value, {});
+        }
+        item->flags = extend ? old->flags : flags;
+        item->deadline = extend ? old->deadline : deadlineOf(exptime);
+        if (old != nullptr && old->linked) {
+            unlink(stripe, old);
+        }
+        link(stripe, item);
+        *cas = item->cas;
+    } else if (old != nullptr && old->linked && !extend) {
+        // The old value must not outlive a failed set.
+        unlink(stripe, old);
+    }
+    if (old != nullptr) {
+        unref(stripe, old);
+    }
+    return error;
+}
+
+bool MemcacheStore::remove(std::string_view key, uint64_t hash) {
+    checkFlush();
+    Stripe &stripe = stripeOf(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    MemcacheItem *item = find(stripe, key, hash);
+    if (item == nullptr) {
+        return false;
+    }
+    unlink(stripe, item);
+    return true;
+}
+
+bool MemcacheStore::touch(std::string_view key, uint64_t hash, int64_t exptime) {
+    checkFlush();
+    Stripe &stripe = stripeOf(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    MemcacheItem *item = find(stripe, key, hash);
+    if (item == nullptr) {
+        return false;
+    }
+    item->deadline = deadlineOf(exptime);
+    item->referenced = true;
+    return true;
+}
+
+MemcacheStore::Result MemcacheStore::incrDecr(std::string_view key, uint64_t hash, bool incr, uint64_t delta,
+                                              const uint64_t *initial, int64_t exptime, uint64_t *value,
+                                              uint64_t *cas) {
+    if (key.size() > kMaxKeyBytes) {
+        return Result::kNotFound;
+    }
+    checkFlush();
+    Stripe &stripe = stripeOf(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    MemcacheItem *old = find(stripe, key, hash);
+    uint64_t next;
+    if (old == nullptr) {
+        if (initial == nullptr) {
+            return Result::kNotFound;
+        }
+        next = *initial;
+    } else {
+        uint64_t current;
+        std::string_view text = old->value();
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), current);
+        if (text.empty() || parsed.ec != std::errc() || parsed.ptr != text.data() + text.size()) {
+            return Result::kNonNumeric;
+        }
+        next = incr ? current + delta : (current > delta ? current - delta : 0);
+        ++old->refs;
+    }
+    char digits[24];
+    auto printed = std::to_chars(digits, digits + sizeof digits, next);
+    std::string_view text(digits, printed.ptr - digits);
+    Result error = Result::kStored;
+    MemcacheItem *item = allocate(stripe, key, hash, text.size(), &error);
+    if (item != nullptr) {
+        copyValue(item, text, {});
+        item->flags = old != nullptr ? old->flags : 0;
+        item->deadline = old != nullptr ? old->deadline : deadlineOf(exptime);
+        if (old != nullptr && old->linked) {
+            unlink(stripe, old);
+        }
+        link(stripe, item);
+        *value = next;
+        *cas = item->cas;
+    }
+    if (old != nullptr) {
+        unref(stripe, old);
+    }
+    return error;
+}
+
+void MemcacheStore::flush(int64_t delay) {
+    if (delay > 0) {
+        m_flushAt.store(nowSeconds() + delay);
+        return;
+    }
+    m_flushAt.store(0);
+    for (auto &stripe: m_stripes) {
+        std::lock_guard<std::mutex> lock(stripe->mutex);
+        flushStripe(*stripe);
+    }
+}
+
+MemcacheStore::Stats MemcacheStore::stats() const {
+    Stats stats;
+    for (const auto &stripe: m_stripes) {
+        std::lock_guard<std::mutex> lock(stripe->mutex);
+        stats.items += stripe->size;
+        stats.bytes += stripe->bytes;
+        stats.reservedBytes += stripe->slabs.reservedBytes();
+        stats.evictions += stripe->evictions;
+    }
+    return stats;
+}
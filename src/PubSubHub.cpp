@@ -0,0 +1,261 @@
+#include "src/include/PubSubHub.h"
+#include "src/include/EventLoop.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/fmtlog.h"
+
+#include <algorithm>
+
+using namespace faliks;
+
+PubSubHub::PubSubHub(const std::vector<EventLoop *> &loops) {
+    for (EventLoop *loop: loops) {
+        if (m_byLoop.count(loop) != 0) {
+            continue;
+        }
+        auto shard = std::make_unique<Shard>();
+        shard->loop = loop;
+        shard->loopIndex = m_shards.size();
+        m_byLoop.emplace(loop, shard.get());
+        m_shards.push_back(std::move(shard));
+    }
+}
+
+PubSubHub::~PubSubHub() = default;
+
+PubSubHub::Shard *PubSubHub::shardOf(const TcpConnectionPtr &conn) const {
+    auto found = m_byLoop.find(conn->getLoop());
+    if (found == m_byLoop.end()) {
+        loge("PubSubHub - {} is on a loop the hub does not know", conn->getName());
+        return nullptr;
+    }
+    return found->second;
+}
+
+PubSubHub::Shard *PubSubHub::retainShard(const TcpConnectionPtr &conn) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_subscribers.find(conn.get());
+    if (found != m_subscribers.end()) {
+        ++found->second.refs;
+        return found->second.shard;
+    }
+    Shard *shard = shardOf(conn);
+    if (shard != nullptr) {
+        m_subscribers.emplace(conn.get(), Subscriber{shard, 1});
+    }
+    return shard;
+}
+
+void PubSubHub::releaseShard(const TcpConnection *conn) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_subscribers.find(conn);
+    if (found != m_subscribers.end() && --found->second.refs == 0) {
+        m_subscribers.erase(found);
+    }
+}
+
+PubSubHub::Shard *PubSubHub::subscribedShard(const TcpConnection *conn) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_subscribers.find(conn);
+    return found == m_subscribers.end() ? nullptr : found->second.shard;
+}
+
+void PubSubHub::countSubscriber(const std::string &topic, size_t loopIndex, bool added) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (added) {
+        auto &counts = m_topics[topic];
+        counts.resize(m_shards.size());
+        ++counts[loopIndex];
+        return;
+    }
+    auto found = m_topics.find(topic);
+    if (found == m_topics.end()) {
+        return;
+    }
+    auto &counts = found->second;
+    --counts[loopIndex];
+    if (std::all_of(counts.begin(), counts.end(), [](size_t count) { return count == 0; })) {
+        m_topics.erase(found);
+    }
+}
+
+void PubSubHub::subscribe(const TcpConnectionPtr &conn, const std::string &topic) {
+    Shard *shard = retainShard(conn);
+    if (shard == nullptr) {
+        return;
+    }
+    // Counted before the loop gets to it, so a publish that follows this
+    // call is not skipped for that loop.
+    countSubscriber(topic, shard->loopIndex, true);
+    shard->loop->runInLoop([this, shard, conn, topic] {
+        subscribeInLoop(shard, conn, topic);
+    });
+}
+
+void PubSubHub::subscribeInLoop(Shard *shard, const TcpConnectionPtr &conn, const std::string &topic) {
+    Topic &entry = shard->topics[topic];
+    if (entry.index.count(conn.get()) != 0) {
+        countSubscriber(topic, shard->loopIndex, false);
+        releaseShard(conn.get());
+        return;
+    }
+    entry.index.emplace(conn.get(), entry.subscribers.size());
+    entry.subscribers.push_back(conn);
+    shard->byConnection[conn.get()].push_back(topic);
+}
+
+void PubSubHub::unsubscribe(const TcpConnectionPtr &conn, const std::string &topic) {
+    Shard *shard = subscribedShard(conn.get());
+    if (shard == nullptr) {
+        return;
+    }
+    shard->loop->runInLoop([this, shard, conn, topic] {
+        if (unsubscribeInLoop(shard, conn.get(), topic)) {
+            auto found = shard->byConnection.find(conn.get());
+            auto &topics = found->second;
+            topics.erase(std::find(topics.begin(), topics.end(), topic));
+            if (topics.empty()) {
+                shard->byConnection.erase(found);
+            }
+        }
+    });
+}
+
+bool PubSubHub::unsubscribeInLoop(Shard *shard, const TcpConnection *conn, const std::string &topic) {
+    auto found = shard->topics.find(topic);
+    if (found == shard->topics.end()) {
+        return false;
+    }
+    Topic &entry = found->second;
+    auto it = entry.index.find(conn);
+    if (it == entry.index.end()) {
+        return false;
+    }
+    size_t index = it->second;
+    entry.index.erase(it);
+    // Before the last reference to conn may go, so its address is not reused
+    // while it still has a record.
+    releaseShard(conn);
+    if (index + 1 != entry.subscribers.size()) {
+        entry.subscribers[index] = std::move(entry.subscribers.back());
+        entry.index[entry.subscribers[index].get()] = index;
+    }
+    entry.subscribers.pop_back();
+    if (entry.subscribers.empty()) {
+        shard->topics.erase(found);
+    }
+    countSubscriber(topic, shard->loopIndex, false);
+    return true;
+}
+
+void PubSubHub::unsubscribeAll(const TcpConnectionPtr &conn) {
+    Shard *shard = subscribedShard(conn.get());
+    if (shard == nullptr) {
+        return;
+    }
+    shard->loop->runInLoop([this, shard, conn] {
+        unsubscribeAllInLoop(shard, conn.get());
+    });
+}
+
+void PubSubHub::unsubscribeAllInLoop(Shard *shard, const TcpConnection *conn) {
+    auto found = shard->byConnection.find(conn);
+    if (found == shard->byConnection.end()) {
+        return;
+    }
+    std::vector<std::string> topics = std::move(found->second);
+    shard->byConnection.erase(found);
+    for (auto &topic: topics) {
+        unsubscribeInLoop(shard, conn, topic);
+    }
+}
+
+size_t PubSubHub::publish(const std::string &topic, const Payload &payload) {
+    std::vector<Shard *> targets;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_topics.find(topic);
+        if (found == m_topics.end()) {
+            return 0;
+        }
+        for (size_t i = 0; i < found->second.size(); ++i) {
+            if (found->second[i] != 0) {
+                targets.push_back(m_shards[i].get());
+            }
+        }
+    }
+    for (Shard *shard: targets) {
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->pending.emplace_back(topic, payload);
+            first = !shard->flushQueued.exchange(true, std::memory_order_acq_rel);
+        }
+        if (first) {
+            shard->loop->runInLoop([this, shard] {
+                flushInLoop(shard);
+            });
+        }
+    }
+    return targets.size();
+}
+
+void PubSubHub::flushInLoop(Shard *shard) {
+    std::vector<std::pair<std::string, Payload>> pending;
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        pending.swap(shard->pending);
+        shard->flushQueued.store(false, std::memory_order_release);
+    }
+    // Grouped by topic, in the order each topic first appears.
+    std::vector<std::pair<Topic *, std::vector<Payload>>> groups;
+    for (auto &item: pending) {
+        auto found = shard->topics.find(item.first);
+        if (found == shard->topics.end()) {
+            continue;
+        }
+        auto group = std::find_if(groups.begin(), groups.end(), [&found](const auto &g) {
+            return g.first == &found->second;
+        });
+        if (group == groups.end()) {
+            groups.emplace_back(&found->second, std::vector<Payload>());
+            group = groups.end() - 1;
+        }
+        group->second.push_back(std::move(item.second));
+    }
+    std::vector<const TcpConnection *> closed;
+    for (auto &group: groups) {
+        for (auto &conn: group.first->subscribers) {
+            if (!conn->connected()) {
+                closed.push_back(conn.get());
+            } else if (conn->getLoop() == shard->loop) {
+                conn->sendReferenced(group.second);
+            } else {
+                // Migrated since it subscribed.
+                for (auto &payload: group.second) {
+                    conn->send(*payload);
+                }
+            }
+        }
+    }
+    for (const TcpConnection *conn: closed) {
+        unsubscribeAllInLoop(shard, conn);
+    }
+}
+
+size_t PubSubHub::numSubscribers(const std::string &topic) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_topics.find(topic);
+    if (found == m_topics.end()) {
+        return 0;
+    }
+    size_t count = 0;
+    for (size_t n: found->second) {
+        count += n;
+    }
+    return count;
+}
+
+size_t PubSubHub::numTopics() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_topics.size();
+}
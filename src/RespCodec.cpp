@@ -0,0 +1,367 @@
+#include "src/include/RespCodec.h"
+#include "src/include/Buffer.h"
+
+#include <cassert>
+#include <charconv>
+#include <cstring>
+
+using namespace faliks;
+
+namespace {
+    bool isTypeByte(char c) {
+        switch (c) {
+            case '+':
+            case '-':
+            case ':':
+            case '$':
+            case '*':
+            case '_':
+            case '#':
+            case ',':
+            case '(':
+            case '!':
+            case '=':
+            case '%':
+            case '~':
+            case '|':
+            case '>':
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool parseInt(const char *begin, const char *end, int64_t *value) {
+        auto result = std::from_chars(begin, end, *value);
+        return begin != end && result.ec == std::errc() && result.ptr == end;
+    }
+
+    void appendHeader(Buffer *buf, char type, int64_t value) {
+        char line[24];
+        line[0] = type;
+        auto result = std::to_chars(line + 1, line + sizeof line - 2, value);
+        result.ptr[0] = '\r';
+        result.ptr[1] = '\n';
+        buf->append(line, result.ptr + 2 - line);
+    }
+}
+
+RespParser::RespParser(size_t maxBulkBytes, size_t maxElements)
+        : m_offset(0),
+          m_bulkLength(-1),
+          m_bulkType(Type::kBulkString),
+          m_complete(false),
+          m_maxBulkBytes(maxBulkBytes),
+          m_maxElements(maxElements) {
+    // Values are 32-bit offsets.
+    assert(maxBulkBytes < UINT32_MAX);
+}
+
+void RespParser::reset() {
+    m_offset = 0;
+    m_bulkLength = -1;
+    m_complete = false;
+    m_error.clear();
+    m_nodes.clear();
+    m_stack.clear();
+    m_values.clear();
+}
+
+void RespParser::consume(Buffer *buf) {
+    assert(m_complete);
+    buf->retrieve(m_offset);
+    reset();
+}
+
+RespParser::Result RespParser::fail(const char *error) {
+    m_error = error;
+    return Result::kError;
+}
+
+RespParser::Result RespParser::parse(const Buffer *buf) {
+    if (m_complete) {
+        return Result::kComplete;
+    }
+    if (!m_error.empty()) {
+        return Result::kError;
+    }
+    const char *base = buf->peek();
+    const char *end = base + buf->readableBytes();
+    while (!m_complete) {
+        if (m_offset > UINT32_MAX - m_maxBulkBytes) {
+            return fail("Protocol error: message too large");
+        }
+        if (m_bulkLength >= 0) {
+            auto length = static_cast<size_t>(m_bulkLength);
+            if (static_cast<size_t>(end - base) - m_offset < length + 2) {
+                return Result::kNeedMore;
+            }
+            const char *data = base + m_offset;
+            if (data[length] != '\r' || data[length + 1] != '\n') {
+                return fail("Protocol error: bulk string not terminated by CRLF");
+            }
+            addNode(m_bulkType, base, data, length, m_bulkLength);
+            m_offset += length + 2;
+            m_bulkLength = -1;
+            valueDone();
+            continue;
+        }
+        const char *begin = base + m_offset;
+        if (begin == end) {
+            return Result::kNeedMore;
+        }
+        bool atStart = m_nodes.empty() && m_stack.empty();
+        if (atStart && !isTypeByte(*begin)) {
+            if (!parseInline(base, end)) {
+                return m_error.empty() ? Result::kNeedMore : Result::kError;
+            }
+            continue;
+        }
+        const auto *lf = static_cast<const char *>(memchr(begin, '\n', end - begin));
+        if (lf == nullptr) {
+            if (static_cast<size_t>(end - begin) > kMaxLineBytes) {
+                return fail("Protocol error: too big line");
+            }
+            return Result::kNeedMore;
+        }
+        if (lf == begin || lf[-1] != '\r') {
+            return fail("Protocol error: expected CRLF");
+        }
+        m_offset = lf + 1 - base;
+        if (!parseLine(base, begin, lf - 1)) {
+            return Result::kError;
+        }
+    }
+    m_values.clear();
+    m_values.reserve(m_nodes.size());
+    for (const Node &node: m_nodes) {
+        m_values.push_back({node.type, std::string_view(base + node.offset, node.length), node.integer});
+    }
+    return Result::kComplete;
+}
+
+bool RespParser::parseInline(const char *base, const char *end) {
+    const char *begin = base + m_offset;
+    const auto *lf = static_cast<const char *>(memchr(begin, '\n', end - begin));
+    if (lf == nullptr) {
+        if (static_cast<size_t>(end - begin) > kMaxLineBytes) {
+            fail("Protocol error: too big inline request");
+        }
+        return false;
+    }
+    const char *lineEnd = lf > begin && lf[-1] == '\r' ? lf - 1 : lf;
+    m_offset = lf + 1 - base;
+    // The array header goes first; its count is known at the end.
+    addNode(Type::kArray, base, begin, 0, 0);
+    int64_t count = 0;
+    const char *p = begin;
+    while (p < lineEnd) {
+        while (p < lineEnd && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        const char *word = p;
+        while (p < lineEnd && *p != ' ' && *p != '\t') {
+            ++p;
+        }
+        if (p > word) {
+            addNode(Type::kSimpleString, base, word, p - word, 0);
+            ++count;
+        }
+    }
+    if (count == 0) {
+        // Empty lines between commands are skipped.
+        m_nodes.clear();
+        return true;
+    }
+    m_nodes.front().integer = count;
+    m_complete = true;
+    return true;
+}
+
+bool RespParser::parseLine(const char *base, const char *line, const char *lineEnd) {
+    auto type = static_cast<Type>(line[0]);
+    const char *text = line + 1;
+    int64_t value = 0;
+    switch (type) {
+        case Type::kSimpleString:
+        case Type::kError:
+            addNode(type, base, text, lineEnd - text, 0);
+            valueDone();
+            return true;
+        case Type::kDouble:
+        case Type::kBigNumber:
+            if (text == lineEnd) {
+                fail("Protocol error: empty number");
+                return false;
+            }
+            addNode(type, base, text, lineEnd - text, 0);
+            valueDone();
+            return true;
+        case Type::kInteger:
+            if (!parseInt(text, lineEnd, &value)) {
+                fail("Protocol error: invalid integer");
+                return false;
+            }
+            addNode(type, base, text, lineEnd - text, value);
+            valueDone();
+            return true;
+        case Type::kNull:
+            if (text != lineEnd) {
+                fail("Protocol error: invalid null");
+                return false;
+            }
+            addNode(type, base, text, 0, 0);
+            valueDone();
+            return true;
+        case Type::kBoolean:
+            if (lineEnd - text != 1 || (*text != 't' && *text != 'f')) {
+                fail("Protocol error: invalid boolean");
+                return false;
+            }
+            addNode(type, base, text, 0, *text == 't' ? 1 : 0);
+            valueDone();
+            return true;
+        case Type::kBulkString:
+        case Type::kBulkError:
+        case Type::kVerbatim:
+            if (!parseInt(text, lineEnd, &value) || value < -1 || (value == -1 && type != Type::kBulkString)) {
+                fail("Protocol error: invalid bulk length");
+                return false;
+            }
+            if (value == -1) {
+                addNode(Type::kNull, base, text, 0, 0);
+                valueDone();
+                return true;
+            }
+            if (static_cast<uint64_t>(value) > m_maxBulkBytes) {
+                fail("Protocol error: invalid bulk length");
+                return false;
+            }
+            m_bulkLength = value;
+            m_bulkType = type;
+            return true;
+        case Type::kArray:
+        case Type::kSet:
+        case Type::kPush:
+        case Type::kMap:
+        case Type::kAttribute: {
+            bool pairs = type == Type::kMap || type == Type::kAttribute;
+            if (!parseInt(text, lineEnd, &value) || value < -1 || (value == -1 && type != Type::kArray) ||
+                value > static_cast<int64_t>(pairs ? m_maxElements / 2 : m_maxElements)) {
+                fail("Protocol error: invalid multibulk length");
+                return false;
+            }
+            if (value == -1) {
+                addNode(Type::kNull, base, text, 0, 0);
+                valueDone();
+                return true;
+            }
+            if (m_stack.size() >= kMaxDepth) {
+                fail("Protocol error: nested too deep");
+                return false;
+            }
+            openAggregate(type, base, value, type == Type::kAttribute);
+            return true;
+        }
+    }
+    fail("Protocol error: invalid type byte");
+    return false;
+}
+
+void RespParser::addNode(Type type, const char *base, const char *data, size_t length, int64_t integer) {
+    m_nodes.push_back({type, static_cast<uint32_t>(data - base), static_cast<uint32_t>(length), integer});
+}
+
+void RespParser::openAggregate(Type type, const char *base, int64_t count, bool attribute) {
+    addNode(type, base, base + m_offset, 0, count);
+    int64_t elements = type == Type::kMap || type == Type::kAttribute ? 2 * count : count;
+    if (elements > 0) {
+        m_stack.push_back({elements, attribute});
+    } else if (!attribute) {
+        valueDone();
+    }
+}
+
+void RespParser::valueDone() {
+    while (!m_stack.empty()) {
+        Frame &top = m_stack.back();
+        if (--top.remaining > 0) {
+            return;
+        }
+        bool attribute = top.attribute;
+        m_stack.pop_back();
+        // The value an attribute annotates is still to come.
+        if (attribute) {
+            return;
+        }
+    }
+    m_complete = true;
+}
+
+bool RespParser::command(std::vector<std::string_view> *args) const {
+    if (m_values.empty() || m_values[0].type != Type::kArray ||
+        m_values[0].integer != static_cast<int64_t>(m_values.size() - 1)) {
+        return false;
+    }
+    args->clear();
+    for (size_t i = 1; i < m_values.size(); ++i) {
+        const Value &value = m_values[i];
+        if (value.type != Type::kBulkString && value.type != Type::kSimpleString) {
+            return false;
+        }
+        args->push_back(value.data);
+    }
+    return true;
+}
+
+void RespWriter::appendSimpleString(Buffer *buf, std::string_view text) {
+    buf->ensureWritableBytes(text.size() + 3);
+    buf->append("+", 1);
+    buf->append(text.data(), text.size());
+    buf->append("\r\n", 2);
+}
+
+void RespWriter::appendError(Buffer *buf, std::string_view message) {
+    buf->ensureWritableBytes(message.size() + 3);
+    buf->append("-", 1);
+    buf->append(message.data(), message.size());
+    buf->append("\r\n", 2);
+}
+
+void RespWriter::appendInteger(Buffer *buf, int64_t value) {
+    appendHeader(buf, ':', value);
+}
+
+void RespWriter::appendBulkString(Buffer *buf, std::string_view data) {
+    buf->ensureWritableBytes(data.size() + 24);
+    appendHeader(buf, '$', static_cast<int64_t>(data.size()));
+    buf->append(data.data(), data.size());
+    buf->append("\r\n", 2);
+}
+
+void RespWriter::appendNull(Buffer *buf, int protocol) {
+    if (protocol >= 3) {
+        buf->append("_\r\n", 3);
+    } else {
+        buf->append("$-1\r\n", 5);
+    }
+}
+
+void RespWriter::appendArrayHeader(Buffer *buf, size_t count) {
+    appendHeader(buf, '*', static_cast<int64_t>(count));
+}
+
+void RespWriter::appendMapHeader(Buffer *buf, size_t pairs, int protocol) {
+    if (protocol >= 3) {
+        appendHeader(buf, '%', static_cast<int64_t>(pairs));
+    } else {
+        appendHeader(buf, '*', static_cast<int64_t>(2 * pairs));
+    }
+}
+
+void RespWriter::appendCommand(Buffer *buf, const std::vector<std::string_view> &args) {
+    appendArrayHeader(buf, args.size());
+    for (std::string_view arg: args) {
+        appendBulkString(buf, arg);
+    }
+}
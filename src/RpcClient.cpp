@@ -0,0 +1,178 @@
+#include "src/include/RpcClient.h"
+#include "src/include/EventLoop.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/fmtlog.h"
+
+using namespace faliks;
+
+RpcClient::RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, size_t maxFrameBytes)
+        : m_loop(loop),
+          m_client(loop, serverAddr, name),
+          m_codec(4, LengthHeaderCodec::ByteOrder::kBigEndian, maxFrameBytes),
+          m_nextId(1),
+          m_connected(false),
+          m_flushQueued(false),
+          m_timerAt(0) {
+    m_codec.setFrameBatchCallback([this](const TcpConnectionPtr &, const std::vector<std::string_view> &frames,
+                                         Timestamp) {
+        onFrames(frames);
+    });
+    m_client.setConnectionCallback([this](const TcpConnectionPtr &conn) {
+        onConnection(conn);
+    });
+    m_client.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+        m_codec.onMessage(conn, buf, receiveTime);
+    });
+}
+
+RpcClient::~RpcClient() {
+    if (m_timerAt != 0) {
+        m_loop->cancel(m_timer);
+    }
+    // The TcpClient closes the connection later, after this is gone.
+    TcpConnectionPtr conn = m_client.connection();
+    if (conn) {
+        conn->setConnectionCallback(defaultConnectionCallback);
+        conn->setMessageCallback(defaultMessageCallback);
+    }
+}
+
+void RpcClient::call(std::string_view method, std::string_view request, Callback cb, double timeout) {
+    uint64_t id = m_nextId.fetch_add(1, std::memory_order_relaxed);
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!RpcCodec::appendRequest(m_codec, &m_outgoing, id, method, request)) {
+            // Reported from the loop like every other outcome.
+            m_calls.push_back({0, timeout, std::move(cb)});
+        } else {
+            m_calls.push_back({id, timeout, std::move(cb)});
+        }
+        first = !m_flushQueued.exchange(true, std::memory_order_acq_rel);
+    }
+    // Queued even in the loop, so calls made in one go share the send.
+    if (first) {
+        m_loop->queueInLoop([this] {
+            flushInLoop();
+        });
+    }
+}
+
+void RpcClient::flushInLoop() {
+    thread_local Buffer output;
+    std::vector<Call> calls;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        output.swap(m_outgoing);
+        calls.swap(m_calls);
+        m_flushQueued.store(false, std::memory_order_release);
+    }
+    TcpConnectionPtr conn = m_client.connection();
+    if (!conn || !conn->connected()) {
+        output.retrieveAll();
+        for (auto &call: calls) {
+            call.callback(RpcStatus::kDisconnected, {});
+        }
+        return;
+    }
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    for (auto &call: calls) {
+        if (call.id == 0) {
+            call.callback(RpcStatus::kBadRequest, "method name too long or request too large");
+            continue;
+        }
+        auto deadline = now + static_cast<int64_t>(call.timeout * Timestamp::kMicroSecondsPerSecond);
+        m_pending.emplace(call.id, Pending{deadline, std::move(call.callback)});
+        addDeadline(call.id, deadline);
+    }
+    conn->send(&output);
+    output.retrieveAll();
+}
+
+void RpcClient::addDeadline(uint64_t id, int64_t deadline) {
+    // Answered calls leave their deadlines behind; drop them once they
+    // outnumber the live ones.
+    if (m_deadlines.size() > 2 * m_pending.size() + 1024) {
+        std::vector<Deadline> live;
+        live.reserve(m_pending.size());
+        for (auto &item: m_pending) {
+            live.emplace_back(item.second.deadline, item.first);
+        }
+        m_deadlines = decltype(m_deadlines)(std::greater<>(), std::move(live));
+    } else {
+        m_deadlines.emplace(deadline, id);
+    }
+    if (m_timerAt == 0 || m_deadlines.top().first < m_timerAt) {
+        if (m_timerAt != 0) {
+            m_loop->cancel(m_timer);
+        }
+        m_timerAt = m_deadlines.top().first;
+        m_timer = m_loop->runAt(Timestamp(m_timerAt), [this] {
+            expire();
+        });
+    }
+}
+
+void RpcClient::expire() {
+    m_timerAt = 0;
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    std::vector<Callback> expired;
+    while (!m_deadlines.empty() && m_deadlines.top().first <= now) {
+        auto found = m_pending.find(m_deadlines.top().second);
+        m_deadlines.pop();
+        if (found != m_pending.end()) {
+            expired.push_back(std::move(found->second.callback));
+            m_pending.erase(found);
+        }
+    }
+    if (!m_deadlines.empty()) {
+        m_timerAt = m_deadlines.top().first;
+        m_timer = m_loop->runAt(Timestamp(m_timerAt), [this] {
+            expire();
+        });
+    }
+    for (auto &callback: expired) {
+        callback(RpcStatus::kTimeout, {});
+    }
+}
+
+void RpcClient::onFrames(const std::vector<std::string_view> &frames) {
+    for (std::string_view frame: frames) {
+        RpcCodec::Message message{};
+        if (!RpcCodec::decode(frame, &message) || message.kind != RpcCodec::Kind::kResponse) {
+            loge("RpcClient::onFrames [{}] - malformed response", m_client.name());
+            continue;
+        }
+        // Late answers to expired calls are dropped.
+        auto found = m_pending.find(message.id);
+        if (found == m_pending.end()) {
+            continue;
+        }
+        Callback callback = std::move(found->second.callback);
+        m_pending.erase(found);
+        callback(message.status, message.body);
+    }
+}
+
+void RpcClient::failAll(RpcStatus status) {
+    std::unordered_map<uint64_t, Pending> pending;
+    pending.swap(m_pending);
+    m_deadlines = decltype(m_deadlines)();
+    if (m_timerAt != 0) {
+        m_loop->cancel(m_timer);
+        m_timerAt = 0;
+    }
+    for (auto &item: pending) {
+        item.second.callback(status, {});
+    }
+}
+
+void RpcClient::onConnection(const TcpConnectionPtr &conn) {
+    m_connected.store(conn->connected(), std::memory_order_release);
+    if (!conn->connected()) {
+        failAll(RpcStatus::kDisconnected);
+    }
+    if (m_connectionCallback) {
+        m_connectionCallback(conn);
+    }
+}
@@ -0,0 +1,90 @@
+#include "src/include/RpcCodec.h"
+#include "src/include/LengthHeaderCodec.h"
+
+using namespace faliks;
+
+namespace {
+    void putId(char *out, uint64_t id) {
+        for (int i = 7; i >= 0; --i) {
+            out[i] = static_cast<char>(id & 0xff);
+            id >>= 8;
+        }
+    }
+
+    uint64_t getId(const char *in) {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(in);
+        uint64_t id = 0;
+        for (int i = 0; i < 8; ++i) {
+            id = (id << 8) | bytes[i];
+        }
+        return id;
+    }
+}
+
+const char *faliks::rpcStatusName(RpcStatus status) {
+    switch (status) {
+        case RpcStatus::kOk:
+            return "ok";
+        case RpcStatus::kNoSuchMethod:
+            return "no such method";
+        case RpcStatus::kBadRequest:
+            return "bad request";
+        case RpcStatus::kOverloaded:
+            return "overloaded";
+        case RpcStatus::kHandlerError:
+            return "handler error";
+        case RpcStatus::kTimeout:
+            return "timeout";
+        case RpcStatus::kDisconnected:
+            return "disconnected";
+    }
+    return "unknown";
+}
+
+bool RpcCodec::appendRequest(const LengthHeaderCodec &codec, Buffer *buf, uint64_t id, std::string_view method,
+                             std::string_view body) {
+    if (method.size() > kMaxMethodBytes) {
+        return false;
+    }
+    char head[10];
+    head[0] = static_cast<char>(Kind::kRequest);
+    putId(head + 1, id);
+    head[9] = static_cast<char>(method.size());
+    return codec.appendFrame(buf, {std::string_view(head, sizeof head), method, body});
+}
+
+bool RpcCodec::appendResponse(const LengthHeaderCodec &codec, Buffer *buf, uint64_t id, RpcStatus status,
+                              std::string_view body) {
+    char head[10];
+    head[0] = static_cast<char>(Kind::kResponse);
+    putId(head + 1, id);
+    head[9] = static_cast<char>(status);
+    return codec.appendFrame(buf, {std::string_view(head, sizeof head), body});
+}
+
+bool RpcCodec::decode(std::string_view frame, Message *message) {
+    if (frame.size() < 10) {
+        return false;
+    }
+    auto kind = static_cast<uint8_t>(frame[0]);
+    message->id = getId(frame.data() + 1);
+    auto tag = static_cast<uint8_t>(frame[9]);
+    if (kind == static_cast<uint8_t>(Kind::kRequest)) {
+        if (frame.size() < 10 + static_cast<size_t>(tag)) {
+            return false;
+        }
+        message->kind = Kind::kRequest;
+        message->method = frame.substr(10, tag);
+        message->status = RpcStatus::kOk;
+        message->body = frame.substr(10 + tag);
+        return true;
+    }
+    if (kind == static_cast<uint8_t>(Kind::kResponse) && tag <= static_cast<uint8_t>(RpcStatus::kHandlerError)) {
+        message->kind = Kind::kResponse;
+        message->method = {};
+        message->status = static_cast<RpcStatus>(tag);
+        message->body = frame.substr(10);
+        return true;
+    }
+    return false;
+}
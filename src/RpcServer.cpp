@@ -0,0 +1,100 @@
+#include "src/include/RpcServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/Offload.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/WorkStealingPool.h"
+#include "base/include/fmtlog.h"
+
+using namespace faliks;
+
+namespace {
+    // The connection whose input is being handled in this thread, and where
+    // its answers collect meanwhile.
+    thread_local const TcpConnection *t_batchConnection = nullptr;
+    thread_local Buffer *t_batchOutput = nullptr;
+}
+
+void RpcServer::Responder::respond(RpcStatus status, std::string_view body) const {
+    TcpConnectionPtr conn = m_conn.lock();
+    if (!conn) {
+        return;
+    }
+    if (conn.get() == t_batchConnection) {
+        RpcCodec::appendResponse(*m_codec, t_batchOutput, m_id, status, body);
+        return;
+    }
+    Buffer output;
+    if (RpcCodec::appendResponse(*m_codec, &output, m_id, status, body)) {
+        conn->send(&output);
+    }
+}
+
+RpcServer::RpcServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                     TcpServer::Option option, size_t maxFrameBytes)
+        : m_server(loop, listenAddr, name, option),
+          m_codec(4, LengthHeaderCodec::ByteOrder::kBigEndian, maxFrameBytes) {
+    m_codec.setFrameBatchCallback([this](const TcpConnectionPtr &conn, const std::vector<std::string_view> &frames,
+                                         Timestamp) {
+        onFrames(conn, frames);
+    });
+    m_server.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+        m_codec.onMessage(conn, buf, receiveTime);
+    });
+}
+
+void RpcServer::registerHandler(const std::string &method, Handler handler) {
+    if (method.size() > RpcCodec::kMaxMethodBytes) {
+        loge("RpcServer::registerHandler - method name {} too long", method);
+        return;
+    }
+    m_handlers[method] = std::move(handler);
+}
+
+void RpcServer::registerOffloaded(const std::string &method, WorkStealingPool *pool, Work work) {
+    auto shared = std::make_shared<const Work>(std::move(work));
+    registerHandler(method, [pool, shared](std::string_view request, const Responder &responder) {
+        struct Result {
+            RpcStatus status;
+            std::string response;
+        };
+        bool queued = offload(*pool, [shared, request = std::string(request)] {
+            Result result{RpcStatus::kOk, {}};
+            result.status = (*shared)(request, &result.response);
+            return result;
+        }, [responder](Result result) {
+            responder.respond(result.status, result.response);
+        });
+        if (!queued) {
+            responder.fail(RpcStatus::kOverloaded);
+        }
+    });
+}
+
+void RpcServer::onFrames(const TcpConnectionPtr &conn, const std::vector<std::string_view> &frames) {
+    thread_local Buffer output;
+    thread_local std::string method;
+    t_batchConnection = conn.get();
+    t_batchOutput = &output;
+    for (std::string_view frame: frames) {
+        RpcCodec::Message message{};
+        if (!RpcCodec::decode(frame, &message) || message.kind != RpcCodec::Kind::kRequest) {
+            loge("RpcServer::onFrames [{}] - malformed request", conn->getName());
+            conn->forceClose();
+            break;
+        }
+        method.assign(message.method);
+        auto found = m_handlers.find(method);
+        Responder responder(conn, &m_codec, message.id);
+        if (found == m_handlers.end()) {
+            responder.fail(RpcStatus::kNoSuchMethod, message.method);
+        } else {
+            found->second(message.body, responder);
+        }
+    }
+    t_batchConnection = nullptr;
+    t_batchOutput = nullptr;
+    if (output.readableBytes() > 0) {
+        conn->send(&output);
+        output.retrieveAll();
+    }
+}
@@ -0,0 +1,65 @@
+#include "src/include/SendBatch.h"
+#include "src/include/EventLoop.h"
+#include "src/include/TcpConnection.h"
+#include "src/include/TcpServer.h"
+
+#include <cassert>
+
+using namespace faliks;
+
+SendBatch::SendBatch(TcpServer *server)
+        : m_server(server),
+          m_messages(0) {
+}
+
+void SendBatch::add(const TcpConnectionPtr &conn, std::string message) {
+    LoopBatch &batch = m_batches[conn->getLoop()];
+    auto it = batch.byConnection.find(conn.get());
+    if (it == batch.byConnection.end()) {
+        it = batch.byConnection.emplace(conn.get(), batch.targets.size()).first;
+        batch.targets.push_back({conn, ConnectionHandle(), {}});
+    }
+    batch.targets[it->second].messages.push_back(std::move(message));
+    ++m_messages;
+}
+
+void SendBatch::add(ConnectionHandle handle, std::string message) {
+    assert(m_server != nullptr);
+    EventLoop *loop = m_server->loopOf(handle);
+    if (loop == nullptr) {
+        return;
+    }
+    LoopBatch &batch = m_batches[loop];
+    auto it = batch.byHandle.find(handle.value());
+    if (it == batch.byHandle.end()) {
+        it = batch.byHandle.emplace(handle.value(), batch.targets.size()).first;
+        batch.targets.push_back({nullptr, handle, {}});
+    }
+    batch.targets[it->second].messages.push_back(std::move(message));
+    ++m_messages;
+}
+
+size_t SendBatch::post() {
+    size_t posted = 0;
+    for (auto &item: m_batches) {
+        if (item.second.targets.empty()) {
+            continue;
+        }
+        // A connection that migrated since it was added is handed over by
+        // send(), which forwards to its new loop.
+        item.first->runInLoop([server = m_server, targets = std::move(item.second.targets)]() mutable {
+            for (auto &target: targets) {
+                TcpConnectionPtr conn = target.conn ? target.conn : server->findInLoop(target.handle);
+                if (conn) {
+                    conn->send(std::move(target.messages));
+                }
+            }
+        });
+        item.second.targets.clear();
+        item.second.byConnection.clear();
+        item.second.byHandle.clear();
+        ++posted;
+    }
+    m_messages = 0;
+    return posted;
+}
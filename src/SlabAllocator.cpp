@@ -0,0 +1,77 @@
+#include "src/include/SlabAllocator.h"
+#include "base/include/fmtlog.h"
+
+#include <sys/mman.h>
+#include <algorithm>
+
+using namespace faliks;
+
+SlabAllocator::SlabAllocator(size_t memoryLimit, size_t minChunkBytes, double growthFactor)
+        : m_memoryLimit(memoryLimit),
+          m_reservedBytes(0) {
+    size_t size = (std::max<size_t>(minChunkBytes, 8) + 7) & ~size_t(7);
+    while (size < kPageBytes / 2) {
+        m_classes.push_back({size, kPageBytes / size, {}, 0, nullptr});
+        // Rounded so chunks stay aligned, and always growing.
+        size = std::max(size + 8, (static_cast<size_t>(static_cast<double>(size) * growthFactor) + 7) & ~size_t(7));
+    }
+    m_classes.push_back({kPageBytes, 1, {}, 0, nullptr});
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (SlabClass &slabClass: m_classes) {
+        for (char *page: slabClass.pages) {
+            ::munmap(page, kPageBytes);
+        }
+    }
+}
+
+size_t SlabAllocator::classOf(size_t size) const {
+    auto it = std::lower_bound(m_classes.begin(), m_classes.end(), size, [](const SlabClass &slabClass, size_t s) {
+        return slabClass.chunkBytes < s;
+    });
+    return static_cast<size_t>(it - m_classes.begin());
+}
+
+void *SlabAllocator::allocate(size_t cls) {
+    SlabClass &slabClass = m_classes[cls];
+    if (slabClass.freeList != nullptr) {
+        void *chunk = slabClass.freeList;
+        slabClass.freeList = *static_cast<void **>(chunk);
+        return chunk;
+    }
+    if (slabClass.pages.empty() || slabClass.carved == slabClass.chunksPerPage) {
+        if (!slabClass.pages.empty() && m_reservedBytes + kPageBytes > m_memoryLimit) {
+            return nullptr;
+        }
+        // Anonymous pages are backed only once touched.
+        void *page = ::mmap(nullptr, kPageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            loge("SlabAllocator::allocate - mmap");
+            return nullptr;
+        }
+        slabClass.pages.push_back(static_cast<char *>(page));
+        slabClass.carved = 0;
+        m_reservedBytes += kPageBytes;
+    }
+    return slabClass.pages.back() + slabClass.chunkBytes * slabClass.carved++;
+}
+
+void SlabAllocator::deallocate(void *chunk, size_t cls) {
+    SlabClass &slabClass = m_classes[cls];
+    *static_cast<void **>(chunk) = slabClass.freeList;
+    slabClass.freeList = chunk;
+}
+
+size_t SlabAllocator::numChunks(size_t cls) const {
+    const SlabClass &slabClass = m_classes[cls];
+    if (slabClass.pages.empty()) {
+        return 0;
+    }
+    return (slabClass.pages.size() - 1) * slabClass.chunksPerPage + slabClass.carved;
+}
+
+void *SlabAllocator::chunkAt(size_t cls, size_t index) const {
+    const SlabClass &slabClass = m_classes[cls];
+    return slabClass.pages[index / slabClass.chunksPerPage] + slabClass.chunkBytes * (index % slabClass.chunksPerPage);
+}
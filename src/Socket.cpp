@@ -4,6 +4,9 @@
 
 #include <unistd.h>
 #include <netinet/tcp.h>
+#include <linux/filter.h>
+#include <cerrno>
+#include <cstring>
 
 namespace faliks {
     Socket::~Socket() {
@@ -44,7 +47,11 @@ namespace faliks {
     }
 
     void Socket::bindAddress(const InetAddress &localAddr) const {
-        if (::bind(m_sockFd, localAddr.getSockAddr(), sizeof(sockaddr_in6)) < 0) {
+        if (!localAddr.valid()) {
+            loge("bind socket failed: invalid address");
+            return;
+        }
+        if (::bind(m_sockFd, localAddr.getSockAddr(), localAddr.getSockLen()) < 0) {
             loge("bind socket failed");
         }
     }
@@ -57,13 +64,11 @@ namespace faliks {
     }
 
     int Socket::accept(InetAddress *peeraddr) const {
-        struct sockaddr_in6 addr{};
-        memset(&addr, 0, sizeof addr);
+        struct sockaddr_storage addr{};
         auto addrLen = static_cast<socklen_t>(sizeof addr);
         int connfd = ::accept4(m_sockFd, (sockaddr *) &addr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (connfd < 0) {
             int savedErrno = errno;
-            loge("accept socket failed");
             switch (savedErrno) {
                 case EAGAIN:
                 case ECONNABORTED:
@@ -89,8 +94,9 @@ namespace faliks {
                     loge("unknown error of ::accept {}", savedErrno);
                     break;
             }
+            errno = savedErrno;
         } else {
-            peeraddr->setSockAddrInet6(addr);
+            *peeraddr = InetAddress(reinterpret_cast<struct sockaddr *>(&addr), addrLen);
         }
         return connfd;
     }
@@ -108,7 +114,7 @@ namespace faliks {
 
     void Socket::setReuseAddr(bool on) const {
         int optVal = on ? 1 : 0;
-        setsockopt(m_sockFd, SOL_SOCKET, SO_REUSEPORT, &optVal, static_cast<socklen_t>(sizeof optVal));
+        setsockopt(m_sockFd, SOL_SOCKET, SO_REUSEADDR, &optVal, static_cast<socklen_t>(sizeof optVal));
     }
 
     void Socket::setReusePort(bool on) const {
@@ -120,6 +126,33 @@ namespace faliks {
         }
     }
 
+    bool Socket::attachReusePortCpuSteering(const std::vector<int> &cpuToIndex, int numSockets) const {
+        // A = the cpu that received the packet; return the group index mapped
+        // to it, or cpu % numSockets for cpus without one.
+        std::vector<struct sock_filter> code;
+        code.push_back({BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)});
+        for (size_t cpu = 0; cpu < cpuToIndex.size(); ++cpu) {
+            if (cpuToIndex[cpu] >= 0) {
+                code.push_back({BPF_JMP | BPF_JEQ | BPF_K, 0, 1, static_cast<uint32_t>(cpu)});
+                code.push_back({BPF_RET | BPF_K, 0, 0, static_cast<uint32_t>(cpuToIndex[cpu])});
+            }
+        }
+        code.push_back({BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(numSockets)});
+        code.push_back({BPF_RET | BPF_A, 0, 0, 0});
+        if (code.size() > BPF_MAXINSNS) {
+            loge("reuseport steering program too long: {} instructions", code.size());
+            return false;
+        }
+        struct sock_fprog prog{};
+        prog.len = static_cast<unsigned short>(code.size());
+        prog.filter = code.data();
+        if (::setsockopt(m_sockFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog) < 0) {
+            loge("attach reuseport cbpf failed: {}", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
     void Socket::setKeepAlive(bool on) {
         int optVal = on ? 1 : 0;
         int ret = setsockopt(m_sockFd, SOL_SOCKET, SO_KEEPALIVE, &optVal, static_cast<socklen_t>(sizeof optVal));
@@ -0,0 +1,216 @@
+#include "src/include/StaticFileHandler.h"
+#include "src/include/HttpRequest.h"
+#include "src/include/HttpResponse.h"
+
+#include <cassert>
+#include <charconv>
+
+using namespace faliks;
+
+namespace {
+    struct ContentType {
+        std::string_view extension;
+        std::string_view type;
+    };
+
+    const ContentType kContentTypes[] = {
+            {"html",  "text/html; charset=utf-8"},
+            {"htm",   "text/html; charset=utf-8"},
+            {"css",   "text/css; charset=utf-8"},
+            {"js",    "text/javascript; charset=utf-8"},
+            {"json",  "application/json"},
+            {"txt",   "text/plain; charset=utf-8"},
+            {"xml",   "application/xml"},
+            {"svg",   "image/svg+xml"},
+            {"png",   "image/png"},
+            {"jpg",   "image/jpeg"},
+            {"jpeg",  "image/jpeg"},
+            {"gif",   "image/gif"},
+            {"webp",  "image/webp"},
+            {"ico",   "image/x-icon"},
+            {"woff2", "font/woff2"},
+            {"wasm",  "application/wasm"},
+            {"pdf",   "application/pdf"},
+    };
+
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    // Percent-decodes path into out; false on a bad escape or a NUL.
+    bool decodePath(std::string_view path, std::string *out) {
+        out->clear();
+        for (size_t i = 0; i < path.size(); ++i) {
+            char c = path[i];
+            if (c == '%') {
+                if (i + 2 >= path.size()) {
+                    return false;
+                }
+                int high = hexValue(path[i + 1]);
+                int low = hexValue(path[i + 2]);
+                if (high < 0 || low < 0 || (high == 0 && low == 0)) {
+                    return false;
+                }
+                c = static_cast<char>(high * 16 + low);
+                i += 2;
+            }
+            out->push_back(c);
+        }
+        return true;
+    }
+
+    bool parseNumber(std::string_view text, uint64_t *value) {
+        if (text.empty()) {
+            return false;
+        }
+        auto result = std::from_chars(text.data(), text.data() + text.size(), *value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    // A single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range.
+    // Returns 1 for a satisfiable range, 0 to ignore the header and -1 if
+    // the range is not satisfiable.
+    int parseRange(std::string_view header, uint64_t size, uint64_t *first, uint64_t *last) {
+        if (header.substr(0, 6) != "bytes=" || header.find(',') != std::string_view::npos) {
+            return 0;
+        }
+        header.remove_prefix(6);
+        size_t dash = header.find('-');
+        if (dash == std::string_view::npos) {
+            return 0;
+        }
+        std::string_view from = header.substr(0, dash);
+        std::string_view to = header.substr(dash + 1);
+        uint64_t value;
+        if (from.empty()) {
+            if (!parseNumber(to, &value)) {
+                return 0;
+            }
+            if (value == 0 || size == 0) {
+                return -1;
+            }
+            *first = value >= size ? 0 : size - value;
+            *last = size - 1;
+            return 1;
+        }
+        if (!parseNumber(from, first)) {
+            return 0;
+        }
+        if (to.empty()) {
+            *last = size - 1;
+        } else if (!parseNumber(to, last) || *last < *first) {
+            return 0;
+        } else if (*last >= size) {
+            *last = size - 1;
+        }
+        return *first < size ? 1 : -1;
+    }
+
+    void appendNumber(std::string *out, uint64_t value, int base = 10) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof digits, value, base);
+        out->append(digits, result.ptr - digits);
+    }
+}
+
+StaticFileHandler::StaticFileHandler(FileCache *cache, const std::string &urlPrefix)
+        : m_cache(cache),
+          m_urlPrefix(urlPrefix),
+          m_indexFile("index.html") {
+    assert(!urlPrefix.empty() && urlPrefix.front() == '/' && urlPrefix.back() == '/');
+}
+
+std::string_view StaticFileHandler::contentType(std::string_view path) {
+    size_t dot = path.rfind('.');
+    if (dot != std::string_view::npos && path.find('/', dot) == std::string_view::npos) {
+        std::string_view extension = path.substr(dot + 1);
+        for (const auto &entry: kContentTypes) {
+            if (equalsIgnoreCase(entry.extension, extension)) {
+                return entry.type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+bool StaticFileHandler::handle(const HttpRequest &request, HttpResponse *response) const {
+    std::string_view target = request.path();
+    if (target.substr(0, m_urlPrefix.size()) != m_urlPrefix) {
+        return false;
+    }
+    if (request.method() != HttpRequest::Method::kGet && request.method() != HttpRequest::Method::kHead) {
+        response->setStatus(405);
+        response->addHeader("Allow", "GET, HEAD");
+        return true;
+    }
+    thread_local std::string path;
+    if (!decodePath(target.substr(m_urlPrefix.size()), &path)) {
+        response->setStatus(400);
+        return true;
+    }
+    if (path.empty() || path.back() == '/') {
+        path += m_indexFile;
+    }
+    FileCache::FilePtr file = m_cache->get(path);
+    if (!file) {
+        response->setStatus(404);
+        return true;
+    }
+
+    // Weak: the mtime has a one second resolution.
+    thread_local std::string etag;
+    etag.assign("W/\"");
+    appendNumber(&etag, file->size(), 16);
+    etag.push_back('-');
+    appendNumber(&etag, static_cast<uint64_t>(file->mtime()), 16);
+    etag.push_back('"');
+    response->addHeader("ETag", etag);
+    response->addHeader("Accept-Ranges", "bytes");
+    if (headerListsToken(request.header("If-None-Match"), etag) || request.header("If-None-Match") == "*") {
+        response->setStatus(304);
+        return true;
+    }
+    response->setContentType(contentType(path));
+
+    uint64_t first = 0;
+    uint64_t last = file->size() == 0 ? 0 : file->size() - 1;
+    uint64_t length = file->size();
+    std::string_view range = request.header("Range");
+    std::string_view ifRange = request.header("If-Range");
+    if (!range.empty() && (ifRange.empty() || ifRange == etag)) {
+        int result = parseRange(range, file->size(), &first, &last);
+        if (result < 0) {
+            thread_local std::string contentRange;
+            contentRange.assign("bytes */");
+            appendNumber(&contentRange, file->size());
+            response->setStatus(416);
+            response->addHeader("Content-Range", contentRange);
+            return true;
+        }
+        if (result > 0) {
+            thread_local std::string contentRange;
+            contentRange.assign("bytes ");
+            appendNumber(&contentRange, first);
+            contentRange.push_back('-');
+            appendNumber(&contentRange, last);
+            contentRange.push_back('/');
+            appendNumber(&contentRange, file->size());
+            response->setStatus(206);
+            response->addHeader("Content-Range", contentRange);
+            length = last - first + 1;
+        }
+    }
+    if (file->data() != nullptr) {
+        response->setBodyReference(file->data() + first, length, file);
+    } else {
+        response->setFileBody(file->fd(), static_cast<off_t>(first), length, file);
+    }
+    return true;
+}
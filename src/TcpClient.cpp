@@ -0,0 +1,123 @@
+#include "src/include/TcpClient.h"
+#include "src/include/Connector.h"
+#include "src/include/EventLoop.h"
+#include "base/include/fmtlog.h"
+
+#include <sys/socket.h>
+#include <cassert>
+
+using namespace faliks;
+
+namespace {
+    InetAddress localAddressOf(int sockfd) {
+        struct sockaddr_storage addr{};
+        socklen_t len = sizeof addr;
+        if (::getsockname(sockfd, reinterpret_cast<struct sockaddr *>(&addr), &len) < 0) {
+            loge("TcpClient getsockname");
+        }
+        return InetAddress(reinterpret_cast<struct sockaddr *>(&addr), len);
+    }
+
+    InetAddress peerAddressOf(int sockfd) {
+        struct sockaddr_storage addr{};
+        socklen_t len = sizeof addr;
+        if (::getpeername(sockfd, reinterpret_cast<struct sockaddr *>(&addr), &len) < 0) {
+            loge("TcpClient getpeername");
+        }
+        return InetAddress(reinterpret_cast<struct sockaddr *>(&addr), len);
+    }
+}
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+        : m_loop(loop),
+          m_connector(std::make_shared<Connector>(loop, serverAddr)),
+          m_name(nameArg),
+          m_connNamePrefix(std::make_shared<const std::string>(nameArg + "-" + serverAddr.toIpPort() + "#")),
+          m_connectionCallback(defaultConnectionCallback),
+          m_messageCallback(defaultMessageCallback),
+          m_retry(false),
+          m_connect(false),
+          m_nextConnId(1) {
+    m_connector->setNewConnectionCallback([this](int sockfd) { newConnection(sockfd); });
+    logd("TcpClient::TcpClient [{}] - connector for {}", m_name, serverAddr.toIpPort());
+}
+
+TcpClient::~TcpClient() {
+    m_loop->assertInLoopThread();
+    logd("TcpClient::~TcpClient [{}]", m_name);
+    m_connector->stop();
+    TcpConnectionPtr conn;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        conn = m_connection;
+    }
+    if (conn) {
+        // The connection may outlive the client, so its close no longer
+        // comes back here.
+        assert(conn->getLoop() == m_loop);
+        conn->setCloseCallback([](const TcpConnectionPtr &c) {
+            c->getLoop()->queueInLoop([c] { c->connectDestroyed(); });
+        });
+        conn->forceClose();
+    }
+}
+
+void TcpClient::connect() {
+    logi("TcpClient::connect [{}] - connecting to {}", m_name, m_connector->serverAddress().toIpPort());
+    m_connect = true;
+    m_connector->start();
+}
+
+void TcpClient::disconnect() {
+    m_connect = false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_connection) {
+        m_connection->shutdown();
+    }
+}
+
+void TcpClient::stop() {
+    m_connect = false;
+    m_connector->stop();
+}
+
+void TcpClient::setRetryDelays(double initialDelay, double maxDelay) {
+    m_connector->setRetryDelays(initialDelay, maxDelay);
+}
+
+int TcpClient::connectRetries() const {
+    return m_connector->retries();
+}
+
+void TcpClient::newConnection(int sockfd) {
+    m_loop->assertInLoopThread();
+    InetAddress peerAddr(peerAddressOf(sockfd));
+    InetAddress localAddr(localAddressOf(sockfd));
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(m_loop, m_connNamePrefix, m_nextConnId++, sockfd,
+                                                            localAddr, peerAddr);
+    conn->setConnectionCallback(m_connectionCallback);
+    conn->setMessageCallback(m_messageCallback);
+    conn->setWriteCompleteCallback(m_writeCompleteCallback);
+    conn->setCloseCallback([this](const TcpConnectionPtr &c) { removeConnection(c); });
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connection = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn) {
+    m_loop->assertInLoopThread();
+    assert(m_loop == conn->getLoop());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert(m_connection == conn);
+        m_connection.reset();
+    }
+    m_loop->queueInLoop([conn] { conn->connectDestroyed(); });
+    if (m_retry && m_connect) {
+        logi("TcpClient::removeConnection [{}] - reconnecting to {}", m_name,
+             m_connector->serverAddress().toIpPort());
+        m_connector->restart();
+    }
+}
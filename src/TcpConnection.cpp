@@ -3,23 +3,31 @@
 #include "src/include/InetAddress.h"
 #include "src/include/Socket.h"
 #include "src/include/Channel.h"
+#include "src/include/LoopLoad.h"
 #include "src/include/Buffer.h"
 #include "base/include/fmtlog.h"
 
 #include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 
 using namespace faliks;
 using namespace std;
 
 
 void TcpConnection::handleRead(Timestamp receiveTime) {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
     int savedErrno = 0;
     ssize_t n = m_inputBuffer.readFd(m_channel->getFd(), &savedErrno);
     if (n > 0) {
+        m_bytesTransferred.store(m_bytesTransferred.load(std::memory_order_relaxed) + n,
+                                 std::memory_order_relaxed);
         m_messageCallback(shared_from_this(), &m_inputBuffer, receiveTime);
     } else if (n == 0) {
         handleClose();
+    } else if (savedErrno == ECONNRESET) {
+        logd("TcpConnection::handleRead [{}] reset by peer", getName());
+        handleClose();
     } else {
         errno = savedErrno;
         loge("TcpConnection::handleRead");
@@ -28,39 +36,117 @@ void TcpConnection::handleRead(Timestamp receiveTime) {
 }
 
 void TcpConnection::handleWrite() {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
 
     if (m_channel->isWriting()) {
-        ssize_t n = ::write(m_channel->getFd(),
-                            m_outputBuffer.peek(),
-                            m_outputBuffer.readableBytes());
-        if (n > 0) {
-            m_outputBuffer.retrieve(n);
-            if (m_outputBuffer.readableBytes() == 0) {
-                m_channel->disableWriting();
-                if (m_writeCompleteCallback) {
-                    m_loop->queueInLoop([this, self = shared_from_this()]() {
-                        m_writeCompleteCallback(self);
-                    });
-                }
-                if (m_state == kDisconnecting) {
-                    shutdownInLoop();
-                }
+        if (m_outputBuffer.readableBytes() > 0) {
+            ssize_t n = ::write(m_channel->getFd(),
+                                m_outputBuffer.peek(),
+                                m_outputBuffer.readableBytes());
+            if (n > 0) {
+                m_bytesTransferred.store(m_bytesTransferred.load(std::memory_order_relaxed) + n,
+                                         std::memory_order_relaxed);
+                m_outputBuffer.retrieve(n);
+            } else {
+                loge("TcpConnection::handleWrite");
+                return;
+            }
+        }
+        if (m_outputBuffer.readableBytes() == 0 && !m_segments.empty() && !writeSegments()) {
+            return;
+        }
+        if (m_outputBuffer.readableBytes() == 0 && m_segments.empty()) {
+            m_channel->disableWriting();
+            if (m_writeCompleteCallback) {
+                queueWriteComplete();
+            }
+            if (m_state == kDisconnecting) {
+                shutdownInLoop();
             }
-        } else {
-            loge("TcpConnection::handleWrite");
         }
     } else {
         logw("Connection fd = {} is down, no more writing", m_channel->getFd());
     }
 }
 
+// Writes queued segments until the socket is full. A file that shrank
+// under sendfile cannot deliver the promised bytes, so the connection is
+// closed, as after any other error.
+bool TcpConnection::writeSegments() {
+    const int kMaxIov = 64;
+    while (!m_segments.empty()) {
+        OutputSegment &segment = m_segments.front();
+        ssize_t n;
+        if (segment.fd >= 0) {
+            n = ::sendfile(m_channel->getFd(), segment.fd, &segment.offset, segment.len);
+        } else {
+            // Consecutive memory segments go out in one writev.
+            struct iovec vec[kMaxIov];
+            int iovcnt = 0;
+            for (auto it = m_segments.begin(); it != m_segments.end() && it->fd < 0 && iovcnt < kMaxIov; ++it) {
+                vec[iovcnt].iov_base = const_cast<char *>(it->data);
+                vec[iovcnt].iov_len = it->len;
+                ++iovcnt;
+            }
+            n = ::writev(m_channel->getFd(), vec, iovcnt);
+        }
+        if (n < 0 && errno == EWOULDBLOCK) {
+            return true;
+        }
+        if (n <= 0) {
+            loge("TcpConnection::writeSegments [{}]", n == 0 ? "file shrank" : strerror(errno));
+            m_segments.clear();
+            m_outputBuffer.retrieveAll();
+            m_channel->disableWriting();
+            forceClose();
+            return false;
+        }
+        m_bytesTransferred.store(m_bytesTransferred.load(std::memory_order_relaxed) + n,
+                                 std::memory_order_relaxed);
+        if (segment.fd >= 0) {
+            segment.len -= n;
+            if (segment.len > 0) {
+                return true;
+            }
+            m_segments.pop_front();
+            continue;
+        }
+        auto left = static_cast<size_t>(n);
+        while (left > 0 && left >= m_segments.front().len) {
+            left -= m_segments.front().len;
+            m_segments.pop_front();
+        }
+        if (left > 0) {
+            m_segments.front().data += left;
+            m_segments.front().len -= left;
+            return true;
+        }
+    }
+    return true;
+}
+
+// Like every deferred task of the connection, in the loop that owns it
+// when the callback runs: a migration queued ahead may have moved it.
+void TcpConnection::queueWriteComplete() {
+    queueInOwnerLoop([this]() {
+        m_writeCompleteCallback(shared_from_this());
+    });
+}
+
 void TcpConnection::handleClose() {
-    m_loop->assertInLoopThread();
-    loge("fd = {} state = {}", m_channel->getFd(), stateToString());
+    getLoop()->assertInLoopThread();
+    logd("fd = {} state = {}", m_channel->getFd(), stateToString());
     assert(m_state == kConnected || m_state == kDisconnecting);
     setState(kDisconnected);
     m_channel->disableAll();
+
+    TcpConnectionPtr guardThis(shared_from_this());
+    if (m_connectionCallback) {
+        m_connectionCallback(guardThis);
+    }
+    if (m_closeCallback) {
+        m_closeCallback(guardThis);
+    }
 }
 
 void TcpConnection::handleError() {
@@ -70,7 +156,11 @@ void TcpConnection::handleError() {
     if (getsockopt(m_channel->getFd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
         optval = errno;
     }
-    loge("TcpConnection::handleError [{}]", strerror(optval));
+    if (optval == ECONNRESET || optval == EPIPE) {
+        logd("TcpConnection::handleError [{}]", strerror(optval));
+    } else {
+        loge("TcpConnection::handleError [{}]", strerror(optval));
+    }
 }
 
 void TcpConnection::sendInLoop(const std::string &message) {
@@ -78,23 +168,23 @@ void TcpConnection::sendInLoop(const std::string &message) {
 }
 
 void TcpConnection::sendInLoop(const void *message, size_t len) {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
     ssize_t nwrote = 0;
     size_t remaining = len;
     bool faultError = false;
-    if (m_state == kDisconnecting) {
+    if (m_state == kDisconnected) {
         logw("disconnected, give up writing");
         return;
     }
 
-    if (!m_channel->isWriting() && m_outputBuffer.readableBytes() == 0) {
+    if (!m_channel->isWriting() && m_outputBuffer.readableBytes() == 0 && m_segments.empty()) {
         nwrote = ::write(m_channel->getFd(), message, len);
         if (nwrote >= 0) {
+            m_bytesTransferred.store(m_bytesTransferred.load(std::memory_order_relaxed) + nwrote,
+                                     std::memory_order_relaxed);
             remaining = len - nwrote;
             if (remaining == 0 && m_writeCompleteCallback) {
-                m_loop->queueInLoop([this, self = shared_from_this()]() {
-                    m_writeCompleteCallback(self);
-                });
+                queueWriteComplete();
             }
         } else {
             nwrote = 0;
@@ -105,34 +195,270 @@ void TcpConnection::sendInLoop(const void *message, size_t len) {
                 }
             }
         }
+    }
+
+    assert(remaining <= len);
+    if (!faultError && remaining > 0) {
+        appendOutput(static_cast<const char *>(message) + nwrote, remaining);
+    }
+}
+
+// Writes as many messages as the socket takes with gather writes and
+// buffers the rest, like sendInLoop does for a single one.
+void TcpConnection::sendInLoop(const std::vector<std::string> &messages) {
+    getLoop()->assertInLoopThread();
+    if (m_state == kDisconnected) {
+        logw("disconnected, give up writing");
+        return;
+    }
+    thread_local std::vector<struct iovec> slices;
+    slices.clear();
+    for (const auto &message: messages) {
+        slices.push_back({const_cast<char *>(message.data()), message.size()});
+    }
+    sendSlices(slices.data(), slices.size(), nullptr);
+}
+
+// Sends slices in order behind whatever output is queued: straight to the
+// socket while nothing is, with one writev per 64 of them, and the rest as
+// segments that ownerOf(i) keeps alive, or as copies without ownerOf.
+void TcpConnection::sendSlices(const struct iovec *slices, size_t count,
+                               const std::function<std::shared_ptr<const void>(size_t)> &ownerOf) {
+    const size_t kMaxIov = 64;
+    size_t index = 0;
+    size_t offset = 0;
+    if (!m_channel->isWriting() && m_outputBuffer.readableBytes() == 0 && m_segments.empty()) {
+        while (index < count) {
+            struct iovec vec[kMaxIov];
+            size_t iovcnt = std::min(count - index, kMaxIov);
+            size_t batch = 0;
+            for (size_t i = 0; i < iovcnt; ++i) {
+                size_t skip = i == 0 ? offset : 0;
+                vec[i].iov_base = static_cast<char *>(slices[index + i].iov_base) + skip;
+                vec[i].iov_len = slices[index + i].iov_len - skip;
+                batch += vec[i].iov_len;
+            }
+            ssize_t nwrote = ::writev(m_channel->getFd(), vec, static_cast<int>(iovcnt));
+            if (nwrote < 0) {
+                if (errno != EWOULDBLOCK) {
+                    loge("TcpConnection::sendSlices");
+                    if (errno == EPIPE || errno == ECONNRESET) {
+                        return;
+                    }
+                }
+                break;
+            }
+            m_bytesTransferred.store(m_bytesTransferred.load(std::memory_order_relaxed) + nwrote,
+                                     std::memory_order_relaxed);
+            auto left = static_cast<size_t>(nwrote);
+            while (index < count && left >= slices[index].iov_len - offset) {
+                left -= slices[index].iov_len - offset;
+                offset = 0;
+                ++index;
+            }
+            offset += left;
+            if (static_cast<size_t>(nwrote) < batch) {
+                break;
+            }
+        }
+        if (index == count && m_writeCompleteCallback) {
+            queueWriteComplete();
+        }
+    }
+    for (; index < count; ++index) {
+        if (slices[index].iov_len > offset) {
+            const char *data = static_cast<const char *>(slices[index].iov_base) + offset;
+            size_t len = slices[index].iov_len - offset;
+            if (ownerOf) {
+                appendSegment({data, -1, 0, len, ownerOf(index)});
+            } else {
+                appendOutput(data, len);
+            }
+        }
+        offset = 0;
+    }
+}
+
+void TcpConnection::appendOutput(const char *data, size_t len) {
+    // Behind uncopied segments the bytes have to wait their turn.
+    if (!m_segments.empty()) {
+        auto copy = std::make_shared<std::string>(data, len);
+        appendSegment({copy->data(), -1, 0, len, std::move(copy)});
+        return;
+    }
+    size_t oldLen = m_outputBuffer.readableBytes();
+    if (oldLen + len >= m_highWaterMark
+        && oldLen < m_highWaterMark
+        && m_highWaterMarkCallback) {
+        queueInOwnerLoop([this, oldLen, len]() {
+            m_highWaterMarkCallback(shared_from_this(), oldLen + len);
+        });
+    }
+    m_outputBuffer.append(data, len);
+    if (!m_channel->isWriting()) {
+        m_channel->enableWriting();
+    }
+}
+
+void TcpConnection::appendSegment(OutputSegment segment) {
+    m_segments.push_back(std::move(segment));
+    if (!m_channel->isWriting()) {
+        m_channel->enableWriting();
+    }
+}
+
+void TcpConnection::sendReferenced(Buffer *prefix, const void *data, size_t len, std::shared_ptr<const void> owner) {
+    getLoop()->assertInLoopThread();
+    thread_local Buffer empty(0);
+    if (prefix == nullptr) {
+        prefix = &empty;
+    }
+    if (m_state != kConnected) {
+        prefix->retrieveAll();
+        return;
+    }
+    if (m_flushQueued.load(std::memory_order_acquire)) {
+        flushPendingSends();
+    }
+    size_t prefixLen = prefix->readableBytes();
+    size_t written = 0;
+    bool complete = false;
+    if (!m_channel->isWriting() && m_outputBuffer.readableBytes() == 0 && m_segments.empty()) {
+        struct iovec vec[2];
+        vec[0].iov_base = const_cast<char *>(prefix->peek());
+        vec[0].iov_len = prefixLen;
+        vec[1].iov_base = const_cast<void *>(data);
+        vec[1].iov_len = len;
+        ssize_t n = ::writev(m_channel->getFd(), vec, 2);
+        if (n >= 0) {
+            m_bytesTransferred.store(m_bytesTransferred.load(std::memory_order_relaxed) + n,
+                                     std::memory_order_relaxed);
+            written = n;
+            complete = written == prefixLen + len;
+        } else if (errno != EWOULDBLOCK) {
+            loge("TcpConnection::sendReferenced");
+            if (errno == EPIPE || errno == ECONNRESET) {
+                prefix->retrieveAll();
+                return;
+            }
+        }
+    }
+    if (written < prefixLen) {
+        appendOutput(prefix->peek() + written, prefixLen - written);
+    }
+    size_t dataWritten = written > prefixLen ? written - prefixLen : 0;
+    if (dataWritten < len) {
+        appendSegment({static_cast<const char *>(data) + dataWritten, -1, 0, len - dataWritten, std::move(owner)});
+    }
+    prefix->retrieveAll();
+    if (complete && m_writeCompleteCallback) {
+        queueWriteComplete();
+    }
+}
+
+void TcpConnection::sendReferenced(const std::vector<std::shared_ptr<const std::string>> &payloads) {
+    getLoop()->assertInLoopThread();
+    if (m_state != kConnected) {
+        return;
+    }
+    if (m_flushQueued.load(std::memory_order_acquire)) {
+        flushPendingSends();
+    }
+    thread_local std::vector<struct iovec> slices;
+    slices.clear();
+    for (const auto &payload: payloads) {
+        slices.push_back({const_cast<char *>(payload->data()), payload->size()});
+    }
+    sendSlices(slices.data(), slices.size(), [&payloads](size_t i) {
+        return std::shared_ptr<const void>(payloads[i]);
+    });
+}
 
-        assert(remaining <= len);
-        if (!faultError && remaining > 0) {
-            auto oldLen = static_cast<ssize_t>(m_outputBuffer.readableBytes());
-            if (oldLen + remaining >= m_highWaterMark
-                && oldLen < m_highWaterMark
-                && m_highWaterMarkCallback) {
-                m_loop->queueInLoop([this, self = shared_from_this(), oldLen, remaining]() {
-                    m_highWaterMarkCallback(self, oldLen + remaining);
-                });
+void TcpConnection::sendReferenced(const struct iovec *slices, size_t count,
+                                   const std::shared_ptr<const void> &owner) {
+    getLoop()->assertInLoopThread();
+    if (m_state != kConnected) {
+        return;
+    }
+    if (m_flushQueued.load(std::memory_order_acquire)) {
+        flushPendingSends();
+    }
+    sendSlices(slices, count, [&owner](size_t) { return owner; });
+}
+
+void TcpConnection::sendFile(Buffer *prefix, int fd, off_t offset, size_t len, std::shared_ptr<const void> owner) {
+    getLoop()->assertInLoopThread();
+    thread_local Buffer empty(0);
+    if (prefix == nullptr) {
+        prefix = &empty;
+    }
+    if (m_state != kConnected) {
+        prefix->retrieveAll();
+        return;
+    }
+    if (m_flushQueued.load(std::memory_order_acquire)) {
+        flushPendingSends();
+    }
+    size_t prefixLen = prefix->readableBytes();
+    size_t written = 0;
+    OutputSegment segment{nullptr, fd, offset, len, std::move(owner)};
+    if (!m_channel->isWriting() && m_outputBuffer.readableBytes() == 0 && m_segments.empty()) {
+        ssize_t n = prefixLen > 0 ? ::write(m_channel->getFd(), prefix->peek(), prefixLen) : 0;
+        if (n >= 0) {
+            written = n;
+            size_t sent = 0;
+            if (written == prefixLen && len > 0) {
+                ssize_t m = ::sendfile(m_channel->getFd(), fd, &segment.offset, len);
+                if (m > 0) {
+                    sent = m;
+                    segment.len -= sent;
+                }
             }
-            m_outputBuffer.append(static_cast<const char *>(message) + nwrote, remaining);
-            if (!m_channel->isWriting()) {
-                m_channel->enableWriting();
+            m_bytesTransferred.store(m_bytesTransferred.load(std::memory_order_relaxed) + written + sent,
+                                     std::memory_order_relaxed);
+        } else if (errno != EWOULDBLOCK) {
+            loge("TcpConnection::sendFile");
+            if (errno == EPIPE || errno == ECONNRESET) {
+                prefix->retrieveAll();
+                return;
             }
         }
     }
+    if (written < prefixLen) {
+        appendOutput(prefix->peek() + written, prefixLen - written);
+    }
+    prefix->retrieveAll();
+    // A failed sendfile is retried, and reported, from handleWrite.
+    if (segment.len > 0) {
+        appendSegment(std::move(segment));
+    } else if (written == prefixLen && m_writeCompleteCallback && !m_channel->isWriting()) {
+        queueWriteComplete();
+    }
+}
+
+void TcpConnection::flushPendingSends() {
+    getLoop()->assertInLoopThread();
+    std::vector<std::string> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        pending.swap(m_pendingSends);
+        m_flushQueued.store(false, std::memory_order_release);
+    }
+    sendInLoop(pending);
 }
 
 void TcpConnection::shutdownInLoop() {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
+    if (m_flushQueued.load(std::memory_order_acquire)) {
+        flushPendingSends();
+    }
     if (!m_channel->isWriting()) {
         m_socket->shutdownWrite();
     }
 }
 
 void TcpConnection::forceCloseInLoop() {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
     if (m_state == kConnected || m_state == kDisconnecting) {
         handleClose();
     }
@@ -149,7 +475,7 @@ const char *TcpConnection::stateToString() const {
 }
 
 void TcpConnection::startReadInLoop() {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
     if (!m_reading || !m_channel->isReading()) {
         m_channel->enableReading();
         m_reading = true;
@@ -157,7 +483,7 @@ void TcpConnection::startReadInLoop() {
 }
 
 void TcpConnection::stopReadInLoop() {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
     if (m_reading || m_channel->isReading()) {
         m_channel->disableReading();
         m_reading = false;
@@ -166,15 +492,30 @@ void TcpConnection::stopReadInLoop() {
 
 TcpConnection::TcpConnection(EventLoop *loop, const string &name, int sockfd, const InetAddress &localAddr,
                              const InetAddress &peerAddr)
+        : TcpConnection(loop, make_shared<const string>(name), 0, sockfd, localAddr, peerAddr) {
+}
+
+TcpConnection::TcpConnection(EventLoop *loop, std::shared_ptr<const std::string> namePrefix, uint64_t id, int sockfd,
+                             const InetAddress &localAddr, const InetAddress &peerAddr)
         : m_loop(loop),
-          m_name(name),
+          m_id(id),
+          m_namePrefix(std::move(namePrefix)),
           m_state(kConnecting),
           m_reading(true),
           m_socket(make_unique<Socket>(sockfd)),
           m_channel(make_unique<Channel>(loop, sockfd)),
           m_localAddr(localAddr),
           m_peerAddr(peerAddr),
-          m_highWaterMark(64 * 1024 * 1024) {
+          m_highWaterMark(64 * 1024 * 1024),
+          m_bytesTransferred(0),
+          m_migrations(0),
+          m_attaching(false),
+          m_pendingMigration(nullptr),
+          m_flushQueued(false) {
+    m_channel->setType(Channel::Type::kConnection);
+    // Counted from the moment TcpServer picks the loop, so placement sees the
+    // connections of one accept burst before their loop establishes them.
+    getLoop()->load().connectionUp();
     m_channel->setReadCallback([this](Timestamp receiveTime) {
         handleRead(receiveTime);
     });
@@ -187,15 +528,28 @@ TcpConnection::TcpConnection(EventLoop *loop, const string &name, int sockfd, co
     m_channel->setErrorCallback([this]() {
         handleError();
     });
-    logd("TcpConnection::ctor[{}] fd = {}", m_name, sockfd);
-    m_socket->setKeepAlive(true);
+    logd("TcpConnection::ctor[{}] fd = {}", getName(), sockfd);
+    if (!m_localAddr.isUnix()) {
+        m_socket->setKeepAlive(true);
+    }
 }
 
 TcpConnection::~TcpConnection() {
-    logd("TcpConnection::dtor[{}] fd = {} state = {}", m_name, m_channel->getFd(), stateToString());
+    logd("TcpConnection::dtor[{}] fd = {} state = {}", getName(), m_channel->getFd(), stateToString());
     assert(m_state == kDisconnected);
 }
 
+const std::string &TcpConnection::getName() const {
+    std::call_once(m_nameOnce, [this] {
+        m_name = m_id == 0 ? *m_namePrefix : *m_namePrefix + std::to_string(m_id);
+    });
+    return m_name;
+}
+
+int TcpConnection::fd() const {
+    return m_socket->fd();
+}
+
 bool TcpConnection::getTcpInfo(struct tcp_info *tcpInfo) const {
     return m_socket->getTcpInfo(tcpInfo);
 }
@@ -213,26 +567,66 @@ void TcpConnection::send(const void *message, int len) {
 
 void TcpConnection::send(const string &message) {
     if (m_state == kConnected) {
-        if (m_loop->isInLoopThread()) {
+        if (getLoop()->isInLoopThread()) {
+            if (m_flushQueued.load(std::memory_order_acquire)) {
+                flushPendingSends();
+            }
             sendInLoop(message);
         } else {
-            m_loop->runInLoop([this, self = shared_from_this(), message]() {
-                sendInLoop(message);
-            });
+            bool first;
+            {
+                std::lock_guard<std::mutex> lock(m_pendingMutex);
+                m_pendingSends.push_back(message);
+                first = !m_flushQueued.exchange(true, std::memory_order_acq_rel);
+            }
+            if (first) {
+                queueFlush();
+            }
+        }
+    }
+}
+
+void TcpConnection::send(std::vector<std::string> &&messages) {
+    if (m_state == kConnected) {
+        if (getLoop()->isInLoopThread()) {
+            if (m_flushQueued.load(std::memory_order_acquire)) {
+                flushPendingSends();
+            }
+            sendInLoop(messages);
+        } else {
+            bool first;
+            {
+                std::lock_guard<std::mutex> lock(m_pendingMutex);
+                for (auto &message: messages) {
+                    m_pendingSends.push_back(std::move(message));
+                }
+                first = !m_flushQueued.exchange(true, std::memory_order_acq_rel);
+            }
+            if (first) {
+                queueFlush();
+            }
         }
     }
 }
 
+// Later sends pile up behind this flush, which drains them in order on
+// whichever loop owns the connection when it runs.
+void TcpConnection::queueFlush() {
+    queueInOwnerLoop([this]() {
+        flushPendingSends();
+    });
+}
+
 void TcpConnection::send(Buffer *message) {
     if (m_state == kConnected) {
-        if (m_loop->isInLoopThread()) {
+        if (getLoop()->isInLoopThread()) {
+            if (m_flushQueued.load(std::memory_order_acquire)) {
+                flushPendingSends();
+            }
             sendInLoop(message->peek(), message->readableBytes());
             message->retrieveAll();
         } else {
-            m_loop->runInLoop([this, self = shared_from_this(), message]() {
-                sendInLoop(message->peek(), message->readableBytes());
-                message->retrieveAll();
-            });
+            send(message->retrieveAllAsString());
         }
     }
 }
@@ -240,7 +634,7 @@ void TcpConnection::send(Buffer *message) {
 void TcpConnection::shutdown() {
     if (m_state == kConnected) {
         setState(kDisconnecting);
-        m_loop->runInLoop([this]() {
+        runInOwnerLoop([this]() {
             shutdownInLoop();
         });
     }
@@ -249,7 +643,7 @@ void TcpConnection::shutdown() {
 void TcpConnection::forceClose() {
     if (m_state == kConnected || m_state == kDisconnecting) {
         setState(kDisconnecting);
-        m_loop->queueInLoop([this]() {
+        queueInOwnerLoop([this]() {
             forceCloseInLoop();
         });
     }
@@ -258,30 +652,106 @@ void TcpConnection::forceClose() {
 void TcpConnection::forceCloseWithDelay(double seconds) {
     if (m_state == kConnected || m_state == kDisconnecting) {
         setState(kDisconnecting);
-        m_loop->runAfter(seconds, [this]() {
+        getLoop()->runAfter(seconds, [this]() {
             forceClose();
         });
     }
 }
 
 void TcpConnection::setTcpNoDelay(bool on) {
-    m_socket->setTcpNoDelay(on);
+    if (!m_localAddr.isUnix()) {
+        m_socket->setTcpNoDelay(on);
+    }
 }
 
 void TcpConnection::startRead() {
-    m_loop->runInLoop([this]() {
+    runInOwnerLoop([this]() {
         startReadInLoop();
     });
 }
 
 void TcpConnection::stopRead() {
-    m_loop->runInLoop([this]() {
+    runInOwnerLoop([this]() {
         stopReadInLoop();
     });
 }
 
+void TcpConnection::runInOwnerLoop(std::function<void()> cb) {
+    if (getLoop()->isInLoopThread()) {
+        cb();
+    } else {
+        queueInOwnerLoop(std::move(cb));
+    }
+}
+
+void TcpConnection::queueInOwnerLoop(std::function<void()> cb) {
+    getLoop()->queueInLoop([self = shared_from_this(), cb = std::move(cb)]() mutable {
+        if (self->getLoop()->isInLoopThread()) {
+            cb();
+        } else {
+            self->queueInOwnerLoop(std::move(cb));
+        }
+    });
+}
+
+void TcpConnection::migrateTo(EventLoop *loop) {
+    queueInOwnerLoop([this, loop]() {
+        migrateInLoop(loop);
+    });
+}
+
+void TcpConnection::migrateInLoop(EventLoop *loop) {
+    EventLoop *from = getLoop();
+    from->assertInLoopThread();
+    if (m_attaching) {
+        m_pendingMigration = loop;
+        return;
+    }
+    if (loop == from || m_state != kConnected) {
+        return;
+    }
+    logd("TcpConnection::migrateInLoop [{}] fd = {} to loop of thread {}", getName(), m_channel->getFd(),
+         loop->threadId());
+    m_channel->disableAll();
+    m_channel->remove();
+    m_channel->setOwnerLoop(loop);
+    from->load().connectionDown();
+    loop->load().connectionUp();
+    m_migrations.store(m_migrations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    // Functors forwarded to the new loop may run before the attach: the
+    // channel already belongs to it and registers itself on first update, and
+    // a further migration waits for the attach.
+    m_attaching = true;
+    m_loop.store(loop, std::memory_order_release);
+    if (m_migrateCallback) {
+        m_migrateCallback(shared_from_this(), from, loop);
+    }
+    loop->queueInLoop([this, self = shared_from_this()]() {
+        attachInLoop();
+    });
+}
+
+void TcpConnection::attachInLoop() {
+    getLoop()->assertInLoopThread();
+    m_attaching = false;
+    if (m_state != kConnected && m_state != kDisconnecting) {
+        return;
+    }
+    if (m_reading && !m_channel->isReading()) {
+        m_channel->enableReading();
+    }
+    if ((m_outputBuffer.readableBytes() > 0 || !m_segments.empty()) && !m_channel->isWriting()) {
+        m_channel->enableWriting();
+    }
+    if (m_pendingMigration) {
+        EventLoop *loop = m_pendingMigration;
+        m_pendingMigration = nullptr;
+        migrateInLoop(loop);
+    }
+}
+
 void TcpConnection::connectEstablished() {
-    m_loop->assertInLoopThread();
+    getLoop()->assertInLoopThread();
     assert(m_state == kConnecting);
     setState(kConnected);
     m_channel->tie(shared_from_this());
@@ -290,15 +760,28 @@ void TcpConnection::connectEstablished() {
 }
 
 void TcpConnection::connectDestroyed() {
-    m_loop->assertInLoopThread();
-    if (m_state == kConnected) {
+    getLoop()->assertInLoopThread();
+    // A connection being shut down still has its events enabled.
+    if (m_state == kConnected || m_state == kDisconnecting) {
         setState(kDisconnected);
         m_channel->disableAll();
 
         m_connectionCallback(shared_from_this());
+    } else if (m_state == kConnecting) {
+        // Destroyed before it was established, so never in the poller.
+        setState(kDisconnected);
+        getLoop()->load().connectionDown();
+        return;
     }
     m_channel->remove();
+    getLoop()->load().connectionDown();
 }
 
+void faliks::defaultConnectionCallback(const std::shared_ptr<TcpConnection> &conn) {
+    logd("{} -> {} is {}", conn->localAddress().toIpPort(), conn->peerAddress().toIpPort(),
+         (conn->connected() ? "UP" : "DOWN"));
+}
 
-
+void faliks::defaultMessageCallback(const std::shared_ptr<TcpConnection> &, Buffer *buffer, Timestamp) {
+    buffer->retrieveAll();
+}
@@ -5,89 +5,532 @@
 #include "src/include/TcpConnection.h"
 #include "src/include/InetAddress.h"
 #include "src/include/Buffer.h"
+#include "src/include/LoopPlacement.h"
+#include "src/include/LoopLoad.h"
+#include "base/include/CountDownLatch.h"
 #include "base/include/fmtlog.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+
 using namespace faliks;
 
-struct sockaddr_in6 getLocalAddr(int sockfd) {
-    struct sockaddr_in6 localAddr{};
-    memset(&localAddr, 0, sizeof localAddr);
+InetAddress getLocalAddr(int sockfd) {
+    struct sockaddr_storage localAddr{};
     socklen_t addrlen = sizeof localAddr;
     auto *addr = reinterpret_cast<struct sockaddr *>(&localAddr);
     if (::getsockname(sockfd, addr, &addrlen) < 0) {
         loge("getLocalAddr");
     }
-    return localAddr;
-}
-
-void defaultConnectionCallback(const std::shared_ptr<TcpConnection> &conn) {
-    logi("{} -> {} is {}", conn->localAddress().toIpPort(), conn->peerAddress().toIpPort(),
-         (conn->connected() ? "UP" : "DOWN"));
+    return InetAddress(addr, addrlen);
 }
 
-void defaultMessageCallback(const std::shared_ptr<TcpConnection> &conn, Buffer *buffer, Timestamp receiveTime) {
-    buffer->retrieveAll();
+int getIncomingCpu(int sockfd) {
+    int cpu = -1;
+    socklen_t len = sizeof cpu;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0) {
+        return -1;
+    }
+    return cpu;
 }
 
 
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
     m_loop->assertInLoopThread();
-    EventLoop *ioLoop = m_threadPool->getNextLoop();
-    char buf[64];
-    snprintf(buf, sizeof buf, "-%s#%d", m_ipPort.c_str(), m_nextConnId);
-    ++m_nextConnId;
-    std::string connName = m_name + buf;
+    EventLoop *ioLoop = m_incomingCpuPlacement ? m_threadPool->getLoopForCpu(getIncomingCpu(sockfd))
+                                               : m_threadPool->getLoopForPeer(peerAddr);
+    establishConnection(ioLoop, sockfd, peerAddr);
+}
 
-    logi("TcpServer::newConnection [{}] - new connection [{}] from {}",
-         m_name, connName, peerAddr.toIpPort());
+void TcpServer::establishConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr) {
+    uint64_t id = m_nextConnId.fetch_add(1, std::memory_order_relaxed);
+    logd("TcpServer::newConnection [{}] - new connection #{} from {}", m_name, id, peerAddr.toIpPort());
 
-    InetAddress localAddr(getLocalAddr(sockfd));
-    TcpConnectionPtr conn = std::make_shared<TcpConnection>(ioLoop, connName, sockfd, localAddr, peerAddr);
+    // A listener bound to one address, or a unix socket, accepts only on it.
+    InetAddress localAddr = m_localAddrKnown ? m_listenAddr : getLocalAddr(sockfd);
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(ioLoop, m_connNamePrefix, id, sockfd, localAddr,
+                                                            peerAddr);
 
-    m_connections[connName] = conn;
+    ConnectionShard *shard = &shardOf(ioLoop);
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->connections.emplace(id, conn);
+    }
+    m_numConnections.fetch_add(1, std::memory_order_relaxed);
     conn->setConnectionCallback(m_connectionCallback);
     conn->setMessageCallback(m_messageCallback);
     conn->setWriteCompleteCallback(m_writeCompleteCallback);
-    conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
-    ioLoop->runInLoop([conn]() mutable { conn->connectEstablished(); });
-
+    conn->setCloseCallback([this](const TcpConnectionPtr &c) { removeConnection(c); });
+    conn->setMigrateCallback([this](const TcpConnectionPtr &c, EventLoop *from, EventLoop *to) {
+        moveConnection(c, from, to);
+    });
+    ioLoop->runInLoop([shard, conn]() mutable {
+        // Destroyed already by a server going away.
+        if (conn->disconnected()) {
+            return;
+        }
+        conn->setHandle(shard->acquireSlot(conn));
+        conn->connectEstablished();
+    });
 }
 
-void TcpServer::removeConnection(const faliks::TcpServer::TcpConnectionPtr &conn) {
-    m_loop->runInLoop([this, conn] { removeConnectionInLoop(conn); });
+TcpServer::ConnectionShard &TcpServer::shardOf(EventLoop *loop) {
+    auto it = m_shardOfLoop.find(loop);
+    assert(it != m_shardOfLoop.end());
+    return *it->second;
 }
 
-void TcpServer::removeConnectionInLoop(const TcpServer::TcpConnectionPtr &conn) {
-    m_loop->assertInLoopThread();
-    logi("TcpServer::removeConnectionInLoop [{}] - connection {}", m_name, conn->getName());
-    size_t n = m_connections.erase(conn->getName());
-    assert(n == 1);
+// Runs in the connection's loop and touches only that loop's shard.
+void TcpServer::removeConnection(const TcpServer::TcpConnectionPtr &conn) {
+    logd("TcpServer::removeConnection [{}] - connection #{}", m_name, conn->id());
     EventLoop *ioLoop = conn->getLoop();
+    {
+        ConnectionShard &shard = shardOf(ioLoop);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // The destructor has taken it over and destroys it itself.
+        if (shard.connections.erase(conn->id()) == 0) {
+            return;
+        }
+    }
+    m_numConnections.fetch_sub(1, std::memory_order_relaxed);
+    ConnectionHandle handle = conn->handle();
+    if (handle.valid()) {
+        // Only a migrated connection closes away from its slot.
+        ConnectionShard *home = m_shards[handle.loopIndex()].get();
+        home->loop->runInLoop([home, handle] { home->releaseSlot(handle); });
+    }
     ioLoop->queueInLoop([conn] { conn->connectDestroyed(); });
 }
 
+// Runs in the old loop. Both shards are locked so aggregate views and the
+// destructor see the connection exactly once.
+void TcpServer::moveConnection(const TcpConnectionPtr &conn, EventLoop *from, EventLoop *to) {
+    ConnectionShard &source = shardOf(from);
+    ConnectionShard &target = shardOf(to);
+    std::scoped_lock lock(source.mutex, target.mutex);
+    if (source.connections.erase(conn->id()) == 1) {
+        target.connections.emplace(conn->id(), conn);
+    }
+}
+
+ConnectionHandle TcpServer::ConnectionShard::acquireSlot(const TcpConnectionPtr &conn) {
+    loop->assertInLoopThread();
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else if (slots.size() < ConnectionHandle::kMaxSlots) {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.push_back({1, nullptr});
+    } else {
+        return {};
+    }
+    slots[slot].conn = conn;
+    return {index, slot, slots[slot].generation};
+}
+
+void TcpServer::ConnectionShard::releaseSlot(ConnectionHandle handle) {
+    loop->assertInLoopThread();
+    ConnectionSlot &entry = slots[handle.slot()];
+    assert(entry.generation == handle.generation());
+    entry.conn.reset();
+    entry.generation = (entry.generation + 1) & ConnectionHandle::kGenerationMask;
+    if (entry.generation == 0) {
+        entry.generation = 1;
+    }
+    freeSlots.push_back(handle.slot());
+}
+
+EventLoop *TcpServer::loopOf(ConnectionHandle handle) const {
+    if (m_shutdownState == ShutdownState::kStopped || !handle.valid() || handle.loopIndex() >= m_shards.size()) {
+        return nullptr;
+    }
+    return m_shards[handle.loopIndex()]->loop;
+}
+
+TcpServer::TcpConnectionPtr TcpServer::findInLoop(ConnectionHandle handle) {
+    EventLoop *loop = loopOf(handle);
+    if (loop == nullptr) {
+        return nullptr;
+    }
+    loop->assertInLoopThread();
+    ConnectionShard &home = *m_shards[handle.loopIndex()];
+    if (handle.slot() >= home.slots.size() || home.slots[handle.slot()].generation != handle.generation()) {
+        return nullptr;
+    }
+    return home.slots[handle.slot()].conn;
+}
+
+void TcpServer::sendTo(ConnectionHandle handle, std::string payload) {
+    EventLoop *loop = loopOf(handle);
+    if (loop == nullptr) {
+        return;
+    }
+    loop->runInLoop([this, handle, payload = std::move(payload)] {
+        if (TcpConnectionPtr conn = findInLoop(handle)) {
+            conn->send(payload);
+        }
+    });
+}
+
+void TcpServer::forEachConnection(const std::function<void(const TcpConnectionPtr &)> &cb) {
+    std::vector<TcpConnectionPtr> connections;
+    for (auto &shard: m_shards) {
+        connections.clear();
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            connections.reserve(shard->connections.size());
+            for (auto &item: shard->connections) {
+                connections.push_back(item.second);
+            }
+        }
+        for (auto &conn: connections) {
+            cb(conn);
+        }
+    }
+}
+
 TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
                      TcpServer::Option option)
+        : TcpServer(loop, listenAddr, nameArg, std::vector<int>(), option) {
+}
+
+TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
+                     const std::vector<int> &listenFds, TcpServer::Option option)
         : m_loop(loop),
+          m_listenAddr(listenAddr),
           m_ipPort(listenAddr.toIpPort()),
           m_name(nameArg),
-          m_acceptor(new Acceptor(loop, listenAddr, option == Option::kReusePort)),
+          m_connNamePrefix(std::make_shared<const std::string>(nameArg + "-" + m_ipPort + "#")),
+          m_localAddrKnown(listenAddr.isUnix() || (listenAddr.port() != 0 && !listenAddr.isAnyAddress())),
+          m_acceptorPerLoop(option == Option::kReusePortPerLoop),
+          m_adoptedListenFds(listenFds),
+          m_cpuSteering(false),
+          m_maxAcceptsPerEvent(32),
           m_threadPool(new ThreadPool(loop, nameArg)),
           m_connectionCallback(defaultConnectionCallback),
           m_messageCallback(defaultMessageCallback),
-          m_nextConnId(1) {
-
+          m_incomingCpuPlacement(false),
+          m_rebalanceInterval(0),
+          m_rebalanceHighWater(0.8),
+          m_rebalanceMargin(0.2),
+          m_started(0),
+          m_nextConnId(1),
+          m_numConnections(0),
+          m_shutdownState(ShutdownState::kRunning),
+          m_closeTimeout(0),
+          m_phaseStartUs(0),
+          m_phaseDeadlineUs(0),
+          m_phaseConnections(0) {
+    if (!m_acceptorPerLoop) {
+        if (m_adoptedListenFds.empty()) {
+            m_acceptor = std::make_unique<Acceptor>(loop, listenAddr, option == Option::kReusePort);
+        } else {
+            m_acceptor = std::make_unique<Acceptor>(loop, m_adoptedListenFds[0]);
+            for (size_t i = 1; i < m_adoptedListenFds.size(); ++i) {
+                ::close(m_adoptedListenFds[i]);
+            }
+            m_adoptedListenFds.clear();
+        }
+        m_acceptor->setNewConnectionCallback([this](int sockfd, const InetAddress &peerAddr) {
+            newConnection(sockfd, peerAddr);
+        });
+    }
 }
 
 TcpServer::~TcpServer() {
     m_loop->assertInLoopThread();
-    logi("TcpServer::~TcpServer [%s] destructing", m_name);
+    logi("TcpServer::~TcpServer [{}] destructing", m_name);
+    if (m_started && m_rebalanceInterval > 0) {
+        m_loop->cancel(m_rebalanceTimer);
+    }
+    if (m_shutdownState == ShutdownState::kStopped) {
+        return;
+    }
+    if (m_shutdownState != ShutdownState::kRunning) {
+        m_loop->cancel(m_shutdownTimer);
+    }
+    stopAccepting(true);
+    destroyConnections(true);
 
-    for (auto &item: m_connections) {
+    // Flush slot releases and sendTo() calls already queued on the loops,
+    // they refer to the shards.
+    CountDownLatch flushed(static_cast<int>(m_shards.size()));
+    for (auto &shard: m_shards) {
+        shard->loop->runInLoop([&flushed] { flushed.countDown(); });
+    }
+    flushed.wait();
+}
+
+// Acceptors belong to their loops, which are still running here.
+void TcpServer::stopAccepting(bool wait) {
+    m_loop->assertInLoopThread();
+    m_acceptor.reset();
+    for (auto &acceptor: m_loopAcceptors) {
+        EventLoop *loop = acceptor->ownerLoop();
+        if (loop == m_loop) {
+            acceptor.reset();
+        } else if (wait) {
+            CountDownLatch latch(1);
+            loop->runInLoop([&acceptor, &latch] {
+                acceptor.reset();
+                latch.countDown();
+            });
+            latch.wait();
+        } else {
+            std::shared_ptr<Acceptor> owned(std::move(acceptor));
+            loop->runInLoop([owned]() mutable { owned.reset(); });
+        }
+    }
+    m_loopAcceptors.clear();
+}
+
+void TcpServer::destroyConnections(bool wait) {
+    ConnectionMap connections;
+    for (auto &shard: m_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        connections.merge(shard->connections);
+    }
+    m_numConnections.fetch_sub(connections.size(), std::memory_order_relaxed);
+    // Waited for by a destructor, a close already being handled calls back
+    // into this.
+    std::shared_ptr<CountDownLatch> latch;
+    if (wait) {
+        latch = std::make_shared<CountDownLatch>(static_cast<int>(connections.size()));
+    }
+    for (auto &item: connections) {
         TcpConnectionPtr conn(item.second);
         item.second.reset();
-        conn->getLoop()->runInLoop([conn] { conn->connectDestroyed(); });
+        conn->getLoop()->runInLoop([conn, latch] {
+            conn->connectDestroyed();
+            if (latch) {
+                latch->countDown();
+            }
+        });
+    }
+    if (latch) {
+        latch->wait();
+    }
+}
+
+std::vector<int> TcpServer::listenFds() const {
+    m_loop->assertInLoopThread();
+    std::vector<int> fds;
+    if (m_acceptor) {
+        fds.push_back(m_acceptor->socket().fd());
+    }
+    for (auto &acceptor: m_loopAcceptors) {
+        fds.push_back(acceptor->socket().fd());
     }
+    return fds;
+}
+
+std::vector<int> TcpServer::detachIdleConnections() {
+    m_loop->assertInLoopThread();
+    std::mutex mutex;
+    std::vector<int> fds;
+    // Reading stops before the loop returns to poll, so whatever arrives
+    // later stays in the socket for the new owner.
+    visitInLoops([&mutex, &fds](const TcpConnectionPtr &conn) {
+        if (!conn->connected() || conn->hasPendingOutput() || conn->inputBuffer()->readableBytes() > 0) {
+            return false;
+        }
+        int fd = ::dup(conn->fd());
+        if (fd < 0) {
+            loge("TcpServer::detachIdleConnections dup");
+            return false;
+        }
+        conn->stopRead();
+        conn->forceClose();
+        std::lock_guard<std::mutex> lock(mutex);
+        fds.push_back(fd);
+        return true;
+    });
+    logi("TcpServer::detachIdleConnections [{}] - {} connections", m_name, fds.size());
+    return fds;
+}
+
+void TcpServer::adoptConnection(int sockfd) {
+    m_loop->assertInLoopThread();
+    assert(m_started);
+    struct sockaddr_storage peer{};
+    socklen_t len = sizeof peer;
+    if (::getpeername(sockfd, reinterpret_cast<struct sockaddr *>(&peer), &len) < 0) {
+        loge("TcpServer::adoptConnection getpeername");
+        ::close(sockfd);
+        return;
+    }
+    int flags = ::fcntl(sockfd, F_GETFL);
+    ::fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+    ::fcntl(sockfd, F_SETFD, FD_CLOEXEC);
+    newConnection(sockfd, InetAddress(reinterpret_cast<struct sockaddr *>(&peer), len));
+}
+
+size_t TcpServer::visitInLoops(const std::function<bool(const TcpConnectionPtr &)> &visit) {
+    std::atomic<size_t> hits(0);
+    CountDownLatch latch(static_cast<int>(m_shards.size()));
+    for (auto &shard: m_shards) {
+        ConnectionShard *current = shard.get();
+        current->loop->runInLoop([current, &visit, &hits, &latch] {
+            std::vector<TcpConnectionPtr> connections;
+            {
+                std::lock_guard<std::mutex> lock(current->mutex);
+                for (auto &item: current->connections) {
+                    connections.push_back(item.second);
+                }
+            }
+            for (auto &conn: connections) {
+                if (conn->getLoop()->isInLoopThread() && visit(conn)) {
+                    hits.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            latch.countDown();
+        });
+    }
+    latch.wait();
+    return hits.load();
+}
+
+void TcpServer::probeInLoops(std::function<bool(const TcpConnectionPtr &)> visit) {
+    m_loop->assertInLoopThread();
+    auto probe = std::make_shared<LoopProbe>(LoopProbe{m_shards.size(), 0});
+    m_probe = probe;
+    auto shared = std::make_shared<std::function<bool(const TcpConnectionPtr &)>>(std::move(visit));
+    EventLoop *base = m_loop;
+    for (auto &shard: m_shards) {
+        ConnectionShard *current = shard.get();
+        current->loop->runInLoop([base, current, shared, probe] {
+            std::vector<TcpConnectionPtr> connections;
+            {
+                std::lock_guard<std::mutex> lock(current->mutex);
+                for (auto &item: current->connections) {
+                    connections.push_back(item.second);
+                }
+            }
+            size_t hits = 0;
+            for (auto &conn: connections) {
+                if (conn->getLoop()->isInLoopThread() && (*shared)(conn)) {
+                    ++hits;
+                }
+            }
+            base->runInLoop([probe, hits] {
+                probe->hits += hits;
+                --probe->pending;
+            });
+        });
+    }
+}
+
+// Queued even in the loop thread: the caller may be handling an event of a
+// channel in the same poll result as an acceptor about to be destroyed.
+void TcpServer::shutdown(double drainTimeout, double closeTimeout, const ShutdownCallback &cb) {
+    m_loop->queueInLoop([this, drainTimeout, closeTimeout, cb] {
+        startShutdown(drainTimeout, closeTimeout, cb);
+    });
+}
+
+void TcpServer::startShutdown(double drainTimeout, double closeTimeout, const ShutdownCallback &cb) {
+    m_loop->assertInLoopThread();
+    if (!m_started || m_shutdownState != ShutdownState::kRunning) {
+        return;
+    }
+    logi("TcpServer::shutdown [{}] - {} connections", m_name, numConnections());
+    if (m_rebalanceInterval > 0) {
+        m_loop->cancel(m_rebalanceTimer);
+        m_rebalanceInterval = 0;
+    }
+    m_shutdownCallback = cb;
+    m_closeTimeout = closeTimeout;
+    m_phaseStartUs = Timestamp::now().microSecondsSinceEpoch();
+    m_phaseConnections = numConnections();
+    stopAccepting(false);
+    finishShutdownPhase("stop-accepting", false);
+
+    m_shutdownState = ShutdownState::kDraining;
+    m_phaseDeadlineUs = m_phaseStartUs + static_cast<int64_t>(drainTimeout * 1000 * 1000);
+    const double kShutdownTick = 0.01;
+    m_shutdownTimer = m_loop->runEvery(kShutdownTick, [this] { advanceShutdown(); });
+    probeInLoops([](const TcpConnectionPtr &conn) { return conn->hasPendingOutput(); });
+}
+
+// Every tick reads what the loops have reported and, where a phase needs
+// fresh counts, probes them again. It never waits for a loop, so the
+// deadlines hold even when one is stalled.
+void TcpServer::advanceShutdown() {
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    auto closeDeadline = [this, now] { return now + static_cast<int64_t>(m_closeTimeout * 1000 * 1000); };
+    const bool reported = m_probe->pending == 0;
+    switch (m_shutdownState) {
+        case ShutdownState::kDraining: {
+            bool busy = !reported || m_probe->hits > 0;
+            if (busy && now < m_phaseDeadlineUs) {
+                if (reported) {
+                    probeInLoops([](const TcpConnectionPtr &conn) { return conn->hasPendingOutput(); });
+                }
+                return;
+            }
+            finishShutdownPhase("drain", busy);
+            probeInLoops([](const TcpConnectionPtr &conn) {
+                if (!conn->connected() || conn->hasPendingOutput() || conn->inputBuffer()->readableBytes() > 0) {
+                    return false;
+                }
+                conn->shutdown();
+                return true;
+            });
+            m_shutdownState = ShutdownState::kClosingIdle;
+            m_phaseDeadlineUs = closeDeadline();
+            return;
+        }
+        case ShutdownState::kClosingIdle: {
+            // Done once as many connections closed as the loops half-closed.
+            bool closing = !reported || numConnections() + m_probe->hits > m_phaseConnections;
+            if (closing && now < m_phaseDeadlineUs) {
+                return;
+            }
+            finishShutdownPhase("close-idle", closing);
+            forEachConnection([](const TcpConnectionPtr &conn) { conn->forceClose(); });
+            m_shutdownState = ShutdownState::kForceClosing;
+            m_phaseDeadlineUs = closeDeadline();
+            return;
+        }
+        case ShutdownState::kForceClosing:
+            if (numConnections() > 0 && now < m_phaseDeadlineUs) {
+                return;
+            }
+            finishShutdownPhase("force-close", numConnections() > 0);
+            // Whatever is left, and the destruction of the closed ones that is
+            // still queued, runs before the probe reports.
+            destroyConnections(false);
+            probeInLoops([](const TcpConnectionPtr &) { return false; });
+            m_shutdownState = ShutdownState::kStopping;
+            return;
+        case ShutdownState::kStopping:
+            if (!reported) {
+                return;
+            }
+            m_loop->cancel(m_shutdownTimer);
+            m_threadPool->stop();
+            m_shutdownState = ShutdownState::kStopped;
+            finishShutdownPhase("join", false);
+            if (m_shutdownCallback) {
+                m_shutdownCallback(m_shutdownPhases);
+            }
+            return;
+        default:
+            return;
+    }
+}
+
+void TcpServer::finishShutdownPhase(const char *name, bool timedOut) {
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    size_t connections = numConnections();
+    m_shutdownPhases.push_back({name, now - m_phaseStartUs, m_phaseConnections, connections, timedOut});
+    logi("TcpServer::shutdown [{}] - {} took {}us, connections {} -> {}{}", m_name, name, now - m_phaseStartUs,
+         m_phaseConnections, connections, timedOut ? ", timed out" : "");
+    m_phaseStartUs = now;
+    m_phaseConnections = connections;
 }
 
 void TcpServer::setThreadNum(int numThreads) {
@@ -95,12 +538,164 @@ void TcpServer::setThreadNum(int numThreads) {
     m_threadPool->setThreadNum(numThreads);
 }
 
+void TcpServer::setThreadCpuSets(const std::vector<std::vector<int>> &cpuSets) {
+    m_threadPool->setCpuSets(cpuSets);
+}
+
+void TcpServer::setNumaLocalMemory(bool on) {
+    m_threadPool->setNumaLocalMemory(on);
+}
+
+void TcpServer::setPlacement(std::unique_ptr<LoopPlacement> placement) {
+    m_threadPool->setPlacement(std::move(placement));
+}
+
+void TcpServer::setRebalancing(double interval, double highWater, double margin) {
+    m_rebalanceInterval = interval;
+    m_rebalanceHighWater = highWater;
+    m_rebalanceMargin = margin;
+}
+
+void TcpServer::rebalance() {
+    m_loop->assertInLoopThread();
+    std::vector<EventLoop *> loops = m_threadPool->getAllLoops();
+    if (loops.size() < 2) {
+        return;
+    }
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    EventLoop *busiest = loops[0];
+    EventLoop *idlest = loops[0];
+    double busiestUtilization = busiest->load().utilization(now);
+    double idlestUtilization = busiestUtilization;
+    for (auto *loop: loops) {
+        double utilization = loop->load().utilization(now);
+        if (utilization > busiestUtilization) {
+            busiest = loop;
+            busiestUtilization = utilization;
+        }
+        if (utilization < idlestUtilization) {
+            idlest = loop;
+            idlestUtilization = utilization;
+        }
+    }
+
+    std::unordered_map<uint64_t, uint64_t> marks;
+    std::vector<std::pair<uint64_t, TcpConnectionPtr>> candidates;
+    uint64_t total = 0;
+    ConnectionShard *hot = &shardOf(busiest);
+    for (auto &shard: m_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (auto &item: shard->connections) {
+            uint64_t bytes = item.second->bytesTransferred();
+            auto it = m_trafficMarks.find(item.first);
+            uint64_t recent = bytes - (it == m_trafficMarks.end() ? 0 : it->second);
+            marks.emplace(item.first, bytes);
+            if (shard.get() == hot && recent > 0) {
+                candidates.emplace_back(recent, item.second);
+                total += recent;
+            }
+        }
+    }
+    m_trafficMarks.swap(marks);
+
+    double gap = busiestUtilization - idlestUtilization;
+    if (busiestUtilization < m_rebalanceHighWater || gap < m_rebalanceMargin || total == 0) {
+        return;
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.first > rhs.first;
+    });
+    // Move about half the gap. A connection hotter than the gap would just
+    // move the hot spot, so it stays.
+    const int kMaxMigrationsPerRound = 8;
+    double moved = 0;
+    int migrations = 0;
+    for (auto &candidate: candidates) {
+        if (moved >= gap / 2 || migrations == kMaxMigrationsPerRound) {
+            break;
+        }
+        double share = busiestUtilization * static_cast<double>(candidate.first) / static_cast<double>(total);
+        if (share >= gap) {
+            continue;
+        }
+        logi("TcpServer::rebalance [{}] - migrate {} ({:.2f} of {:.2f}) to a loop at {:.2f}",
+             m_name, candidate.second->getName(), share, busiestUtilization, idlestUtilization);
+        candidate.second->migrateTo(idlest);
+        moved += share;
+        ++migrations;
+    }
+}
+
 void TcpServer::start() {
     if (m_started.exchange(1) == 0) {
         m_threadPool->start(m_threadInitCallback);
+        std::vector<EventLoop *> loops = m_threadPool->getAllLoops();
+        assert(loops.size() <= ConnectionHandle::kMaxLoops);
+        for (auto *loop: loops) {
+            m_shards.emplace_back(new ConnectionShard(loop, static_cast<uint32_t>(m_shards.size())));
+            m_shardOfLoop.emplace(loop, m_shards.back().get());
+        }
+        if (m_rebalanceInterval > 0) {
+            m_rebalanceTimer = m_loop->runEvery(m_rebalanceInterval, [this] { rebalance(); });
+        }
 
-        assert(!m_acceptor->listening());
-        m_loop->runInLoop([this] { m_acceptor->listen(); });
+        if (m_acceptorPerLoop) {
+            startLoopAcceptors();
+        } else {
+            assert(!m_acceptor->listening());
+            m_acceptor->setMaxAcceptsPerEvent(m_maxAcceptsPerEvent);
+            m_loop->runInLoop([this] { m_acceptor->listen(); });
+        }
+    }
+}
+
+InetAddress TcpServer::localAddress() const {
+    if (m_acceptor) {
+        return getLocalAddr(m_acceptor->socket().fd());
+    }
+    assert(!m_loopAcceptors.empty());
+    return getLocalAddr(m_loopAcceptors.front()->socket().fd());
+}
+
+void TcpServer::startLoopAcceptors() {
+    m_loop->assertInLoopThread();
+    std::vector<EventLoop *> loops = m_threadPool->getAllLoops();
+    // The first member resolves port 0, the others join the group it made.
+    InetAddress bindAddr = m_listenAddr;
+    for (size_t i = 0; i < loops.size(); ++i) {
+        EventLoop *loop = loops[i];
+        if (i < m_adoptedListenFds.size()) {
+            m_loopAcceptors.emplace_back(new Acceptor(loop, m_adoptedListenFds[i]));
+        } else {
+            m_loopAcceptors.emplace_back(new Acceptor(loop, bindAddr, true));
+        }
+        if (i == 0 && !bindAddr.isUnix() && bindAddr.port() == 0) {
+            bindAddr = getLocalAddr(m_loopAcceptors.front()->socket().fd());
+        }
+        m_loopAcceptors.back()->setMaxAcceptsPerEvent(m_maxAcceptsPerEvent);
+        m_loopAcceptors.back()->setNewConnectionCallback([this, loop](int sockfd, const InetAddress &peerAddr) {
+            establishConnection(loop, sockfd, peerAddr);
+        });
+    }
+    for (size_t i = loops.size(); i < m_adoptedListenFds.size(); ++i) {
+        ::close(m_adoptedListenFds[i]);
+    }
+    m_adoptedListenFds.clear();
+    // The kernel numbers the reuseport group in listen() order, which the
+    // steering program relies on, so listen one loop at a time. Adopted
+    // sockets keep the places they had.
+    for (auto &acceptor: m_loopAcceptors) {
+        CountDownLatch latch(1);
+        Acceptor *listening = acceptor.get();
+        listening->ownerLoop()->runInLoop([listening, &latch] {
+            listening->listen();
+            latch.countDown();
+        });
+        latch.wait();
+    }
+    if (m_cpuSteering && !m_loopAcceptors.empty()) {
+        m_loopAcceptors.front()->socket().attachReusePortCpuSteering(m_threadPool->cpuToLoop(),
+                                                                     static_cast<int>(m_loopAcceptors.size()));
     }
 }
 
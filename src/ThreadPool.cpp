@@ -1,6 +1,9 @@
 #include "src/include/ThreadPool.h"
 #include "src/include/EventLoop.h"
 #include "src/include/EventLoopThread.h"
+#include "src/include/LoopLoad.h"
+#include "src/include/LoopPlacement.h"
+#include "base/include/Timestamp.h"
 
 using namespace faliks;
 using namespace std;
@@ -10,7 +13,8 @@ ThreadPool::ThreadPool(EventLoop *baseLoop, const string &nameArg) :
         m_name(nameArg),
         m_started(false),
         m_numThreads(0),
-        m_next(0) {
+        m_next(0),
+        m_numaLocalMemory(false) {
 
 }
 
@@ -18,6 +22,10 @@ ThreadPool::~ThreadPool() {
 
 }
 
+void ThreadPool::setPlacement(std::unique_ptr<LoopPlacement> placement) {
+    m_placement = std::move(placement);
+}
+
 void ThreadPool::start(const ThreadInitCallback &cb) {
     assert(!m_started);
     m_baseLoop->assertInLoopThread();
@@ -28,14 +36,39 @@ void ThreadPool::start(const ThreadInitCallback &cb) {
         char buf[m_name.size() + 32];
         snprintf(buf, sizeof buf, "%s%d", m_name.c_str(), i);
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        if (!m_cpuSets.empty()) {
+            const std::vector<int> &cpus = m_cpuSets[i % m_cpuSets.size()];
+            t->setCpuAffinity(cpus, m_numaLocalMemory);
+            for (int cpu: cpus) {
+                if (cpu < 0) {
+                    continue;
+                }
+                if (static_cast<size_t>(cpu) >= m_cpuToLoop.size()) {
+                    m_cpuToLoop.resize(cpu + 1, -1);
+                }
+                if (m_cpuToLoop[cpu] < 0) {
+                    m_cpuToLoop[cpu] = i;
+                }
+            }
+        }
         m_threads.push_back(std::unique_ptr<EventLoopThread>(t));
         m_loops.push_back(t->startLoop());
+        m_loads.push_back(&m_loops.back()->load());
     }
     if (m_numThreads == 0 && cb) {
         cb(m_baseLoop);
     }
 }
 
+void ThreadPool::stop() {
+    m_baseLoop->assertInLoopThread();
+    m_loads.clear();
+    m_loops.clear();
+    m_cpuToLoop.clear();
+    m_next = 0;
+    m_threads.clear();
+}
+
 EventLoop *ThreadPool::getNextLoop() {
     m_baseLoop->assertInLoopThread();
     assert(m_started);
@@ -61,6 +94,25 @@ EventLoop *ThreadPool::getLoopForHash(size_t hashCode) {
     return loop;
 }
 
+EventLoop *ThreadPool::getLoopForPeer(const InetAddress &peerAddr) {
+    m_baseLoop->assertInLoopThread();
+    assert(m_started);
+    if (!m_placement || m_loops.empty()) {
+        return getNextLoop();
+    }
+    size_t index = m_placement->select(m_loads, peerAddr, Timestamp::now().microSecondsSinceEpoch());
+    assert(index < m_loops.size());
+    return m_loops[index];
+}
+
+EventLoop *ThreadPool::getLoopForCpu(int cpu) {
+    m_baseLoop->assertInLoopThread();
+    if (cpu >= 0 && static_cast<size_t>(cpu) < m_cpuToLoop.size() && m_cpuToLoop[cpu] >= 0) {
+        return m_loops[m_cpuToLoop[cpu]];
+    }
+    return getNextLoop();
+}
+
 std::vector<EventLoop *> ThreadPool::getAllLoops() {
     m_baseLoop->assertInLoopThread();
     assert(m_started);
@@ -2,6 +2,7 @@
 #include "src/include/EventLoop.h"
 #include "src/include/Timer.h"
 #include "src/include/Channel.h"
+#include "src/include/LoopMetrics.h"
 #include "base/include/fmtlog.h"
 
 #include <sys/timerfd.h>
@@ -79,10 +80,10 @@ namespace faliks {
         return earliestChanged;
     }
 
-    void TimerQueue::cancelInLoop(Timer *timer) {
+    void TimerQueue::cancelInLoop(TimerId timerId) {
         m_loop->assertInLoopThread();
         assert(m_timers.size() == m_activeTimers.size());
-        ActiveTimer timer1(timer, timer->sequence());
+        ActiveTimer timer1(timerId.m_timer, timerId.m_sequence);
         auto it = m_activeTimers.find(timer1);
         if (it != m_activeTimers.end()) {
             size_t n = m_timers.erase(Entry(it->first->expiration(), it->first));
@@ -104,6 +105,12 @@ namespace faliks {
         m_callingExpiredTimers = true;
         m_cancelingTimers.clear();
 
+        if (m_loop->metricsEnabled()) {
+            for (const auto &it: expired) {
+                m_loop->metrics().recordTimerLateness(now.microSecondsSinceEpoch() -
+                                                      it.first.microSecondsSinceEpoch());
+            }
+        }
         for (const auto &it: expired) {
             it.second->run();
         }
@@ -159,6 +166,8 @@ namespace faliks {
               m_timers(),
               m_callingExpiredTimers(false) {
         m_timerFdChannel.setReadCallback([this](Timestamp) { handleRead(); });
+        m_timerFdChannel.setHighPriority(true);
+        m_timerFdChannel.setType(Channel::Type::kTimer);
         m_timerFdChannel.enableReading();
     }
 
@@ -174,12 +183,12 @@ namespace faliks {
 
     TimerId TimerQueue::addTimer(std::function<void()> cb, Timestamp when, double interval) {
         auto timer = new Timer(std::move(cb), when, interval);
-        m_loop->runInLoop([this, timer]() { addTimerInLoop(timer); });
+        m_loop->runInLoop([this, timer]() { addTimerInLoop(timer); }, EventLoop::Priority::kHigh);
         return {timer, timer->sequence()};
     }
 
     void TimerQueue::cancel(TimerId timerId) {
-        m_loop->runInLoop([this, timerId]() { cancelInLoop(timerId.m_timer); });
+        m_loop->runInLoop([this, timerId]() { cancelInLoop(timerId); }, EventLoop::Priority::kHigh);
     }
 
 
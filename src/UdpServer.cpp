@@ -0,0 +1,90 @@
+#include "src/include/UdpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/ThreadPool.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/fmtlog.h"
+
+#include <cassert>
+
+using namespace faliks;
+
+namespace {
+    void runAndWait(EventLoop *loop, const std::function<void()> &cb) {
+        if (loop->isInLoopThread()) {
+            cb();
+            return;
+        }
+        CountDownLatch latch(1);
+        loop->runInLoop([&cb, &latch] {
+            cb();
+            latch.countDown();
+        });
+        latch.wait();
+    }
+}
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg, Option option)
+        : m_loop(loop),
+          m_listenAddr(listenAddr),
+          m_name(nameArg),
+          m_socketPerLoop(option == Option::kReusePortPerLoop),
+          m_threadPool(std::make_shared<ThreadPool>(loop, nameArg)),
+          m_receiveBatch(16),
+          m_gro(true),
+          m_gso(true),
+          m_started(false) {
+}
+
+UdpServer::~UdpServer() {
+    m_loop->assertInLoopThread();
+    logd("UdpServer::~UdpServer [{}] destructing", m_name);
+    for (auto &socket: m_sockets) {
+        runAndWait(socket->getLoop(), [&socket] { socket.reset(); });
+    }
+}
+
+void UdpServer::setThreadNum(int numThreads) {
+    assert(numThreads >= 0);
+    m_threadPool->setThreadNum(numThreads);
+}
+
+void UdpServer::start() {
+    m_loop->assertInLoopThread();
+    if (m_started) {
+        return;
+    }
+    m_started = true;
+    m_threadPool->start(m_threadInitCallback);
+    std::vector<EventLoop *> loops = m_socketPerLoop ? m_threadPool->getAllLoops() : std::vector<EventLoop *>{m_loop};
+    m_sockets.resize(loops.size());
+    // One at a time, so the sockets join the reuseport group in loop order.
+    for (size_t i = 0; i < loops.size(); ++i) {
+        EventLoop *loop = loops[i];
+        std::unique_ptr<UdpSocket> &socket = m_sockets[i];
+        runAndWait(loop, [this, loop, &socket] {
+            socket = std::make_unique<UdpSocket>(loop, m_listenAddr, m_socketPerLoop);
+            socket->setReceiveBatch(m_receiveBatch);
+            socket->setGro(m_gro);
+            socket->setGso(m_gso && socket->gsoEnabled());
+            socket->setMessageCallback(m_messageCallback);
+        });
+    }
+    logi("UdpServer::start [{}] - {} sockets on {}, gro = {} gso = {}", m_name, m_sockets.size(),
+         m_listenAddr.toIpPort(), m_sockets.front()->groEnabled(), m_sockets.front()->gsoEnabled());
+}
+
+uint64_t UdpServer::packetsReceived() const {
+    uint64_t total = 0;
+    for (const auto &socket: m_sockets) {
+        total += socket->packetsReceived();
+    }
+    return total;
+}
+
+uint64_t UdpServer::packetsSent() const {
+    uint64_t total = 0;
+    for (const auto &socket: m_sockets) {
+        total += socket->packetsSent();
+    }
+    return total;
+}
@@ -0,0 +1,312 @@
+#include "src/include/UdpSocket.h"
+#include "src/include/Channel.h"
+#include "src/include/EventLoop.h"
+#include "base/include/fmtlog.h"
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+using namespace faliks;
+
+namespace {
+    const int kMaxReadRounds = 4;
+    const size_t kGroControlSize = CMSG_SPACE(sizeof(int));
+    const size_t kGsoControlSize = CMSG_SPACE(sizeof(uint16_t));
+
+    int createUdpSocket(sa_family_t family) {
+        int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+        if (sockfd < 0) {
+            loge("UdpSocket socket error: {}", strerror(errno));
+        }
+        return sockfd;
+    }
+
+    bool gsoSupported(int sockfd) {
+        int size = 0;
+        socklen_t len = sizeof size;
+        return ::getsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &size, &len) == 0;
+    }
+
+    bool samePeer(const InetAddress &a, const InetAddress &b) {
+        return a.getSockLen() == b.getSockLen() && memcmp(a.getSockAddr(), b.getSockAddr(), a.getSockLen()) == 0;
+    }
+}
+
+UdpSocket::UdpSocket(EventLoop *loop, const InetAddress &bindAddr, bool reuseport)
+        : m_loop(loop),
+          m_socket(createUdpSocket(bindAddr.family())),
+          m_channel(std::make_unique<Channel>(loop, m_socket.fd())),
+          m_gro(false),
+          m_gso(gsoSupported(m_socket.fd())),
+          m_receiveBatch(16),
+          m_maxDatagramSize(2048),
+          m_bufferSize(0),
+          m_pendingHead(0),
+          m_maxPending(65536),
+          m_flushQueued(false),
+          m_sendMsgs(kMaxSendBatch),
+          m_sendIovecs(kMaxSendBatch * kMaxSegments),
+          m_sendControl(kMaxSendBatch * kGsoControlSize),
+          m_packetsReceived(0),
+          m_packetsSent(0),
+          m_receiveCalls(0),
+          m_sendCalls(0),
+          m_drops(0),
+          m_alive(std::make_shared<char>()) {
+    if (reuseport) {
+        m_socket.setReusePort(true);
+    }
+    m_socket.bindAddress(bindAddr);
+    setGro(true);
+    m_channel->setReadCallback([this](Timestamp receiveTime) { handleRead(receiveTime); });
+    m_channel->setWriteCallback([this] { handleWrite(); });
+    m_channel->enableReading();
+    logd("UdpSocket fd = {} bound to {} gro = {} gso = {}", m_socket.fd(), bindAddr.toIpPort(), m_gro, m_gso);
+}
+
+UdpSocket::~UdpSocket() {
+    m_loop->assertInLoopThread();
+    m_channel->disableAll();
+    m_channel->remove();
+}
+
+InetAddress UdpSocket::localAddress() const {
+    struct sockaddr_storage addr{};
+    socklen_t len = sizeof addr;
+    if (::getsockname(m_socket.fd(), reinterpret_cast<struct sockaddr *>(&addr), &len) < 0) {
+        loge("UdpSocket::localAddress");
+    }
+    return InetAddress(reinterpret_cast<struct sockaddr *>(&addr), len);
+}
+
+void UdpSocket::setReceiveBatch(size_t batch) {
+    m_receiveBatch = std::max<size_t>(batch, 1);
+    allocateReceiveBuffers();
+}
+
+void UdpSocket::setMaxDatagramSize(size_t size) {
+    m_maxDatagramSize = size;
+    allocateReceiveBuffers();
+}
+
+void UdpSocket::setGro(bool on) {
+    int optval = on ? 1 : 0;
+    bool ok = ::setsockopt(m_socket.fd(), SOL_UDP, UDP_GRO, &optval, sizeof optval) == 0;
+    m_gro = on && ok;
+    allocateReceiveBuffers();
+}
+
+void UdpSocket::allocateReceiveBuffers() {
+    m_bufferSize = m_gro ? kGroBufferSize : m_maxDatagramSize;
+    m_recvBuffers.assign(m_receiveBatch * m_bufferSize, 0);
+    m_recvMsgs.assign(m_receiveBatch, mmsghdr{});
+    m_recvIovecs.assign(m_receiveBatch, iovec{});
+    m_recvAddrs.assign(m_receiveBatch, sockaddr_storage{});
+    m_recvControl.assign(m_receiveBatch * kGroControlSize, 0);
+    for (size_t i = 0; i < m_receiveBatch; ++i) {
+        m_recvIovecs[i].iov_base = &m_recvBuffers[i * m_bufferSize];
+        m_recvIovecs[i].iov_len = m_bufferSize;
+        struct msghdr &hdr = m_recvMsgs[i].msg_hdr;
+        hdr.msg_iov = &m_recvIovecs[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_name = &m_recvAddrs[i];
+        hdr.msg_control = &m_recvControl[i * kGroControlSize];
+    }
+}
+
+void UdpSocket::handleRead(Timestamp receiveTime) {
+    m_loop->assertInLoopThread();
+    for (int round = 0; round < kMaxReadRounds; ++round) {
+        for (auto &msg: m_recvMsgs) {
+            msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+            msg.msg_hdr.msg_controllen = kGroControlSize;
+            msg.msg_hdr.msg_flags = 0;
+        }
+        int n = ::recvmmsg(m_socket.fd(), m_recvMsgs.data(), static_cast<unsigned int>(m_receiveBatch), 0, nullptr);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                loge("UdpSocket::handleRead - {}", strerror(errno));
+            }
+            return;
+        }
+        addCounter(m_receiveCalls, 1);
+        uint64_t received = 0;
+        for (int i = 0; i < n; ++i) {
+            struct msghdr &hdr = m_recvMsgs[i].msg_hdr;
+            size_t len = m_recvMsgs[i].msg_len;
+            if (hdr.msg_flags & MSG_TRUNC) {
+                addCounter(m_drops, 1);
+                continue;
+            }
+            size_t segment = len;
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int gsoSize;
+                    memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof gsoSize);
+                    segment = gsoSize > 0 ? static_cast<size_t>(gsoSize) : len;
+                }
+            }
+            InetAddress peer(reinterpret_cast<struct sockaddr *>(&m_recvAddrs[i]), hdr.msg_namelen);
+            const char *data = &m_recvBuffers[i * m_bufferSize];
+            size_t offset = 0;
+            do {
+                size_t datagram = std::min(segment, len - offset);
+                ++received;
+                if (m_messageCallback) {
+                    m_messageCallback(this, data + offset, datagram, peer, receiveTime);
+                }
+                offset += datagram;
+            } while (offset < len);
+        }
+        addCounter(m_packetsReceived, received);
+        if (static_cast<size_t>(n) < m_receiveBatch) {
+            return;
+        }
+    }
+}
+
+void UdpSocket::handleWrite() {
+    flush();
+}
+
+void UdpSocket::send(const InetAddress &peer, const void *data, size_t len) {
+    if (m_loop->isInLoopThread()) {
+        sendInLoop(peer, data, len);
+    } else {
+        std::weak_ptr<void> alive(m_alive);
+        m_loop->runInLoop([this, alive, peer, message = std::string(static_cast<const char *>(data), len)] {
+            if (alive.lock()) {
+                sendInLoop(peer, message.data(), message.size());
+            }
+        });
+    }
+}
+
+void UdpSocket::sendInLoop(const InetAddress &peer, const void *data, size_t len) {
+    if (m_pending.size() - m_pendingHead >= m_maxPending) {
+        addCounter(m_drops, 1);
+        return;
+    }
+    m_pending.push_back({peer, m_sendData.size(), len});
+    m_sendData.append(static_cast<const char *>(data), len);
+    // Everything sent during this iteration leaves together; a socket
+    // waiting for EPOLLOUT flushes then.
+    if (!m_flushQueued && !m_channel->isWriting()) {
+        m_flushQueued = true;
+        std::weak_ptr<void> alive(m_alive);
+        m_loop->queueInLoop([this, alive] {
+            if (alive.lock()) {
+                m_flushQueued = false;
+                flush();
+            }
+        });
+    }
+}
+
+void UdpSocket::flush() {
+    m_loop->assertInLoopThread();
+    while (m_pendingHead < m_pending.size()) {
+        size_t count = buildSendBatch();
+        int n = ::sendmmsg(m_socket.fd(), m_sendMsgs.data(), static_cast<unsigned int>(count), 0);
+        if (n < 0) {
+            int savedErrno = errno;
+            if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) {
+                if (!m_channel->isWriting()) {
+                    m_channel->enableWriting();
+                }
+                return;
+            } else if (savedErrno == EINTR) {
+                continue;
+            } else if (m_sendSegments[0] > 1 &&
+                       (savedErrno == EIO || savedErrno == EINVAL || savedErrno == EMSGSIZE)) {
+                // The route's device cannot segment, or the segments exceed its MTU.
+                logw("UdpSocket::flush - turning GSO off: {}", strerror(savedErrno));
+                m_gso = false;
+                continue;
+            }
+            // Only the first message failed, e.g. an unreachable peer.
+            logd("UdpSocket::flush - dropping {} datagrams: {}", m_sendSegments[0], strerror(savedErrno));
+            m_pendingHead += m_sendSegments[0];
+            addCounter(m_drops, m_sendSegments[0]);
+            continue;
+        }
+        addCounter(m_sendCalls, 1);
+        size_t sent = 0;
+        for (int i = 0; i < n; ++i) {
+            sent += m_sendSegments[i];
+        }
+        m_pendingHead += sent;
+        addCounter(m_packetsSent, sent);
+    }
+    m_pending.clear();
+    m_pendingHead = 0;
+    m_sendData.clear();
+    if (m_channel->isWriting()) {
+        m_channel->disableWriting();
+    }
+}
+
+size_t UdpSocket::buildSendBatch() {
+    m_sendSegments.clear();
+    size_t messages = 0;
+    size_t iovecs = 0;
+    size_t i = m_pendingHead;
+    while (i < m_pending.size() && messages < kMaxSendBatch) {
+        const PendingDatagram &first = m_pending[i];
+        // A run of datagrams of the segment size to one peer, of which the
+        // last may be shorter.
+        size_t count = 1;
+        size_t bytes = first.len;
+        if (m_gso && first.len > 0) {
+            while (i + count < m_pending.size() && count < kMaxSegments) {
+                const PendingDatagram &next = m_pending[i + count];
+                if (next.len == 0 || next.len > first.len || bytes + next.len > kMaxGsoBytes ||
+                    !samePeer(next.peer, first.peer)) {
+                    break;
+                }
+                bytes += next.len;
+                ++count;
+                if (next.len < first.len) {
+                    break;
+                }
+            }
+        }
+        struct mmsghdr &msg = m_sendMsgs[messages];
+        memset(&msg, 0, sizeof msg);
+        msg.msg_hdr.msg_name = const_cast<struct sockaddr *>(first.peer.getSockAddr());
+        msg.msg_hdr.msg_namelen = first.peer.getSockLen();
+        msg.msg_hdr.msg_iov = &m_sendIovecs[iovecs];
+        msg.msg_hdr.msg_iovlen = count;
+        for (size_t k = 0; k < count; ++k) {
+            const PendingDatagram &datagram = m_pending[i + k];
+            m_sendIovecs[iovecs].iov_base = &m_sendData[datagram.offset];
+            m_sendIovecs[iovecs].iov_len = datagram.len;
+            ++iovecs;
+        }
+        if (count > 1) {
+            msg.msg_hdr.msg_control = &m_sendControl[messages * kGsoControlSize];
+            msg.msg_hdr.msg_controllen = kGsoControlSize;
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            auto segmentSize = static_cast<uint16_t>(first.len);
+            memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof segmentSize);
+        }
+        m_sendSegments.push_back(count);
+        ++messages;
+        i += count;
+    }
+    return messages;
+}
@@ -0,0 +1,317 @@
+#include "src/include/WebSocketCodec.h"
+#include "src/include/Buffer.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+
+#include <immintrin.h>
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace faliks;
+
+namespace {
+    const char kAcceptGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+    uint32_t rotateLeft(uint32_t x, int n) {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    // SHA-1 of data, only needed for the handshake.
+    void sha1(std::string_view data, unsigned char digest[20]) {
+        uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+        std::string message(data);
+        uint64_t bitLen = static_cast<uint64_t>(data.size()) * 8;
+        message.push_back(static_cast<char>(0x80));
+        while (message.size() % 64 != 56) {
+            message.push_back('\0');
+        }
+        for (int i = 7; i >= 0; --i) {
+            message.push_back(static_cast<char>(bitLen >> (i * 8)));
+        }
+        for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+            uint32_t w[80];
+            for (int i = 0; i < 16; ++i) {
+                const auto *p = reinterpret_cast<const unsigned char *>(message.data() + chunk + i * 4);
+                w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+            }
+            for (int i = 16; i < 80; ++i) {
+                w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int i = 0; i < 80; ++i) {
+                uint32_t f, k;
+                if (i < 20) {
+                    f = (b & c) | (~b & d);
+                    k = 0x5A827999;
+                } else if (i < 40) {
+                    f = b ^ c ^ d;
+                    k = 0x6ED9EBA1;
+                } else if (i < 60) {
+                    f = (b & c) | (b & d) | (c & d);
+                    k = 0x8F1BBCDC;
+                } else {
+                    f = b ^ c ^ d;
+                    k = 0xCA62C1D6;
+                }
+                uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = rotateLeft(b, 30);
+                b = a;
+                a = temp;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+        for (int i = 0; i < 5; ++i) {
+            digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+            digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+            digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+            digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+        }
+    }
+
+    std::string base64(const unsigned char *data, size_t len) {
+        static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        for (size_t i = 0; i < len; i += 3) {
+            uint32_t group = uint32_t(data[i]) << 16;
+            if (i + 1 < len) {
+                group |= uint32_t(data[i + 1]) << 8;
+            }
+            if (i + 2 < len) {
+                group |= data[i + 2];
+            }
+            out.push_back(kAlphabet[(group >> 18) & 63]);
+            out.push_back(kAlphabet[(group >> 12) & 63]);
+            out.push_back(i + 1 < len ? kAlphabet[(group >> 6) & 63] : '=');
+            out.push_back(i + 2 < len ? kAlphabet[group & 63] : '=');
+        }
+        return out;
+    }
+
+    // Returns the header length.
+    size_t encodeHeader(char *header, WebSocketCodec::Opcode opcode, size_t payloadLen, bool fin,
+                        const uint32_t *maskKey) {
+        header[0] = static_cast<char>((fin ? 0x80 : 0) | static_cast<uint8_t>(opcode));
+        char maskBit = maskKey ? static_cast<char>(0x80) : 0;
+        size_t len;
+        if (payloadLen < 126) {
+            header[1] = static_cast<char>(maskBit | payloadLen);
+            len = 2;
+        } else if (payloadLen <= 0xFFFF) {
+            header[1] = static_cast<char>(maskBit | 126);
+            header[2] = static_cast<char>(payloadLen >> 8);
+            header[3] = static_cast<char>(payloadLen);
+            len = 4;
+        } else {
+            header[1] = static_cast<char>(maskBit | 127);
+            for (int i = 0; i < 8; ++i) {
+                header[2 + i] = static_cast<char>(static_cast<uint64_t>(payloadLen) >> ((7 - i) * 8));
+            }
+            len = 10;
+        }
+        if (maskKey) {
+            memcpy(header + len, maskKey, 4);
+            len += 4;
+        }
+        return len;
+    }
+
+    bool isContinuation(unsigned char c) {
+        return (c & 0xC0) == 0x80;
+    }
+}
+
+int WebSocketCodec::decodeHeader(const char *data, size_t len, FrameHeader *header) {
+    if (len < 2) {
+        return 0;
+    }
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    header->fin = (p[0] & 0x80) != 0;
+    header->rsv = static_cast<uint8_t>((p[0] >> 4) & 0x7);
+    header->opcode = static_cast<Opcode>(p[0] & 0x0F);
+    header->masked = (p[1] & 0x80) != 0;
+    uint64_t payloadLen = p[1] & 0x7F;
+    size_t headerLen = 2;
+    if (payloadLen == 126) {
+        if (len < 4) {
+            return 0;
+        }
+        payloadLen = (uint64_t(p[2]) << 8) | p[3];
+        headerLen = 4;
+    } else if (payloadLen == 127) {
+        if (len < 10) {
+            return 0;
+        }
+        payloadLen = 0;
+        for (int i = 0; i < 8; ++i) {
+            payloadLen = (payloadLen << 8) | p[2 + i];
+        }
+        // The most significant bit must be 0.
+        if (payloadLen >> 63) {
+            return -1;
+        }
+        headerLen = 10;
+    }
+    if (header->masked) {
+        if (len < headerLen + 4) {
+            return 0;
+        }
+        memcpy(&header->maskKey, data + headerLen, 4);
+        headerLen += 4;
+    } else {
+        header->maskKey = 0;
+    }
+    header->payloadLen = payloadLen;
+    header->headerLen = headerLen;
+    return 1;
+}
+
+void WebSocketCodec::appendFrame(Buffer *buf, Opcode opcode, std::string_view payload, bool fin,
+                                 const uint32_t *maskKey) {
+    char header[kMaxHeaderBytes];
+    buf->append(header, encodeHeader(header, opcode, payload.size(), fin, maskKey));
+    buf->append(payload.data(), payload.size());
+    if (maskKey) {
+        unmask(buf->beginWrite() - payload.size(), payload.size(), *maskKey);
+    }
+}
+
+void WebSocketCodec::appendFrame(std::string *out, Opcode opcode, std::string_view payload, bool fin,
+                                 const uint32_t *maskKey) {
+    char header[kMaxHeaderBytes];
+    out->append(header, encodeHeader(header, opcode, payload.size(), fin, maskKey));
+    out->append(payload.data(), payload.size());
+    if (maskKey) {
+        unmask(&(*out)[out->size() - payload.size()], payload.size(), *maskKey);
+    }
+}
+
+// Every block is a multiple of four bytes, so the key stays aligned.
+void WebSocketCodec::unmask(char *data, size_t len, uint32_t maskKey) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i key256 = _mm256_set1_epi32(static_cast<int>(maskKey));
+    for (; i + 32 <= len; i += 32) {
+        auto *p = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), key256));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i key128 = _mm_set1_epi32(static_cast<int>(maskKey));
+    for (; i + 16 <= len; i += 16) {
+        auto *p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t key128 = vreinterpretq_u8_u32(vdupq_n_u32(maskKey));
+    for (; i + 16 <= len; i += 16) {
+        auto *p = reinterpret_cast<uint8_t *>(data + i);
+        vst1q_u8(p, veorq_u8(vld1q_u8(p), key128));
+    }
+#endif
+    const uint64_t key64 = (static_cast<uint64_t>(maskKey) << 32) | maskKey;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        word ^= key64;
+        memcpy(data + i, &word, 8);
+    }
+    const auto *key = reinterpret_cast<const unsigned char *>(&maskKey);
+    for (; i < len; ++i) {
+        data[i] = static_cast<char>(data[i] ^ key[i & 3]);
+    }
+}
+
+// ASCII runs are skipped 16 bytes at a time; the rest is checked against
+// the well-formed sequences of Unicode table 3-7.
+bool WebSocketCodec::isValidUtf8(const char *data, size_t len) {
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    size_t i = 0;
+    while (i < len) {
+#if defined(__SSE2__)
+        while (i + 16 <= len &&
+               _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i))) == 0) {
+            i += 16;
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        while (i + 16 <= len && vmaxvq_u8(vld1q_u8(p + i)) < 0x80) {
+            i += 16;
+        }
+#endif
+        while (i + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, p + i, 8);
+            if (word & 0x8080808080808080ULL) {
+                break;
+            }
+            i += 8;
+        }
+        if (i >= len) {
+            break;
+        }
+        unsigned char c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t n;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            if (c == 0xE0) {
+                low = 0xA0;
+            } else if (c == 0xED) {
+                high = 0x9F;
+            }
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            if (c == 0xF0) {
+                low = 0x90;
+            } else if (c == 0xF4) {
+                high = 0x8F;
+            }
+        } else {
+            return false;
+        }
+        if (i + n >= len) {
+            return false;
+        }
+        if (p[i + 1] < low || p[i + 1] > high) {
+            return false;
+        }
+        for (size_t k = 2; k <= n; ++k) {
+            if (!isContinuation(p[i + k])) {
+                return false;
+            }
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+bool WebSocketCodec::isValidCloseCode(uint16_t code) {
+    if (code >= 3000 && code <= 4999) {
+        return true;
+    }
+    return code >= 1000 && code <= 1011 && code != 1004 && code != 1005 && code != 1006;
+}
+
+std::string WebSocketCodec::acceptKey(std::string_view clientKey) {
+    std::string input(clientKey);
+    input += kAcceptGuid;
+    unsigned char digest[20];
+    sha1(input, digest);
+    return base64(digest, sizeof digest);
+}
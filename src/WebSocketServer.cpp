@@ -0,0 +1,319 @@
+#include "src/include/WebSocketServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/TcpConnection.h"
+#include "src/include/ThreadPool.h"
+#include "base/include/fmtlog.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace faliks;
+
+namespace {
+    using Opcode = WebSocketCodec::Opcode;
+
+    const uint16_t kProtocolError = 1002;
+    const uint16_t kInvalidPayload = 1007;
+    const uint16_t kMessageTooBig = 1009;
+
+    void appendCloseFrame(Buffer *buf, uint16_t code, std::string_view reason) {
+        char payload[125];
+        payload[0] = static_cast<char>(code >> 8);
+        payload[1] = static_cast<char>(code);
+        size_t len = std::min(reason.size(), sizeof payload - 2);
+        memcpy(payload + 2, reason.data(), len);
+        WebSocketCodec::appendFrame(buf, Opcode::kClose, std::string_view(payload, len + 2));
+    }
+}
+
+struct WebSocketConnection::LoopConnections {
+    // Set once the loops exist; only broadcast() reads it.
+    EventLoop *loop = nullptr;
+    std::mutex mutex;
+    std::vector<WebSocketConnection *> connections GUARDED_BY(mutex);
+};
+
+WebSocketConnection::WebSocketConnection(const std::shared_ptr<TcpConnection> &conn)
+        : m_conn(conn),
+          m_rawConn(conn.get()),
+          m_registry(nullptr),
+          m_index(0),
+          m_messageOpcode(Opcode::kText),
+          m_fragmented(false),
+          m_open(false),
+          m_closeSent(false) {
+}
+
+void WebSocketConnection::sendFrame(WebSocketCodec::Opcode opcode, std::string_view payload) {
+    std::shared_ptr<TcpConnection> conn = m_conn.lock();
+    if (!conn || m_closeSent.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (conn->getLoop()->isInLoopThread()) {
+        thread_local Buffer output;
+        WebSocketCodec::appendFrame(&output, opcode, payload);
+        conn->send(&output);
+    } else {
+        std::string frame;
+        WebSocketCodec::appendFrame(&frame, opcode, payload);
+        conn->send(frame);
+    }
+}
+
+void WebSocketConnection::close(uint16_t code, std::string_view reason) {
+    std::shared_ptr<TcpConnection> conn = m_conn.lock();
+    if (!conn || m_closeSent.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    Buffer output;
+    appendCloseFrame(&output, code, reason);
+    conn->send(&output);
+    conn->shutdown();
+}
+
+WebSocketServer::WebSocketServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                                 TcpServer::Option option)
+        : m_server(loop, listenAddr, name, option),
+          m_maxMessageBytes(16 * 1024 * 1024),
+          m_numConnections(0) {
+    m_server.setUpgradeCallback(
+            [this](const TcpConnectionPtr &conn, const HttpRequest &request, HttpResponse *response) {
+                onUpgrade(conn, request, response);
+            },
+            [this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+                onMessage(conn, buf, receiveTime);
+            },
+            [this](const TcpConnectionPtr &conn) {
+                onClose(conn);
+            });
+}
+
+WebSocketServer::~WebSocketServer() = default;
+
+void WebSocketServer::start() {
+    // Complete before any acceptor listens, since onUpgrade reads it from the IO loops.
+    std::shared_ptr<ThreadPool> pool = m_server.tcpServer()->threadPool();
+    m_loops.resize(static_cast<size_t>(std::max(pool->numThreads(), 1)));
+    for (auto &registry: m_loops) {
+        registry = std::make_unique<LoopConnections>();
+    }
+    m_server.start();
+    std::vector<EventLoop *> loops = pool->getAllLoops();
+    assert(loops.size() == m_loops.size());
+    for (size_t i = 0; i < loops.size(); ++i) {
+        m_loops[i]->loop = loops[i];
+    }
+}
+
+void WebSocketServer::onUpgrade(const TcpConnectionPtr &conn, const HttpRequest &request, HttpResponse *response) {
+    std::string_view key = request.header("Sec-WebSocket-Key");
+    if (request.method() != HttpRequest::Method::kGet || request.version() != HttpRequest::Version::kHttp11 ||
+        !headerListsToken(request.header("Upgrade"), "websocket") ||
+        !headerListsToken(request.header("Connection"), "Upgrade") || key.size() != 24) {
+        response->setStatus(400);
+        return;
+    }
+    if (request.header("Sec-WebSocket-Version") != "13") {
+        response->setStatus(426);
+        response->addHeader("Sec-WebSocket-Version", "13");
+        return;
+    }
+    if (m_handshakeCallback && !m_handshakeCallback(request)) {
+        response->setStatus(403);
+        return;
+    }
+    // The home shard, which stays put when the connection migrates.
+    size_t index = conn->handle().loopIndex();
+    if (index >= m_loops.size()) {
+        response->setStatus(503);
+        return;
+    }
+    response->setStatus(101);
+    response->addHeader("Upgrade", "websocket");
+    response->addHeader("Connection", "Upgrade");
+    response->addHeader("Sec-WebSocket-Accept", WebSocketCodec::acceptKey(key));
+
+    auto ws = std::make_shared<WebSocketConnection>(conn);
+    ws->m_registry = m_loops[index].get();
+    {
+        std::lock_guard<std::mutex> lock(ws->m_registry->mutex);
+        ws->m_index = ws->m_registry->connections.size();
+        ws->m_registry->connections.push_back(ws.get());
+    }
+    ws->m_open.store(true, std::memory_order_release);
+    m_numConnections.fetch_add(1, std::memory_order_relaxed);
+    conn->setContext(ws);
+    // After the 101, which is sent when this returns.
+    conn->getLoop()->queueInLoop([this, ws] {
+        if (ws->connected() && m_connectionCallback) {
+            m_connectionCallback(ws);
+        }
+    });
+}
+
+void WebSocketServer::onClose(const TcpConnectionPtr &conn) {
+    auto *holder = std::any_cast<WebSocketConnectionPtr>(conn->getMutableContext());
+    if (holder == nullptr) {
+        return;
+    }
+    WebSocketConnectionPtr ws = *holder;
+    {
+        std::lock_guard<std::mutex> lock(ws->m_registry->mutex);
+        auto &connections = ws->m_registry->connections;
+        connections[ws->m_index] = connections.back();
+        connections[ws->m_index]->m_index = ws->m_index;
+        connections.pop_back();
+    }
+    ws->m_open.store(false, std::memory_order_release);
+    m_numConnections.fetch_sub(1, std::memory_order_relaxed);
+    if (m_connectionCallback) {
+        m_connectionCallback(ws);
+    }
+    // The context holds ws, which refers back to conn only weakly.
+    conn->setContext(std::any());
+}
+
+void WebSocketServer::fail(const TcpConnectionPtr &conn, WebSocketConnection *ws, uint16_t code, Buffer *buf) {
+    logd("WebSocketServer::fail - {} closing with {}", conn->getName(), code);
+    buf->retrieveAll();
+    if (!ws->m_closeSent.exchange(true, std::memory_order_acq_rel)) {
+        thread_local Buffer output;
+        appendCloseFrame(&output, code, {});
+        conn->send(&output);
+    }
+    conn->shutdown();
+}
+
+void WebSocketServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+    auto *holder = std::any_cast<WebSocketConnectionPtr>(conn->getMutableContext());
+    // Past a close, input is only read to notice the peer going away.
+    if (holder == nullptr || !conn->connected()) {
+        buf->retrieveAll();
+        return;
+    }
+    WebSocketConnectionPtr ws = *holder;
+    while (buf->readableBytes() > 0 && conn->connected()) {
+        WebSocketCodec::FrameHeader header{};
+        int result = WebSocketCodec::decodeHeader(buf->peek(), buf->readableBytes(), &header);
+        if (result == 0) {
+            break;
+        }
+        auto opcode = static_cast<uint8_t>(header.opcode);
+        bool control = (opcode & 0x8) != 0;
+        // Clients mask every frame; control frames are short and whole.
+        if (result < 0 || header.rsv != 0 || !header.masked ||
+            (control && (!header.fin || header.payloadLen > 125 || opcode > 0xA)) || (!control && opcode > 0x2)) {
+            fail(conn, ws.get(), kProtocolError, buf);
+            return;
+        }
+        if (!control && (ws->m_fragments.size() + header.payloadLen > m_maxMessageBytes)) {
+            fail(conn, ws.get(), kMessageTooBig, buf);
+            return;
+        }
+        if (buf->readableBytes() - header.headerLen < header.payloadLen) {
+            break;
+        }
+        auto *payload = const_cast<char *>(buf->peek()) + header.headerLen;
+        auto len = static_cast<size_t>(header.payloadLen);
+        WebSocketCodec::unmask(payload, len, header.maskKey);
+        std::string_view data(payload, len);
+
+        if (header.opcode == Opcode::kPing) {
+            ws->sendFrame(Opcode::kPong, data);
+        } else if (header.opcode == Opcode::kClose) {
+            uint16_t code = 1000;
+            if (len == 1) {
+                fail(conn, ws.get(), kProtocolError, buf);
+                return;
+            }
+            if (len >= 2) {
+                code = static_cast<uint16_t>((static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]));
+                if (!WebSocketCodec::isValidCloseCode(code)) {
+                    fail(conn, ws.get(), kProtocolError, buf);
+                    return;
+                }
+                if (!WebSocketCodec::isValidUtf8(payload + 2, len - 2)) {
+                    fail(conn, ws.get(), kInvalidPayload, buf);
+                    return;
+                }
+            }
+            // Echo the code, or answer an empty close with an empty one.
+            if (!ws->m_closeSent.exchange(true, std::memory_order_acq_rel)) {
+                thread_local Buffer output;
+                if (len >= 2) {
+                    appendCloseFrame(&output, code, {});
+                } else {
+                    WebSocketCodec::appendFrame(&output, Opcode::kClose, {});
+                }
+                conn->send(&output);
+            }
+            buf->retrieveAll();
+            conn->shutdown();
+            return;
+        } else if (header.opcode == Opcode::kContinuation || !header.fin || ws->m_fragmented) {
+            if ((header.opcode == Opcode::kContinuation) != ws->m_fragmented) {
+                fail(conn, ws.get(), kProtocolError, buf);
+                return;
+            }
+            if (!ws->m_fragmented) {
+                ws->m_fragmented = true;
+                ws->m_messageOpcode = header.opcode;
+                ws->m_fragments.clear();
+            }
+            ws->m_fragments.append(data);
+            if (header.fin) {
+                ws->m_fragmented = false;
+                bool binary = ws->m_messageOpcode == Opcode::kBinary;
+                if (!binary && !WebSocketCodec::isValidUtf8(ws->m_fragments)) {
+                    fail(conn, ws.get(), kInvalidPayload, buf);
+                    return;
+                }
+                if (m_messageCallback) {
+                    m_messageCallback(ws, ws->m_fragments, binary);
+                }
+                ws->m_fragments.clear();
+            }
+        } else {
+            // A whole message in one frame is handed out in place.
+            bool binary = header.opcode == Opcode::kBinary;
+            if (!binary && !WebSocketCodec::isValidUtf8(data)) {
+                fail(conn, ws.get(), kInvalidPayload, buf);
+                return;
+            }
+            if (m_messageCallback) {
+                m_messageCallback(ws, data, binary);
+            }
+        }
+        buf->retrieve(header.headerLen + len);
+    }
+}
+
+void WebSocketServer::broadcast(std::string_view message, bool binary) {
+    auto frame = std::make_shared<std::string>();
+    WebSocketCodec::appendFrame(frame.get(), binary ? Opcode::kBinary : Opcode::kText, message);
+    std::shared_ptr<const std::string> shared = std::move(frame);
+    for (auto &entry: m_loops) {
+        LoopConnections *registry = entry.get();
+        registry->loop->runInLoop([this, registry, shared] {
+            broadcastInLoop(registry, shared);
+        });
+    }
+}
+
+void WebSocketServer::broadcastInLoop(LoopConnections *registry, const std::shared_ptr<const std::string> &frame) {
+    EventLoop *loop = registry->loop;
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    for (WebSocketConnection *ws: registry->connections) {
+        if (ws->m_closeSent.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        TcpConnection *conn = ws->m_rawConn;
+        if (conn->getLoop() == loop) {
+            conn->sendReferenced(nullptr, frame->data(), frame->size(), frame);
+        } else {
+            // Migrated since it opened.
+            conn->send(*frame);
+        }
+    }
+}
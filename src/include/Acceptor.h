@@ -20,12 +20,19 @@ namespace faliks {
         NewConnectionCallback m_newConnectionCallback;
         bool m_listening;
         int m_idleFd;
+        int m_maxAcceptsPerEvent;
 
         void handleRead();
 
+        void setupChannel();
+
     public:
         Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
 
+        // Adopts a socket that is already bound, and usually listening, e.g.
+        // one inherited from the process this one replaces. Takes ownership.
+        Acceptor(EventLoop *loop, int listenFd);
+
         ~Acceptor();
 
         void setNewConnectionCallback(const NewConnectionCallback &cb) {
@@ -34,7 +41,14 @@ namespace faliks {
 
         void listen();
 
+        // Connections drained per readiness event before returning to the loop.
+        void setMaxAcceptsPerEvent(int maxAccepts) { m_maxAcceptsPerEvent = maxAccepts > 0 ? maxAccepts : 1; }
+
         [[nodiscard]] bool listening() const { return m_listening; }
+
+        [[nodiscard]] const Socket &socket() const { return m_acceptSocket; }
+
+        [[nodiscard]] EventLoop *ownerLoop() const { return m_loop; }
     };
 }
 
@@ -13,6 +13,16 @@ namespace faliks {
     class EventLoop;
 
     class Channel : NoneCopyable {
+    public:
+        enum class Type : uint8_t {
+            kOther = 0,
+            kWakeup,
+            kTimer,
+            kAcceptor,
+            kConnection,
+            kNumTypes
+        };
+
     private:
         using EventCallback = std::function<void()>;
         using ReadEventCallback = std::function<void(Timestamp)>;
@@ -27,6 +37,8 @@ namespace faliks {
         int m_revents;
         int m_index;
         bool m_logHup;
+        bool m_highPriority;
+        Type m_type;
 
         std::weak_ptr<void> m_tie;
         bool m_tied;
@@ -101,8 +113,21 @@ namespace faliks {
 
         void doNotLogHup();
 
+        void setHighPriority(bool on) { m_highPriority = on; }
+
+        [[nodiscard]] bool highPriority() const { return m_highPriority; }
+
+        void setType(Type type) { m_type = type; }
+
+        [[nodiscard]] Type type() const { return m_type; }
+
+        static const char *typeToString(Type type);
+
         [[nodiscard]] EventLoop *ownerLoop() const;
 
+        // Rebinds a removed channel to another loop, the caller adds it there.
+        void setOwnerLoop(EventLoop *loop);
+
         void remove();
     };
 
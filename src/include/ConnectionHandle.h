@@ -0,0 +1,50 @@
+#ifndef MUDUO_LEARN_CONNECTIONHANDLE_H
+#define MUDUO_LEARN_CONNECTIONHANDLE_H
+
+#include "base/include/Copyable.h"
+
+#include <cstdint>
+
+namespace faliks {
+    // Names a connection of a TcpServer without owning it: the IO loop it was
+    // accepted on, a slot in that loop's table and the generation of the slot.
+    // A slot is reused once its connection closes, with a new generation, so a
+    // stale handle never reaches the next connection. See TcpServer::sendTo.
+    class ConnectionHandle : public Copyable {
+    private:
+        static const int kSlotBits = 24;
+        static const int kGenerationBits = 28;
+        uint64_t m_value;
+
+    public:
+        static const uint32_t kMaxLoops = 1u << (64 - kSlotBits - kGenerationBits);
+        static const uint32_t kMaxSlots = 1u << kSlotBits;
+        static const uint32_t kGenerationMask = (1u << kGenerationBits) - 1;
+
+        ConnectionHandle() : m_value(0) {}
+
+        // Rebuilds a handle from value(), e.g. one kept in an atomic.
+        explicit ConnectionHandle(uint64_t value) : m_value(value) {}
+
+        // Generations start at 1, so a default-constructed handle is invalid.
+        ConnectionHandle(uint32_t loopIndex, uint32_t slot, uint32_t generation)
+                : m_value((static_cast<uint64_t>(loopIndex) << (kSlotBits + kGenerationBits)) |
+                          (static_cast<uint64_t>(slot) << kGenerationBits) | (generation & kGenerationMask)) {}
+
+        [[nodiscard]] uint32_t loopIndex() const { return static_cast<uint32_t>(m_value >> (kSlotBits + kGenerationBits)); }
+
+        [[nodiscard]] uint32_t slot() const { return static_cast<uint32_t>(m_value >> kGenerationBits) & (kMaxSlots - 1); }
+
+        [[nodiscard]] uint32_t generation() const { return static_cast<uint32_t>(m_value) & kGenerationMask; }
+
+        [[nodiscard]] uint64_t value() const { return m_value; }
+
+        [[nodiscard]] bool valid() const { return generation() != 0; }
+
+        bool operator==(const ConnectionHandle &rhs) const { return m_value == rhs.m_value; }
+
+        bool operator!=(const ConnectionHandle &rhs) const { return m_value != rhs.m_value; }
+    };
+}
+
+#endif //MUDUO_LEARN_CONNECTIONHANDLE_H
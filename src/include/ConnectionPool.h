@@ -0,0 +1,111 @@
+#ifndef MUDUO_LEARN_CONNECTIONPOOL_H
+#define MUDUO_LEARN_CONNECTIONPOOL_H
+
+#include "src/include/TcpConnection.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace faliks {
+
+    class EventLoop;
+
+    class TcpClient;
+
+    // Connections from one loop to one backend, used entirely in that loop:
+    // no locks, and callers get connections served by their own thread.
+    // Connections are opened on demand up to maxConnections and reopened
+    // with backoff when they close. acquire() leases one exclusively; the
+    // caller may replace its message callback and gives it back with
+    // release(), which restores the pool's.
+    class ConnectionPool : NoneCopyable {
+    public:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+        using AcquireCallback = std::function<void(const TcpConnectionPtr &)>;
+        using MessageCallback = std::function<void(const TcpConnectionPtr &, Buffer *, Timestamp)>;
+
+    private:
+        EventLoop *m_loop;
+        const InetAddress m_backendAddr;
+        const std::string m_name;
+        const size_t m_maxConnections;
+        double m_initialRetryDelay;
+        double m_maxRetryDelay;
+        MessageCallback m_messageCallback;
+        std::vector<std::unique_ptr<TcpClient>> m_clients;
+        size_t m_numConnected;
+        std::vector<TcpConnectionPtr> m_idle;
+        std::deque<AcquireCallback> m_waiters;
+
+        void openConnection();
+
+        void onConnection(const TcpConnectionPtr &conn);
+
+        void serveWaiters();
+
+    public:
+        ConnectionPool(EventLoop *loop, const InetAddress &backendAddr, const std::string &nameArg,
+                       size_t maxConnections);
+
+        // Destroy in the loop thread; connections still leased are closed.
+        ~ConnectionPool();
+
+        // For idle connections and new ones, call before acquire().
+        void setMessageCallback(const MessageCallback &cb) { m_messageCallback = cb; }
+
+        // See Connector::setRetryDelays, call before acquire().
+        void setRetryDelays(double initialDelay, double maxDelay) {
+            m_initialRetryDelay = initialDelay;
+            m_maxRetryDelay = maxDelay;
+        }
+
+        // Calls cb with a connected connection, at once if one is idle,
+        // otherwise once one is released or opened. Waits as long as the
+        // backend is unreachable. Loop thread only.
+        void acquire(AcquireCallback cb);
+
+        // Returns a leased connection; a closed one is dropped. Loop thread only.
+        void release(const TcpConnectionPtr &conn);
+
+        [[nodiscard]] EventLoop *getLoop() const { return m_loop; }
+
+        // Connections open or being opened.
+        [[nodiscard]] size_t numConnections() const { return m_clients.size(); }
+
+        [[nodiscard]] size_t numIdle() const { return m_idle.size(); }
+
+        [[nodiscard]] size_t numWaiting() const { return m_waiters.size(); }
+    };
+
+    // A ConnectionPool in each of a set of loops, e.g. a TcpServer's IO loops,
+    // so a handler reaches the backend from its own loop without a hop to
+    // another thread. Configure before the loops use their pools.
+    class LoopConnectionPools : NoneCopyable {
+    private:
+        // Built in the constructor and read-only afterwards.
+        std::unordered_map<EventLoop *, std::unique_ptr<ConnectionPool>> m_pools;
+
+    public:
+        LoopConnectionPools(const std::vector<EventLoop *> &loops, const InetAddress &backendAddr,
+                            const std::string &nameArg, size_t maxConnectionsPerLoop);
+
+        // Destroys each pool in its loop and waits, so call it while the loops run.
+        ~LoopConnectionPools();
+
+        void setMessageCallback(const ConnectionPool::MessageCallback &cb);
+
+        void setRetryDelays(double initialDelay, double maxDelay);
+
+        // nullptr for a loop without a pool.
+        [[nodiscard]] ConnectionPool *poolOf(EventLoop *loop) const;
+
+        // The pool of the calling thread's loop.
+        [[nodiscard]] ConnectionPool *local() const;
+    };
+}
+
+#endif //MUDUO_LEARN_CONNECTIONPOOL_H
@@ -0,0 +1,95 @@
+#ifndef MUDUO_LEARN_CONNECTOR_H
+#define MUDUO_LEARN_CONNECTOR_H
+
+#include "base/include/NoneCopyable.h"
+#include "src/include/InetAddress.h"
+#include "src/include/TimerId.h"
+
+#include <functional>
+#include <memory>
+
+namespace faliks {
+
+    class Channel;
+
+    class EventLoop;
+
+    // Opens one connection to serverAddr without blocking the loop: the socket
+    // connects in the background and EPOLLOUT reports the result. A failed
+    // attempt is retried after a delay that doubles from the initial to the
+    // max delay, each one drawn uniformly from its upper half so that many
+    // clients of a restarted backend do not come back in lockstep.
+    // Lives in one loop; start(), restart() and stop() may be called from any
+    // thread.
+    class Connector : NoneCopyable, public std::enable_shared_from_this<Connector> {
+    public:
+        using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    private:
+        enum class State {
+            kDisconnected, kConnecting, kConnected
+        };
+
+        EventLoop *m_loop;
+        const InetAddress m_serverAddr;
+        bool m_connect;
+        State m_state;
+        std::unique_ptr<Channel> m_channel;
+        NewConnectionCallback m_newConnectionCallback;
+        double m_initialRetryDelay;
+        double m_maxRetryDelay;
+        double m_retryDelay;
+        int m_retries;
+        uint64_t m_jitterState;
+        TimerId m_retryTimer;
+        bool m_retryPending;
+
+        void startInLoop();
+
+        void stopInLoop();
+
+        void connect();
+
+        void connecting(int sockfd);
+
+        void handleWrite();
+
+        void handleError();
+
+        void retry(int sockfd);
+
+        int removeAndResetChannel();
+
+        double nextRetryDelay();
+
+    public:
+        Connector(EventLoop *loop, const InetAddress &serverAddr);
+
+        ~Connector();
+
+        // Gets the connected socket and owns it from then on.
+        void setNewConnectionCallback(const NewConnectionCallback &cb) { m_newConnectionCallback = cb; }
+
+        // In seconds, call before start().
+        void setRetryDelays(double initialDelay, double maxDelay) {
+            m_initialRetryDelay = initialDelay;
+            m_maxRetryDelay = maxDelay;
+            m_retryDelay = initialDelay;
+        }
+
+        [[nodiscard]] const InetAddress &serverAddress() const { return m_serverAddr; }
+
+        // Failed attempts since the last successful one.
+        [[nodiscard]] int retries() const { return m_retries; }
+
+        void start();
+
+        // Starts over with the initial delay, e.g. after the connection closed.
+        // Loop thread only.
+        void restart();
+
+        void stop();
+    };
+}
+
+#endif //MUDUO_LEARN_CONNECTOR_H
@@ -6,6 +6,8 @@
 #include <unistd.h>
 #include <memory>
 #include <mutex>
+#include <deque>
+#include <vector>
 
 #include <boost/any.hpp>
 
@@ -20,6 +22,10 @@ namespace faliks {
 
     class TimerQueue;
 
+    class LoopMetrics;
+
+    class LoopLoad;
+
     class EventLoop : NoneCopyable {
     private:
         using ChannelList = std::vector<Channel *>;
@@ -27,7 +33,7 @@ namespace faliks {
         std::atomic<bool> m_quit;
         std::atomic<bool> m_eventHandling;
         std::atomic<bool> m_callingPendingFunctors;
-        int64_t m_iteration;
+        std::atomic<int64_t> m_iteration;
         const pid_t m_threadId;
         Timestamp m_pollReturnTime;
         std::unique_ptr<Poller> m_poller;
@@ -38,8 +44,23 @@ namespace faliks {
         ChannelList m_activeChannels;
         Channel *m_currentActiveChannel;
         std::mutex m_pendingMutex;
-        std::mutex m_quitMutex;
         std::vector<std::function<void()>> m_pendingFunctors;
+        std::vector<std::function<void()>> m_urgentFunctors;
+        std::deque<std::function<void()>> m_carriedFunctors;
+        std::atomic<size_t> m_carriedCount;
+        ChannelList m_deferredChannels;
+        size_t m_maxFunctorsPerIteration;
+        int64_t m_ioBudgetUs;
+        int64_t m_taskBudgetUs;
+        std::unique_ptr<LoopMetrics> m_metrics;
+        std::atomic<bool> m_metricsEnabled;
+        std::unique_ptr<LoopLoad> m_load;
+        Timestamp m_lastHandlerEnd;
+        Timestamp m_pendingSince;
+        std::atomic<bool> m_watched;
+        std::atomic<int64_t> m_activityStartUs;
+        std::atomic<int> m_activityFd;
+        std::atomic<int> m_activityType;
 
         void abortNotInLoopThread();
 
@@ -47,9 +68,33 @@ namespace faliks {
 
         void printActiveChannels() const;
 
+        void handleActiveChannels();
+
+        void handleChannel(Channel *channel, bool timed);
+
+        void runFunctor(const std::function<void()> &functor);
+
         void doPendingFunctors();
 
+        void runCarriedFunctors();
+
+        [[nodiscard]] bool hasCarriedWork() const;
+
     public:
+        enum class Priority {
+            kHigh,
+            kNormal
+        };
+
+        // What the loop thread is doing, published for watchdogs while watched.
+        // startUs is 0 while the loop waits in poll, fd is -1 for queued functors.
+        struct Activity {
+            int64_t iteration;
+            int64_t startUs;
+            int fd;
+            int channelType;
+        };
+
         EventLoop();
 
         ~EventLoop();
@@ -66,9 +111,38 @@ namespace faliks {
 
         [[nodiscard]] int64_t iteration() const;
 
-        void runInLoop(std::function<void()> cb);
+        [[nodiscard]] pid_t threadId() const { return m_threadId; }
+
+        void setWatched(bool on) { m_watched = on; }
+
+        [[nodiscard]] Activity activity() const;
+
+        void runInLoop(std::function<void()> cb, Priority priority = Priority::kNormal);
+
+        void queueInLoop(std::function<void()> cb, Priority priority = Priority::kNormal);
+
+        // Per-iteration budgets, 0 means unlimited. Work left over when a budget
+        // is exhausted carries over to the next iteration; high priority functors
+        // and channels are never deferred.
+        void setMaxFunctorsPerIteration(size_t maxFunctors);
+
+        void setIoTimeBudget(double seconds);
+
+        void setTaskTimeBudget(double seconds);
+
+        // Metrics are recorded by the loop thread and may be read from any thread.
+        void setMetricsEnabled(bool on) { m_metricsEnabled = on; }
+
+        [[nodiscard]] bool metricsEnabled() const { return m_metricsEnabled; }
+
+        [[nodiscard]] LoopMetrics &metrics() { return *m_metrics; }
+
+        [[nodiscard]] const LoopMetrics &metrics() const { return *m_metrics; }
+
+        // Published for connection placement, readable from any thread.
+        [[nodiscard]] LoopLoad &load() { return *m_load; }
 
-        void queueInLoop(std::function<void()> cb);
+        [[nodiscard]] const LoopLoad &load() const { return *m_load; }
 
         [[nodiscard]] size_t queueSize();
 
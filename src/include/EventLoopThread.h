@@ -8,6 +8,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <vector>
 
 namespace faliks {
 
@@ -23,6 +24,8 @@ namespace faliks {
         std::mutex m_mutex;
         std::condition_variable m_cond GUARDED_BY(m_mutex);
         ThreadInitCallback m_callback;
+        std::vector<int> m_cpus;
+        bool m_localMemory;
 
         void threadFunc();
 
@@ -33,6 +36,9 @@ namespace faliks {
 
         ~EventLoopThread();
 
+        // Applied in the loop thread before the EventLoop is allocated.
+        void setCpuAffinity(const std::vector<int> &cpus, bool localMemory);
+
         EventLoop *startLoop();
     };
 
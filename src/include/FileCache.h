@@ -0,0 +1,138 @@
+#ifndef MUDUO_LEARN_FILECACHE_H
+#define MUDUO_LEARN_FILECACHE_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/ThreadSaftyCheck.h"
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace faliks {
+
+    class Channel;
+
+    class EventLoop;
+
+    // Open files below a root directory, with their size and mtime, kept in
+    // an LRU so serving a cached file needs no open, stat or read. Small
+    // files can also be mapped and sent from memory. Changes are picked up
+    // through inotify on the directories of cached files, handled in loop,
+    // so a replaced or modified file is reopened on the next get(). Shared
+    // by all loops; get() takes a short lock.
+    class FileCache : NoneCopyable {
+    public:
+        // The descriptor, and the mapping if any, stay valid while a File is
+        // held, also after it left the cache. Files are best replaced by
+        // rename: a mapped file truncated in place faults on access.
+        class File : NoneCopyable {
+        private:
+            const int m_fd;
+            const size_t m_size;
+            const time_t m_mtime;
+            const char *m_data;
+
+        public:
+            File(int fd, size_t size, time_t mtime, const char *data);
+
+            ~File();
+
+            [[nodiscard]] int fd() const { return m_fd; }
+
+            [[nodiscard]] size_t size() const { return m_size; }
+
+            [[nodiscard]] time_t mtime() const { return m_mtime; }
+
+            // The mapped contents, nullptr if the file is not mapped.
+            [[nodiscard]] const char *data() const { return m_data; }
+        };
+
+        using FilePtr = std::shared_ptr<const File>;
+
+    private:
+        struct Entry {
+            std::string path;
+            FilePtr file;
+            int wd;
+        };
+
+        struct Watch {
+            std::string dir;
+            size_t entries;
+            // Bumped by every event, so a file loaded while its directory
+            // changed is not cached.
+            uint64_t generation;
+        };
+
+        using EntryList = std::list<Entry>;
+
+        EventLoop *m_loop;
+        const std::string m_root;
+        int m_rootFd;
+        int m_inotifyFd;
+        std::unique_ptr<Channel> m_channel;
+        const size_t m_maxEntries;
+        size_t m_mmapMaxFileBytes;
+        size_t m_mmapMaxTotalBytes;
+        std::mutex m_mutex;
+        EntryList m_lru GUARDED_BY(m_mutex);
+        std::unordered_map<std::string, EntryList::iterator> m_entries GUARDED_BY(m_mutex);
+        std::unordered_map<int, Watch> m_watches GUARDED_BY(m_mutex);
+        std::unordered_map<std::string, int> m_watchOfDir GUARDED_BY(m_mutex);
+        size_t m_mappedBytes GUARDED_BY(m_mutex);
+        std::atomic<uint64_t> m_hits;
+        std::atomic<uint64_t> m_misses;
+        std::atomic<uint64_t> m_invalidations;
+
+        void handleRead();
+
+        int watchDirLocked(const std::string &dir);
+
+        void unwatchIfUnusedLocked(int wd);
+
+        void eraseLocked(EntryList::iterator it);
+
+        void eraseWatchLocked(int wd);
+
+        FilePtr load(const std::string &path, bool mayMap);
+
+    public:
+        // Create and destroy in loop's thread, where invalidations run.
+        FileCache(EventLoop *loop, const std::string &root, size_t maxEntries = 1024);
+
+        ~FileCache();
+
+        // Map files of at most maxFileBytes while the mapped total stays
+        // within maxTotalBytes. Off by default.
+        void setMmap(size_t maxFileBytes, size_t maxTotalBytes) {
+            m_mmapMaxFileBytes = maxFileBytes;
+            m_mmapMaxTotalBytes = maxTotalBytes;
+        }
+
+        // path is relative to the root, like "css/site.css". nullptr if it
+        // is not a regular file or leaves the root through "..".
+        FilePtr get(std::string_view path);
+
+        void clear();
+
+        [[nodiscard]] size_t size();
+
+        [[nodiscard]] size_t mappedBytes();
+
+        [[nodiscard]] uint64_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] uint64_t misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+        // Entries dropped because their file changed.
+        [[nodiscard]] uint64_t invalidations() const { return m_invalidations.load(std::memory_order_relaxed); }
+    };
+}
+
+#endif //MUDUO_LEARN_FILECACHE_H
@@ -0,0 +1,80 @@
+#ifndef MUDUO_LEARN_HOTRESTART_H
+#define MUDUO_LEARN_HOTRESTART_H
+
+#include "base/include/NoneCopyable.h"
+#include "src/include/TcpServer.h"
+
+#include <sys/types.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace faliks {
+
+    class Channel;
+
+    class EventLoop;
+
+    // Hands a running TcpServer's sockets to the process replacing it, over a
+    // Unix domain socket with SCM_RIGHTS. The old process listen()s on path;
+    // the new one calls takeOver(path), builds its TcpServer on the listening
+    // sockets and adopts the connections. The listen queue is shared the whole
+    // time, so no connection attempt is refused. Once the sockets are sent the
+    // old server shuts down with the drain timeouts. Only the owner may
+    // connect to path, and only a peer of the allowed uid gets the sockets.
+    class HotRestart : NoneCopyable {
+    private:
+        EventLoop *m_loop;
+        TcpServer *m_server;
+        const std::string m_path;
+        int m_listenFd;
+        std::unique_ptr<Channel> m_channel;
+        bool m_handOffConnections;
+        uid_t m_allowedUid;
+        double m_drainTimeout;
+        double m_closeTimeout;
+        TcpServer::ShutdownCallback m_drainedCallback;
+
+        void handleRead();
+
+        void stopListening();
+
+    public:
+        HotRestart(EventLoop *loop, TcpServer *server, const std::string &path);
+
+        ~HotRestart();
+
+        // Also hand over connections with nothing in flight, see
+        // TcpServer::detachIdleConnections. Off by default.
+        void setHandOffConnections(bool on) { m_handOffConnections = on; }
+
+        // Passed to TcpServer::shutdown() once the sockets are handed over.
+        void setDrainTimeouts(double drainTimeout, double closeTimeout) {
+            m_drainTimeout = drainTimeout;
+            m_closeTimeout = closeTimeout;
+        }
+
+        // The user a successor must run as, this process's effective uid by
+        // default.
+        void setAllowedUid(uid_t uid) { m_allowedUid = uid; }
+
+        void setDrainedCallback(const TcpServer::ShutdownCallback &cb) { m_drainedCallback = cb; }
+
+        // Waits in the loop for a successor to connect to path.
+        void listen();
+
+        // Successor side, blocking: takes the sockets of the process listening
+        // on path. Returns false if there is none.
+        static bool takeOver(const std::string &path, std::vector<int> *listenFds, std::vector<int> *connectionFds);
+
+        // One tagged message carrying up to kMaxFdsPerMessage descriptors.
+        static constexpr size_t kMaxFdsPerMessage = 64;
+
+        static bool sendFds(int sockfd, char tag, const int *fds, size_t count);
+
+        // Returns false on error or end of stream.
+        static bool recvFds(int sockfd, char *tag, std::vector<int> *fds);
+    };
+}
+
+#endif //MUDUO_LEARN_HOTRESTART_H
@@ -0,0 +1,75 @@
+#ifndef MUDUO_LEARN_HTTPPARSER_H
+#define MUDUO_LEARN_HTTPPARSER_H
+
+#include "base/include/Copyable.h"
+#include "base/include/Timestamp.h"
+#include "src/include/HttpRequest.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace faliks {
+
+    class Buffer;
+
+    // Parses requests in place in a connection's input buffer. parse() picks
+    // up where the previous call stopped, so a request trickling in is not
+    // scanned again, and nothing is copied: the request refers to the buffer
+    // by offsets until it is complete. Pipelined requests stay in the buffer
+    // behind the current one; consume() drops the current one and starts
+    // over on the next.
+    class HttpParser : public Copyable {
+    public:
+        enum class Result {
+            kNeedMore, kComplete, kError
+        };
+
+    private:
+        enum class State {
+            kRequestLine, kHeaders, kBody, kChunkSize, kChunkData, kTrailers, kComplete, kError
+        };
+
+        State m_state;
+        // Bytes of the current request parsed so far.
+        size_t m_offset;
+        uint64_t m_remaining;
+        // Where the trailers start, once the last chunk is read.
+        size_t m_trailerOffset;
+        size_t m_maxHeaderBytes;
+        size_t m_maxBodyBytes;
+        int m_errorStatus;
+        HttpRequest m_request;
+
+        // The next CRLF-terminated line from the offset, nullptr if it has
+        // not arrived; advances the offset past it.
+        const char *nextLine(const char *base, const char *end, const char **lineEnd);
+
+        bool parseRequestLine(const char *base, const char *begin, const char *end);
+
+        bool parseHeader(const char *base, const char *begin, const char *end);
+
+        bool parseChunkSize(const char *begin, const char *end);
+
+        bool startBody();
+
+        Result fail(int status);
+
+    public:
+        explicit HttpParser(size_t maxHeaderBytes = 64 * 1024, size_t maxBodyBytes = 16 * 1024 * 1024);
+
+        Result parse(Buffer *buf, Timestamp receiveTime);
+
+        // After kComplete, until consume().
+        [[nodiscard]] const HttpRequest &request() const { return m_request; }
+
+        // Retrieves the complete request from buf and starts on the next.
+        void consume(Buffer *buf);
+
+        void reset();
+
+        // The status to answer with after kError: 400, 413, 431, 501 or 505.
+        [[nodiscard]] int errorStatus() const { return m_errorStatus; }
+    };
+}
+
+#endif //MUDUO_LEARN_HTTPPARSER_H
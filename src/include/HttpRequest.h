@@ -0,0 +1,97 @@
+#ifndef MUDUO_LEARN_HTTPREQUEST_H
+#define MUDUO_LEARN_HTTPREQUEST_H
+
+#include "base/include/Copyable.h"
+#include "base/include/Timestamp.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace faliks {
+
+    // A parsed request. Everything but a chunked body is a view into the
+    // connection's input buffer, so it is valid only while the request is
+    // being handled; copy what has to outlive the handler.
+    class HttpRequest : public Copyable {
+    public:
+        enum class Method {
+            kInvalid, kGet, kHead, kPost, kPut, kDelete, kOptions, kPatch
+        };
+        enum class Version {
+            kUnknown, kHttp10, kHttp11
+        };
+
+    private:
+        friend class HttpParser;
+
+        // Offsets from the start of the request: the buffer may move while
+        // the request is still arriving.
+        struct Span {
+            uint32_t offset;
+            uint32_t len;
+        };
+
+        const char *m_base;
+        Method m_method;
+        Version m_version;
+        Span m_path;
+        Span m_query;
+        std::vector<std::pair<Span, Span>> m_headers;
+        Span m_body;
+        bool m_chunked;
+        std::string m_chunkedBody;
+        Timestamp m_receiveTime;
+
+        [[nodiscard]] std::string_view view(Span span) const { return {m_base + span.offset, span.len}; }
+
+    public:
+        HttpRequest();
+
+        void reset();
+
+        [[nodiscard]] Method method() const { return m_method; }
+
+        [[nodiscard]] const char *methodString() const;
+
+        [[nodiscard]] Version version() const { return m_version; }
+
+        [[nodiscard]] std::string_view path() const { return view(m_path); }
+
+        // Without the '?', empty if there is none.
+        [[nodiscard]] std::string_view query() const { return view(m_query); }
+
+        // The value of the first header named field, compared without regard
+        // to case; empty if there is none.
+        [[nodiscard]] std::string_view header(std::string_view field) const;
+
+        [[nodiscard]] bool hasHeader(std::string_view field) const;
+
+        [[nodiscard]] size_t numHeaders() const { return m_headers.size(); }
+
+        [[nodiscard]] std::string_view headerName(size_t i) const { return view(m_headers[i].first); }
+
+        [[nodiscard]] std::string_view headerValue(size_t i) const { return view(m_headers[i].second); }
+
+        [[nodiscard]] std::string_view body() const {
+            return m_chunked ? std::string_view(m_chunkedBody) : view(m_body);
+        }
+
+        // HTTP/1.1 keeps the connection unless told to close, 1.0 only when
+        // asked to keep it.
+        [[nodiscard]] bool keepAlive() const;
+
+        [[nodiscard]] Timestamp receiveTime() const { return m_receiveTime; }
+    };
+
+    // Case-insensitive comparison for header names and tokens.
+    bool equalsIgnoreCase(std::string_view a, std::string_view b);
+
+    // Whether a comma-separated header value such as "keep-alive, Upgrade"
+    // lists token.
+    bool headerListsToken(std::string_view value, std::string_view token);
+}
+
+#endif //MUDUO_LEARN_HTTPREQUEST_H
@@ -0,0 +1,97 @@
+#ifndef MUDUO_LEARN_HTTPRESPONSE_H
+#define MUDUO_LEARN_HTTPRESPONSE_H
+
+#include "base/include/Copyable.h"
+
+#include <sys/types.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace faliks {
+
+    class Buffer;
+
+    // Filled in by the handler, serialized by HttpServer. reset() keeps the
+    // storage, so a connection reuses one response for all its requests.
+    class HttpResponse : public Copyable {
+    public:
+        // A body sent without copying: len bytes at data, or with fd >= 0 a
+        // range of a file sent with sendfile(2). owner keeps either alive.
+        struct BodyReference {
+            const char *data;
+            int fd;
+            off_t offset;
+            size_t len;
+            std::shared_ptr<const void> owner;
+        };
+
+    private:
+        int m_statusCode;
+        std::string m_statusMessage;
+        std::vector<std::pair<std::string, std::string>> m_headers;
+        size_t m_numHeaders;
+        std::string m_body;
+        bool m_closeConnection;
+        bool m_chunked;
+        bool m_http10;
+        std::vector<uint32_t> m_chunkSizes;
+        BodyReference m_bodyReference;
+
+    public:
+        HttpResponse();
+
+        void reset();
+
+        // An empty message is replaced by the standard reason phrase.
+        void setStatus(int code, std::string_view message = {});
+
+        [[nodiscard]] int statusCode() const { return m_statusCode; }
+
+        void addHeader(std::string_view field, std::string_view value);
+
+        void setContentType(std::string_view type) { addHeader("Content-Type", type); }
+
+        void setBody(std::string_view body) { m_body.assign(body.data(), body.size()); }
+
+        void appendBody(std::string_view data) { m_body.append(data.data(), data.size()); }
+
+        [[nodiscard]] const std::string &body() const { return m_body; }
+
+        // Replace the body, which then is neither set nor chunked.
+        void setBodyReference(const char *data, size_t len, std::shared_ptr<const void> owner) {
+            m_bodyReference = {data, -1, 0, len, std::move(owner)};
+        }
+
+        void setFileBody(int fd, off_t offset, size_t len, std::shared_ptr<const void> owner) {
+            m_bodyReference = {nullptr, fd, offset, len, std::move(owner)};
+        }
+
+        // Sent by HttpServer after what appendToBuffer() wrote, if owner is set.
+        [[nodiscard]] const BodyReference &bodyReference() const { return m_bodyReference; }
+
+        // Sends the body with Transfer-Encoding: chunked, one chunk per
+        // appendChunk(). An HTTP/1.0 peer gets it with a Content-Length.
+        void setChunked(bool on) { m_chunked = on; }
+
+        void appendChunk(std::string_view data);
+
+        void setCloseConnection(bool on) { m_closeConnection = on; }
+
+        [[nodiscard]] bool closeConnection() const { return m_closeConnection; }
+
+        // Answering an HTTP/1.0 request: keep-alive has to be said.
+        void setHttp10(bool on) { m_http10 = on; }
+
+        // dateHeader is a complete "Date: ...\r\n" line. A response to HEAD
+        // leaves out the body but keeps its length.
+        void appendToBuffer(Buffer *buf, std::string_view dateHeader, bool includeBody = true) const;
+    };
+
+    const char *httpStatusMessage(int code);
+}
+
+#endif //MUDUO_LEARN_HTTPRESPONSE_H
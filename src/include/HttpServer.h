@@ -0,0 +1,87 @@
+#ifndef MUDUO_LEARN_HTTPSERVER_H
+#define MUDUO_LEARN_HTTPSERVER_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/Timestamp.h"
+#include "src/include/HttpRequest.h"
+#include "src/include/HttpResponse.h"
+#include "src/include/TcpServer.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace faliks {
+
+    class Buffer;
+
+    class TcpConnection;
+
+    // HTTP/1.1 on a TcpServer. The handler runs in the connection's loop
+    // and answers synchronously, so pipelined requests are answered in
+    // order; the responses to everything one read brought in go out in a
+    // single send.
+    class HttpServer : NoneCopyable {
+    public:
+        using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+        using UpgradeCallback = std::function<void(const TcpConnectionPtr &, const HttpRequest &, HttpResponse *)>;
+        using MessageCallback = std::function<void(const TcpConnectionPtr &, Buffer *, Timestamp)>;
+        using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
+
+    private:
+        TcpServer m_server;
+        HttpCallback m_httpCallback;
+        UpgradeCallback m_upgradeCallback;
+        MessageCallback m_upgradedMessageCallback;
+        ConnectionCallback m_upgradedCloseCallback;
+        size_t m_maxHeaderBytes;
+        size_t m_maxBodyBytes;
+
+        void onConnection(const TcpConnectionPtr &conn);
+
+        void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    public:
+        HttpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                   TcpServer::Option option = TcpServer::Option::kNoReusePort);
+
+        // Answers 404 until set.
+        void setHttpCallback(const HttpCallback &cb) { m_httpCallback = cb; }
+
+        // Requests with an Upgrade header go to upgradeCallback instead. If
+        // it answers 101 the connection switches protocols: the callback may
+        // replace the connection's context, and from then on input goes to
+        // messageCallback and the close to closeCallback. The 101 is sent
+        // after the callback returns, so output has to wait until then.
+        void setUpgradeCallback(const UpgradeCallback &upgradeCallback, const MessageCallback &messageCallback,
+                                const ConnectionCallback &closeCallback) {
+            m_upgradeCallback = upgradeCallback;
+            m_upgradedMessageCallback = messageCallback;
+            m_upgradedCloseCallback = closeCallback;
+        }
+
+        // A request head above maxHeaderBytes is answered with 431, a body
+        // above maxBodyBytes with 413. Call before start().
+        void setLimits(size_t maxHeaderBytes, size_t maxBodyBytes) {
+            m_maxHeaderBytes = maxHeaderBytes;
+            m_maxBodyBytes = maxBodyBytes;
+        }
+
+        void setThreadNum(int numThreads) { m_server.setThreadNum(numThreads); }
+
+        void start() { m_server.start(); }
+
+        // For the settings HttpServer does not wrap.
+        TcpServer *tcpServer() { return &m_server; }
+
+        [[nodiscard]] EventLoop *getLoop() const { return m_server.getLoop(); }
+
+        // "Date: <IMF-fixdate>\r\n" for now's second, formatted once per
+        // second and thread.
+        static std::string_view dateHeader(Timestamp now);
+    };
+}
+
+#endif //MUDUO_LEARN_HTTPSERVER_H
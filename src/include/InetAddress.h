@@ -4,24 +4,47 @@
 #include "base/include/Copyable.h"
 
 #include <netinet/in.h>
+#include <sys/un.h>
 #include <string>
 
 namespace faliks {
+    // An IPv4, IPv6 or Unix domain socket address. Unix addresses are made
+    // with unixPath() or, for the Linux abstract namespace, unixAbstract().
     class InetAddress : public Copyable {
     private:
         union {
             struct sockaddr_in m_sockaddrIn;
             struct sockaddr_in6 m_sockaddrIn6;
+            struct sockaddr_un m_sockaddrUn;
         };
+        // Only AF_UNIX needs it: abstract names are not NUL-terminated.
+        socklen_t m_unixLen;
+
+        // AF_UNIX with no length, which valid() rejects.
+        static InetAddress invalidUnix();
 
     public:
         explicit InetAddress(uint16_t port = 0, bool localhost = false, bool ipv6 = false);
 
         InetAddress(const char *ip, uint16_t port, bool ipv6 = false);
 
-        explicit InetAddress(const struct sockaddr_in &sockaddrIn) : m_sockaddrIn(sockaddrIn) {}
+        explicit InetAddress(const struct sockaddr_in &sockaddrIn) : m_sockaddrIn(sockaddrIn), m_unixLen(0) {}
+
+        explicit InetAddress(const struct sockaddr_in6 &sockaddrIn6) : m_sockaddrIn6(sockaddrIn6), m_unixLen(0) {}
+
+        // Copies an address of any supported family, e.g. from getsockname().
+        InetAddress(const struct sockaddr *addr, socklen_t len);
+
+        // Both return an invalid address, rather than truncate, when the name
+        // does not fit in sun_path.
+        static InetAddress unixPath(const std::string &path);
+
+        // A name in the abstract namespace, which needs no file and vanishes
+        // with the last socket bound to it.
+        static InetAddress unixAbstract(const std::string &name);
 
-        explicit InetAddress(const struct sockaddr_in6 &sockaddrIn6) : m_sockaddrIn6(sockaddrIn6) {}
+        // False only for a unix address whose name did not fit.
+        [[nodiscard]] bool valid() const { return !isUnix() || m_unixLen > 0; }
 
         [[nodiscard]] sa_family_t family() const { return m_sockaddrIn.sin_family; }
 
@@ -33,10 +56,22 @@ namespace faliks {
 
         [[nodiscard]] const struct sockaddr* getSockAddr() const;
 
+        // Length to pass to bind() and connect().
+        [[nodiscard]] socklen_t getSockLen() const;
+
+        [[nodiscard]] bool isUnix() const { return family() == AF_UNIX; }
+
+        // The path, or "@" and the name for an abstract address; empty for
+        // unnamed ones such as accepted peers.
+        [[nodiscard]] std::string unixName() const;
+
         void setSockAddrInet6(const struct sockaddr_in6 &sockaddrIn6) { m_sockaddrIn6 = sockaddrIn6; }
 
         [[nodiscard]] uint32_t ipv4NetEndian() const;
 
+        // INADDR_ANY or in6addr_any.
+        [[nodiscard]] bool isAnyAddress() const;
+
         [[nodiscard]] uint16_t portNetEndian() const { return m_sockaddrIn.sin_port; }
 
         static bool resolve(const char *hostname, InetAddress *result);
@@ -0,0 +1,101 @@
+#ifndef MUDUO_LEARN_KVSERVER_H
+#define MUDUO_LEARN_KVSERVER_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/Timestamp.h"
+#include "src/include/KvTable.h"
+#include "src/include/TcpServer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace faliks {
+
+    class Buffer;
+
+    class TcpConnection;
+
+    // An in-memory key-value server speaking RESP2 and RESP3, enough of
+    // Redis for GET, SET, MGET, MSET, DEL, EXISTS, INCR and friends. Every
+    // IO loop owns one shard of the keys, a KvTable touched only in its
+    // thread. Commands on keys of the connection's own shard run at once;
+    // the rest of what one read brought in is grouped by shard and posted as
+    // one task per shard, and the replies, multi-key ones aggregated, go out
+    // in command order in one send. Tasks in the loops refer to the server,
+    // so it goes away after they stop.
+    class KvServer : NoneCopyable {
+    public:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+
+    private:
+        struct Shard {
+            EventLoop *loop = nullptr;
+            KvTable table;
+        };
+
+        // A connection's parser and the batches whose replies it waits for.
+        struct Context;
+
+        // The commands of one read that went to other shards.
+        struct Batch;
+
+        TcpServer m_server;
+        int m_numThreads;
+        // Made in start(), each filled in by its loop before any connection.
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        std::atomic<size_t> m_nextShard;
+        size_t m_maxBulkBytes;
+
+        void onConnection(const TcpConnectionPtr &conn);
+
+        void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+        // The shard of the loop, or numShards() if it has none.
+        [[nodiscard]] size_t shardOfLoop(const EventLoop *loop) const;
+
+        void runCommand(const TcpConnectionPtr &conn, Context *context, const std::vector<std::string_view> &args,
+                        size_t local, std::shared_ptr<Batch> *batch, Buffer *output);
+
+        // A reply that needs no shard, behind those of the batch if any.
+        void replyAtOnce(Batch *batch, const Buffer &reply, Buffer *output);
+
+        void dispatch(const TcpConnectionPtr &conn, Context *context, const std::shared_ptr<Batch> &batch);
+
+        void runPart(const std::shared_ptr<Batch> &batch, size_t shard);
+
+        void finishBatch(const std::shared_ptr<Batch> &batch);
+
+        void flushWaiting(const TcpConnectionPtr &conn, Context *context);
+
+    public:
+        KvServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                 TcpServer::Option option = TcpServer::Option::kNoReusePort);
+
+        void setThreadNum(int numThreads) {
+            m_numThreads = numThreads;
+            m_server.setThreadNum(numThreads);
+        }
+
+        // A longer bulk string is a protocol error. Call before start().
+        void setMaxBulkBytes(size_t maxBulkBytes) { m_maxBulkBytes = maxBulkBytes; }
+
+        // Takes the TcpServer's thread init callback.
+        void start();
+
+        // For the settings KvServer does not wrap.
+        TcpServer *tcpServer() { return &m_server; }
+
+        [[nodiscard]] size_t numShards() const { return m_shards.size(); }
+
+        // The shard key belongs to, by its KvTable::hash.
+        [[nodiscard]] size_t shardOf(uint64_t hash) const {
+            return static_cast<size_t>(((hash >> 32) * m_shards.size()) >> 32);
+        }
+    };
+}
+
+#endif //MUDUO_LEARN_KVSERVER_H
@@ -0,0 +1,66 @@
+#ifndef MUDUO_LEARN_KVTABLE_H
+#define MUDUO_LEARN_KVTABLE_H
+
+#include "base/include/NoneCopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace faliks {
+
+    // String keys to string values in one open-addressing table with linear
+    // probing. Probes walk an array of hashes alone and touch an entry only
+    // when its hash matches. Callers pass hash(key) in, so it is computed
+    // once per key however the key is routed. Not thread safe.
+    class KvTable : NoneCopyable {
+    private:
+        struct Entry {
+            std::string key;
+            std::string value;
+        };
+
+        // 0 marks an empty slot and 1 an erased one; hash() never returns
+        // either.
+        static constexpr uint64_t kEmpty = 0;
+        static constexpr uint64_t kErased = 1;
+
+        std::vector<uint64_t> m_hashes;
+        std::vector<Entry> m_entries;
+        size_t m_size;
+        // Live and erased slots, which both lengthen probes.
+        size_t m_used;
+
+        [[nodiscard]] size_t mask() const { return m_hashes.size() - 1; }
+
+        // The slot holding key, or the size of the table.
+        [[nodiscard]] size_t findSlot(std::string_view key, uint64_t hash) const;
+
+        void rehash(size_t capacity);
+
+    public:
+        // Rounded up to a power of two.
+        explicit KvTable(size_t initialCapacity = 16);
+
+        static uint64_t hash(std::string_view key);
+
+        // nullptr if absent. Valid until the next insert or erase.
+        std::string *find(std::string_view key, uint64_t hash);
+
+        // The value of key, inserted empty if absent, and whether it was.
+        std::pair<std::string *, bool> emplace(std::string_view key, uint64_t hash);
+
+        bool erase(std::string_view key, uint64_t hash);
+
+        void clear();
+
+        [[nodiscard]] size_t size() const { return m_size; }
+
+        [[nodiscard]] size_t capacity() const { return m_hashes.size(); }
+    };
+}
+
+#endif //MUDUO_LEARN_KVTABLE_H
@@ -0,0 +1,83 @@
+#ifndef MUDUO_LEARN_LENGTHHEADERCODEC_H
+#define MUDUO_LEARN_LENGTHHEADERCODEC_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/Timestamp.h"
+#include "src/include/Buffer.h"
+
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace faliks {
+
+    class TcpConnection;
+
+    // Frames made of a length header and that many payload bytes. Install
+    // onMessage() as the message callback; frames are handed out as views
+    // into the input buffer, valid until the callback returns, and retrieved
+    // afterwards. With a batch callback every complete frame of one read
+    // arrives in a single call. Stateless apart from its settings, so one
+    // codec can serve all loops.
+    class LengthHeaderCodec : NoneCopyable {
+    public:
+        enum class ByteOrder {
+            kBigEndian, kLittleEndian
+        };
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+        using FrameCallback = std::function<void(const TcpConnectionPtr &, std::string_view frame, Timestamp)>;
+        using FrameBatchCallback = std::function<void(const TcpConnectionPtr &,
+                                                      const std::vector<std::string_view> &frames, Timestamp)>;
+
+    private:
+        const size_t m_headerBytes;
+        const ByteOrder m_byteOrder;
+        const size_t m_maxFrameBytes;
+        FrameCallback m_frameCallback;
+        FrameBatchCallback m_frameBatchCallback;
+
+        [[nodiscard]] uint64_t decodeLength(const char *header) const;
+
+        void encodeLength(uint64_t length, char *header) const;
+
+    public:
+        // headerBytes is 1, 2, 4 or 8, at most Buffer::CHEAP_PREPEND. A frame
+        // announcing more than maxFrameBytes closes the connection.
+        explicit LengthHeaderCodec(size_t headerBytes = 4, ByteOrder byteOrder = ByteOrder::kBigEndian,
+                                   size_t maxFrameBytes = 64 * 1024 * 1024);
+
+        void setFrameCallback(const FrameCallback &cb) { m_frameCallback = cb; }
+
+        // Takes precedence over the frame callback.
+        void setFrameBatchCallback(const FrameBatchCallback &cb) { m_frameBatchCallback = cb; }
+
+        void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+        // Turns buf, holding one payload, into a frame by writing the header
+        // into its prependable space. False if the payload is too long for
+        // the header or the limit.
+        bool encode(Buffer *buf) const;
+
+        // Appends a whole frame, e.g. to collect several into one send.
+        bool appendFrame(Buffer *buf, std::string_view payload) const;
+
+        // Appends a frame whose payload is parts, one after the other.
+        bool appendFrame(Buffer *buf, std::initializer_list<std::string_view> parts) const;
+
+        // Encodes buf in place and sends it, leaving it empty.
+        void send(const TcpConnectionPtr &conn, Buffer *buf) const;
+
+        void send(const TcpConnectionPtr &conn, std::string_view payload) const;
+
+        [[nodiscard]] size_t headerBytes() const { return m_headerBytes; }
+
+        [[nodiscard]] size_t maxFrameBytes() const { return m_maxFrameBytes; }
+
+        // The longest payload both the header and the limit allow.
+        [[nodiscard]] size_t maxPayloadBytes() const;
+    };
+}
+
+#endif //MUDUO_LEARN_LENGTHHEADERCODEC_H
@@ -0,0 +1,46 @@
+#ifndef MUDUO_LEARN_LOOPLOAD_H
+#define MUDUO_LEARN_LOOPLOAD_H
+
+#include "base/include/NoneCopyable.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace faliks {
+
+    // Load signals of one EventLoop for connection placement. Utilization is
+    // folded into an EWMA by the loop thread once per window; the connection
+    // count is changed by the thread that places, migrates or destroys a
+    // connection.
+    // Every reader is lock-free.
+    class LoopLoad : NoneCopyable {
+    private:
+        std::atomic<int64_t> m_connections;
+        std::atomic<double> m_utilization;
+        std::atomic<int64_t> m_updatedUs;
+        int64_t m_windowStartUs;
+        int64_t m_windowBusyUs;
+
+    public:
+        static constexpr int64_t kWindowUs = 100 * 1000;
+        static constexpr double kAlpha = 0.3;
+
+        LoopLoad();
+
+        void connectionUp() { m_connections.fetch_add(1, std::memory_order_relaxed); }
+
+        void connectionDown() { m_connections.fetch_sub(1, std::memory_order_relaxed); }
+
+        [[nodiscard]] int64_t connections() const { return m_connections.load(std::memory_order_relaxed); }
+
+        // Called by the loop thread after every iteration.
+        void recordIteration(int64_t busyUs, int64_t endUs);
+
+        // The EWMA, decayed as if idle for the windows the loop has not
+        // reported, since a loop blocked in poll publishes nothing.
+        [[nodiscard]] double utilization(int64_t nowUs) const;
+    };
+}
+
+
+#endif //MUDUO_LEARN_LOOPLOAD_H
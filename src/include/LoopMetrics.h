@@ -0,0 +1,66 @@
+#ifndef MUDUO_LEARN_LOOPMETRICS_H
+#define MUDUO_LEARN_LOOPMETRICS_H
+
+#include "base/include/Histogram.h"
+#include "base/include/NoneCopyable.h"
+#include "src/include/Channel.h"
+
+#include <array>
+#include <atomic>
+#include <string>
+
+namespace faliks {
+
+    constexpr size_t kNumChannelTypes = static_cast<size_t>(Channel::Type::kNumTypes);
+
+    // Times are in microseconds.
+    struct LoopMetricsSnapshot {
+        int64_t iterations = 0;
+        HistogramSnapshot pollBlocked;
+        HistogramSnapshot busy;
+        HistogramSnapshot eventsPerIteration;
+        std::array<HistogramSnapshot, kNumChannelTypes> handler;
+        HistogramSnapshot queueDepth;
+        HistogramSnapshot queueWait;
+        HistogramSnapshot timerLateness;
+
+        // Fraction of the wall time spent outside of poll.
+        [[nodiscard]] double utilization() const;
+
+        [[nodiscard]] std::string toString() const;
+    };
+
+    // Written only by the owner loop thread, so recording needs neither locks nor
+    // atomic read-modify-write; snapshot() may be called from any thread.
+    class LoopMetrics : NoneCopyable {
+    private:
+        std::atomic<int64_t> m_iterations;
+        Histogram m_pollBlocked;
+        Histogram m_busy;
+        Histogram m_eventsPerIteration;
+        std::array<Histogram, kNumChannelTypes> m_handler;
+        Histogram m_queueDepth;
+        Histogram m_queueWait;
+        Histogram m_timerLateness;
+
+    public:
+        LoopMetrics();
+
+        void recordPoll(int64_t blockedUs, size_t numEvents);
+
+        void recordBusy(int64_t busyUs);
+
+        void recordHandler(Channel::Type type, int64_t handlerUs) {
+            m_handler[static_cast<size_t>(type)].record(handlerUs);
+        }
+
+        void recordQueue(size_t depth, int64_t waitUs);
+
+        void recordTimerLateness(int64_t latenessUs) { m_timerLateness.record(latenessUs); }
+
+        [[nodiscard]] LoopMetricsSnapshot snapshot() const;
+    };
+}
+
+
+#endif //MUDUO_LEARN_LOOPMETRICS_H
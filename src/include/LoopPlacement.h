@@ -0,0 +1,82 @@
+#ifndef MUDUO_LEARN_LOOPPLACEMENT_H
+#define MUDUO_LEARN_LOOPPLACEMENT_H
+
+#include "base/include/NoneCopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace faliks {
+
+    class InetAddress;
+
+    class LoopLoad;
+
+    // Chooses the loop of a new connection. loads[i] belongs to the i-th loop of
+    // the pool; select() runs in the accepting loop only.
+    class LoopPlacement : NoneCopyable {
+    public:
+        virtual ~LoopPlacement() = default;
+
+        virtual size_t select(const std::vector<const LoopLoad *> &loads, const InetAddress &peerAddr,
+                              int64_t nowUs) = 0;
+    };
+
+    class RoundRobinPlacement : public LoopPlacement {
+    private:
+        size_t m_next = 0;
+
+    public:
+        size_t select(const std::vector<const LoopLoad *> &loads, const InetAddress &peerAddr,
+                      int64_t nowUs) override;
+    };
+
+    // Fewest live connections, ties rotate so an idle pool still spreads.
+    class LeastConnectionsPlacement : public LoopPlacement {
+    private:
+        size_t m_next = 0;
+
+    public:
+        size_t select(const std::vector<const LoopLoad *> &loads, const InetAddress &peerAddr,
+                      int64_t nowUs) override;
+    };
+
+    // Samples two distinct loops and takes the one with the lower utilization
+    // EWMA, or the fewer connections when both are within kTieUtilization.
+    class PowerOfTwoChoicesPlacement : public LoopPlacement {
+    private:
+        uint64_t m_state;
+
+        size_t random(size_t bound);
+
+    public:
+        static constexpr double kTieUtilization = 0.02;
+
+        explicit PowerOfTwoChoicesPlacement(uint64_t seed = 0x9e3779b97f4a7c15ULL);
+
+        size_t select(const std::vector<const LoopLoad *> &loads, const InetAddress &peerAddr,
+                      int64_t nowUs) override;
+    };
+
+    // Peers keep their loop while the pool size is unchanged, and only about
+    // 1/n of them move when it changes. Hashes the ip, plus the port if asked.
+    class ConsistentHashPlacement : public LoopPlacement {
+    private:
+        int m_virtualNodes;
+        bool m_withPort;
+        std::vector<std::pair<uint64_t, size_t>> m_ring;
+        size_t m_ringLoops;
+
+        void buildRing(size_t numLoops);
+
+    public:
+        explicit ConsistentHashPlacement(int virtualNodes = 160, bool withPort = false);
+
+        size_t select(const std::vector<const LoopLoad *> &loads, const InetAddress &peerAddr,
+                      int64_t nowUs) override;
+    };
+}
+
+
+#endif //MUDUO_LEARN_LOOPPLACEMENT_H
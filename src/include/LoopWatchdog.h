@@ -0,0 +1,80 @@
+#ifndef MUDUO_LEARN_LOOPWATCHDOG_H
+#define MUDUO_LEARN_LOOPWATCHDOG_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/ThreadSaftyCheck.h"
+#include "base/include/Thread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace faliks {
+
+    class EventLoop;
+
+    struct StallReport {
+        EventLoop *loop;
+        pid_t tid;
+        int64_t iteration;
+        double stalledSeconds;
+        int fd;
+        std::string activity;
+        std::string stack;
+    };
+
+    // Watches the published activity of EventLoops. When one callback runs longer
+    // than the threshold the loop thread is interrupted with a signal, its stack is
+    // captured in the signal handler and reported once per stalled callback.
+    // A stalled thread blocked in a syscall may see it return early with EINTR.
+    class LoopWatchdog : NoneCopyable {
+    private:
+        using StallCallback = std::function<void(const StallReport &)>;
+
+        struct Watched {
+            EventLoop *loop;
+            int64_t reportedStartUs;
+        };
+
+        const int64_t m_thresholdUs;
+        const int m_checkIntervalMs;
+        const int m_signal;
+        bool m_running GUARDED_BY(m_mutex);
+        std::vector<Watched> m_loops GUARDED_BY(m_mutex);
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        StallCallback m_stallCallback;
+        Thread m_thread;
+
+        void threadFunc();
+
+        void check(Watched &watched, int64_t nowUs);
+
+        std::string captureStack(pid_t tid) const;
+
+    public:
+        explicit LoopWatchdog(double thresholdSeconds = 1.0, double checkIntervalSeconds = 0.1,
+                              int signal = SIGUSR2);
+
+        ~LoopWatchdog();
+
+        // Called in the watchdog thread, it must not watch or unwatch loops.
+        void setStallCallback(const StallCallback &cb) { m_stallCallback = cb; }
+
+        void start();
+
+        void stop();
+
+        // Loops must be unwatched before they are destroyed.
+        void watch(EventLoop *loop);
+
+        void unwatch(EventLoop *loop);
+    };
+}
+
+
+#endif //MUDUO_LEARN_LOOPWATCHDOG_H
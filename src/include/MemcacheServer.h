@@ -0,0 +1,69 @@
+#ifndef MUDUO_LEARN_MEMCACHESERVER_H
+#define MUDUO_LEARN_MEMCACHESERVER_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/Timestamp.h"
+#include "src/include/MemcacheStore.h"
+#include "src/include/TcpServer.h"
+
+#include <memory>
+#include <string>
+
+namespace faliks {
+
+    class Buffer;
+
+    class TcpConnection;
+
+    // A cache server speaking the memcached text and binary protocols, told
+    // apart by the first byte of a connection. Items live in a MemcacheStore
+    // shared by all loops. The replies to what one read brought in go out in
+    // one gather write: header lines are copied, but values are sent from
+    // the slab chunks they live in, which stay acquired until the kernel has
+    // them, so a get of many keys copies no value at all.
+    class MemcacheServer : NoneCopyable {
+    public:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+
+    private:
+        // The protocol of a connection and what is left to drop of a value
+        // it was refused.
+        struct Context;
+
+        TcpServer m_server;
+        int m_numThreads;
+        size_t m_memoryLimit;
+        size_t m_numStripes;
+        // Made in start(). Output waiting in connections keeps it alive.
+        std::shared_ptr<MemcacheStore> m_store;
+
+        void onConnection(const TcpConnectionPtr &conn);
+
+        void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    public:
+        MemcacheServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                       TcpServer::Option option = TcpServer::Option::kNoReusePort);
+
+        void setThreadNum(int numThreads) {
+            m_numThreads = numThreads;
+            m_server.setThreadNum(numThreads);
+        }
+
+        // For all items, 64 MiB by default. Call before start().
+        void setMemoryLimit(size_t bytes) { m_memoryLimit = bytes; }
+
+        // Four per loop by default. Call before start().
+        void setNumStripes(size_t numStripes) { m_numStripes = numStripes; }
+
+        void start();
+
+        // For the settings MemcacheServer does not wrap.
+        TcpServer *tcpServer() { return &m_server; }
+
+        // nullptr before start().
+        MemcacheStore *store() { return m_store.get(); }
+    };
+}
+
+#endif //MUDUO_LEARN_MEMCACHESERVER_H
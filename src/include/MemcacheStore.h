@@ -0,0 +1,160 @@
+#ifndef MUDUO_LEARN_MEMCACHESTORE_H
+#define MUDUO_LEARN_MEMCACHESTORE_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/ThreadSaftyCheck.h"
+#include "src/include/SlabAllocator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace faliks {
+
+    // An item at the start of a slab chunk: this header, the key, then the
+    // value followed by "\r\n", so the text protocol can send value and
+    // terminator from the chunk as they are. What the accessors return does
+    // not change while the item is acquired, also after it is replaced,
+    // deleted or evicted; a new value always goes into a new item.
+    struct MemcacheItem {
+        MemcacheItem *next;
+        uint64_t hash;
+        uint64_t cas;
+        // Steady clock seconds, 0 for never.
+        int64_t deadline;
+        uint32_t flags;
+        uint32_t valueBytes;
+        // Acquired references, which keep the chunk from reuse.
+        uint32_t refs;
+        uint16_t keyBytes;
+        uint8_t slabClass;
+        // In the table. A freed chunk reads as unlinked.
+        bool linked;
+        // The CLOCK bit, set on every access.
+        bool referenced;
+
+        [[nodiscard]] const char *keyData() const { return reinterpret_cast<const char *>(this + 1); }
+
+        [[nodiscard]] std::string_view key() const { return {keyData(), keyBytes}; }
+
+        [[nodiscard]] const char *valueData() const { return keyData() + keyBytes; }
+
+        [[nodiscard]] std::string_view value() const { return {valueData(), valueBytes}; }
+    };
+
+    // The items of a memcached server in stripes, each a mutex over a hash
+    // table and a SlabAllocator of its own, so loops contend only when they
+    // touch the same stripe at once. A stripe that runs out of memory in a
+    // size class evicts an item of that class picked by CLOCK: a hand sweeps
+    // the class's chunks, clearing the bits of items used since its last
+    // pass and taking the first one not used, skipping acquired ones.
+    // Acquired items are read without the lock, so replies can point at
+    // them while they wait in output queues. Thread safe.
+    class MemcacheStore : NoneCopyable {
+    public:
+        static constexpr size_t kMaxKeyBytes = 250;
+
+        enum class StoreMode {
+            kSet, kAdd, kReplace, kAppend, kPrepend, kCas
+        };
+
+        enum class Result {
+            kStored, kNotStored, kExists, kNotFound, kNonNumeric, kTooLarge, kOutOfMemory
+        };
+
+        struct Stats {
+            size_t items = 0;
+            // Key and value bytes of the items.
+            size_t bytes = 0;
+            size_t reservedBytes = 0;
+            uint64_t evictions = 0;
+        };
+
+    private:
+        struct Stripe {
+            const size_t index;
+            std::mutex mutex;
+            SlabAllocator slabs GUARDED_BY(mutex);
+            std::vector<MemcacheItem *> buckets GUARDED_BY(mutex);
+            size_t size GUARDED_BY(mutex);
+            size_t bytes GUARDED_BY(mutex);
+            // A CLOCK hand per size class, an index into its chunks.
+            std::vector<size_t> hands GUARDED_BY(mutex);
+            uint64_t nextCas GUARDED_BY(mutex);
+            uint64_t evictions GUARDED_BY(mutex);
+
+            Stripe(size_t index, size_t memoryLimit);
+        };
+
+        std::vector<std::unique_ptr<Stripe>> m_stripes;
+        // When a delayed flush_all takes effect, 0 if none is pending.
+        std::atomic<int64_t> m_flushAt;
+
+        [[nodiscard]] Stripe &stripeOf(uint64_t hash) const {
+            return *m_stripes[((hash >> 32) * m_stripes.size()) >> 32];
+        }
+
+        // Runs a delayed flush whose time has come.
+        void checkFlush();
+
+        // The live item of key, unlinking it if it expired.
+        MemcacheItem *find(Stripe &stripe, std::string_view key, uint64_t hash);
+
+        void link(Stripe &stripe, MemcacheItem *item);
+
+        // Frees the item unless it is acquired, then its last release does.
+        void unlink(Stripe &stripe, MemcacheItem *item);
+
+        void unref(Stripe &stripe, MemcacheItem *item);
+
+        // A new item with room for the key and valueBytes, evicting if the
+        // class is full. nullptr if it is too large or nothing is evictable.
+        MemcacheItem *allocate(Stripe &stripe, std::string_view key, uint64_t hash, size_t valueBytes,
+                               Result *error);
+
+        void flushStripe(Stripe &stripe);
+
+    public:
+        // memoryLimit is split between the stripes.
+        MemcacheStore(size_t memoryLimit, size_t numStripes);
+
+        ~MemcacheStore();
+
+        // A seconds count as memcached takes it: relative up to 30 days,
+        // else a unix time, negative for already expired. 0 for never.
+        static int64_t deadlineOf(int64_t exptime);
+
+        // nullptr if absent or expired. Release what is returned.
+        const MemcacheItem *acquire(std::string_view key, uint64_t hash);
+
+        void release(const MemcacheItem *const *items, size_t count);
+
+        void release(const MemcacheItem *item) { release(&item, 1); }
+
+        // cas is compared in kCas mode and set to the stored item's. Append
+        // and prepend keep the flags and expiry of the item they extend.
+        Result store(StoreMode mode, std::string_view key, uint64_t hash, uint32_t flags, int64_t exptime,
+                     std::string_view value, uint64_t *cas);
+
+        bool remove(std::string_view key, uint64_t hash);
+
+        bool touch(std::string_view key, uint64_t hash, int64_t exptime);
+
+        // Adds to or subtracts from a decimal value, wrapping at 2^64 and
+        // stopping at 0. A missing key is created with *initial if given.
+        Result incrDecr(std::string_view key, uint64_t hash, bool incr, uint64_t delta, const uint64_t *initial,
+                        int64_t exptime, uint64_t *value, uint64_t *cas);
+
+        // Every item goes, after delay seconds if positive.
+        void flush(int64_t delay = 0);
+
+        [[nodiscard]] Stats stats() const;
+
+        [[nodiscard]] size_t numStripes() const { return m_stripes.size(); }
+    };
+}
+
+#endif //MUDUO_LEARN_MEMCACHESTORE_H
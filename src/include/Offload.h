@@ -0,0 +1,40 @@
+#ifndef MUDUO_LEARN_OFFLOAD_H
+#define MUDUO_LEARN_OFFLOAD_H
+
+#include "base/include/WorkStealingPool.h"
+#include "src/include/EventLoop.h"
+
+#include <cassert>
+#include <type_traits>
+#include <utility>
+
+namespace faliks {
+
+    // Runs work() on the pool and then done(result), or done() for void work,
+    // back in loop. Returns false when the pool shed the task, so the caller
+    // can answer "overloaded" right away. loop must outlive the task.
+    template<typename Work, typename Done>
+    bool offload(WorkStealingPool &pool, EventLoop *loop, Work work, Done done) {
+        return pool.trySubmit([loop, work = std::move(work), done = std::move(done)]() mutable {
+            if constexpr (std::is_void_v<std::invoke_result_t<Work &>>) {
+                work();
+                loop->queueInLoop(std::move(done));
+            } else {
+                loop->queueInLoop([result = work(), done = std::move(done)]() mutable {
+                    done(std::move(result));
+                });
+            }
+        });
+    }
+
+    // Same, returning to the loop of the calling thread.
+    template<typename Work, typename Done>
+    bool offload(WorkStealingPool &pool, Work work, Done done) {
+        EventLoop *loop = EventLoop::getEventLoopOfCurrentThread();
+        assert(loop != nullptr);
+        return offload(pool, loop, std::move(work), std::move(done));
+    }
+}
+
+
+#endif //MUDUO_LEARN_OFFLOAD_H
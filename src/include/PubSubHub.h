@@ -0,0 +1,119 @@
+#ifndef MUDUO_LEARN_PUBSUBHUB_H
+#define MUDUO_LEARN_PUBSUBHUB_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/ThreadSaftyCheck.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace faliks {
+
+    class EventLoop;
+
+    class TcpConnection;
+
+    // Topics with subscribed connections, partitioned by IO loop. Each loop
+    // keeps the subscribers it owns and is only touched in its thread, so a
+    // publish is stored once and costs at most one task per loop that has
+    // subscribers, where every subscriber's output queue references the same
+    // bytes. Publishes that pile up before the loop runs go out together,
+    // one writev per subscriber; order is kept within a topic. Subscribing
+    // and publishing work from any thread. A connection stays in the shard
+    // it first subscribed in until its last subscription ends, even if it
+    // migrates meanwhile. Tasks in the loops refer to the hub, so it goes
+    // away after they stop.
+    class PubSubHub : NoneCopyable {
+    public:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+        using Payload = std::shared_ptr<const std::string>;
+
+    private:
+        struct Topic {
+            std::vector<TcpConnectionPtr> subscribers;
+            std::unordered_map<const TcpConnection *, size_t> index;
+        };
+
+        struct Shard {
+            EventLoop *loop;
+            size_t loopIndex;
+            std::unordered_map<std::string, Topic> topics;
+            std::unordered_map<const TcpConnection *, std::vector<std::string>> byConnection;
+            // Publishes waiting for the loop, taken by one task at a time.
+            std::mutex mutex;
+            std::vector<std::pair<std::string, Payload>> pending GUARDED_BY(mutex);
+            std::atomic<bool> flushQueued{false};
+        };
+
+        // The shard a connection's subscriptions live in. refs counts them,
+        // and the subscribe tasks not yet run, which keep conn alive.
+        struct Subscriber {
+            Shard *shard;
+            size_t refs;
+        };
+
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        std::unordered_map<EventLoop *, Shard *> m_byLoop;
+        mutable std::mutex m_mutex;
+        // Subscribers of each topic per loop index, to skip loops without any.
+        std::unordered_map<std::string, std::vector<size_t>> m_topics GUARDED_BY(m_mutex);
+        std::unordered_map<const TcpConnection *, Subscriber> m_subscribers GUARDED_BY(m_mutex);
+
+        Shard *shardOf(const TcpConnectionPtr &conn) const;
+
+        // The shard of conn's subscriptions, taking a reference to it.
+        Shard *retainShard(const TcpConnectionPtr &conn);
+
+        void releaseShard(const TcpConnection *conn);
+
+        // nullptr if conn has no subscriptions.
+        Shard *subscribedShard(const TcpConnection *conn) const;
+
+        void subscribeInLoop(Shard *shard, const TcpConnectionPtr &conn, const std::string &topic);
+
+        bool unsubscribeInLoop(Shard *shard, const TcpConnection *conn, const std::string &topic);
+
+        void unsubscribeAllInLoop(Shard *shard, const TcpConnection *conn);
+
+        void flushInLoop(Shard *shard);
+
+        void countSubscriber(const std::string &topic, size_t loopIndex, bool added);
+
+    public:
+        // loops are the IO loops of the server, see ThreadPool::getAllLoops.
+        explicit PubSubHub(const std::vector<EventLoop *> &loops);
+
+        ~PubSubHub();
+
+        // Subscribing twice is a no-op.
+        void subscribe(const TcpConnectionPtr &conn, const std::string &topic);
+
+        void unsubscribe(const TcpConnectionPtr &conn, const std::string &topic);
+
+        // Call when conn closes. A closed subscriber is dropped at the next
+        // publish anyway, but holds the connection until then.
+        void unsubscribeAll(const TcpConnectionPtr &conn);
+
+        static Payload makePayload(std::string message) {
+            return std::make_shared<const std::string>(std::move(message));
+        }
+
+        // Returns the number of loops the message was posted to.
+        size_t publish(const std::string &topic, std::string message) {
+            return publish(topic, makePayload(std::move(message)));
+        }
+
+        size_t publish(const std::string &topic, const Payload &payload);
+
+        // Includes subscriptions the loops have not applied yet.
+        [[nodiscard]] size_t numSubscribers(const std::string &topic) const;
+
+        [[nodiscard]] size_t numTopics() const;
+    };
+}
+
+#endif //MUDUO_LEARN_PUBSUBHUB_H
@@ -0,0 +1,147 @@
+#ifndef MUDUO_LEARN_RESPCODEC_H
+#define MUDUO_LEARN_RESPCODEC_H
+
+#include "base/include/Copyable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace faliks {
+
+    class Buffer;
+
+    // Parses RESP2 and RESP3 messages in place in a connection's input
+    // buffer, commands and replies alike. parse() picks up where the previous
+    // call stopped, so a message trickling in is not scanned again; values
+    // are kept as offsets into the buffer until the message is complete and
+    // are valid until consume(). Pipelined messages stay in the buffer
+    // behind the current one. A line that does not start with a type byte
+    // is an inline command, split at spaces.
+    class RespParser : public Copyable {
+    public:
+        enum class Result {
+            kNeedMore, kComplete, kError
+        };
+
+        enum class Type : char {
+            kSimpleString = '+',
+            kError = '-',
+            kInteger = ':',
+            kBulkString = '$',
+            kArray = '*',
+            // RESP3, and the RESP2 null bulk string and null array.
+            kNull = '_',
+            kBoolean = '#',
+            kDouble = ',',
+            kBigNumber = '(',
+            kBulkError = '!',
+            kVerbatim = '=',
+            kMap = '%',
+            kSet = '~',
+            kAttribute = '|',
+            kPush = '>',
+        };
+
+        // One value of a message, in pre-order: an aggregate is followed by
+        // its elements, and an attribute by its pairs and then the value it
+        // annotates.
+        struct Value {
+            Type type;
+            // The text of everything but aggregates, kNull and kBoolean.
+            std::string_view data;
+            // kInteger's value, kBoolean's 0 or 1, and the number of
+            // elements of an aggregate, pairs for kMap and kAttribute.
+            int64_t integer;
+        };
+
+    private:
+        struct Node {
+            Type type;
+            uint32_t offset;
+            uint32_t length;
+            int64_t integer;
+        };
+
+        struct Frame {
+            int64_t remaining;
+            bool attribute;
+        };
+
+        // Bytes of the current message parsed so far.
+        size_t m_offset;
+        // Body bytes of the bulk value whose header has been parsed, or -1.
+        int64_t m_bulkLength;
+        Type m_bulkType;
+        bool m_complete;
+        std::string m_error;
+        std::vector<Node> m_nodes;
+        std::vector<Frame> m_stack;
+        std::vector<Value> m_values;
+        size_t m_maxBulkBytes;
+        size_t m_maxElements;
+
+        Result fail(const char *error);
+
+        bool parseInline(const char *base, const char *end);
+
+        // A header line or simple value that has arrived in full.
+        bool parseLine(const char *base, const char *line, const char *lineEnd);
+
+        void addNode(Type type, const char *base, const char *data, size_t length, int64_t integer);
+
+        // Pushes an aggregate of count elements, or finishes it if empty.
+        void openAggregate(Type type, const char *base, int64_t count, bool attribute);
+
+        void valueDone();
+
+    public:
+        static constexpr size_t kMaxLineBytes = 64 * 1024;
+        static constexpr size_t kMaxDepth = 32;
+
+        explicit RespParser(size_t maxBulkBytes = 512 * 1024 * 1024, size_t maxElements = 1024 * 1024);
+
+        Result parse(const Buffer *buf);
+
+        // After kComplete, until consume().
+        [[nodiscard]] const std::vector<Value> &values() const { return m_values; }
+
+        // The message as a command: an array of strings, or an inline
+        // command. False for anything else.
+        bool command(std::vector<std::string_view> *args) const;
+
+        // Retrieves the complete message from buf and starts on the next.
+        void consume(Buffer *buf);
+
+        void reset();
+
+        // After kError, "Protocol error: ..." as Redis words it.
+        [[nodiscard]] const std::string &error() const { return m_error; }
+    };
+
+    // Appends RESP values to a Buffer. Where RESP2 and RESP3 differ, the
+    // protocol version decides.
+    struct RespWriter {
+        static void appendSimpleString(Buffer *buf, std::string_view text);
+
+        static void appendError(Buffer *buf, std::string_view message);
+
+        static void appendInteger(Buffer *buf, int64_t value);
+
+        static void appendBulkString(Buffer *buf, std::string_view data);
+
+        static void appendNull(Buffer *buf, int protocol);
+
+        static void appendArrayHeader(Buffer *buf, size_t count);
+
+        // A RESP2 map is a flat array of keys and values.
+        static void appendMapHeader(Buffer *buf, size_t pairs, int protocol);
+
+        // A command as an array of bulk strings.
+        static void appendCommand(Buffer *buf, const std::vector<std::string_view> &args);
+    };
+}
+
+#endif //MUDUO_LEARN_RESPCODEC_H
@@ -0,0 +1,131 @@
+#ifndef MUDUO_LEARN_RPCCLIENT_H
+#define MUDUO_LEARN_RPCCLIENT_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/ThreadSaftyCheck.h"
+#include "src/include/Buffer.h"
+#include "src/include/LengthHeaderCodec.h"
+#include "src/include/RpcCodec.h"
+#include "src/include/TcpClient.h"
+#include "src/include/TimerId.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace faliks {
+
+    // Calls on one connection to an RpcServer. Any number of calls may be in
+    // flight, answered in any order. Calls made before the loop gets to them,
+    // e.g. several from one callback, go out together in one send. Every call
+    // has a deadline; one loop timer, armed for the earliest, expires them.
+    class RpcClient : NoneCopyable {
+    public:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+        // response is valid during the call; with a status other than kOk it
+        // is the error text, if any.
+        using Callback = std::function<void(RpcStatus status, std::string_view response)>;
+        using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
+
+    private:
+        struct Call {
+            uint64_t id;
+            double timeout;
+            Callback callback;
+        };
+
+        struct Pending {
+            int64_t deadline;
+            Callback callback;
+        };
+
+        // Microseconds since the epoch and call id.
+        using Deadline = std::pair<int64_t, uint64_t>;
+
+        EventLoop *m_loop;
+        TcpClient m_client;
+        LengthHeaderCodec m_codec;
+        ConnectionCallback m_connectionCallback;
+        std::atomic<uint64_t> m_nextId;
+        std::atomic<bool> m_connected;
+
+        std::mutex m_mutex;
+        Buffer m_outgoing GUARDED_BY(m_mutex);
+        std::vector<Call> m_calls GUARDED_BY(m_mutex);
+        std::atomic<bool> m_flushQueued;
+
+        // In loop. Deadlines of answered calls stay in the heap until they
+        // come up or the heap is rebuilt.
+        std::unordered_map<uint64_t, Pending> m_pending;
+        std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> m_deadlines;
+        TimerId m_timer;
+        int64_t m_timerAt;
+
+        void onConnection(const TcpConnectionPtr &conn);
+
+        void onFrames(const std::vector<std::string_view> &frames);
+
+        void flushInLoop();
+
+        void addDeadline(uint64_t id, int64_t deadline);
+
+        void expire();
+
+        void failAll(RpcStatus status);
+
+    public:
+        RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+                  size_t maxFrameBytes = 64 * 1024 * 1024);
+
+        // Destroy in the loop thread once no more calls are made; calls still
+        // pending are dropped without their callbacks.
+        ~RpcClient();
+
+        void connect() { m_client.connect(); }
+
+        void disconnect() { m_client.disconnect(); }
+
+        void enableRetry() { m_client.enableRetry(); }
+
+        // Set before connect().
+        void setConnectionCallback(const ConnectionCallback &cb) { m_connectionCallback = cb; }
+
+        [[nodiscard]] bool connected() const { return m_connected.load(std::memory_order_acquire); }
+
+        [[nodiscard]] EventLoop *getLoop() const { return m_loop; }
+
+        // Any thread. cb runs in the loop exactly once: with the answer,
+        // with kTimeout after timeout seconds, or with kDisconnected when
+        // there is no connection or it closes first.
+        void call(std::string_view method, std::string_view request, Callback cb, double timeout = 5.0);
+
+        // Typed, through Serializer, see RpcCodec.h. A response that does
+        // not decode is reported as kBadRequest.
+        template<typename Serializer, typename Request, typename Response>
+        void call(std::string_view method, const Request &request,
+                  std::function<void(RpcStatus, const Response &)> cb, double timeout = 5.0) {
+            thread_local std::string body;
+            body.clear();
+            Serializer::encode(request, &body);
+            call(method, body, [cb = std::move(cb)](RpcStatus status, std::string_view response) {
+                Response value{};
+                if (status == RpcStatus::kOk && !Serializer::decode(response, &value)) {
+                    status = RpcStatus::kBadRequest;
+                }
+                cb(status, value);
+            }, timeout);
+        }
+
+        // Calls waiting for an answer, in loop.
+        [[nodiscard]] size_t numPending() const { return m_pending.size(); }
+    };
+}
+
+#endif //MUDUO_LEARN_RPCCLIENT_H
@@ -0,0 +1,97 @@
+#ifndef MUDUO_LEARN_RPCCODEC_H
+#define MUDUO_LEARN_RPCCODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace faliks {
+
+    class Buffer;
+
+    class LengthHeaderCodec;
+
+    enum class RpcStatus : uint8_t {
+        kOk = 0,
+        kNoSuchMethod,
+        kBadRequest,
+        kOverloaded,
+        kHandlerError,
+        // Decided by the client, never sent.
+        kTimeout,
+        kDisconnected,
+    };
+
+    const char *rpcStatusName(RpcStatus status);
+
+    // RPC messages inside LengthHeaderCodec frames. A request is
+    // kind, id, method length, method and body; a response is kind, id,
+    // status and body, an error text unless the status is kOk. The id, big
+    // endian, pairs a response with its request, so responses may come in
+    // any order.
+    class RpcCodec {
+    public:
+        enum class Kind : uint8_t {
+            kRequest = 0, kResponse = 1
+        };
+
+        struct Message {
+            Kind kind;
+            uint64_t id;
+            std::string_view method;
+            RpcStatus status;
+            std::string_view body;
+        };
+
+        static constexpr size_t kMaxMethodBytes = 255;
+
+        static bool appendRequest(const LengthHeaderCodec &codec, Buffer *buf, uint64_t id, std::string_view method,
+                                  std::string_view body);
+
+        static bool appendResponse(const LengthHeaderCodec &codec, Buffer *buf, uint64_t id, RpcStatus status,
+                                   std::string_view body);
+
+        // Views into frame. False if it is malformed.
+        static bool decode(std::string_view frame, Message *message);
+    };
+
+    // Serializers turn typed requests and responses into bodies. One is a
+    // type with, for every T it handles,
+    //     static void encode(const T &value, std::string *out);
+    //     static bool decode(std::string_view in, T *value);
+    // and is passed as a template argument to RpcServer::registerMethod and
+    // RpcClient::call.
+
+    // Bodies as they are.
+    struct RpcRawSerializer {
+        static void encode(const std::string &value, std::string *out) { out->assign(value); }
+
+        static bool decode(std::string_view in, std::string *value) {
+            value->assign(in);
+            return true;
+        }
+    };
+
+    // Trivially copyable structs byte for byte, for peers of the same build.
+    struct RpcPodSerializer {
+        template<typename T>
+        static void encode(const T &value, std::string *out) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            out->assign(reinterpret_cast<const char *>(&value), sizeof value);
+        }
+
+        template<typename T>
+        static bool decode(std::string_view in, T *value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (in.size() != sizeof *value) {
+                return false;
+            }
+            memcpy(value, in.data(), sizeof *value);
+            return true;
+        }
+    };
+}
+
+#endif //MUDUO_LEARN_RPCCODEC_H
@@ -0,0 +1,110 @@
+#ifndef MUDUO_LEARN_RPCSERVER_H
+#define MUDUO_LEARN_RPCSERVER_H
+
+#include "base/include/Copyable.h"
+#include "base/include/NoneCopyable.h"
+#include "src/include/LengthHeaderCodec.h"
+#include "src/include/RpcCodec.h"
+#include "src/include/TcpServer.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace faliks {
+
+    class WorkStealingPool;
+
+    // Request/response RPC on a TcpServer, see RpcCodec for the messages.
+    // Handlers run in the connection's loop and may answer at once or later
+    // from any thread; answers given while a read is being handled go out
+    // together in one send. Offloaded methods run on a WorkStealingPool and
+    // answer kOverloaded when the pool sheds them.
+    class RpcServer : NoneCopyable {
+    public:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+
+        // Completes one call. Answer once, from any thread; a call never
+        // answered runs into the caller's deadline.
+        class Responder : public Copyable {
+        private:
+            std::weak_ptr<TcpConnection> m_conn;
+            const LengthHeaderCodec *m_codec;
+            uint64_t m_id;
+
+        public:
+            Responder(const TcpConnectionPtr &conn, const LengthHeaderCodec *codec, uint64_t id)
+                    : m_conn(conn), m_codec(codec), m_id(id) {}
+
+            void reply(std::string_view response) const { respond(RpcStatus::kOk, response); }
+
+            void fail(RpcStatus status, std::string_view message = {}) const { respond(status, message); }
+
+            void respond(RpcStatus status, std::string_view body) const;
+        };
+
+        // request is valid during the call.
+        using Handler = std::function<void(std::string_view request, const Responder &)>;
+        // Fills *response, or an error text with a status other than kOk.
+        using Work = std::function<RpcStatus(std::string_view request, std::string *response)>;
+
+    private:
+        TcpServer m_server;
+        LengthHeaderCodec m_codec;
+        std::unordered_map<std::string, Handler> m_handlers;
+
+        void onFrames(const TcpConnectionPtr &conn, const std::vector<std::string_view> &frames);
+
+    public:
+        RpcServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                  TcpServer::Option option = TcpServer::Option::kNoReusePort,
+                  size_t maxFrameBytes = 64 * 1024 * 1024);
+
+        // Register every method before start().
+        void registerHandler(const std::string &method, Handler handler);
+
+        // pool outlives the server.
+        void registerOffloaded(const std::string &method, WorkStealingPool *pool, Work work);
+
+        // Typed, through Serializer, see RpcCodec.h. Runs in the loop, or on
+        // pool if given. A request that does not decode gets kBadRequest.
+        template<typename Serializer, typename Request, typename Response>
+        void registerMethod(const std::string &method, std::function<RpcStatus(const Request &, Response *)> fn,
+                            WorkStealingPool *pool = nullptr) {
+            Work work = [fn = std::move(fn)](std::string_view request, std::string *response) {
+                Request value{};
+                if (!Serializer::decode(request, &value)) {
+                    return RpcStatus::kBadRequest;
+                }
+                Response result{};
+                RpcStatus status = fn(value, &result);
+                if (status == RpcStatus::kOk) {
+                    Serializer::encode(result, response);
+                }
+                return status;
+            };
+            if (pool != nullptr) {
+                registerOffloaded(method, pool, std::move(work));
+                return;
+            }
+            registerHandler(method, [work = std::move(work)](std::string_view request, const Responder &responder) {
+                thread_local std::string output;
+                output.clear();
+                RpcStatus status = work(request, &output);
+                responder.respond(status, output);
+            });
+        }
+
+        void setThreadNum(int numThreads) { m_server.setThreadNum(numThreads); }
+
+        void start() { m_server.start(); }
+
+        // For the settings RpcServer does not wrap.
+        TcpServer *tcpServer() { return &m_server; }
+    };
+}
+
+#endif //MUDUO_LEARN_RPCSERVER_H
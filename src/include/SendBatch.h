@@ -0,0 +1,63 @@
+#ifndef MUDUO_LEARN_SENDBATCH_H
+#define MUDUO_LEARN_SENDBATCH_H
+
+#include "base/include/NoneCopyable.h"
+#include "src/include/ConnectionHandle.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace faliks {
+
+    class EventLoop;
+
+    class TcpConnection;
+
+    class TcpServer;
+
+    // Collects replies for many connections on a worker thread and hands
+    // them to their loops with one task per loop instead of one per send.
+    // Each loop writes the messages of a connection with gather I/O, in the
+    // order they were added.
+    class SendBatch : NoneCopyable {
+    private:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+
+        struct Target {
+            TcpConnectionPtr conn;
+            ConnectionHandle handle;
+            std::vector<std::string> messages;
+        };
+
+        struct LoopBatch {
+            std::vector<Target> targets;
+            std::unordered_map<const TcpConnection *, size_t> byConnection;
+            std::unordered_map<uint64_t, size_t> byHandle;
+        };
+
+        TcpServer *m_server;
+        std::unordered_map<EventLoop *, LoopBatch> m_batches;
+        size_t m_messages;
+
+    public:
+        // Adding by handle needs the server the handles belong to.
+        explicit SendBatch(TcpServer *server = nullptr);
+
+        void add(const TcpConnectionPtr &conn, std::string message);
+
+        // Dropped on arrival if the connection has closed, like TcpServer::sendTo.
+        void add(ConnectionHandle handle, std::string message);
+
+        [[nodiscard]] size_t size() const { return m_messages; }
+
+        [[nodiscard]] bool empty() const { return m_messages == 0; }
+
+        // Posts the batch and leaves this one empty for reuse. Returns the
+        // number of loops posted to.
+        size_t post();
+    };
+}
+
+#endif //MUDUO_LEARN_SENDBATCH_H
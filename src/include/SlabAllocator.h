@@ -0,0 +1,64 @@
+#ifndef MUDUO_LEARN_SLABALLOCATOR_H
+#define MUDUO_LEARN_SLABALLOCATOR_H
+
+#include "base/include/NoneCopyable.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace faliks {
+
+    // Fixed size chunks carved out of pages of kPageBytes, in classes whose
+    // chunk sizes grow by a factor from a minimum up to a whole page. A
+    // class takes pages while the memory limit allows, but always its first
+    // one, so no size ever finds its class without memory. Freed chunks go
+    // back to their class and are never returned to the system. Chunks stay
+    // in place and can be swept by index, e.g. to look for victims when a
+    // class runs out. Not thread safe.
+    class SlabAllocator : NoneCopyable {
+    public:
+        static constexpr size_t kPageBytes = 1024 * 1024;
+
+    private:
+        struct SlabClass {
+            size_t chunkBytes;
+            size_t chunksPerPage;
+            std::vector<char *> pages;
+            // Chunks handed out from the last page so far.
+            size_t carved;
+            void *freeList;
+        };
+
+        std::vector<SlabClass> m_classes;
+        const size_t m_memoryLimit;
+        size_t m_reservedBytes;
+
+    public:
+        // minChunkBytes is rounded up to a multiple of 8.
+        explicit SlabAllocator(size_t memoryLimit, size_t minChunkBytes = 64, double growthFactor = 1.25);
+
+        ~SlabAllocator();
+
+        // The smallest class with chunks of at least size bytes, or
+        // numClasses() if size exceeds a page.
+        [[nodiscard]] size_t classOf(size_t size) const;
+
+        [[nodiscard]] size_t numClasses() const { return m_classes.size(); }
+
+        [[nodiscard]] size_t chunkBytes(size_t cls) const { return m_classes[cls].chunkBytes; }
+
+        // nullptr when the class has no free chunk and no page may be added.
+        void *allocate(size_t cls);
+
+        void deallocate(void *chunk, size_t cls);
+
+        // Chunks of cls ever handed out, free ones included.
+        [[nodiscard]] size_t numChunks(size_t cls) const;
+
+        [[nodiscard]] void *chunkAt(size_t cls, size_t index) const;
+
+        [[nodiscard]] size_t reservedBytes() const { return m_reservedBytes; }
+    };
+}
+
+#endif //MUDUO_LEARN_SLABALLOCATOR_H
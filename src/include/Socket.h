@@ -3,6 +3,8 @@
 
 #include "base/include/NoneCopyable.h"
 
+#include <vector>
+
 struct tcp_info;
 
 namespace faliks {
@@ -37,6 +39,10 @@ namespace faliks {
 
         void setReusePort(bool on) const;
 
+        // Steers new connections of this socket's SO_REUSEPORT group to the
+        // member with index cpuToIndex[receiving cpu], in listen() order.
+        bool attachReusePortCpuSteering(const std::vector<int> &cpuToIndex, int numSockets) const;
+
         void setKeepAlive(bool on);
     };
 
@@ -0,0 +1,42 @@
+#ifndef MUDUO_LEARN_STATICFILEHANDLER_H
+#define MUDUO_LEARN_STATICFILEHANDLER_H
+
+#include "base/include/NoneCopyable.h"
+#include "src/include/FileCache.h"
+
+#include <string>
+#include <string_view>
+
+namespace faliks {
+
+    class HttpRequest;
+
+    class HttpResponse;
+
+    // Answers GET and HEAD for files below a URL prefix from a FileCache.
+    // Mapped files go out as a gather write of the head and the mapping,
+    // the others with sendfile. Supports a single byte range, ETag and
+    // If-None-Match. Call handle() from the HttpServer callback.
+    class StaticFileHandler : NoneCopyable {
+    private:
+        FileCache *m_cache;
+        const std::string m_urlPrefix;
+        std::string m_indexFile;
+
+    public:
+        // urlPrefix starts and ends with '/', "/static/" serves
+        // "/static/a.css" as "a.css" below the cache's root.
+        explicit StaticFileHandler(FileCache *cache, const std::string &urlPrefix = "/");
+
+        // Served for paths ending in '/'.
+        void setIndexFile(const std::string &name) { m_indexFile = name; }
+
+        // False if the path is not below the prefix, the request is left
+        // to the caller then.
+        bool handle(const HttpRequest &request, HttpResponse *response) const;
+
+        static std::string_view contentType(std::string_view path);
+    };
+}
+
+#endif //MUDUO_LEARN_STATICFILEHANDLER_H
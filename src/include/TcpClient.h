@@ -0,0 +1,89 @@
+#ifndef MUDUO_LEARN_TCPCLIENT_H
+#define MUDUO_LEARN_TCPCLIENT_H
+
+#include "src/include/TcpConnection.h"
+#include "base/include/ThreadSaftyCheck.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace faliks {
+
+    class Connector;
+
+    class EventLoop;
+
+    // One outbound connection served by the same TcpConnection as the server
+    // side, with all callbacks in loop. With retry enabled a closed
+    // connection is reopened through the Connector's backoff.
+    class TcpClient : NoneCopyable {
+    private:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+        using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
+        using MessageCallback = std::function<void(const TcpConnectionPtr &, Buffer *, Timestamp)>;
+        using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
+
+        EventLoop *m_loop;
+        std::shared_ptr<Connector> m_connector;
+        const std::string m_name;
+        const std::shared_ptr<const std::string> m_connNamePrefix;
+        ConnectionCallback m_connectionCallback;
+        MessageCallback m_messageCallback;
+        WriteCompleteCallback m_writeCompleteCallback;
+        std::atomic<bool> m_retry;
+        std::atomic<bool> m_connect;
+        uint64_t m_nextConnId;
+        mutable std::mutex m_mutex;
+        TcpConnectionPtr m_connection GUARDED_BY(m_mutex);
+
+        void newConnection(int sockfd);
+
+        void removeConnection(const TcpConnectionPtr &conn);
+
+    public:
+        TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+
+        // Destroy in the loop thread.
+        ~TcpClient();
+
+        void connect();
+
+        // Half-closes the connection, which is not reopened.
+        void disconnect();
+
+        // Gives up connecting, leaving an established connection alone.
+        void stop();
+
+        [[nodiscard]] TcpConnectionPtr connection() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_connection;
+        }
+
+        [[nodiscard]] EventLoop *getLoop() const { return m_loop; }
+
+        [[nodiscard]] const std::string &name() const { return m_name; }
+
+        [[nodiscard]] bool retry() const { return m_retry; }
+
+        // Reconnect when an established connection closes.
+        void enableRetry() { m_retry = true; }
+
+        // See Connector::setRetryDelays, call before connect().
+        void setRetryDelays(double initialDelay, double maxDelay);
+
+        // Failed connect attempts since the last success.
+        [[nodiscard]] int connectRetries() const;
+
+        // Callbacks are copied into each connection, set them before connect().
+        void setConnectionCallback(const ConnectionCallback &cb) { m_connectionCallback = cb; }
+
+        void setMessageCallback(const MessageCallback &cb) { m_messageCallback = cb; }
+
+        void setWriteCompleteCallback(const WriteCompleteCallback &cb) { m_writeCompleteCallback = cb; }
+    };
+}
+
+#endif //MUDUO_LEARN_TCPCLIENT_H
@@ -4,15 +4,25 @@
 #include "base/include/NoneCopyable.h"
 #include "src/include/InetAddress.h"
 #include "src/include/Buffer.h"
+#include "src/include/ConnectionHandle.h"
 #include "base/include/Timestamp.h"
+#include "base/include/ThreadSaftyCheck.h"
 
 
+#include <sys/types.h>
+#include <any>
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <functional>
+#include <mutex>
 #include <string>
+#include <vector>
 
 struct tcp_info;
 
+struct iovec;
+
 namespace faliks {
 
     class Channel;
@@ -31,13 +41,28 @@ namespace faliks {
         using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
         using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
         using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+        using MigrateCallback = std::function<void(const TcpConnectionPtr &, EventLoop *from, EventLoop *to)>;
 
         enum StateE {
             kDisconnected = 0, kConnecting, kConnected, kDisconnecting
         };
 
-        EventLoop *m_loop;
-        const std::string m_name;
+        // Output queued behind m_outputBuffer without being copied: memory
+        // owner keeps alive, or with fd >= 0 a file range for sendfile(2).
+        struct OutputSegment {
+            const char *data;
+            int fd;
+            off_t offset;
+            size_t len;
+            std::shared_ptr<const void> owner;
+        };
+
+        std::atomic<EventLoop *> m_loop;
+        const uint64_t m_id;
+        ConnectionHandle m_handle;
+        const std::shared_ptr<const std::string> m_namePrefix;
+        mutable std::once_flag m_nameOnce;
+        mutable std::string m_name;
         StateE m_state;
         bool m_reading;
         std::unique_ptr<Socket> m_socket;
@@ -49,9 +74,19 @@ namespace faliks {
         WriteCompleteCallback m_writeCompleteCallback;
         HighWaterMarkCallback m_highWaterMarkCallback;
         CloseCallback m_closeCallback;
+        MigrateCallback m_migrateCallback;
         size_t m_highWaterMark;
         Buffer m_inputBuffer;
         Buffer m_outputBuffer;
+        std::atomic<uint64_t> m_bytesTransferred;
+        std::atomic<int> m_migrations;
+        bool m_attaching;
+        EventLoop *m_pendingMigration;
+        std::mutex m_pendingMutex;
+        std::vector<std::string> m_pendingSends GUARDED_BY(m_pendingMutex);
+        std::atomic<bool> m_flushQueued;
+        std::deque<OutputSegment> m_segments;
+        std::any m_context;
 
         void handleRead(Timestamp receiveTime);
 
@@ -65,6 +100,23 @@ namespace faliks {
 
         void sendInLoop(const void *message, size_t len);
 
+        void sendInLoop(const std::vector<std::string> &messages);
+
+        void sendSlices(const struct iovec *slices, size_t count,
+                        const std::function<std::shared_ptr<const void>(size_t)> &ownerOf);
+
+        void appendOutput(const char *data, size_t len);
+
+        void appendSegment(OutputSegment segment);
+
+        bool writeSegments();
+
+        void queueWriteComplete();
+
+        void queueFlush();
+
+        void flushPendingSends();
+
         void shutdownInLoop();
 
         void forceCloseInLoop();
@@ -77,6 +129,16 @@ namespace faliks {
 
         void stopReadInLoop();
 
+        // The owner loop changes when the connection migrates, so functors
+        // that land on a former owner are forwarded to the current one.
+        void runInOwnerLoop(std::function<void()> cb);
+
+        void queueInOwnerLoop(std::function<void()> cb);
+
+        void migrateInLoop(EventLoop *loop);
+
+        void attachInLoop();
+
     public:
         TcpConnection(EventLoop *loop,
                       const std::string &name,
@@ -84,11 +146,29 @@ namespace faliks {
                       const InetAddress &localAddr,
                       const InetAddress &peerAddr);
 
+        // The name is formatted as namePrefix + id on first use of getName(),
+        // so the accept path never builds strings. Id 0 leaves the prefix alone.
+        TcpConnection(EventLoop *loop,
+                      std::shared_ptr<const std::string> namePrefix,
+                      uint64_t id,
+                      int sockfd,
+                      const InetAddress &localAddr,
+                      const InetAddress &peerAddr);
+
         ~TcpConnection();
 
-        EventLoop *getLoop() const { return m_loop; }
+        EventLoop *getLoop() const { return m_loop.load(std::memory_order_acquire); }
 
-        const std::string &getName() const { return m_name; }
+        const std::string &getName() const;
+
+        [[nodiscard]] uint64_t id() const { return m_id; }
+
+        [[nodiscard]] int fd() const;
+
+        // Set by TcpServer before the connection callback runs.
+        [[nodiscard]] ConnectionHandle handle() const { return m_handle; }
+
+        void setHandle(ConnectionHandle handle) { m_handle = handle; }
 
         const InetAddress &localAddress() const { return m_localAddr; }
 
@@ -98,6 +178,11 @@ namespace faliks {
 
         bool disconnected() const { return m_state == kDisconnected; }
 
+        // Bytes read and written so far, a hotness signal for rebalancing.
+        [[nodiscard]] uint64_t bytesTransferred() const { return m_bytesTransferred.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] int migrations() const { return m_migrations.load(std::memory_order_relaxed); }
+
         bool getTcpInfo(struct tcp_info *tcpInfo) const;
 
         std::string getTcpInfoString() const;
@@ -108,6 +193,32 @@ namespace faliks {
 
         void send(Buffer *message);
 
+        // Sends the messages in order, with gather writes in the loop.
+        void send(std::vector<std::string> &&messages);
+
+        // In the connection's loop: sends what prefix, if any, holds, leaving
+        // it empty, then len bytes at data in the same writev. What the socket
+        // does not take waits uncopied, with owner keeping data alive.
+        void sendReferenced(Buffer *prefix, const void *data, size_t len, std::shared_ptr<const void> owner);
+
+        // In the connection's loop: the payloads in order, with one writev per
+        // 64 of them. The rest waits uncopied, referencing the payloads.
+        void sendReferenced(const std::vector<std::shared_ptr<const std::string>> &payloads);
+
+        // In the connection's loop: count slices of memory in order, with one
+        // writev per 64 of them. The rest waits uncopied, owner keeping every
+        // slice alive until the last byte is sent.
+        void sendReferenced(const struct iovec *slices, size_t count, const std::shared_ptr<const void> &owner);
+
+        // In the connection's loop: sends what prefix holds, then len bytes
+        // of fd from offset with sendfile(2). owner keeps fd open until then.
+        void sendFile(Buffer *prefix, int fd, off_t offset, size_t len, std::shared_ptr<const void> owner);
+
+        // Moves the connection, with its buffers and pending output, to another
+        // loop. Callable from any thread; callbacks keep their order and run in
+        // the new loop afterwards. Ignored unless the connection is connected.
+        void migrateTo(EventLoop *loop);
+
         void shutdown();
 
         void forceClose();
@@ -130,11 +241,29 @@ namespace faliks {
 
         void setCloseCallback(const CloseCallback &cb) { m_closeCallback = cb; }
 
+        // Runs in the old loop once the connection has left it, before it is
+        // attached to the new one.
+        void setMigrateCallback(const MigrateCallback &cb) { m_migrateCallback = cb; }
+
         void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark) {
             m_highWaterMarkCallback = cb;
             m_highWaterMark = highWaterMark;
         }
 
+        // Output not yet handed to the kernel, call in the connection's loop.
+        [[nodiscard]] bool hasPendingOutput() const {
+            return m_outputBuffer.readableBytes() > 0 || !m_segments.empty() ||
+                   m_flushQueued.load(std::memory_order_acquire);
+        }
+
+        // Per-connection state of a protocol layered on top, e.g. a parser.
+        // Use it in the connection's loop.
+        void setContext(const std::any &context) { m_context = context; }
+
+        [[nodiscard]] const std::any &getContext() const { return m_context; }
+
+        std::any *getMutableContext() { return &m_context; }
+
         Buffer *inputBuffer() { return &m_inputBuffer; }
 
         Buffer *outputBuffer() { return &m_outputBuffer; }
@@ -144,6 +273,11 @@ namespace faliks {
         void connectDestroyed();
     };
 
+    // Used by TcpServer and TcpClient when no callback is set.
+    void defaultConnectionCallback(const std::shared_ptr<TcpConnection> &conn);
+
+    void defaultMessageCallback(const std::shared_ptr<TcpConnection> &conn, Buffer *buffer, Timestamp receiveTime);
+
 }
 
 #endif //MUDUO_LEARN_TCPCONNECTION_H
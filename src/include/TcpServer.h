@@ -2,12 +2,16 @@
 #define MUDUO_LEARN_TCPSERVER_H
 
 #include "src/include/TcpConnection.h"
+#include "src/include/TimerId.h"
+#include "base/include/ThreadSaftyCheck.h"
 
 #include <atomic>
 #include <memory>
 #include <string>
 #include <functional>
-#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace faliks {
 
@@ -17,47 +21,168 @@ namespace faliks {
 
     class ThreadPool;
 
+    class LoopPlacement;
+
     class TcpServer : NoneCopyable {
+    public:
+        // One phase of shutdown(), reported when it ends.
+        struct ShutdownPhase {
+            const char *name;
+            int64_t durationUs;
+            size_t connectionsBefore;
+            size_t connectionsAfter;
+            bool timedOut;
+        };
+        using ShutdownCallback = std::function<void(const std::vector<ShutdownPhase> &)>;
+
     private:
         using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
         using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
         using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
         using ThreadInitCallback = std::function<void(EventLoop *)>;
         using MessageCallback = std::function<void(const TcpConnectionPtr &, Buffer *, Timestamp)>;
-        using ConnectionMap = std::map<std::string, TcpConnectionPtr>;
+        using ConnectionMap = std::unordered_map<uint64_t, TcpConnectionPtr>;
         EventLoop *m_loop;
+        const InetAddress m_listenAddr;
         const std::string m_ipPort;
         const std::string m_name;
+        const std::shared_ptr<const std::string> m_connNamePrefix;
+        const bool m_localAddrKnown;
+        const bool m_acceptorPerLoop;
         std::unique_ptr<Acceptor> m_acceptor;
+        std::vector<std::unique_ptr<Acceptor>> m_loopAcceptors;
+        std::vector<int> m_adoptedListenFds;
+        bool m_cpuSteering;
+        int m_maxAcceptsPerEvent;
         std::shared_ptr<ThreadPool> m_threadPool;
         ConnectionCallback m_connectionCallback;
         WriteCompleteCallback m_writeCompleteCallback;
         ThreadInitCallback m_threadInitCallback;
         MessageCallback m_messageCallback;
 
+        bool m_incomingCpuPlacement;
+        double m_rebalanceInterval;
+        double m_rebalanceHighWater;
+        double m_rebalanceMargin;
+        TimerId m_rebalanceTimer;
+        std::unordered_map<uint64_t, uint64_t> m_trafficMarks;
+
         std::atomic<int32_t> m_started;
-        int m_nextConnId;
-        ConnectionMap m_connections;
+        std::atomic<uint64_t> m_nextConnId;
+
+        struct ConnectionSlot {
+            uint32_t generation;
+            TcpConnectionPtr conn;
+        };
+
+        // The connections served by one IO loop. Only that loop adds and
+        // removes them on the hot path; the lock is taken by another thread
+        // only for aggregate views, migrations and destruction. The slot table
+        // backs ConnectionHandle and holds the connections accepted on this
+        // loop, wherever they migrate; only this loop touches it.
+        struct ConnectionShard {
+            EventLoop *loop;
+            uint32_t index;
+            std::mutex mutex;
+            ConnectionMap connections GUARDED_BY(mutex);
+            std::vector<ConnectionSlot> slots;
+            std::vector<uint32_t> freeSlots;
+
+            ConnectionShard(EventLoop *loopArg, uint32_t indexArg) : loop(loopArg), index(indexArg) {}
+
+            ConnectionHandle acquireSlot(const TcpConnectionPtr &conn);
+
+            void releaseSlot(ConnectionHandle handle);
+        };
+        std::vector<std::unique_ptr<ConnectionShard>> m_shards;
+        // Built in start() and read-only afterwards.
+        std::unordered_map<EventLoop *, ConnectionShard *> m_shardOfLoop;
+        std::atomic<size_t> m_numConnections;
+
+        enum class ShutdownState {
+            kRunning, kDraining, kClosingIdle, kForceClosing, kStopping, kStopped
+        };
+        // Counts the IO loops report back to the base loop for one round of
+        // probeInLoops. Replaced every round, so late reports of an earlier
+        // round land in an object nobody reads.
+        struct LoopProbe {
+            size_t pending;
+            size_t hits;
+        };
+        std::atomic<ShutdownState> m_shutdownState;
+        double m_closeTimeout;
+        TimerId m_shutdownTimer;
+        int64_t m_phaseStartUs;
+        int64_t m_phaseDeadlineUs;
+        size_t m_phaseConnections;
+        std::shared_ptr<LoopProbe> m_probe;
+        std::vector<ShutdownPhase> m_shutdownPhases;
+        ShutdownCallback m_shutdownCallback;
+
+        ConnectionShard &shardOf(EventLoop *loop);
+
+        // Runs visit in each connection's loop and waits, returns how many
+        // connections it returned true for.
+        size_t visitInLoops(const std::function<bool(const TcpConnectionPtr &)> &visit);
+
+        // Like visitInLoops without waiting: the loops add their counts to a
+        // new m_probe from the base loop, so a stalled loop cannot block it.
+        void probeInLoops(std::function<bool(const TcpConnectionPtr &)> visit);
+
+        // With wait, returns once the acceptors are gone; otherwise their
+        // loops destroy them when they get to it.
+        void stopAccepting(bool wait);
+
+        // Queues connectDestroyed() for every connection in its loop. With
+        // wait, returns once all ran.
+        void destroyConnections(bool wait);
+
+        void startShutdown(double drainTimeout, double closeTimeout, const ShutdownCallback &cb);
+
+        void advanceShutdown();
+
+        void finishShutdownPhase(const char *name, bool timedOut);
 
         void newConnection(int sockfd, const InetAddress &peerAddr);
 
+        void establishConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+
         void removeConnection(const TcpConnectionPtr &conn);
 
-        void removeConnectionInLoop(const TcpConnectionPtr &conn);
+        void moveConnection(const TcpConnectionPtr &conn, EventLoop *from, EventLoop *to);
+
+        void startLoopAcceptors();
+
+        void rebalance();
 
     public:
+        // kReusePortPerLoop gives every IO loop its own SO_REUSEPORT listener, so
+        // a connection is accepted and served by the same thread and placement
+        // is left to the kernel (see setCpuSteering).
         enum class Option {
             kNoReusePort,
-            kReusePort
+            kReusePort,
+            kReusePortPerLoop
         };
 
         TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
                   Option option = Option::kNoReusePort);
 
+        // Serves listenAddr on sockets that are already bound to it, see
+        // HotRestart. With kReusePortPerLoop loop i takes listenFds[i] and
+        // loops beyond them open new members of the group; otherwise the
+        // first one is used. Takes ownership of all of them.
+        TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
+                  const std::vector<int> &listenFds, Option option = Option::kNoReusePort);
+
         ~TcpServer();
 
         [[nodiscard]] const std::string &ipPort() const { return m_ipPort; }
 
+        // The address the listener is bound to, with the port the kernel
+        // picked for port 0. With kReusePortPerLoop, only after start().
+        [[nodiscard]] InetAddress localAddress() const;
+
         [[nodiscard]] const std::string &name() const { return m_name; }
 
         [[nodiscard]] EventLoop *getLoop() const { return m_loop; }
@@ -66,6 +191,32 @@ namespace faliks {
 
         void setThreadInitCallback(const ThreadInitCallback &cb) { m_threadInitCallback = cb; }
 
+        // Pins IO loop i to cpuSets[i % cpuSets.size()], call before start().
+        void setThreadCpuSets(const std::vector<std::vector<int>> &cpuSets);
+
+        void setNumaLocalMemory(bool on);
+
+        // Hands a new connection to the loop pinned to the cpu that received its
+        // packets (SO_INCOMING_CPU) instead of the next loop in round-robin order.
+        void setIncomingCpuPlacement(bool on) { m_incomingCpuPlacement = on; }
+
+        // Chooses the IO loop of each new connection, see LoopPlacement.h.
+        void setPlacement(std::unique_ptr<LoopPlacement> placement);
+
+        // With kReusePortPerLoop, attaches a CBPF program to the listener group
+        // that hands each connection to the loop pinned to the cpu receiving it,
+        // see setThreadCpuSets. Call before start().
+        void setCpuSteering(bool on) { m_cpuSteering = on; }
+
+        // Connections each acceptor drains per readiness event, call before start().
+        void setMaxAcceptsPerEvent(int maxAccepts) { m_maxAcceptsPerEvent = maxAccepts; }
+
+        // Every interval seconds, if the busiest IO loop is above highWater
+        // utilization and ahead of the idlest by margin, migrates the connections
+        // with the most traffic since the last round from the busiest loop to the
+        // idlest. Call before start(); interval 0 disables it.
+        void setRebalancing(double interval, double highWater = 0.8, double margin = 0.2);
+
         std::shared_ptr<ThreadPool> threadPool() { return m_threadPool; }
 
         void start();
@@ -73,6 +224,51 @@ namespace faliks {
         void setConnectionCallback(const ConnectionCallback &cb) { m_connectionCallback = cb; }
 
         void setMessageCallback(const MessageCallback &cb) { m_messageCallback = cb; }
+
+        // Stops the server in phases, callable from any thread:
+        //   1. stop accepting, the listening sockets are closed;
+        //   2. wait up to drainTimeout for output in flight to reach the kernel;
+        //   3. half-close connections with nothing in flight, wait up to
+        //      closeTimeout for their peers to close;
+        //   4. force-close the rest, waiting at most closeTimeout again;
+        //   5. quit and join the IO loops.
+        // So it takes at most drainTimeout + 2 * closeTimeout plus the join.
+        // The base loop never waits for an IO loop before the join, so a
+        // stalled one delays only that.
+        // cb runs in the base loop with the phases once the loops are joined;
+        // the server can then only be destroyed.
+        void shutdown(double drainTimeout, double closeTimeout, const ShutdownCallback &cb);
+
+        // The listening sockets, for handing them to a successor. Base loop only.
+        std::vector<int> listenFds() const;
+
+        // Takes the connections with nothing in flight out of service and
+        // returns duplicates of their sockets, which stay open for whoever
+        // adopts them. Their connection callbacks see them go down. Base loop
+        // only.
+        std::vector<int> detachIdleConnections();
+
+        // Serves an already connected socket, e.g. one detached by the
+        // process this one replaces. Call after start(), from the base loop.
+        void adoptConnection(int sockfd);
+
+        [[nodiscard]] size_t numConnections() const { return m_numConnections.load(std::memory_order_relaxed); }
+
+        // Calls cb from this thread for every connection, one shard at a time,
+        // e.g. to broadcast with send(). Connections that come or go meanwhile
+        // may be missed or visited after they closed.
+        void forEachConnection(const std::function<void(const TcpConnectionPtr &)> &cb);
+
+        // Sends payload to the connection named by handle, from any thread,
+        // without holding a reference to it. The payload is routed to the loop
+        // owning the handle's slot and dropped if the connection has closed.
+        void sendTo(ConnectionHandle handle, std::string payload);
+
+        // The loop owning the handle's slot, nullptr for an invalid handle.
+        [[nodiscard]] EventLoop *loopOf(ConnectionHandle handle) const;
+
+        // Resolves a handle in loopOf(handle), nullptr if the connection closed.
+        TcpConnectionPtr findInLoop(ConnectionHandle handle);
     };
 }
 
@@ -14,6 +14,12 @@ namespace faliks {
 
     class EventLoopThread;
 
+    class InetAddress;
+
+    class LoopLoad;
+
+    class LoopPlacement;
+
     class ThreadPool : NoneCopyable {
     private:
         EventLoop *m_baseLoop;
@@ -23,6 +29,11 @@ namespace faliks {
         int m_next;
         std::vector<EventLoop *> m_loops;
         std::vector<std::unique_ptr<EventLoopThread>> m_threads;
+        std::vector<std::vector<int>> m_cpuSets;
+        bool m_numaLocalMemory;
+        std::vector<int> m_cpuToLoop;
+        std::unique_ptr<LoopPlacement> m_placement;
+        std::vector<const LoopLoad *> m_loads;
     public:
         using ThreadInitCallback = std::function<void(EventLoop *)>;
 
@@ -32,13 +43,36 @@ namespace faliks {
 
         void setThreadNum(int numThreads) { m_numThreads = numThreads; }
 
+        [[nodiscard]] int numThreads() const { return m_numThreads; }
+
+        // Loop i is pinned to cpuSets[i % cpuSets.size()].
+        void setCpuSets(const std::vector<std::vector<int>> &cpuSets) { m_cpuSets = cpuSets; }
+
+        // Each pinned loop prefers memory from the NUMA node it runs on.
+        void setNumaLocalMemory(bool on) { m_numaLocalMemory = on; }
+
+        // Used by getLoopForPeer, round-robin when not set.
+        void setPlacement(std::unique_ptr<LoopPlacement> placement);
+
         void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
+        // Quits and joins the IO loops, call once nothing uses them any more.
+        // Afterwards everything runs on the base loop.
+        void stop();
+
         EventLoop *getNextLoop();
 
         EventLoop *getLoopForHash(size_t hashCode);
 
+        EventLoop *getLoopForPeer(const InetAddress &peerAddr);
+
+        // The loop pinned to the cpu, round-robin when no loop is pinned to it.
+        EventLoop *getLoopForCpu(int cpu);
+
         std::vector<EventLoop *> getAllLoops();
+
+        // Index of the loop pinned to each cpu, -1 for cpus without one.
+        [[nodiscard]] const std::vector<int> &cpuToLoop() const { return m_cpuToLoop; }
     };
 }
 
@@ -30,7 +30,9 @@ namespace faliks {
 
         void addTimerInLoop(Timer *timer);
 
-        void cancelInLoop(Timer *timer);
+        // The timer may have fired and been freed already, so it is looked
+        // up by address and sequence without dereferencing it.
+        void cancelInLoop(TimerId timerId);
 
         [[nodiscard]] std::vector<Entry> getExpired(Timestamp now);
 
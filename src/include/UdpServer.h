@@ -0,0 +1,79 @@
+#ifndef MUDUO_LEARN_UDPSERVER_H
+#define MUDUO_LEARN_UDPSERVER_H
+
+#include "src/include/UdpSocket.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace faliks {
+
+    class EventLoop;
+
+    class ThreadPool;
+
+    // Serves datagrams on one address. By default a single socket in the base
+    // loop; with kReusePortPerLoop every IO loop gets its own SO_REUSEPORT
+    // socket and the kernel hashes peers over them, so each datagram is read,
+    // handled and answered by one thread. Reply through the UdpSocket passed
+    // to the callback.
+    class UdpServer : NoneCopyable {
+    public:
+        enum class Option {
+            kNoReusePort,
+            kReusePortPerLoop
+        };
+        using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    private:
+        EventLoop *m_loop;
+        const InetAddress m_listenAddr;
+        const std::string m_name;
+        const bool m_socketPerLoop;
+        std::shared_ptr<ThreadPool> m_threadPool;
+        ThreadInitCallback m_threadInitCallback;
+        UdpSocket::MessageCallback m_messageCallback;
+        size_t m_receiveBatch;
+        bool m_gro;
+        bool m_gso;
+        bool m_started;
+        std::vector<std::unique_ptr<UdpSocket>> m_sockets;
+
+    public:
+        UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
+                  Option option = Option::kNoReusePort);
+
+        ~UdpServer();
+
+        [[nodiscard]] const std::string &name() const { return m_name; }
+
+        [[nodiscard]] EventLoop *getLoop() const { return m_loop; }
+
+        void setThreadNum(int numThreads);
+
+        void setThreadInitCallback(const ThreadInitCallback &cb) { m_threadInitCallback = cb; }
+
+        void setMessageCallback(const UdpSocket::MessageCallback &cb) { m_messageCallback = cb; }
+
+        // Applied to each socket, call before start(); see UdpSocket.
+        void setReceiveBatch(size_t batch) { m_receiveBatch = batch; }
+
+        void setGro(bool on) { m_gro = on; }
+
+        void setGso(bool on) { m_gso = on; }
+
+        // Base loop only.
+        void start();
+
+        // Valid after start(), each used in its own loop.
+        [[nodiscard]] const std::vector<std::unique_ptr<UdpSocket>> &sockets() const { return m_sockets; }
+
+        [[nodiscard]] uint64_t packetsReceived() const;
+
+        [[nodiscard]] uint64_t packetsSent() const;
+    };
+}
+
+#endif //MUDUO_LEARN_UDPSERVER_H
@@ -0,0 +1,154 @@
+#ifndef MUDUO_LEARN_UDPSOCKET_H
+#define MUDUO_LEARN_UDPSOCKET_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/Timestamp.h"
+#include "src/include/InetAddress.h"
+#include "src/include/Socket.h"
+
+#include <sys/socket.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace faliks {
+
+    class Channel;
+
+    class EventLoop;
+
+    // A bound datagram socket served by one loop. Reads drain the socket
+    // with recvmmsg into buffers allocated once; with UDP_GRO the kernel may
+    // hand over several datagrams from one peer in a single buffer, which
+    // are split again before the callback. send() queues datagrams and the
+    // loop writes them with sendmmsg once per iteration; with UDP_SEGMENT,
+    // runs of equal-sized datagrams to one peer leave as a single message.
+    // Both offloads are used when the kernel supports them.
+    class UdpSocket : NoneCopyable {
+    public:
+        using MessageCallback = std::function<void(UdpSocket *, const char *data, size_t len,
+                                                   const InetAddress &peerAddr, Timestamp receiveTime)>;
+
+        static constexpr size_t kMaxSendBatch = 64;
+        // UDP_MAX_SEGMENTS of older kernels.
+        static constexpr size_t kMaxSegments = 64;
+        static constexpr size_t kMaxGsoBytes = 65000;
+        // Receive buffers hold a whole coalesced run when GRO is on.
+        static constexpr size_t kGroBufferSize = 65536;
+
+    private:
+        struct PendingDatagram {
+            InetAddress peer;
+            size_t offset;
+            size_t len;
+        };
+
+        EventLoop *m_loop;
+        Socket m_socket;
+        std::unique_ptr<Channel> m_channel;
+        MessageCallback m_messageCallback;
+        bool m_gro;
+        bool m_gso;
+        size_t m_receiveBatch;
+        size_t m_maxDatagramSize;
+        size_t m_bufferSize;
+        std::vector<char> m_recvBuffers;
+        std::vector<struct mmsghdr> m_recvMsgs;
+        std::vector<struct iovec> m_recvIovecs;
+        std::vector<struct sockaddr_storage> m_recvAddrs;
+        std::vector<char> m_recvControl;
+        std::string m_sendData;
+        std::vector<PendingDatagram> m_pending;
+        size_t m_pendingHead;
+        size_t m_maxPending;
+        bool m_flushQueued;
+        std::vector<struct mmsghdr> m_sendMsgs;
+        std::vector<struct iovec> m_sendIovecs;
+        std::vector<char> m_sendControl;
+        std::atomic<uint64_t> m_packetsReceived;
+        std::atomic<uint64_t> m_packetsSent;
+        std::atomic<uint64_t> m_receiveCalls;
+        std::atomic<uint64_t> m_sendCalls;
+        std::atomic<uint64_t> m_drops;
+        // Queued flushes hold it weakly, the socket may be gone when they run.
+        std::shared_ptr<void> m_alive;
+        std::vector<size_t> m_sendSegments;
+
+        void handleRead(Timestamp receiveTime);
+
+        void handleWrite();
+
+        void allocateReceiveBuffers();
+
+        void sendInLoop(const InetAddress &peer, const void *data, size_t len);
+
+        // Fills m_sendMsgs from the pending datagrams and m_sendSegments with
+        // the datagrams each message carries, returns the number of messages.
+        size_t buildSendBatch();
+
+        static void addCounter(std::atomic<uint64_t> &counter, uint64_t n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+    public:
+        // reuseport lets several sockets, usually one per loop, share the
+        // address; the kernel spreads peers over them.
+        UdpSocket(EventLoop *loop, const InetAddress &bindAddr, bool reuseport = false);
+
+        // Create and destroy in the loop thread.
+        ~UdpSocket();
+
+        void setMessageCallback(const MessageCallback &cb) { m_messageCallback = cb; }
+
+        // Buffers read per recvmmsg call. Loop thread only.
+        void setReceiveBatch(size_t batch);
+
+        // Longer datagrams are dropped when GRO is off; 2048 by default.
+        // Loop thread only.
+        void setMaxDatagramSize(size_t size);
+
+        // Turn the offloads off, e.g. to compare. Loop thread only.
+        void setGro(bool on);
+
+        void setGso(bool on) { m_gso = on; }
+
+        // Datagrams queued beyond this are dropped while the socket is not
+        // writable.
+        void setMaxPending(size_t maxPending) { m_maxPending = maxPending; }
+
+        // Callable from any thread; in the loop thread the data is copied and
+        // written at the end of the iteration.
+        void send(const InetAddress &peer, const void *data, size_t len);
+
+        void send(const InetAddress &peer, const std::string &message) { send(peer, message.data(), message.size()); }
+
+        // Writes what is queued now. Loop thread only.
+        void flush();
+
+        [[nodiscard]] EventLoop *getLoop() const { return m_loop; }
+
+        [[nodiscard]] int fd() const { return m_socket.fd(); }
+
+        [[nodiscard]] InetAddress localAddress() const;
+
+        [[nodiscard]] bool groEnabled() const { return m_gro; }
+
+        [[nodiscard]] bool gsoEnabled() const { return m_gso; }
+
+        [[nodiscard]] uint64_t packetsReceived() const { return m_packetsReceived.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] uint64_t packetsSent() const { return m_packetsSent.load(std::memory_order_relaxed); }
+
+        // System calls, to see how well batching works.
+        [[nodiscard]] uint64_t receiveCalls() const { return m_receiveCalls.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] uint64_t sendCalls() const { return m_sendCalls.load(std::memory_order_relaxed); }
+
+        // Truncated datagrams received and datagrams that could not be sent.
+        [[nodiscard]] uint64_t drops() const { return m_drops.load(std::memory_order_relaxed); }
+    };
+}
+
+#endif //MUDUO_LEARN_UDPSOCKET_H
@@ -0,0 +1,61 @@
+#ifndef MUDUO_LEARN_WEBSOCKETCODEC_H
+#define MUDUO_LEARN_WEBSOCKETCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace faliks {
+
+    class Buffer;
+
+    // RFC 6455 framing, without extensions. Unmasking and UTF-8 checking
+    // use SSE2, AVX2 or NEON where the build enables them.
+    class WebSocketCodec {
+    public:
+        enum class Opcode : uint8_t {
+            kContinuation = 0x0, kText = 0x1, kBinary = 0x2, kClose = 0x8, kPing = 0x9, kPong = 0xA
+        };
+
+        struct FrameHeader {
+            bool fin;
+            // RSV1-3, nonzero only with an extension.
+            uint8_t rsv;
+            Opcode opcode;
+            bool masked;
+            // The key bytes in wire order.
+            uint32_t maskKey;
+            uint64_t payloadLen;
+            size_t headerLen;
+        };
+
+        static constexpr size_t kMaxHeaderBytes = 14;
+
+        // 1 with a complete header, 0 if more bytes are needed, -1 if it is
+        // malformed.
+        static int decodeHeader(const char *data, size_t len, FrameHeader *header);
+
+        // Server frames go unmasked; a client passes its maskKey.
+        static void appendFrame(Buffer *buf, Opcode opcode, std::string_view payload, bool fin = true,
+                                const uint32_t *maskKey = nullptr);
+
+        static void appendFrame(std::string *out, Opcode opcode, std::string_view payload, bool fin = true,
+                                const uint32_t *maskKey = nullptr);
+
+        // XORs len bytes with the key, starting at key byte 0. Also masks.
+        static void unmask(char *data, size_t len, uint32_t maskKey);
+
+        static bool isValidUtf8(const char *data, size_t len);
+
+        static bool isValidUtf8(std::string_view text) { return isValidUtf8(text.data(), text.size()); }
+
+        // Close codes a peer may send.
+        static bool isValidCloseCode(uint16_t code);
+
+        // Sec-WebSocket-Accept for a Sec-WebSocket-Key.
+        static std::string acceptKey(std::string_view clientKey);
+    };
+}
+
+#endif //MUDUO_LEARN_WEBSOCKETCODEC_H
@@ -0,0 +1,138 @@
+#ifndef MUDUO_LEARN_WEBSOCKETSERVER_H
+#define MUDUO_LEARN_WEBSOCKETSERVER_H
+
+#include "base/include/NoneCopyable.h"
+#include "base/include/ThreadSaftyCheck.h"
+#include "src/include/HttpServer.h"
+#include "src/include/WebSocketCodec.h"
+
+#include <any>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace faliks {
+
+    class WebSocketServer;
+
+    // One upgraded connection. The send functions may be called from any
+    // thread; the callbacks run in the connection's loop.
+    class WebSocketConnection : NoneCopyable {
+    private:
+        friend class WebSocketServer;
+
+        struct LoopConnections;
+
+        const std::weak_ptr<TcpConnection> m_conn;
+        // Valid while registered, the entry goes before the connection.
+        TcpConnection *const m_rawConn;
+        LoopConnections *m_registry;
+        size_t m_index;
+        WebSocketCodec::Opcode m_messageOpcode;
+        bool m_fragmented;
+        std::string m_fragments;
+        std::atomic<bool> m_open;
+        std::atomic<bool> m_closeSent;
+        std::any m_context;
+
+        void sendFrame(WebSocketCodec::Opcode opcode, std::string_view payload);
+
+    public:
+        explicit WebSocketConnection(const std::shared_ptr<TcpConnection> &conn);
+
+        void send(std::string_view text) { sendFrame(WebSocketCodec::Opcode::kText, text); }
+
+        void sendBinary(std::string_view data) { sendFrame(WebSocketCodec::Opcode::kBinary, data); }
+
+        void ping(std::string_view payload = {}) { sendFrame(WebSocketCodec::Opcode::kPing, payload); }
+
+        // Sends a close frame and half-closes; the peer answers and closes.
+        void close(uint16_t code = 1000, std::string_view reason = {});
+
+        [[nodiscard]] bool connected() const { return m_open.load(std::memory_order_acquire); }
+
+        [[nodiscard]] std::shared_ptr<TcpConnection> connection() const { return m_conn.lock(); }
+
+        // Application state, use it in the connection's loop.
+        void setContext(const std::any &context) { m_context = context; }
+
+        [[nodiscard]] const std::any &getContext() const { return m_context; }
+
+        std::any *getMutableContext() { return &m_context; }
+    };
+
+    // WebSocket on an HttpServer: requests asking for an upgrade are
+    // accepted, the others go to the HTTP callback. broadcast() encodes a
+    // frame once and hands the same refcounted bytes to every connection,
+    // one task per loop.
+    class WebSocketServer : NoneCopyable {
+    public:
+        using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+        using WebSocketConnectionPtr = std::shared_ptr<WebSocketConnection>;
+        // On open and on close, see WebSocketConnection::connected().
+        using ConnectionCallback = std::function<void(const WebSocketConnectionPtr &)>;
+        // message is valid during the call.
+        using MessageCallback = std::function<void(const WebSocketConnectionPtr &, std::string_view message,
+                                                   bool binary)>;
+        using HandshakeCallback = std::function<bool(const HttpRequest &)>;
+
+    private:
+        using LoopConnections = WebSocketConnection::LoopConnections;
+
+        HttpServer m_server;
+        ConnectionCallback m_connectionCallback;
+        MessageCallback m_messageCallback;
+        HandshakeCallback m_handshakeCallback;
+        size_t m_maxMessageBytes;
+        // One per IO loop, indexed like ConnectionHandle::loopIndex(). Sized in start() before accepting.
+        std::vector<std::unique_ptr<LoopConnections>> m_loops;
+        std::atomic<size_t> m_numConnections;
+
+        void onUpgrade(const TcpConnectionPtr &conn, const HttpRequest &request, HttpResponse *response);
+
+        void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+        void onClose(const TcpConnectionPtr &conn);
+
+        // Sends a close frame with code and shuts the connection down.
+        void fail(const TcpConnectionPtr &conn, WebSocketConnection *ws, uint16_t code, Buffer *buf);
+
+        void broadcastInLoop(LoopConnections *registry, const std::shared_ptr<const std::string> &frame);
+
+    public:
+        WebSocketServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                        TcpServer::Option option = TcpServer::Option::kNoReusePort);
+
+        ~WebSocketServer();
+
+        void setConnectionCallback(const ConnectionCallback &cb) { m_connectionCallback = cb; }
+
+        void setMessageCallback(const MessageCallback &cb) { m_messageCallback = cb; }
+
+        // Decides whether to accept an upgrade, e.g. by path or Origin;
+        // refused ones get 403.
+        void setHandshakeCallback(const HandshakeCallback &cb) { m_handshakeCallback = cb; }
+
+        // A longer message closes the connection with 1009. Default 16MB.
+        void setMaxMessageBytes(size_t maxBytes) { m_maxMessageBytes = maxBytes; }
+
+        void setThreadNum(int numThreads) { m_server.setThreadNum(numThreads); }
+
+        // Call in the base loop's thread.
+        void start();
+
+        // For plain HTTP requests and settings.
+        HttpServer *httpServer() { return &m_server; }
+
+        // Any thread, after start().
+        void broadcast(std::string_view message, bool binary = false);
+
+        [[nodiscard]] size_t numConnections() const { return m_numConnections.load(std::memory_order_relaxed); }
+    };
+}
+
+#endif //MUDUO_LEARN_WEBSOCKETSERVER_H
@@ -0,0 +1,87 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Clients open connections as fast as they can and reset them right away;
+// the server only accepts and tears down. Reports accepted connections/s.
+// usage: AcceptRateBench [seconds] [clients] [loops] [maxAcceptsPerEvent] [base|perloop]
+
+const uint16_t kPort = 2034;
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    int seconds = argc > 1 ? atoi(argv[1]) : 3;
+    int numClients = argc > 2 ? atoi(argv[2]) : 4;
+    int numLoops = argc > 3 ? atoi(argv[3]) : 2;
+    int maxAccepts = argc > 4 ? atoi(argv[4]) : 32;
+    bool perLoop = argc > 5 && strcmp(argv[5], "perloop") == 0;
+
+    EventLoop loop;
+    // Bound to 127.0.0.1, so the local address comes from the listen address.
+    TcpServer server(&loop, InetAddress(kPort, true), "AcceptRateBench",
+                     perLoop ? TcpServer::Option::kReusePortPerLoop : TcpServer::Option::kNoReusePort);
+    server.setThreadNum(numLoops);
+    server.setMaxAcceptsPerEvent(maxAccepts);
+    atomic<int64_t> accepted(0);
+    server.setConnectionCallback([&accepted](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            accepted.fetch_add(1, memory_order_relaxed);
+        }
+    });
+    server.start();
+
+    atomic<int64_t> connected(0);
+    Thread driver([&] {
+        atomic<bool> done(false);
+        vector<unique_ptr<Thread>> clients;
+        for (int i = 0; i < numClients; ++i) {
+            clients.emplace_back(new Thread([&] {
+                struct sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(kPort);
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                // RST on close, so client ports do not pile up in TIME_WAIT.
+                struct linger reset{1, 0};
+                while (!done) {
+                    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                    ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof reset);
+                    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0) {
+                        connected.fetch_add(1, memory_order_relaxed);
+                    }
+                    ::close(fd);
+                }
+            }));
+            clients.back()->start();
+        }
+        this_thread::sleep_for(chrono::seconds(seconds));
+        done = true;
+        for (auto &t: clients) {
+            t->join();
+        }
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    logi("mode = {} loops = {} maxAcceptsPerEvent = {} connected = {} accepted = {} accepted/s = {:.0f}",
+         perLoop ? "perloop" : "base", numLoops, maxAccepts, connected.load(), accepted.load(),
+         static_cast<double>(accepted) / seconds);
+    fmtlog::poll();
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace faliks;
+using namespace std;
+
+// A worker thread replies through TcpServer::sendTo with only the handle of
+// the connection. Once the connection closes the handle must go quiet, also
+// after its slot is reused by the next connection.
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+string readLine(int fd) {
+    string line;
+    char c;
+    while (::read(fd, &c, 1) == 1 && c != '\n') {
+        line.push_back(c);
+    }
+    return line;
+}
+
+// Waits up to 100ms for anything to arrive on fd.
+bool readable(int fd) {
+    struct timeval timeout{0, 100 * 1000};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    char c;
+    return ::read(fd, &c, 1) == 1;
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(0, true), "ConnectionHandleTest");
+    uint16_t port = server.localAddress().port();
+    server.setThreadNum(2);
+    atomic<uint64_t> latest(0);
+    atomic<int> connected(0);
+    server.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            latest = conn->handle().value();
+            ++connected;
+        }
+    });
+    server.start();
+
+    Thread driver([&] {
+        auto handleOf = [&](int expected) {
+            while (connected < expected) {
+                this_thread::yield();
+            }
+            return ConnectionHandle(latest.load());
+        };
+
+        int first = connectTo(port);
+        ConnectionHandle firstHandle = handleOf(1);
+        Thread worker([&] { server.sendTo(firstHandle, "hello\n"); });
+        worker.start();
+        worker.join();
+        string line = readLine(first);
+        logi("handle valid = {} reply = {}", firstHandle.valid(), line);
+        check(firstHandle.valid() && line == "hello", "reply through the handle");
+
+        ::close(first);
+        while (server.numConnections() != 0) {
+            this_thread::yield();
+        }
+        server.sendTo(firstHandle, "stale\n");
+
+        // Two loops take connections in turn, so the third lands on the
+        // first one's loop and slot.
+        int second = connectTo(port);
+        handleOf(2);
+        int third = connectTo(port);
+        ConnectionHandle thirdHandle = handleOf(3);
+        server.sendTo(firstHandle, "stale\n");
+        bool leaked = readable(third) || readable(second);
+        logi("reused slot = {} stale handle delivered = {}",
+             thirdHandle.loopIndex() == firstHandle.loopIndex() && thirdHandle.slot() == firstHandle.slot(), leaked);
+        check(!leaked && thirdHandle != firstHandle, "stale handle goes quiet");
+        server.sendTo(thirdHandle, "third\n");
+        check(readLine(third) == "third", "reused slot gets its own reply");
+        ::close(second);
+        ::close(third);
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#include "src/include/EventLoop.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <vector>
+
+using namespace faliks;
+
+void testFunctorBudget() {
+    EventLoop loop;
+    loop.setMaxFunctorsPerIteration(100);
+
+    std::vector<int64_t> iterations;
+    int order = 0;
+    int urgentOrder = -1;
+
+    Thread producer([&] {
+        for (int i = 0; i < 1000; ++i) {
+            loop.queueInLoop([&] {
+                iterations.push_back(loop.iteration());
+                ++order;
+            });
+        }
+        loop.queueInLoop([&] { urgentOrder = order; }, EventLoop::Priority::kHigh);
+        loop.queueInLoop([&] { loop.quit(); });
+    });
+    producer.start();
+    producer.join();
+    loop.loop();
+
+    check(iterations.size() == 1000, "all functors ran");
+    check(iterations.back() - iterations.front() >= 9, "functors spread over iterations");
+    check(urgentOrder == 0, "high priority functor ran first");
+}
+
+void testTaskTimeBudget() {
+    EventLoop loop;
+    loop.setTaskTimeBudget(0.001);
+
+    int64_t firstIteration = -1;
+    int64_t lastIteration = -1;
+    for (int i = 0; i < 20; ++i) {
+        loop.queueInLoop([&] {
+            if (firstIteration < 0) {
+                firstIteration = loop.iteration();
+            }
+            lastIteration = loop.iteration();
+            Timestamp start(Timestamp::now());
+            while (timeDifference(Timestamp::now(), start) < 0.0005) {
+            }
+        });
+    }
+    loop.queueInLoop([&] { loop.quit(); });
+    loop.wakeup();
+    loop.loop();
+
+    check(lastIteration - firstIteration >= 5, "slow functors carried over");
+}
+
+void testQuitRunsCarriedFunctors() {
+    EventLoop loop;
+    loop.setMaxFunctorsPerIteration(100);
+
+    int ran = 0;
+    loop.queueInLoop([&] { loop.quit(); });
+    for (int i = 0; i < 1000; ++i) {
+        loop.queueInLoop([&] { ++ran; });
+    }
+    loop.wakeup();
+    loop.loop();
+
+    check(ran == 1000, "carried functors ran after quit");
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    Thread t1(testFunctorBudget);
+    t1.start();
+    t1.join();
+    Thread t2(testTaskTimeBudget);
+    t2.start();
+    t2.join();
+    Thread t3(testQuitRunsCarriedFunctors);
+    t3.start();
+    t3.join();
+    logi("EventLoopBudgetTest passed: {}", passed);
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+#include "src/include/HotRestart.h"
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace faliks;
+using namespace std;
+
+// Replaces a server by a new one the way two processes would, through
+// HotRestart, while a client keeps connecting. The old server answers "old",
+// the new one "new". No connection attempt may fail, and an idle connection
+// opened before the restart must be answered by the new server afterwards.
+// First, a successor of another user must be turned away.
+
+const char *kPath = "/tmp/muduo_learn_hot_restart_test.sock";
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+string ask(int fd) {
+    if (::write(fd, "?", 1) != 1) {
+        return "";
+    }
+    char buf[3];
+    size_t have = 0;
+    while (have < sizeof buf) {
+        ssize_t n = ::read(fd, buf + have, sizeof buf - have);
+        if (n <= 0) {
+            return "";
+        }
+        have += n;
+    }
+    return string(buf, have);
+}
+
+// Each server runs in its own thread, standing in for a process. The first
+// one listens on a port picked by the kernel and reports it before ready.
+void runServer(const char *answer, bool successor, uint16_t *port, atomic<bool> *ready, atomic<bool> *stop) {
+    EventLoop loop;
+    unique_ptr<TcpServer> server;
+    vector<int> connections;
+    if (successor) {
+        vector<int> listening;
+        bool took = HotRestart::takeOver(kPath, &listening, &connections);
+        check(took, "takeOver");
+        if (!took) {
+            return;
+        }
+        server = make_unique<TcpServer>(&loop, InetAddress(0, true), answer, listening);
+    } else {
+        server = make_unique<TcpServer>(&loop, InetAddress(0, true), answer);
+        *port = server->localAddress().port();
+    }
+    server->setThreadNum(2);
+    server->setMessageCallback([answer](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+        conn->send(answer);
+    });
+    server->start();
+    for (int fd: connections) {
+        server->adoptConnection(fd);
+    }
+    HotRestart restart(&loop, server.get(), kPath);
+    restart.setHandOffConnections(true);
+    restart.setDrainTimeouts(0.5, 0.2);
+    restart.setDrainedCallback([&](const vector<TcpServer::ShutdownPhase> &) { loop.quit(); });
+    restart.listen();
+    *ready = true;
+    loop.runEvery(0.01, [&] {
+        if (*stop) {
+            loop.quit();
+        }
+    });
+    loop.loop();
+}
+
+// Stands in for a process of another user by allowing a uid this one is not.
+void testRefusesOtherUser() {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(0, true), "stranger");
+    server.start();
+    HotRestart restart(&loop, &server, kPath);
+    restart.setAllowedUid(::geteuid() + 1);
+    restart.listen();
+    struct stat st{};
+    bool ownerOnly = ::stat(kPath, &st) == 0 && (st.st_mode & 0777) == 0600;
+
+    vector<int> listening;
+    vector<int> connections;
+    bool took = true;
+    Thread stranger([&] {
+        took = HotRestart::takeOver(kPath, &listening, &connections);
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    stranger.start();
+    loop.loop();
+    stranger.join();
+    ::unlink(kPath);
+
+    logi("socket mode 0600 = {} stranger took over = {} got {} sockets", ownerOnly, took,
+         listening.size() + connections.size());
+    check(ownerOnly, "socket mode 0600");
+    check(!took && listening.empty() && connections.empty(), "stranger turned away");
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testRefusesOtherUser();
+    atomic<bool> oldReady(false);
+    atomic<bool> newReady(false);
+    atomic<bool> stop(false);
+    uint16_t port = 0;
+    Thread oldServer([&] { runServer("old", false, &port, &oldReady, &stop); });
+    oldServer.start();
+    while (!oldReady) {
+        this_thread::yield();
+    }
+
+    int idle = connectTo(port);
+    string before = ask(idle);
+
+    atomic<bool> done(false);
+    atomic<int> attempts(0);
+    atomic<int> failures(0);
+    atomic<int> answeredByNew(0);
+    Thread client([&] {
+        while (!done) {
+            int fd = connectTo(port);
+            ++attempts;
+            string answer = fd >= 0 ? ask(fd) : "";
+            if (answer.empty()) {
+                ++failures;
+            } else if (answer == "new") {
+                ++answeredByNew;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    });
+    client.start();
+    this_thread::sleep_for(chrono::milliseconds(200));
+
+    Thread newServer([&] { runServer("new", true, nullptr, &newReady, &stop); });
+    newServer.start();
+    oldServer.join();
+    this_thread::sleep_for(chrono::milliseconds(200));
+    done = true;
+    client.join();
+
+    string after = ask(idle);
+    ::close(idle);
+    stop = true;
+    newServer.join();
+    ::unlink(kPath);
+
+    logi("idle connection answered by {} then {}", before, after);
+    logi("connection attempts = {} failed = {} answered by the new server = {}", attempts.load(), failures.load(),
+         answeredByNew.load());
+    check(before == "old" && after == "new", "idle connection handed over");
+    check(failures == 0, "no connection attempt failed");
+    check(answeredByNew > 0, "new server answers");
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
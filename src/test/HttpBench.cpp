@@ -0,0 +1,192 @@
+#include "src/include/HttpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/EventLoopThread.h"
+#include "src/include/InetAddress.h"
+#include "src/include/ThreadPool.h"
+#include "src/include/Buffer.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Client threads keep a pipeline of "GET /plaintext" requests in flight on
+// every connection to an HttpServer answering "Hello, World!". Reports
+// requests per second and per second of server cpu time.
+// usage: HttpBench [loops] [connections] [depth] [clients] [seconds]
+
+const uint16_t kPort = 2045;
+const char kRequest[] = "GET /plaintext HTTP/1.1\r\nHost: localhost\r\nUser-Agent: HttpBench\r\n\r\n";
+
+double threadCpuSeconds() {
+    struct timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+void runAndWait(EventLoop *loop, const function<void()> &cb) {
+    CountDownLatch latch(1);
+    loop->runInLoop([&] {
+        cb();
+        latch.countDown();
+    });
+    latch.wait();
+}
+
+void handle(const HttpRequest &request, HttpResponse *response) {
+    if (request.path() == "/plaintext") {
+        response->setContentType("text/plain");
+        response->setBody("Hello, World!");
+    } else {
+        response->setStatus(404);
+    }
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    int numLoops = argc > 1 ? atoi(argv[1]) : 1;
+    int numConnections = argc > 2 ? atoi(argv[2]) : 64;
+    int depth = argc > 3 ? atoi(argv[3]) : 16;
+    int numClients = argc > 4 ? atoi(argv[4]) : 2;
+    int seconds = argc > 5 ? atoi(argv[5]) : 3;
+
+    EventLoopThread serverThread;
+    EventLoop *serverBase = serverThread.startLoop();
+    unique_ptr<HttpServer> server;
+    vector<EventLoop *> serverLoops;
+    runAndWait(serverBase, [&] {
+        server = make_unique<HttpServer>(serverBase, InetAddress(kPort, true), "HttpBench");
+        server->setThreadNum(numLoops);
+        server->setHttpCallback(handle);
+        server->start();
+        serverLoops = server->tcpServer()->threadPool()->getAllLoops();
+    });
+
+    // Every response has the same length: the Date line is fixed width.
+    size_t responseBytes;
+    {
+        HttpResponse response;
+        Buffer buf;
+        response.setContentType("text/plain");
+        response.setBody("Hello, World!");
+        response.appendToBuffer(&buf, HttpServer::dateHeader(Timestamp::now()));
+        responseBytes = buf.readableBytes();
+    }
+
+    atomic<bool> done(false);
+    atomic<int64_t> responses(0);
+    vector<unique_ptr<Thread>> clients;
+    for (int c = 0; c < numClients; ++c) {
+        clients.emplace_back(new Thread([&, c] {
+            struct Conn {
+                int fd;
+                size_t received;
+                int inFlight;
+            };
+            vector<Conn> conns;
+            int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            for (int i = c; i < numConnections; i += numClients) {
+                conns.push_back({connectTo(kPort), 0, 0});
+            }
+            string burst;
+            for (int i = 0; i < depth; ++i) {
+                burst += kRequest;
+            }
+            for (size_t i = 0; i < conns.size(); ++i) {
+                struct epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.u64 = i;
+                ::epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].fd, &event);
+                ::write(conns[i].fd, burst.data(), burst.size());
+                conns[i].inFlight = depth;
+            }
+            struct epoll_event events[64];
+            vector<char> buf(256 * 1024);
+            int64_t count = 0;
+            while (!done) {
+                int n = ::epoll_wait(epfd, events, 64, 10);
+                for (int i = 0; i < n; ++i) {
+                    Conn &conn = conns[events[i].data.u64];
+                    ssize_t len = ::read(conn.fd, buf.data(), buf.size());
+                    if (len <= 0) {
+                        continue;
+                    }
+                    conn.received += len;
+                    int complete = static_cast<int>(conn.received / responseBytes);
+                    conn.received %= responseBytes;
+                    conn.inFlight -= complete;
+                    count += complete;
+                    // Refill the pipeline to its depth.
+                    int missing = depth - conn.inFlight;
+                    if (missing > 0) {
+                        ::write(conn.fd, burst.data(), missing * (sizeof kRequest - 1));
+                        conn.inFlight = depth;
+                    }
+                }
+                responses.store(count, memory_order_relaxed);
+            }
+            for (auto &conn: conns) {
+                ::close(conn.fd);
+            }
+            ::close(epfd);
+        }));
+        clients.back()->start();
+    }
+
+    auto serverCpu = [&] {
+        double total = 0;
+        for (EventLoop *loop: serverLoops) {
+            runAndWait(loop, [&] { total += threadCpuSeconds(); });
+        }
+        return total;
+    };
+
+    this_thread::sleep_for(chrono::milliseconds(500));
+    int64_t count = responses.load();
+    double cpu = serverCpu();
+    this_thread::sleep_for(chrono::seconds(seconds));
+    count = responses.load() - count;
+    cpu = serverCpu() - cpu;
+    done = true;
+    for (auto &t: clients) {
+        t->join();
+    }
+
+    logi("loops = {} connections = {} depth = {} clients = {} response = {}B", numLoops, numConnections, depth,
+         numClients, responseBytes);
+    logi("{:.0f} requests/s, server cpu {:.2f} cores, {:.0f} requests/s per core",
+         static_cast<double>(count) / seconds, cpu / seconds, cpu > 0 ? static_cast<double>(count) / cpu : 0.0);
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    runAndWait(serverBase, [&] { server.reset(); });
+    fmtlog::poll();
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include "src/include/HttpServer.h"
+#include "src/include/HttpParser.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "src/include/Buffer.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Feeds the parser byte by byte and all at once, including chunked bodies
+// and malformed requests, then talks to an HttpServer: pipelined requests in
+// one write answered in order, HEAD, chunked responses, Connection: close,
+// HTTP/1.0 and the error statuses that close the connection.
+
+const uint16_t kPort = 2044;
+
+// Parses text fed in pieces of step bytes; returns "path|body" per request,
+// or "error <status>".
+vector<string> parseAll(const string &text, size_t step) {
+    HttpParser parser(1024, 1024);
+    Buffer buf;
+    vector<string> requests;
+    for (size_t i = 0; i < text.size(); i += step) {
+        buf.append(text.data() + i, min(step, text.size() - i));
+        while (true) {
+            auto result = parser.parse(&buf, Timestamp::now());
+            if (result == HttpParser::Result::kNeedMore) {
+                break;
+            }
+            if (result == HttpParser::Result::kError) {
+                requests.push_back("error " + to_string(parser.errorStatus()));
+                return requests;
+            }
+            const HttpRequest &request = parser.request();
+            requests.push_back(string(request.path()) + "|" + string(request.body()));
+            parser.consume(&buf);
+        }
+    }
+    return requests;
+}
+
+void testParser() {
+    const string pipeline =
+            "\r\nGET /a?x=1 HTTP/1.1\r\nHost: h\r\nX-Long:   padded value  \r\n\r\n"
+            "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+            "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "3\r\nabc\r\n2;ext=1\r\nde\r\n0\r\nTrailer: t\r\n\r\n"
+            "GET /d HTTP/1.0\r\n\r\n";
+    const vector<string> expected = {"/a|", "/b|hello", "/c|abcde", "/d|"};
+    check(parseAll(pipeline, 1) == expected, "byte by byte");
+    check(parseAll(pipeline, 7) == expected, "in pieces");
+    check(parseAll(pipeline, pipeline.size()) == expected, "all at once");
+
+    HttpParser parser;
+    Buffer buf;
+    buf.append(string("GET /p?q=2 HTTP/1.1\r\nHost: h\r\nConnection: Keep-Alive, Close\r\n\r\n"));
+    check(parser.parse(&buf, Timestamp::now()) == HttpParser::Result::kComplete, "parse one");
+    const HttpRequest &request = parser.request();
+    check(request.method() == HttpRequest::Method::kGet && request.path() == "/p" && request.query() == "q=2" &&
+          request.header("host") == "h" && request.numHeaders() == 2 && !request.keepAlive(), "fields");
+
+    const string chunked = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    string manyTrailers;
+    for (int i = 0; i < 100; ++i) {
+        manyTrailers += "T: xxxxxxxxxx\r\n";
+    }
+    struct Bad {
+        string text;
+        string status;
+    };
+    const vector<Bad> bad = {
+            {"BREW /pot HTTP/1.1\r\n\r\n",                                                      "error 501"},
+            {"GET / HTTP/2.0\r\n\r\n",                                                          "error 505"},
+            {"GET / HTTP/1.1\nHost: h\r\n\r\n",                                                 "error 400"},
+            {"GET / HTTP/1.1\r\nNo colon\r\n\r\n",                                              "error 400"},
+            {"GET / HTTP/1.1\r\nHost : h\r\n\r\n",                                              "error 400"},
+            {"POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n",      "error 400"},
+            {"POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",               "error 400"},
+            {"POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",                                   "error 400"},
+            {"POST / HTTP/1.1\r\nContent-Length: 2000\r\n\r\n",                                 "error 413"},
+            {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n801\r\n",                    "error 413"},
+            {"POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",                              "error 501"},
+            {"GET / HTTP/1.1\r\nX: " + string(2000, 'x') + "\r\n\r\n",                          "error 431"},
+            {"GET / HTTP/1.1\r\nX: " + string(2000, 'x'),                                       "error 431"},
+            {chunked + "1;" + string(2000, 'x'),                                                "error 431"},
+            {chunked + "1;" + string(2000, 'x') + "\r\na\r\n0\r\n\r\n",                           "error 431"},
+            {chunked + "0\r\nT: " + string(2000, 'x') + "\r\n\r\n",                               "error 431"},
+            {chunked + "0\r\n" + manyTrailers + "\r\n",                                          "error 431"},
+    };
+    for (auto &entry: bad) {
+        for (size_t step: {size_t(1), entry.text.size()}) {
+            auto result = parseAll(entry.text, step);
+            check(result.size() == 1 && result[0] == entry.status, "reject " + entry.status + ": " +
+                                                                   entry.text.substr(0, 40));
+        }
+    }
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends request and reads until the server closes, without the Date lines.
+string exchange(const string &request) {
+    int fd = connectTo(kPort);
+    ::write(fd, request.data(), request.size());
+    string reply;
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof buf)) > 0) {
+        reply.append(buf, n);
+    }
+    ::close(fd);
+    string stripped;
+    size_t pos = 0;
+    while (pos < reply.size()) {
+        size_t end = reply.find("\r\n", pos);
+        end = end == string::npos ? reply.size() : end + 2;
+        if (reply.compare(pos, 6, "Date: ") != 0) {
+            stripped.append(reply, pos, end - pos);
+        }
+        pos = end;
+    }
+    return stripped;
+}
+
+void testServer() {
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(kPort, true), "HttpServerTest");
+    server.setThreadNum(2);
+    server.setLimits(1024, 1024);
+    server.setHttpCallback([](const HttpRequest &request, HttpResponse *response) {
+        if (request.path() == "/echo") {
+            response->setBody(string(request.methodString()) + " " + string(request.query()) + " " +
+                              string(request.body()));
+        } else if (request.path() == "/chunked") {
+            response->appendChunk("hello ");
+            response->appendChunk("world");
+        } else {
+            response->setStatus(404);
+        }
+    });
+    server.start();
+
+    Thread client([&] {
+        string reply = exchange("GET /echo?1 HTTP/1.1\r\n\r\n"
+                                "POST /echo?2 HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                                "HEAD /echo?3 HTTP/1.1\r\n\r\n"
+                                "GET /missing HTTP/1.1\r\n\r\n"
+                                "GET /chunked HTTP/1.1\r\n\r\n"
+                                "GET /echo?4 HTTP/1.1\r\nConnection: close\r\n\r\n"
+                                "GET /echo?5 HTTP/1.1\r\n\r\n");
+        check(reply == "HTTP/1.1 200 OK\r\nContent-Length: 6\r\n\r\nGET 1 "
+                       "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nPOST 2 abc"
+                       "HTTP/1.1 200 OK\r\nContent-Length: 7\r\n\r\n"
+                       "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"
+                       "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n6\r\nhello \r\n5\r\nworld\r\n0\r\n\r\n"
+                       "HTTP/1.1 200 OK\r\nContent-Length: 6\r\nConnection: close\r\n\r\nGET 4 ",
+              "pipelined keep-alive then close");
+
+        reply = exchange("GET /echo?1 HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"
+                         "GET /chunked HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"
+                         "GET /echo?2 HTTP/1.0\r\n\r\n");
+        check(reply == "HTTP/1.1 200 OK\r\nContent-Length: 6\r\nConnection: keep-alive\r\n\r\nGET 1 "
+                       "HTTP/1.1 200 OK\r\nContent-Length: 11\r\nConnection: keep-alive\r\n\r\nhello world"
+                       "HTTP/1.1 200 OK\r\nContent-Length: 6\r\nConnection: close\r\n\r\nGET 2 ", "HTTP/1.0");
+
+        reply = exchange("POST /echo?1 HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nwiki\r\n0\r\n\r\n"
+                         "GET /echo HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n"
+                         "GET /echo?never HTTP/1.1\r\n\r\n");
+        check(reply == "HTTP/1.1 200 OK\r\nContent-Length: 11\r\n\r\nPOST 1 wiki"
+                       "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+              "error closes the connection");
+
+        reply = exchange("GET / HTTP/1.1\r\nX: " + string(2000, 'x') + "\r\n\r\n");
+        check(reply.compare(0, 46, "HTTP/1.1 431 Request Header Fields Too Large\r\n") == 0, "431");
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    client.start();
+    loop.loop();
+    client.join();
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testParser();
+    testServer();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/CpuAffinity.h"
+#include "base/include/CurrentThread.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Measures how many connections are served on the cpu (and NUMA node) that
+// sent their packets. Over loopback the receiving cpu is the client's cpu.
+// rr and cpu accept on the base loop and place by round-robin or
+// SO_INCOMING_CPU; reuseport and steer give every loop its own listener,
+// steer with the CBPF program mapping cpus to loops.
+// usage: IncomingCpuTest [rr|cpu|reuseport|steer] [connections] [loops]
+
+atomic<int> g_served(0);
+atomic<int> g_sameCpu(0);
+atomic<int> g_sameNode(0);
+mutex g_mutex;
+set<pid_t> g_servingThreads;
+
+void onMessage(const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+    string msg(buf->retrieveAllAsString());
+    int clientCpu = atoi(msg.c_str());
+    int loopCpu = CpuAffinity::currentCpu();
+    ++g_served;
+    {
+        lock_guard<mutex> lock(g_mutex);
+        g_servingThreads.insert(CurrentThread::tid());
+    }
+    if (clientCpu == loopCpu) {
+        ++g_sameCpu;
+    }
+    if (CpuAffinity::nodeOfCpu(clientCpu) == CpuAffinity::nodeOfCpu(loopCpu)) {
+        ++g_sameNode;
+    }
+    conn->send("ok");
+}
+
+void client(int cpu, int connections, uint16_t port) {
+    CpuAffinity::pinCurrentThread({cpu});
+    for (int i = 0; i < connections; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0) {
+            string msg = to_string(CpuAffinity::currentCpu());
+            ssize_t n = ::write(fd, msg.data(), msg.size());
+            char reply[8];
+            n = ::read(fd, reply, sizeof reply);
+            (void) n;
+        }
+        ::close(fd);
+    }
+}
+
+int main(int argc, char **argv) {
+    fmtlog::startPollingThread(1e8);
+    string mode = argc > 1 ? argv[1] : "rr";
+    int connections = argc > 2 ? atoi(argv[2]) : 1000;
+    int numCpus = CpuAffinity::numCpus();
+    int numLoops = argc > 3 ? atoi(argv[3]) : numCpus;
+    bool perLoop = mode == "reuseport" || mode == "steer";
+
+    EventLoop loop;
+    InetAddress listenAddr(2029, true);
+    TcpServer server(&loop, listenAddr, "IncomingCpuTest",
+                     perLoop ? TcpServer::Option::kReusePortPerLoop : TcpServer::Option::kNoReusePort);
+    vector<vector<int>> cpuSets;
+    for (int cpu = 0; cpu < numCpus; ++cpu) {
+        cpuSets.push_back({cpu});
+    }
+    server.setThreadNum(numLoops);
+    server.setThreadCpuSets(cpuSets);
+    server.setNumaLocalMemory(true);
+    server.setIncomingCpuPlacement(mode == "cpu");
+    server.setCpuSteering(mode == "steer");
+    server.setMessageCallback(onMessage);
+    server.start();
+
+    Thread driver([&] {
+        vector<unique_ptr<Thread>> clients;
+        for (int cpu = 0; cpu < numCpus; ++cpu) {
+            clients.emplace_back(new Thread([=] { client(cpu, connections / numCpus, 2029); }));
+            clients.back()->start();
+        }
+        for (auto &t: clients) {
+            t->join();
+        }
+        loop.quit();
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    int served = g_served;
+    logi("placement = {} cpus = {} loops = {} serving loops = {} served = {} same cpu = {:.1f}% same node = {:.1f}%",
+         mode, numCpus, numLoops, g_servingThreads.size(), served,
+         served ? 100.0 * g_sameCpu / served : 0.0, served ? 100.0 * g_sameNode / served : 0.0);
+    fmtlog::poll();
+    return 0;
+}
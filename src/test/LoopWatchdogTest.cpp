@@ -0,0 +1,43 @@
+#include "src/include/LoopWatchdog.h"
+#include "src/include/EventLoop.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <atomic>
+
+using namespace faliks;
+
+std::atomic<int> stalls(0);
+
+void blockingCallback() {
+    Timestamp start(Timestamp::now());
+    while (timeDifference(Timestamp::now(), start) < 0.5) {
+    }
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+
+    EventLoop loop;
+    LoopWatchdog watchdog(0.2, 0.05);
+    watchdog.setStallCallback([](const StallReport &report) {
+        logi("stalled {:.3f}s in {} at iteration {}\n{}",
+             report.stalledSeconds, report.activity, report.iteration, report.stack);
+        check(report.stack.find("blockingCallback") != std::string::npos, "stack contains the blocking callback");
+        ++stalls;
+    });
+    watchdog.watch(&loop);
+    watchdog.start();
+
+    loop.runAfter(0.1, blockingCallback);
+    loop.runAfter(0.8, [&loop] { loop.quit(); });
+    loop.loop();
+
+    watchdog.unwatch(&loop);
+    watchdog.stop();
+    logi("stall reports = {}", stalls.load());
+    check(stalls == 1, "one stall report");
+    logi("LoopWatchdogTest passed: {}", passed);
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+#include "src/include/MemcacheServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/EventLoopThread.h"
+#include "src/include/InetAddress.h"
+#include "src/include/Buffer.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/Histogram.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <csignal>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// A memtier style load on a MemcacheServer over the text protocol: client
+// threads keep one pipeline of commands on random keys in flight per
+// connection, send the next when every reply has come, and time each
+// pipeline. "set" and "get" run one command, "mixed" one set to nine gets,
+// "multi" gets of ten keys, whose values go out in one gather write from the
+// items. Keys are loaded before the clock starts. Reports commands and keys
+// per second and pipeline latency percentiles.
+// usage: MemcacheBench [set|get|mixed|multi] [loops] [connections] [pipeline] [clients] [seconds] [keys] [value bytes]
+
+const uint16_t kPort = 2055;
+
+void runAndWait(EventLoop *loop, const function<void()> &cb) {
+    CountDownLatch latch(1);
+    loop->runInLoop([&] {
+        cb();
+        latch.countDown();
+    });
+    latch.wait();
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+string keyOf(int i) {
+    char key[32];
+    snprintf(key, sizeof key, "key:%010d", i);
+    return key;
+}
+
+// Takes complete replies off buf, the values of a get with them. The
+// number taken, and the values seen in *hits.
+int consumeReplies(Buffer *buf, int64_t *hits) {
+    int replies = 0;
+    while (true) {
+        const char *crlf = buf->findCRLF();
+        if (crlf == nullptr) {
+            return replies;
+        }
+        size_t lineBytes = crlf + 2 - buf->peek();
+        if (buf->readableBytes() > 6 && memcmp(buf->peek(), "VALUE ", 6) == 0) {
+            // VALUE <key> <flags> <bytes>
+            const char *bytes = crlf;
+            while (bytes[-1] != ' ') {
+                --bytes;
+            }
+            size_t valueBytes = strtoul(bytes, nullptr, 10);
+            if (buf->readableBytes() < lineBytes + valueBytes + 2) {
+                return replies;
+            }
+            buf->retrieve(lineBytes + valueBytes + 2);
+            ++*hits;
+            continue;
+        }
+        buf->retrieve(lineBytes);
+        ++replies;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Clients hang up at the end with replies still on the way.
+    ::signal(SIGPIPE, SIG_IGN);
+    fmtlog::startPollingThread(1e8);
+    string mode = argc > 1 ? argv[1] : "get";
+    int numLoops = argc > 2 ? atoi(argv[2]) : 2;
+    int numConnections = argc > 3 ? atoi(argv[3]) : 50;
+    int pipeline = argc > 4 ? atoi(argv[4]) : 16;
+    int numClients = argc > 5 ? atoi(argv[5]) : 2;
+    int seconds = argc > 6 ? atoi(argv[6]) : 3;
+    int numKeys = argc > 7 ? atoi(argv[7]) : 100000;
+    size_t valueSize = argc > 8 ? static_cast<size_t>(atoi(argv[8])) : 32;
+
+    EventLoopThread serverThread;
+    EventLoop *serverBase = serverThread.startLoop();
+    unique_ptr<MemcacheServer> server;
+    runAndWait(serverBase, [&] {
+        server = make_unique<MemcacheServer>(serverBase, InetAddress(kPort, true), "MemcacheBench");
+        server->setThreadNum(numLoops);
+        // Room for every key, so gets hit.
+        server->setMemoryLimit(max<size_t>(64 << 20, 4 * numKeys * (valueSize + 128)));
+        server->start();
+    });
+
+    const string value(valueSize, 'x');
+    const string setTail = " 0 0 " + to_string(valueSize);
+    {
+        int fd = connectTo(kPort);
+        string request;
+        for (int i = 0; i < numKeys; ++i) {
+            request += "set " + keyOf(i) + setTail + " noreply\r\n" + value + "\r\n";
+        }
+        request += "stats\r\n";
+        for (size_t sent = 0; sent < request.size();) {
+            ssize_t n = ::write(fd, request.data() + sent, request.size() - sent);
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+        }
+        Buffer buf;
+        string reply;
+        while (reply.size() < 5 || reply.compare(reply.size() - 5, 5, "END\r\n") != 0) {
+            int savedErrno;
+            if (buf.readFd(fd, &savedErrno) <= 0) {
+                break;
+            }
+            reply += buf.retrieveAllAsString();
+        }
+        size_t items = reply.find("STAT curr_items ");
+        string loaded = items == string::npos ? "nothing"
+                                              : reply.substr(items + 5, reply.find('\r', items) - items - 5);
+        logi("loaded {}", loaded);
+        ::close(fd);
+    }
+
+    atomic<bool> measuring(false);
+    atomic<bool> done(false);
+    atomic<int64_t> commands(0);
+    atomic<int64_t> keys(0);
+    vector<unique_ptr<Histogram>> latencies;
+    vector<unique_ptr<Thread>> clients;
+    for (int c = 0; c < numClients; ++c) {
+        latencies.emplace_back(new Histogram);
+        Histogram *latencyUs = latencies.back().get();
+        clients.emplace_back(new Thread([&, c, latencyUs] {
+            struct Conn {
+                int fd;
+                Buffer input;
+                int outstanding;
+                int64_t hits;
+                chrono::steady_clock::time_point sent;
+            };
+            vector<unique_ptr<Conn>> conns;
+            int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            mt19937 random(c);
+            uniform_int_distribution<int> anyKey(0, numKeys - 1);
+            const int keysPerGet = mode == "multi" ? 10 : 1;
+            string request;
+            auto send = [&](Conn *conn) {
+                request.clear();
+                for (int i = 0; i < pipeline; ++i) {
+                    bool set = mode == "set" || (mode == "mixed" && random() % 10 == 0);
+                    if (set) {
+                        request += "set " + keyOf(anyKey(random)) + setTail + "\r\n" + value + "\r\n";
+                        continue;
+                    }
+                    request += "get";
+                    for (int k = 0; k < keysPerGet; ++k) {
+                        request += ' ';
+                        request += keyOf(anyKey(random));
+                    }
+                    request += "\r\n";
+                }
+                conn->outstanding = pipeline;
+                conn->hits = 0;
+                conn->sent = chrono::steady_clock::now();
+                ::write(conn->fd, request.data(), request.size());
+            };
+            for (int i = c; i < numConnections; i += numClients) {
+                conns.emplace_back(new Conn{connectTo(kPort), Buffer(), 0, 0, {}});
+                struct epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.ptr = conns.back().get();
+                ::epoll_ctl(epfd, EPOLL_CTL_ADD, conns.back()->fd, &event);
+                send(conns.back().get());
+            }
+            struct epoll_event events[64];
+            while (!done) {
+                int n = ::epoll_wait(epfd, events, 64, 10);
+                for (int i = 0; i < n; ++i) {
+                    auto *conn = static_cast<Conn *>(events[i].data.ptr);
+                    int savedErrno;
+                    if (conn->input.readFd(conn->fd, &savedErrno) <= 0) {
+                        continue;
+                    }
+                    conn->outstanding -= consumeReplies(&conn->input, &conn->hits);
+                    if (conn->outstanding > 0) {
+                        continue;
+                    }
+                    if (measuring.load(memory_order_relaxed)) {
+                        latencyUs->record(chrono::duration_cast<chrono::microseconds>(
+                                chrono::steady_clock::now() - conn->sent).count());
+                        commands.fetch_add(pipeline, memory_order_relaxed);
+                        keys.fetch_add(conn->hits, memory_order_relaxed);
+                    }
+                    send(conn);
+                }
+            }
+            for (auto &conn: conns) {
+                ::close(conn->fd);
+            }
+            ::close(epfd);
+        }));
+        clients.back()->start();
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(500));
+    measuring = true;
+    this_thread::sleep_for(chrono::seconds(seconds));
+    measuring = false;
+    int64_t count = commands.load();
+    int64_t hits = keys.load();
+    done = true;
+    for (auto &t: clients) {
+        t->join();
+    }
+    HistogramSnapshot latency;
+    for (auto &histogram: latencies) {
+        latency.merge(histogram->snapshot());
+    }
+
+    logi("mode = {} loops = {} connections = {} pipeline = {} clients = {} keys = {} value = {}B", mode, numLoops,
+         numConnections, pipeline, numClients, numKeys, valueSize);
+    logi("{:.0f} commands/s, {:.0f} values/s, pipeline latency p50 = {}us p99 = {}us max = {}us",
+         static_cast<double>(count) / seconds, static_cast<double>(hits) / seconds, latency.percentile(50),
+         latency.percentile(99), latency.max());
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    runAndWait(serverBase, [&] { server.reset(); });
+    fmtlog::poll();
+    return 0;
+}
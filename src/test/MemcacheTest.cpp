@@ -0,0 +1,365 @@
+#include "src/include/MemcacheServer.h"
+#include "src/include/MemcacheStore.h"
+#include "src/include/SlabAllocator.h"
+#include "src/include/KvTable.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Fills and frees slab classes up to the memory limit, makes a small store
+// evict by CLOCK while one key stays in use and one item stays acquired
+// across replace, eviction and flush, then talks to a MemcacheServer: text
+// commands pipelined in one write, a get of many large values while another
+// connection overwrites them, noreply, errors and a refused value, then the
+// binary protocol with quiet gets ended by a noop.
+
+const uint16_t kPort = 2054;
+
+void testSlabs() {
+    const size_t kPages = 4;
+    SlabAllocator slabs(kPages * SlabAllocator::kPageBytes, 64, 2.0);
+    bool growing = true;
+    for (size_t cls = 1; cls < slabs.numClasses(); ++cls) {
+        growing = growing && slabs.chunkBytes(cls) > slabs.chunkBytes(cls - 1);
+    }
+    check(growing && slabs.chunkBytes(slabs.numClasses() - 1) == SlabAllocator::kPageBytes, "classes");
+    check(slabs.classOf(1) == 0 && slabs.classOf(64) == 0 && slabs.classOf(65) == 1 &&
+          slabs.classOf(SlabAllocator::kPageBytes + 1) == slabs.numClasses(), "classOf");
+
+    size_t cls = slabs.classOf(1000);
+    vector<void *> chunks;
+    while (void *chunk = slabs.allocate(cls)) {
+        chunks.push_back(chunk);
+    }
+    check(chunks.size() == kPages * (SlabAllocator::kPageBytes / slabs.chunkBytes(cls)) &&
+          slabs.numChunks(cls) == chunks.size() && slabs.chunkAt(cls, 5) == chunks[5], "fill to the limit");
+    // Another class still gets its first page.
+    check(slabs.allocate(0) != nullptr && slabs.allocate(slabs.numClasses() - 1) != nullptr &&
+          slabs.allocate(slabs.numClasses() - 1) == nullptr, "first page past the limit");
+    slabs.deallocate(chunks[7], cls);
+    check(slabs.allocate(cls) == chunks[7] && slabs.allocate(cls) == nullptr, "reuse");
+}
+
+bool stored(MemcacheStore &store, const string &key, const string &value) {
+    uint64_t cas;
+    return store.store(MemcacheStore::StoreMode::kSet, key, KvTable::hash(key), 0, 0, value, &cas) ==
+           MemcacheStore::Result::kStored;
+}
+
+string valueOf(MemcacheStore &store, const string &key) {
+    const MemcacheItem *item = store.acquire(key, KvTable::hash(key));
+    if (item == nullptr) {
+        return "<missing>";
+    }
+    string value(item->value());
+    store.release(item);
+    return value;
+}
+
+void testStore() {
+    // One stripe of a few pages, so values of 1000 bytes evict soon.
+    MemcacheStore store(4 * SlabAllocator::kPageBytes, 1);
+    const string kValue(1000, 'v');
+    check(stored(store, "hot", "hot value") && stored(store, "pinned", kValue), "store");
+    const MemcacheItem *pinned = store.acquire("pinned", KvTable::hash("pinned"));
+    check(pinned != nullptr, "acquire");
+    bool hotSurvived = true;
+    for (int i = 0; i < 20000; ++i) {
+        check(stored(store, "key" + to_string(i), kValue), "store under pressure");
+        if (i % 100 == 0) {
+            hotSurvived = hotSurvived && valueOf(store, "hot") == "hot value";
+        }
+    }
+    MemcacheStore::Stats stats = store.stats();
+    check(stats.evictions > 10000 && stats.reservedBytes <= 5 * SlabAllocator::kPageBytes, "evictions");
+    check(hotSurvived, "used key survives CLOCK");
+    check(valueOf(store, "pinned") == kValue, "acquired item not evicted");
+
+    // Replaced, flushed and evicted, the acquired item still reads the same.
+    check(stored(store, "pinned", "new"), "replace acquired");
+    store.flush();
+    for (int i = 0; i < 20000; ++i) {
+        stored(store, "again" + to_string(i), kValue);
+    }
+    check(pinned->value() == kValue && valueOf(store, "pinned") == "<missing>", "acquired item kept");
+    store.release(pinned);
+
+    uint64_t cas = 0;
+    using Mode = MemcacheStore::StoreMode;
+    using Result = MemcacheStore::Result;
+    auto hash = KvTable::hash("k");
+    check(store.store(Mode::kAdd, "k", hash, 7, 0, "1", &cas) == Result::kStored, "add");
+    uint64_t first = cas;
+    check(store.store(Mode::kAdd, "k", hash, 0, 0, "2", &cas) == Result::kNotStored, "add existing");
+    check(store.store(Mode::kAppend, "k", hash, 0, 0, "0", &cas) == Result::kStored && cas != first, "append");
+    cas = first;
+    check(store.store(Mode::kCas, "k", hash, 0, 0, "x", &cas) == Result::kExists, "stale cas");
+    uint64_t value;
+    check(store.incrDecr("k", hash, true, 5, nullptr, 0, &value, &cas) == Result::kStored && value == 15, "incr");
+    check(store.incrDecr("k", hash, false, 100, nullptr, 0, &value, &cas) == Result::kStored && value == 0, "decr");
+    const MemcacheItem *item = store.acquire("k", hash);
+    check(item != nullptr && item->flags == 7 && item->value() == "0", "flags kept");
+    store.release(item);
+    check(store.store(Mode::kCas, "k", hash, 0, 0, "x", &cas) == Result::kStored && valueOf(store, "k") == "x", "cas");
+    check(store.incrDecr("k", hash, true, 1, nullptr, 0, &value, &cas) == Result::kNonNumeric, "non-numeric");
+    check(store.touch("k", hash, -1) && valueOf(store, "k") == "<missing>", "expired by touch");
+    check(store.store(Mode::kSet, "k", hash, 0, 0, string(SlabAllocator::kPageBytes, 'x'), &cas) ==
+          Result::kTooLarge, "too large");
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void writeAll(int fd, const string &data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t n = ::write(fd, data.data() + sent, data.size() - sent);
+        if (n <= 0) {
+            return;
+        }
+        sent += n;
+    }
+}
+
+size_t countOf(const string &text, const string &part) {
+    size_t count = 0;
+    for (size_t pos = text.find(part); pos != string::npos; pos = text.find(part, pos + part.size())) {
+        ++count;
+    }
+    return count;
+}
+
+// Reads until the reply ends with times occurrences of end, or the peer
+// closes.
+string readUntil(int fd, const string &end, size_t times = 1, bool *closed = nullptr) {
+    string reply;
+    while (reply.size() < end.size() || reply.compare(reply.size() - end.size(), end.size(), end) != 0 ||
+           countOf(reply, end) < times) {
+        char chunk[65536];
+        ssize_t n = ::read(fd, chunk, sizeof chunk);
+        if (n <= 0) {
+            if (closed != nullptr) {
+                *closed = true;
+            }
+            break;
+        }
+        reply.append(chunk, n);
+    }
+    return reply;
+}
+
+string binaryRequest(uint8_t opcode, const string &key, const string &extras, const string &value,
+                     uint32_t opaque = 0) {
+    string request(24, '\0');
+    request[0] = static_cast<char>(0x80);
+    request[1] = static_cast<char>(opcode);
+    request[2] = static_cast<char>(key.size() >> 8);
+    request[3] = static_cast<char>(key.size());
+    request[4] = static_cast<char>(extras.size());
+    uint32_t body = htonl(static_cast<uint32_t>(extras.size() + key.size() + value.size()));
+    memcpy(&request[8], &body, 4);
+    memcpy(&request[12], &opaque, 4);
+    return request + extras + key + value;
+}
+
+struct BinaryReply {
+    uint8_t opcode;
+    uint16_t status;
+    string key;
+    string extras;
+    string value;
+    uint32_t opaque;
+};
+
+vector<BinaryReply> parseBinary(const string &data) {
+    vector<BinaryReply> replies;
+    for (size_t pos = 0; pos + 24 <= data.size();) {
+        const auto *p = reinterpret_cast<const uint8_t *>(data.data() + pos);
+        size_t keyBytes = p[2] << 8 | p[3];
+        size_t extrasBytes = p[4];
+        size_t body = static_cast<size_t>(p[8]) << 24 | p[9] << 16 | p[10] << 8 | p[11];
+        BinaryReply reply{p[1], static_cast<uint16_t>(p[6] << 8 | p[7]), {}, {}, {}, 0};
+        memcpy(&reply.opaque, p + 12, 4);
+        reply.extras = data.substr(pos + 24, extrasBytes);
+        reply.key = data.substr(pos + 24 + extrasBytes, keyBytes);
+        reply.value = data.substr(pos + 24 + extrasBytes + keyBytes, body - extrasBytes - keyBytes);
+        replies.push_back(reply);
+        pos += 24 + body;
+    }
+    return replies;
+}
+
+void testText(MemcacheServer *server) {
+    int first = connectTo(kPort);
+    int second = connectTo(kPort);
+
+    string request = "set a 5 0 3\r\nabc\r\nget a b\r\nadd a 0 0 1\r\nx\r\nappend a 0 0 2\r\nde\r\n"
+                     "incr a 1\r\nset n 0 0 2\r\n10\r\nincr n 5\r\ndecr n 100\r\nset q 0 0 1 noreply\r\nq\r\n"
+                     "delete b\r\ndelete q\r\ntouch n 100\r\nbogus\r\nset a 0 0 x\r\nset a 0 0 2\r\nabcd\r\n"
+                     "gets a\r\n";
+    writeAll(first, request);
+    string reply = readUntil(first, "END\r\n", 2);
+    size_t casAt = reply.rfind("VALUE a 5 5 ") + 12;
+    string expected = "STORED\r\nVALUE a 5 3\r\nabc\r\nEND\r\nNOT_STORED\r\nSTORED\r\n"
+                      "CLIENT_ERROR cannot increment or decrement non-numeric value\r\nSTORED\r\n15\r\n0\r\n"
+                      "NOT_FOUND\r\nDELETED\r\nTOUCHED\r\nERROR\r\nCLIENT_ERROR bad command line format\r\n"
+                      "CLIENT_ERROR bad data chunk\r\nERROR\r\nVALUE a 5 5 ";
+    check(reply.compare(0, expected.size(), expected) == 0 && reply.size() > casAt, "text commands");
+    string cas = reply.substr(casAt, reply.find("\r\n", casAt) - casAt);
+    writeAll(first, "cas a 0 0 1 " + cas + "\r\nz\r\ncas a 0 0 1 " + cas + "\r\ny\r\nget a\r\n");
+    check(readUntil(first, "END\r\n") == "STORED\r\nEXISTS\r\nVALUE a 0 1\r\nz\r\nEND\r\n", "cas");
+
+    // Larger than the socket buffers, so most of the reply waits in the
+    // connection still pointing at the items while they are overwritten.
+    const int kKeys = 40;
+    auto bigValue = [](int i, char fill) { return to_string(i) + string(100000, fill); };
+    request.clear();
+    string get = "get";
+    for (int i = 0; i < kKeys; ++i) {
+        string value = bigValue(i, 'a');
+        request += "set big" + to_string(i) + " " + to_string(i) + " 0 " + to_string(value.size()) + "\r\n" +
+                   value + "\r\n";
+        get += " big" + to_string(i);
+    }
+    writeAll(second, request);
+    readUntil(second, "STORED\r\n", kKeys);
+    writeAll(first, get + " missing\r\n");
+    usleep(100 * 1000);
+    request.clear();
+    for (int i = 0; i < kKeys; ++i) {
+        string value = bigValue(i, 'b');
+        request += "set big" + to_string(i) + " 0 0 " + to_string(value.size()) + " noreply\r\n" + value + "\r\n";
+    }
+    request += "flush_all\r\n";
+    writeAll(second, request);
+    check(readUntil(second, "OK\r\n") == "OK\r\n", "overwrite and flush");
+    expected.clear();
+    for (int i = 0; i < kKeys; ++i) {
+        string value = bigValue(i, 'a');
+        expected += "VALUE big" + to_string(i) + " " + to_string(i) + " " + to_string(value.size()) + "\r\n" +
+                    value + "\r\n";
+    }
+    expected += "END\r\n";
+    reply = readUntil(first, "END\r\n", 1);
+    check(reply == expected, "get_multi of values overwritten while sent");
+    writeAll(first, "get big1\r\n");
+    check(readUntil(first, "END\r\n") == "END\r\n", "flushed");
+
+    // A refused value is dropped, not taken for commands.
+    string tooLarge(2 * 1024 * 1024, 'x');
+    writeAll(first, "set huge 0 0 " + to_string(tooLarge.size()) + "\r\n" + tooLarge + "\r\nversion\r\n");
+    reply = readUntil(first, "\r\nVERSION 1.6.21\r\n");
+    check(reply == "SERVER_ERROR object too large for cache\r\nVERSION 1.6.21\r\n", "too large");
+
+    writeAll(first, "stats\r\n");
+    reply = readUntil(first, "END\r\n");
+    check(reply.find("STAT curr_items 0\r\n") != string::npos && reply.find("STAT threads 2\r\n") != string::npos,
+          "stats");
+    check(server->store() != nullptr && server->store()->stats().items == 0, "empty after flush");
+
+    bool closed = false;
+    writeAll(first, "quit\r\nversion\r\n");
+    check(readUntil(first, "never", 1, &closed).empty() && closed, "quit");
+    ::close(first);
+    ::close(second);
+}
+
+void testBinary() {
+    int fd = connectTo(kPort);
+    string flagsAndExptime("\0\0\0\x2a\0\0\0\0", 8);
+    string request = binaryRequest(0x01, "k1", flagsAndExptime, "one", 1);
+    request += binaryRequest(0x11, "k2", flagsAndExptime, "two", 2);
+    // Quiet gets answer hits only, the noop ends the batch.
+    request += binaryRequest(0x0d, "k1", "", "", 3);
+    request += binaryRequest(0x0d, "missing", "", "", 4);
+    request += binaryRequest(0x09, "k2", "", "", 5);
+    request += binaryRequest(0x0a, "", "", "", 6);
+    writeAll(fd, request);
+    string data;
+    vector<BinaryReply> replies;
+    while (replies.empty() || replies.back().opcode != 0x0a) {
+        char chunk[4096];
+        ssize_t n = ::read(fd, chunk, sizeof chunk);
+        if (n <= 0) {
+            break;
+        }
+        data.append(chunk, n);
+        replies = parseBinary(data);
+    }
+    check(replies.size() == 4 && replies[0].opcode == 0x01 && replies[0].status == 0 && replies[0].opaque == 1 &&
+          replies[1].opcode == 0x0d && replies[1].key == "k1" && replies[1].value == "one" &&
+          replies[1].extras == string("\0\0\0\x2a", 4) && replies[1].opaque == 3 &&
+          replies[2].opcode == 0x09 && replies[2].key.empty() && replies[2].value == "two" &&
+          replies[3].opaque == 6, "quiet gets");
+
+    string incrExtras(20, '\0');
+    incrExtras[7] = 5;
+    incrExtras[15] = 100;
+    request = binaryRequest(0x05, "counter", incrExtras, "");
+    request += binaryRequest(0x05, "counter", incrExtras, "");
+    request += binaryRequest(0x04, "nope", "", "");
+    request += binaryRequest(0x00, "nope", "", "");
+    request += binaryRequest(0x0e, "k1", "", "+", 7);
+    request += binaryRequest(0x00, "k1", "", "");
+    request += binaryRequest(0x01, "k1", "", "bad extras");
+    request += binaryRequest(0x42, "", "", "");
+    request += binaryRequest(0x0b, "", "", "");
+    request += binaryRequest(0x07, "", "", "");
+    writeAll(fd, request);
+    bool closed = false;
+    data = readUntil(fd, "never", 1, &closed);
+    replies = parseBinary(data);
+    check(closed && replies.size() == 10, "binary replies");
+    if (replies.size() == 10) {
+        check(replies[0].value == string("\0\0\0\0\0\0\0\x64", 8) &&
+              replies[1].value == string("\0\0\0\0\0\0\0\x69", 8), "incr with initial");
+        check(replies[2].status == 1 && replies[3].status == 1 && replies[3].value == "Not found", "misses");
+        check(replies[4].status == 0 && replies[4].opaque == 7 && replies[5].value == "one+", "append");
+        check(replies[6].status == 4 && replies[7].status == 0x81 && replies[8].value == "1.6.21" &&
+              replies[9].opcode == 0x07, "errors, version and quit");
+    }
+    ::close(fd);
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testSlabs();
+    testStore();
+
+    EventLoop loop;
+    MemcacheServer server(&loop, InetAddress(kPort, true), "MemcacheTest");
+    server.setThreadNum(2);
+    server.start();
+    Thread client([&] {
+        testText(&server);
+        testBinary();
+        loop.runInLoop([&loop] { loop.quit(); });
+    });
+    client.start();
+    loop.loop();
+    client.join();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
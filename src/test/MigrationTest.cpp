@@ -0,0 +1,322 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "src/include/LoopPlacement.h"
+#include "src/include/ThreadPool.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Moves connections between loops while data flows through them, both echoed
+// by the loop and pushed from a foreign thread, and checks that every byte
+// arrives in order. Checks that callbacks queued behind a migration run in
+// the loop that owns the connection by then. Then lets the rebalancer spread
+// connections that were all placed on one loop.
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool writeAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Reads count consecutive uint32 values starting at 0.
+bool readSequence(int fd, uint32_t count) {
+    uint32_t expected = 0;
+    char buf[4096];
+    size_t have = 0;
+    while (expected < count) {
+        ssize_t n = ::read(fd, buf + have, sizeof buf - have);
+        if (n <= 0) {
+            loge("read stopped at {} of {}", expected, count);
+            return false;
+        }
+        have += n;
+        size_t off = 0;
+        for (; off + sizeof(uint32_t) <= have; off += sizeof(uint32_t)) {
+            uint32_t value;
+            memcpy(&value, buf + off, sizeof value);
+            if (value != expected) {
+                loge("expected {} got {}", expected, value);
+                return false;
+            }
+            ++expected;
+        }
+        memmove(buf, buf + off, have - off);
+        have -= off;
+    }
+    return true;
+}
+
+void testMigrationKeepsOrder() {
+    const uint32_t kCount = 200 * 1000;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(0, true), "MigrationTest");
+    uint16_t port = server.localAddress().port();
+    server.setThreadNum(3);
+
+    mutex mutex;
+    vector<shared_ptr<TcpConnection>> conns;
+    server.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            lock_guard<std::mutex> lock(mutex);
+            conns.push_back(conn);
+        }
+    });
+    // One connection echoes, the other only receives data pushed by a thread.
+    server.setMessageCallback([&](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        conn->send(buf);
+    });
+    server.start();
+
+    Thread driver([&] {
+        int echoFd = connectTo(port);
+        int pushFd = connectTo(port);
+        while (true) {
+            lock_guard<std::mutex> lock(mutex);
+            if (conns.size() == 2) {
+                break;
+            }
+        }
+        struct sockaddr_in pushAddr{};
+        socklen_t pushAddrLen = sizeof pushAddr;
+        ::getsockname(pushFd, reinterpret_cast<sockaddr *>(&pushAddr), &pushAddrLen);
+        if (conns[0]->peerAddress().port() == ntohs(pushAddr.sin_port)) {
+            swap(conns[0], conns[1]);
+        }
+        vector<EventLoop *> loops;
+        loop.runInLoop([&] { loops = server.threadPool()->getAllLoops(); });
+        while (loops.empty()) {
+            this_thread::yield();
+        }
+
+        atomic<bool> done(false);
+        Thread migrator([&] {
+            for (size_t i = 0; !done; ++i) {
+                conns[0]->migrateTo(loops[i % loops.size()]);
+                conns[1]->migrateTo(loops[(i + 1) % loops.size()]);
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+        });
+        Thread pusher([&] {
+            for (uint32_t i = 0; i < kCount; ++i) {
+                conns[1]->send(&i, sizeof i);
+            }
+        });
+        Thread echoWriter([&] {
+            for (uint32_t i = 0; i < kCount; i += 256) {
+                uint32_t chunk[256];
+                uint32_t n = min<uint32_t>(256, kCount - i);
+                for (uint32_t j = 0; j < n; ++j) {
+                    chunk[j] = i + j;
+                }
+                writeAll(echoFd, reinterpret_cast<const char *>(chunk), n * sizeof(uint32_t));
+            }
+        });
+        migrator.start();
+        pusher.start();
+        echoWriter.start();
+        bool echoed = readSequence(echoFd, kCount);
+        bool pushed = readSequence(pushFd, kCount);
+        echoWriter.join();
+        pusher.join();
+        done = true;
+        migrator.join();
+
+        int migrations = conns[0]->migrations() + conns[1]->migrations();
+        logi("echoed in order = {} pushed in order = {} migrations = {}", echoed, pushed, migrations);
+        check(echoed && pushed, "bytes arrive in order");
+        check(migrations > 0, "connections migrated");
+        // The registry follows the connections to their new loops.
+        this_thread::sleep_for(chrono::milliseconds(50));
+        size_t visited = 0;
+        server.forEachConnection([&](const shared_ptr<TcpConnection> &) { ++visited; });
+        ::close(echoFd);
+        ::close(pushFd);
+        conns.clear();
+        this_thread::sleep_for(chrono::milliseconds(100));
+        logi("connections visited = {} left after close = {}", visited, server.numConnections());
+        check(visited == 2, "registry follows the connections");
+        check(server.numConnections() == 0, "closed connections removed");
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+}
+
+// Every reply is sent right after a migration is queued, so its
+// write-complete callback sits behind the migration in the same batch.
+void testCallbacksFollowMigration() {
+    const int kRounds = 50;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(0, true), "CallbackMigrationTest");
+    uint16_t port = server.localAddress().port();
+    server.setThreadNum(2);
+
+    atomic<int> completions(0);
+    atomic<int> inOwnerLoop(0);
+    atomic<int> migrations(0);
+    vector<EventLoop *> loops;
+    server.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        conn->setWriteCompleteCallback([&](const shared_ptr<TcpConnection> &c) {
+            ++completions;
+            if (c->getLoop()->isInLoopThread()) {
+                ++inOwnerLoop;
+            }
+            migrations = c->migrations();
+        });
+    });
+    server.setMessageCallback([&](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        conn->migrateTo(conn->getLoop() == loops[0] ? loops[1] : loops[0]);
+        conn->send(buf);
+    });
+    server.start();
+    loops = server.threadPool()->getAllLoops();
+
+    Thread driver([&] {
+        int fd = connectTo(port);
+        char buf[4];
+        for (int i = 0; i < kRounds; ++i) {
+            if (!writeAll(fd, "ping", 4) || ::read(fd, buf, sizeof buf) != 4) {
+                break;
+            }
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+        ::close(fd);
+        logi("write completions = {} in the owner loop = {} migrations = {}", completions.load(),
+             inOwnerLoop.load(), migrations.load());
+        check(completions == kRounds && migrations > 0, "write completions across migrations");
+        check(inOwnerLoop == kRounds, "write completions in the owner loop");
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+}
+
+class FirstLoopPlacement : public LoopPlacement {
+public:
+    size_t select(const vector<const LoopLoad *> &, const InetAddress &, int64_t) override {
+        return 0;
+    }
+};
+
+void testRebalancerSpreadsHotLoop() {
+    const int kConnections = 4;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(0, true), "RebalanceTest");
+    uint16_t port = server.localAddress().port();
+    server.setThreadNum(2);
+    server.setPlacement(make_unique<FirstLoopPlacement>());
+    server.setRebalancing(0.3, 0.5, 0.2);
+
+    mutex mutex;
+    vector<shared_ptr<TcpConnection>> conns;
+    server.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            lock_guard<std::mutex> lock(mutex);
+            conns.push_back(conn);
+        }
+    });
+    server.setMessageCallback([](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        auto until = chrono::steady_clock::now() + chrono::microseconds(500);
+        while (chrono::steady_clock::now() < until) {
+        }
+        conn->send(buf);
+    });
+    server.start();
+
+    Thread driver([&] {
+        atomic<bool> done(false);
+        vector<unique_ptr<Thread>> clients;
+        for (int i = 0; i < kConnections; ++i) {
+            clients.emplace_back(new Thread([&] {
+                int fd = connectTo(port);
+                char buf[64] = {};
+                while (!done) {
+                    if (::write(fd, buf, sizeof buf) <= 0 || ::read(fd, buf, sizeof buf) <= 0) {
+                        break;
+                    }
+                }
+                ::close(fd);
+            }));
+            clients.back()->start();
+        }
+        this_thread::sleep_for(chrono::seconds(3));
+
+        EventLoop *first = nullptr;
+        loop.runInLoop([&] { first = server.threadPool()->getAllLoops()[0]; });
+        while (first == nullptr) {
+            this_thread::yield();
+        }
+        int moved = 0;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            for (auto &conn: conns) {
+                if (conn->getLoop() != first) {
+                    ++moved;
+                }
+            }
+            conns.clear();
+        }
+        logi("connections = {} moved off the hot loop = {}", kConnections, moved);
+        check(moved > 0 && moved < kConnections, "hot loop spread");
+        done = true;
+        for (auto &t: clients) {
+            t->join();
+        }
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    Thread t1(testMigrationKeepsOrder);
+    t1.start();
+    t1.join();
+    Thread t2(testCallbacksFollowMigration);
+    t2.start();
+    t2.join();
+    Thread t3(testRebalancerSpreadsHotLoop);
+    t3.start();
+    t3.join();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
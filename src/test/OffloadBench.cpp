@@ -0,0 +1,151 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "src/include/Offload.h"
+#include "base/include/Histogram.h"
+#include "base/include/Thread.h"
+#include "base/include/WorkStealingPool.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// One IO loop serves two kinds of line requests: "io" is answered at once,
+// "cpu" needs about a millisecond of hashing. Run inline, the hashing delays
+// every io request behind it; offloaded to a WorkStealingPool, the loop only
+// parses and replies.
+// usage: OffloadBench [inline|offload] [seconds] [cpuClients] [poolThreads]
+
+const uint16_t kPort = 2033;
+
+uint64_t burnCpu(uint64_t seed) {
+    uint64_t hash = seed | 1;
+    for (int i = 0; i < 200000; ++i) {
+        hash ^= hash << 13;
+        hash ^= hash >> 7;
+        hash ^= hash << 17;
+    }
+    return hash;
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool request(int fd, const char *line) {
+    if (::write(fd, line, strlen(line)) <= 0) {
+        return false;
+    }
+    char buf[64];
+    size_t have = 0;
+    while (have == 0 || buf[have - 1] != '\n') {
+        ssize_t n = ::read(fd, buf + have, sizeof buf - have);
+        if (n <= 0) {
+            return false;
+        }
+        have += n;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    bool useOffload = argc > 1 && strcmp(argv[1], "offload") == 0;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    int cpuClients = argc > 3 ? atoi(argv[3]) : 4;
+    int poolThreads = argc > 4 ? atoi(argv[4]) : 2;
+
+    WorkStealingPool pool("compute");
+    pool.setThreadNum(poolThreads);
+    pool.setMaxQueueSize(1024);
+    pool.start();
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort, true), "OffloadBench");
+    server.setThreadNum(1);
+    server.setConnectionCallback([](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([&](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        const char *eol;
+        while ((eol = buf->findEOL()) != nullptr) {
+            string line(buf->peek(), eol);
+            buf->retrieveUntil(eol + 1);
+            if (line != "cpu") {
+                conn->send("ok\n");
+            } else if (!useOffload) {
+                conn->send(to_string(burnCpu(line.size())) + "\n");
+            } else if (!offload(pool, [n = line.size()] { return burnCpu(n); },
+                                [conn](uint64_t hash) { conn->send(to_string(hash) + "\n"); })) {
+                conn->send("overloaded\n");
+            }
+        }
+    });
+    server.start();
+
+    Histogram ioLatency;
+    atomic<int64_t> cpuDone(0);
+    Thread driver([&] {
+        atomic<bool> done(false);
+        vector<unique_ptr<Thread>> clients;
+        for (int i = 0; i < cpuClients; ++i) {
+            clients.emplace_back(new Thread([&] {
+                int fd = connectTo(kPort);
+                while (!done && request(fd, "cpu\n")) {
+                    ++cpuDone;
+                }
+                ::close(fd);
+            }));
+            clients.back()->start();
+        }
+        int fd = connectTo(kPort);
+        auto end = chrono::steady_clock::now() + chrono::seconds(seconds);
+        while (chrono::steady_clock::now() < end) {
+            auto start = chrono::steady_clock::now();
+            if (!request(fd, "io\n")) {
+                break;
+            }
+            ioLatency.record(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+        }
+        ::close(fd);
+        done = true;
+        for (auto &t: clients) {
+            t->join();
+        }
+        loop.runAfter(0.1, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+    pool.stop();
+
+    HistogramSnapshot snapshot = ioLatency.snapshot();
+    logi("mode = {} cpu requests/s = {:.0f} io requests = {} io latency us p50 = {} p99 = {} max = {} shed = {}",
+         useOffload ? "offload" : "inline", static_cast<double>(cpuDone) / seconds, snapshot.count(),
+         snapshot.percentile(50), snapshot.percentile(99), snapshot.max(), pool.shed());
+    fmtlog::poll();
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include "src/include/LoopLoad.h"
+#include "src/include/LoopPlacement.h"
+#include "src/include/InetAddress.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Simulates long-lived connections with heavy-tailed (Pareto) cpu demand
+// arriving at a pool of loops, and reports how evenly each placement policy
+// spreads the demand. A loop whose demand exceeds 1 is saturated; the excess
+// is work that queues up as latency.
+// usage: PlacementBench [loops] [seconds]
+
+struct Arrival {
+    int64_t atUs;
+    int64_t lifetimeUs;
+    double demand;
+    uint32_t ip;
+};
+
+struct Result {
+    double meanImbalance;
+    double saturatedFraction;
+    double excessFraction;
+};
+
+const int64_t kTickUs = 10 * 1000;
+
+vector<Arrival> makeArrivals(int numLoops, int64_t durationUs) {
+    mt19937_64 rng(42);
+    const double meanLifetimeSec = 30.0;
+    const double meanConcurrent = 50.0 * numLoops;
+    const double paretoShape = 1.2;
+    // Pareto mean is shape * scale / (shape - 1); aim for 70% total utilization.
+    const double meanDemand = 0.7 * numLoops / meanConcurrent;
+    const double scale = meanDemand * (paretoShape - 1) / paretoShape;
+
+    exponential_distribution<double> interArrival(meanConcurrent / meanLifetimeSec);
+    exponential_distribution<double> lifetime(1.0 / meanLifetimeSec);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    uniform_int_distribution<uint32_t> client(0, 2047);
+
+    vector<Arrival> arrivals;
+    double t = 0;
+    while (true) {
+        t += interArrival(rng);
+        auto atUs = static_cast<int64_t>(t * 1e6);
+        if (atUs >= durationUs) {
+            break;
+        }
+        double demand = min(1.0, scale / pow(1.0 - uniform(rng), 1.0 / paretoShape));
+        arrivals.push_back({atUs, static_cast<int64_t>(lifetime(rng) * 1e6), demand,
+                            (10u << 24) | client(rng)});
+    }
+    return arrivals;
+}
+
+Result simulate(LoopPlacement &placement, int numLoops, const vector<Arrival> &arrivals, int64_t durationUs) {
+    struct Live {
+        int64_t endUs;
+        size_t loop;
+        double demand;
+    };
+    vector<unique_ptr<LoopLoad>> owned;
+    vector<const LoopLoad *> loads;
+    for (int i = 0; i < numLoops; ++i) {
+        owned.push_back(make_unique<LoopLoad>());
+        loads.push_back(owned.back().get());
+    }
+    vector<double> demand(numLoops, 0.0);
+    vector<Live> live;
+    size_t next = 0;
+    double imbalanceSum = 0;
+    int64_t imbalanceTicks = 0;
+    int64_t saturatedLoopTicks = 0;
+    double excess = 0;
+    double total = 0;
+
+    // Skip the first lifetime so the pool is in steady state when measured.
+    const int64_t warmupUs = 30 * 1000 * 1000;
+    for (int64_t nowUs = kTickUs; nowUs <= durationUs; nowUs += kTickUs) {
+        for (size_t i = 0; i < live.size();) {
+            if (live[i].endUs <= nowUs) {
+                demand[live[i].loop] -= live[i].demand;
+                owned[live[i].loop]->connectionDown();
+                live[i] = live.back();
+                live.pop_back();
+            } else {
+                ++i;
+            }
+        }
+        for (; next < arrivals.size() && arrivals[next].atUs <= nowUs; ++next) {
+            const Arrival &a = arrivals[next];
+            struct sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(a.ip);
+            size_t loop = placement.select(loads, InetAddress(addr), nowUs);
+            owned[loop]->connectionUp();
+            demand[loop] += a.demand;
+            live.push_back({a.atUs + a.lifetimeUs, loop, a.demand});
+        }
+
+        double sum = 0;
+        double highest = 0;
+        for (int i = 0; i < numLoops; ++i) {
+            double busy = min(1.0, demand[i]);
+            owned[i]->recordIteration(static_cast<int64_t>(busy * kTickUs), nowUs);
+            sum += demand[i];
+            highest = max(highest, demand[i]);
+            if (nowUs > warmupUs) {
+                total += demand[i];
+                if (demand[i] > 1.0) {
+                    ++saturatedLoopTicks;
+                    excess += demand[i] - 1.0;
+                }
+            }
+        }
+        if (nowUs > warmupUs && sum > 0) {
+            imbalanceSum += highest / (sum / numLoops);
+            ++imbalanceTicks;
+        }
+    }
+    int64_t loopTicks = imbalanceTicks * numLoops;
+    return {imbalanceTicks ? imbalanceSum / static_cast<double>(imbalanceTicks) : 0.0,
+            loopTicks ? static_cast<double>(saturatedLoopTicks) / static_cast<double>(loopTicks) : 0.0,
+            total > 0 ? excess / total : 0.0};
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    int numLoops = argc > 1 ? atoi(argv[1]) : 8;
+    int seconds = argc > 2 ? atoi(argv[2]) : 600;
+    int64_t durationUs = static_cast<int64_t>(seconds) * 1000 * 1000;
+    vector<Arrival> arrivals = makeArrivals(numLoops, durationUs);
+    logi("loops = {} seconds = {} connections = {}", numLoops, seconds, arrivals.size());
+
+    struct Case {
+        string name;
+        unique_ptr<LoopPlacement> placement;
+    };
+    vector<Case> cases;
+    cases.push_back({"round-robin", make_unique<RoundRobinPlacement>()});
+    cases.push_back({"least-connections", make_unique<LeastConnectionsPlacement>()});
+    cases.push_back({"p2c-ewma", make_unique<PowerOfTwoChoicesPlacement>()});
+    cases.push_back({"consistent-hash", make_unique<ConsistentHashPlacement>()});
+
+    vector<Result> results;
+    for (auto &c: cases) {
+        Result r = simulate(*c.placement, numLoops, arrivals, durationUs);
+        results.push_back(r);
+        logi("{:<18} max/mean demand = {:.3f} saturated loop time = {:.2f}% excess demand = {:.2f}%",
+             c.name, r.meanImbalance, r.saturatedFraction * 100, r.excessFraction * 100);
+    }
+
+    bool passed = results[2].excessFraction <= results[0].excessFraction;
+    logi("p2c-ewma {} round-robin on excess demand", passed ? "beats or ties" : "loses to");
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#include "src/include/PubSubHub.h"
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "src/include/ThreadPool.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// A publisher thread sends messages to one topic with every client
+// subscribed, while a reader thread counts what arrives. "copy" calls send()
+// per subscriber, which copies the message and posts a task each time;
+// "hub" publishes through a PubSubHub, one shared payload and one task per
+// loop. Reports deliveries per second and publisher CPU per message.
+// usage: PubSubBench [copy|hub] [seconds] [subscribers] [loops] [message bytes]
+
+const uint16_t kPort = 2049;
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+double threadCpuSeconds() {
+    struct timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    bool useHub = argc > 1 && strcmp(argv[1], "hub") == 0;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    int numSubscribers = argc > 3 ? atoi(argv[3]) : 1000;
+    int numLoops = argc > 4 ? atoi(argv[4]) : 2;
+    size_t messageSize = argc > 5 ? static_cast<size_t>(atoi(argv[5])) : 256;
+
+    EventLoop loop;
+    // Outlives the server, whose connections unsubscribe as it closes them.
+    unique_ptr<PubSubHub> hub;
+    TcpServer server(&loop, InetAddress(kPort, true), "PubSubBench");
+    server.setThreadNum(numLoops);
+    mutex mutex;
+    vector<shared_ptr<TcpConnection>> conns;
+    server.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            hub->subscribe(conn, "news");
+            lock_guard<std::mutex> lock(mutex);
+            conns.push_back(conn);
+        } else {
+            hub->unsubscribeAll(conn);
+        }
+    });
+    server.start();
+    hub = make_unique<PubSubHub>(server.threadPool()->getAllLoops());
+
+    atomic<int64_t> received(0);
+    Thread driver([&] {
+        vector<int> fds;
+        int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+        for (int i = 0; i < numSubscribers; ++i) {
+            fds.push_back(connectTo(kPort));
+            struct epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fds.back();
+            ::epoll_ctl(epfd, EPOLL_CTL_ADD, fds.back(), &event);
+        }
+        while (hub->numSubscribers("news") != static_cast<size_t>(numSubscribers)) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+
+        atomic<bool> done(false);
+        Thread reader([&] {
+            struct epoll_event events[64];
+            vector<char> buf(256 * 1024);
+            int64_t bytes = 0;
+            while (!done) {
+                int n = ::epoll_wait(epfd, events, 64, 10);
+                for (int i = 0; i < n; ++i) {
+                    ssize_t len = ::read(events[i].data.fd, buf.data(), buf.size());
+                    if (len > 0) {
+                        bytes += len;
+                    }
+                }
+                received.store(bytes / static_cast<int64_t>(messageSize), memory_order_relaxed);
+            }
+        });
+        reader.start();
+
+        atomic<int64_t> published(0);
+        atomic<double> publisherCpu(0);
+        Thread publisher([&] {
+            vector<shared_ptr<TcpConnection>> mine;
+            {
+                lock_guard<std::mutex> lock(mutex);
+                mine = conns;
+            }
+            const string message(messageSize - 1, 'x');
+            // A few messages in flight per subscriber keep the queues bounded.
+            const int64_t kWindow = 4 * static_cast<int64_t>(mine.size());
+            int64_t sent = 0;
+            double cpu = 0;
+            while (!done) {
+                if (sent - received.load(memory_order_relaxed) > kWindow) {
+                    this_thread::yield();
+                    continue;
+                }
+                double cpuStart = threadCpuSeconds();
+                if (useHub) {
+                    hub->publish("news", message + "\n");
+                } else {
+                    for (auto &conn: mine) {
+                        conn->send(message + "\n");
+                    }
+                }
+                cpu += threadCpuSeconds() - cpuStart;
+                sent += static_cast<int64_t>(mine.size());
+                published.fetch_add(1, memory_order_relaxed);
+            }
+            publisherCpu = cpu;
+        });
+        publisher.start();
+
+        this_thread::sleep_for(chrono::seconds(1));
+        int64_t start = received.load();
+        this_thread::sleep_for(chrono::seconds(seconds));
+        int64_t count = received.load() - start;
+        done = true;
+        publisher.join();
+        reader.join();
+        logi("mode = {} subscribers = {} loops = {} message = {}B deliveries/s = {:.0f} "
+             "publisher cpu/message = {:.1f}us", useHub ? "hub" : "copy", numSubscribers, numLoops, messageSize,
+             static_cast<double>(count) / seconds, publisherCpu.load() * 1e6 / static_cast<double>(published.load()));
+        for (int fd: fds) {
+            ::close(fd);
+        }
+        ::close(epfd);
+        {
+            lock_guard<std::mutex> lock(mutex);
+            conns.clear();
+        }
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+    fmtlog::poll();
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "src/include/PubSubHub.h"
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "src/include/ThreadPool.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Clients speak lines to a server backed by a PubSubHub: "sub t", "unsub t"
+// and "pub t message", each answered with "+", and "move", which migrates the
+// connection to the other loop. Checks who receives what across two loops,
+// duplicate subscriptions, unsubscribing, also after a migration, that a
+// closed subscriber is dropped and a large message reaching many subscribers.
+
+const uint16_t kPort = 2048;
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+string readLine(int fd) {
+    string line;
+    char c;
+    while (::read(fd, &c, 1) == 1 && c != '\n') {
+        line += c;
+    }
+    return line;
+}
+
+string command(int fd, const string &line) {
+    string request = line + "\n";
+    ::write(fd, request.data(), request.size());
+    return readLine(fd);
+}
+
+string readBytes(int fd, size_t len) {
+    string data(len, '\0');
+    size_t have = 0;
+    ssize_t n;
+    while (have < len && (n = ::read(fd, &data[have], len - have)) > 0) {
+        have += n;
+    }
+    data.resize(have);
+    return data;
+}
+
+// True if nothing arrives within a short wait.
+bool silent(int fd) {
+    struct timeval timeout{0, 50 * 1000};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    char c;
+    bool quiet = ::read(fd, &c, 1) < 0;
+    timeout.tv_usec = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    return quiet;
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    EventLoop loop;
+    // Outlives the server, whose connections unsubscribe as it closes them.
+    unique_ptr<PubSubHub> hub;
+    vector<EventLoop *> loops;
+    TcpServer server(&loop, InetAddress(kPort, true), "PubSubTest");
+    server.setThreadNum(2);
+    server.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (!conn->connected()) {
+            hub->unsubscribeAll(conn);
+        }
+    });
+    server.setMessageCallback([&](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        const char *eol;
+        while ((eol = buf->findEOL()) != nullptr) {
+            string line(buf->peek(), eol);
+            buf->retrieveUntil(eol + 1);
+            size_t space = line.find(' ');
+            string verb = line.substr(0, space);
+            string rest = space == string::npos ? "" : line.substr(space + 1);
+            if (verb == "sub") {
+                hub->subscribe(conn, rest);
+            } else if (verb == "unsub") {
+                hub->unsubscribe(conn, rest);
+            } else if (verb == "move") {
+                conn->migrateTo(conn->getLoop() == loops[0] ? loops[1] : loops[0]);
+            } else if (verb == "pub") {
+                space = rest.find(' ');
+                string message = rest.substr(space + 1) + "\n";
+                if (message == "big\n") {
+                    message = string(1024 * 1024, 'b') + "\n";
+                }
+                hub->publish(rest.substr(0, space), std::move(message));
+            }
+            conn->send("+\n");
+        }
+    });
+    server.start();
+    loops = server.threadPool()->getAllLoops();
+    hub = make_unique<PubSubHub>(loops);
+
+    Thread client([&] {
+        int a = connectTo(kPort);
+        int b = connectTo(kPort);
+        int c = connectTo(kPort);
+        int d = connectTo(kPort);
+        command(a, "sub a");
+        command(b, "sub a");
+        command(c, "sub a");
+        command(c, "sub b");
+        command(c, "sub a");
+        command(d, "pub a hello");
+        check(readLine(a) == "hello" && readLine(b) == "hello" && readLine(c) == "hello" && silent(c) &&
+              silent(d), "publish to a topic");
+        check(hub->numSubscribers("a") == 3 && hub->numSubscribers("b") == 1 && hub->numTopics() == 2,
+              "subscriber counts");
+
+        command(c, "unsub a");
+        command(d, "pub a x");
+        command(d, "pub b y");
+        command(d, "pub nobody z");
+        check(readLine(a) == "x" && readLine(b) == "x" && readLine(c) == "y", "unsubscribe");
+
+        ::close(b);
+        while (hub->numSubscribers("a") != 1) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        command(d, "pub a w");
+        check(readLine(a) == "w" && hub->numTopics() == 2, "closed subscriber dropped");
+
+        int e = connectTo(kPort);
+        command(e, "sub m");
+        command(e, "move");
+        command(e, "unsub m");
+        command(d, "pub m gone");
+        check(silent(e), "unsubscribe after a migration");
+        command(e, "sub m");
+        command(d, "pub m once");
+        check(readLine(e) == "once" && silent(e), "subscribe again after a migration");
+        ::close(e);
+
+        const int kClients = 100;
+        vector<int> fds;
+        for (int i = 0; i < kClients; ++i) {
+            fds.push_back(connectTo(kPort));
+            command(fds.back(), "sub big");
+        }
+        command(d, "pub big big");
+        int received = 0;
+        for (int fd: fds) {
+            if (readBytes(fd, 1024 * 1024 + 1) == string(1024 * 1024, 'b') + "\n") {
+                ++received;
+            }
+            ::close(fd);
+        }
+        logi("large message reached {} of {} subscribers", received, kClients);
+        check(received == kClients, "large message");
+        ::close(a);
+        ::close(c);
+        ::close(d);
+        while (hub->numTopics() != 0) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    client.start();
+    loop.loop();
+    client.join();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
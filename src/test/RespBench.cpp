@@ -0,0 +1,228 @@
+#include "src/include/KvServer.h"
+#include "src/include/RespCodec.h"
+#include "src/include/EventLoop.h"
+#include "src/include/EventLoopThread.h"
+#include "src/include/InetAddress.h"
+#include "src/include/Buffer.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/Histogram.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// A redis-benchmark style load on a KvServer: client threads keep one
+// pipeline of commands on random keys in flight per connection, send the
+// next when every reply has come, and time each pipeline. "set" and "get"
+// run one command, "mixed" one SET to nine GETs, "mget" MGETs of ten keys
+// that span the shards. Keys are loaded before the clock starts. Reports
+// requests per second and pipeline latency percentiles.
+// usage: RespBench [set|get|mixed|mget] [loops] [connections] [pipeline] [clients] [seconds] [keys] [value bytes]
+
+const uint16_t kPort = 2053;
+
+void runAndWait(EventLoop *loop, const function<void()> &cb) {
+    CountDownLatch latch(1);
+    loop->runInLoop([&] {
+        cb();
+        latch.countDown();
+    });
+    latch.wait();
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+string keyOf(int i) {
+    char key[32];
+    snprintf(key, sizeof key, "key:%010d", i);
+    return key;
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    string mode = argc > 1 ? argv[1] : "get";
+    int numLoops = argc > 2 ? atoi(argv[2]) : 2;
+    int numConnections = argc > 3 ? atoi(argv[3]) : 50;
+    int pipeline = argc > 4 ? atoi(argv[4]) : 16;
+    int numClients = argc > 5 ? atoi(argv[5]) : 2;
+    int seconds = argc > 6 ? atoi(argv[6]) : 3;
+    int numKeys = argc > 7 ? atoi(argv[7]) : 100000;
+    size_t valueSize = argc > 8 ? static_cast<size_t>(atoi(argv[8])) : 3;
+
+    EventLoopThread serverThread;
+    EventLoop *serverBase = serverThread.startLoop();
+    unique_ptr<KvServer> server;
+    runAndWait(serverBase, [&] {
+        server = make_unique<KvServer>(serverBase, InetAddress(kPort, true), "RespBench");
+        server->setThreadNum(numLoops);
+        server->start();
+    });
+
+    const string value(valueSize, 'x');
+    {
+        int fd = connectTo(kPort);
+        Buffer request;
+        for (int i = 0; i < numKeys; ++i) {
+            RespWriter::appendCommand(&request, {"SET", keyOf(i), value});
+        }
+        RespWriter::appendCommand(&request, {"DBSIZE"});
+        ::write(fd, request.peek(), request.readableBytes());
+        RespParser parser;
+        Buffer buf;
+        int replies = 0;
+        while (replies <= numKeys) {
+            int savedErrno;
+            if (buf.readFd(fd, &savedErrno) <= 0) {
+                break;
+            }
+            while (parser.parse(&buf) == RespParser::Result::kComplete) {
+                if (++replies == numKeys + 1) {
+                    logi("loaded {} keys", parser.values()[0].integer);
+                }
+                parser.consume(&buf);
+            }
+        }
+        ::close(fd);
+    }
+
+    atomic<bool> measuring(false);
+    atomic<bool> done(false);
+    atomic<int64_t> requests(0);
+    vector<unique_ptr<Histogram>> latencies;
+    vector<unique_ptr<Thread>> clients;
+    for (int c = 0; c < numClients; ++c) {
+        latencies.emplace_back(new Histogram);
+        Histogram *latencyUs = latencies.back().get();
+        clients.emplace_back(new Thread([&, c, latencyUs] {
+            struct Conn {
+                int fd;
+                RespParser parser;
+                Buffer input;
+                int outstanding;
+                chrono::steady_clock::time_point sent;
+            };
+            vector<unique_ptr<Conn>> conns;
+            int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            mt19937 random(c);
+            uniform_int_distribution<int> anyKey(0, numKeys - 1);
+            Buffer request;
+            vector<string> keys;
+            vector<string_view> args;
+            auto send = [&](Conn *conn) {
+                request.retrieveAll();
+                for (int i = 0; i < pipeline; ++i) {
+                    keys.clear();
+                    if (mode == "mget") {
+                        for (int k = 0; k < 10; ++k) {
+                            keys.push_back(keyOf(anyKey(random)));
+                        }
+                        args.assign({"MGET"});
+                        args.insert(args.end(), keys.begin(), keys.end());
+                    } else {
+                        keys.push_back(keyOf(anyKey(random)));
+                        bool set = mode == "set" || (mode == "mixed" && random() % 10 == 0);
+                        if (set) {
+                            args.assign({"SET", keys[0], value});
+                        } else {
+                            args.assign({"GET", keys[0]});
+                        }
+                    }
+                    RespWriter::appendCommand(&request, args);
+                }
+                conn->outstanding = pipeline;
+                conn->sent = chrono::steady_clock::now();
+                ::write(conn->fd, request.peek(), request.readableBytes());
+            };
+            for (int i = c; i < numConnections; i += numClients) {
+                conns.emplace_back(new Conn{connectTo(kPort), RespParser(), Buffer(), 0, {}});
+                struct epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.ptr = conns.back().get();
+                ::epoll_ctl(epfd, EPOLL_CTL_ADD, conns.back()->fd, &event);
+                send(conns.back().get());
+            }
+            struct epoll_event events[64];
+            while (!done) {
+                int n = ::epoll_wait(epfd, events, 64, 10);
+                for (int i = 0; i < n; ++i) {
+                    auto *conn = static_cast<Conn *>(events[i].data.ptr);
+                    int savedErrno;
+                    if (conn->input.readFd(conn->fd, &savedErrno) <= 0) {
+                        continue;
+                    }
+                    while (conn->parser.parse(&conn->input) == RespParser::Result::kComplete) {
+                        conn->parser.consume(&conn->input);
+                        --conn->outstanding;
+                    }
+                    if (conn->outstanding > 0) {
+                        continue;
+                    }
+                    if (measuring.load(memory_order_relaxed)) {
+                        latencyUs->record(chrono::duration_cast<chrono::microseconds>(
+                                chrono::steady_clock::now() - conn->sent).count());
+                        requests.fetch_add(pipeline, memory_order_relaxed);
+                    }
+                    send(conn);
+                }
+            }
+            for (auto &conn: conns) {
+                ::close(conn->fd);
+            }
+            ::close(epfd);
+        }));
+        clients.back()->start();
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(500));
+    measuring = true;
+    this_thread::sleep_for(chrono::seconds(seconds));
+    measuring = false;
+    int64_t count = requests.load();
+    done = true;
+    for (auto &t: clients) {
+        t->join();
+    }
+    HistogramSnapshot latency;
+    for (auto &histogram: latencies) {
+        latency.merge(histogram->snapshot());
+    }
+
+    logi("mode = {} loops = {} connections = {} pipeline = {} clients = {} keys = {} value = {}B", mode, numLoops,
+         numConnections, pipeline, numClients, numKeys, valueSize);
+    logi("{:.0f} requests/s, pipeline latency p50 = {}us p99 = {}us max = {}us",
+         static_cast<double>(count) / seconds, latency.percentile(50), latency.percentile(99), latency.max());
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    runAndWait(serverBase, [&] { server.reset(); });
+    fmtlog::poll();
+    return 0;
+}
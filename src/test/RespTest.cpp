@@ -0,0 +1,326 @@
+#include "src/include/KvServer.h"
+#include "src/include/KvTable.h"
+#include "src/include/RespCodec.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "src/include/Buffer.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Feeds the RESP parser byte by byte and all at once, RESP2 and RESP3 values
+// and malformed ones, churns a KvTable, then talks to a KvServer with keys on
+// several shards: pipelined commands in one write answered in order,
+// aggregated MGET, DEL and DBSIZE, errors, HELLO 3, QUIT and a protocol error.
+
+const uint16_t kPort = 2052;
+
+// A message as its values: the type byte, then the text, or the integer of
+// integers, booleans and aggregates.
+string render(const vector<RespParser::Value> &values) {
+    string text;
+    for (const auto &value: values) {
+        if (!text.empty()) {
+            text += ' ';
+        }
+        text += static_cast<char>(value.type);
+        switch (value.type) {
+            case RespParser::Type::kNull:
+                break;
+            case RespParser::Type::kBoolean:
+            case RespParser::Type::kArray:
+            case RespParser::Type::kMap:
+            case RespParser::Type::kSet:
+            case RespParser::Type::kAttribute:
+            case RespParser::Type::kPush:
+                text += to_string(value.integer);
+                break;
+            default:
+                text += value.data;
+        }
+    }
+    return text;
+}
+
+// Parses text fed in pieces of step bytes.
+vector<string> parseAll(const string &text, size_t step) {
+    RespParser parser(1024, 64);
+    Buffer buf;
+    vector<string> messages;
+    for (size_t i = 0; i < text.size(); i += step) {
+        buf.append(text.data() + i, min(step, text.size() - i));
+        while (true) {
+            auto result = parser.parse(&buf);
+            if (result == RespParser::Result::kNeedMore) {
+                break;
+            }
+            if (result == RespParser::Result::kError) {
+                messages.push_back("error " + parser.error());
+                return messages;
+            }
+            messages.push_back(render(parser.values()));
+            parser.consume(&buf);
+        }
+    }
+    return messages;
+}
+
+void testParser() {
+    const string pipeline =
+            "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$0\r\n\r\n"
+            "PING\r\n"
+            "\r\n"
+            "get  k\n"
+            "%2\r\n+a\r\n:1\r\n+b\r\n#t\r\n"
+            "|1\r\n+ttl\r\n:3\r\n$5\r\nhello\r\n"
+            "*3\r\n_\r\n$-1\r\n*-1\r\n"
+            ",3.14\r\n(12345678901234567890\r\n!5\r\noops!\r\n=7\r\ntxt:abc\r\n"
+            "~1\r\n:-7\r\n>2\r\n+message\r\n*0\r\n"
+            "-ERR bad\r\n";
+    const vector<string> expected = {
+            "*3 $SET $k $",
+            "*1 +PING",
+            "*2 +get +k",
+            "%2 +a :1 +b #1",
+            "|1 +ttl :3 $hello",
+            "*3 _ _ _",
+            ",3.14",
+            "(12345678901234567890",
+            "!oops!",
+            "=txt:abc",
+            "~1 :-7",
+            ">2 +message *0",
+            "-ERR bad",
+    };
+    check(parseAll(pipeline, 1) == expected, "byte by byte");
+    check(parseAll(pipeline, 5) == expected, "in pieces");
+    check(parseAll(pipeline, pipeline.size()) == expected, "all at once");
+
+    RespParser parser;
+    Buffer buf;
+    buf.append(string("*2\r\n$4\r\nECHO\r\n$2\r\nhi\r\n"));
+    vector<string_view> args;
+    check(parser.parse(&buf) == RespParser::Result::kComplete && parser.command(&args) &&
+          args == vector<string_view>{"ECHO", "hi"}, "command");
+    parser.consume(&buf);
+    buf.append(string("*1\r\n*0\r\n"));
+    check(parser.parse(&buf) == RespParser::Result::kComplete && !parser.command(&args), "nested is no command");
+
+    const vector<string> bad = {
+            "$abc\r\n",
+            "$2\r\nabc\r\n",
+            "$2000\r\n",
+            "*100\r\n",
+            "#x\r\n",
+            ":12a\r\n",
+            "*1\n",
+            "!-1\r\n",
+            "_x\r\n",
+            string(RespParser::kMaxLineBytes + 10, 'x'),
+    };
+    for (const auto &text: bad) {
+        auto messages = parseAll(text, text.size());
+        check(messages.size() == 1 && messages[0].rfind("error Protocol error", 0) == 0, "reject " + text.substr(0, 16));
+    }
+
+    Buffer out;
+    RespWriter::appendCommand(&out, {"SET", "k", "v"});
+    RespWriter::appendInteger(&out, -42);
+    RespWriter::appendNull(&out, 2);
+    RespWriter::appendNull(&out, 3);
+    RespWriter::appendMapHeader(&out, 2, 2);
+    RespWriter::appendMapHeader(&out, 2, 3);
+    check(string(out.peek(), out.readableBytes()) ==
+          "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\n:-42\r\n$-1\r\n_\r\n*4\r\n%2\r\n", "writer");
+}
+
+void testTable() {
+    KvTable table;
+    const int kKeys = 10000;
+    for (int i = 0; i < kKeys; ++i) {
+        string key = "key" + to_string(i);
+        auto [value, inserted] = table.emplace(key, KvTable::hash(key));
+        value->assign("value" + to_string(i));
+        check(inserted, "insert " + key);
+    }
+    check(table.size() == kKeys, "size after inserts");
+    for (int i = 0; i < kKeys; i += 2) {
+        string key = "key" + to_string(i);
+        check(table.erase(key, KvTable::hash(key)), "erase " + key);
+    }
+    check(!table.erase("key0", KvTable::hash("key0")), "erase twice");
+    size_t capacity = table.capacity();
+    // Churn reuses erased slots instead of growing.
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < kKeys; i += 2) {
+            string key = "key" + to_string(i);
+            table.emplace(key, KvTable::hash(key)).first->assign("again");
+            table.erase(key, KvTable::hash(key));
+        }
+    }
+    check(table.capacity() == capacity, "capacity under churn");
+    bool found = true;
+    for (int i = 1; i < kKeys; i += 2) {
+        string key = "key" + to_string(i);
+        string *value = table.find(key, KvTable::hash(key));
+        found = found && value != nullptr && *value == "value" + to_string(i);
+    }
+    check(found && table.size() == kKeys / 2, "find after churn");
+    table.clear();
+    check(table.size() == 0 && table.find("key1", KvTable::hash("key1")) == nullptr, "clear");
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Writes request and reads numReplies replies, or until the peer closes.
+vector<string> roundTrip(int fd, const string &request, size_t numReplies, bool *closed = nullptr) {
+    ::write(fd, request.data(), request.size());
+    RespParser parser;
+    Buffer buf;
+    vector<string> replies;
+    while (replies.size() < numReplies) {
+        auto result = parser.parse(&buf);
+        if (result == RespParser::Result::kComplete) {
+            replies.push_back(render(parser.values()));
+            parser.consume(&buf);
+            continue;
+        }
+        if (result == RespParser::Result::kError) {
+            break;
+        }
+        char chunk[4096];
+        ssize_t n = ::read(fd, chunk, sizeof chunk);
+        if (n <= 0) {
+            if (closed != nullptr) {
+                *closed = true;
+            }
+            break;
+        }
+        buf.append(chunk, n);
+    }
+    return replies;
+}
+
+string command(const vector<string_view> &args) {
+    Buffer buf;
+    RespWriter::appendCommand(&buf, args);
+    return {buf.peek(), buf.readableBytes()};
+}
+
+void testServer(EventLoop *loop, KvServer *server) {
+    int first = connectTo(kPort);
+    int second = connectTo(kPort);
+
+    const int kKeys = 200;
+    string request;
+    vector<string> expected;
+    for (int i = 0; i < kKeys; ++i) {
+        request += command({"SET", "key" + to_string(i), "value" + to_string(i)});
+        expected.emplace_back("+OK");
+    }
+    // Inline, with answers from every shard between others answered at once.
+    request += "PING\r\n";
+    expected.emplace_back("+PONG");
+    for (int i = 0; i < kKeys; ++i) {
+        request += command({"GET", "key" + to_string(i)});
+        expected.push_back("$value" + to_string(i));
+        request += command({"ECHO", to_string(i)});
+        expected.push_back("$" + to_string(i));
+    }
+    check(roundTrip(first, request, expected.size()) == expected, "pipelined SET and GET");
+
+    // The other connection is on another loop and sees the same keys.
+    request = command({"MGET", "key1", "missing", "key2", "key3", "key150"});
+    request += command({"DEL", "key1", "key2", "missing"});
+    request += command({"EXISTS", "key1", "key3", "key3"});
+    request += command({"DBSIZE"});
+    request += command({"INCR", "counter"});
+    request += command({"INCRBY", "counter", "41"});
+    request += command({"DECR", "counter"});
+    request += command({"INCR", "key3"});
+    request += command({"MSET", "a", "1", "b", "2"});
+    request += command({"SET", "a", "x", "NX"});
+    request += command({"SET", "c", "x", "XX"});
+    request += command({"APPEND", "a", "23"});
+    request += command({"STRLEN", "a"});
+    request += command({"get", "a"});
+    request += command({"NOSUCH"});
+    request += command({"GET"});
+    expected = {
+            "*5 $value1 _ $value2 $value3 $value150",
+            ":2",
+            ":2",
+            ":198",
+            ":1",
+            ":42",
+            ":41",
+            "-ERR value is not an integer or out of range",
+            "+OK",
+            "_",
+            "_",
+            ":3",
+            ":3",
+            "$123",
+            "-ERR unknown command 'NOSUCH'",
+            "-ERR wrong number of arguments for 'get' command",
+    };
+    check(roundTrip(second, request, expected.size()) == expected, "commands across shards");
+
+    request = command({"HELLO", "3"}) + command({"GET", "missing"}) + command({"MGET", "missing", "a"});
+    auto replies = roundTrip(second, request, 3);
+    check(replies.size() == 3 && replies[0].rfind("%7 $server $redis", 0) == 0 && replies[1] == "_" &&
+          replies[2] == "*2 _ $123", "HELLO 3");
+
+    request = command({"FLUSHALL"}) + command({"DBSIZE"}) + command({"QUIT"}) + command({"PING"});
+    bool closed = false;
+    replies = roundTrip(first, request, 4, &closed);
+    check(replies == vector<string>{"+OK", ":0", "+OK"} && closed, "QUIT");
+
+    closed = false;
+    replies = roundTrip(second, command({"PING"}) + "*1\r\n$x\r\n", 3, &closed);
+    check(replies == vector<string>{"+PONG", "-ERR Protocol error: invalid bulk length"} && closed,
+          "protocol error");
+
+    check(server->numShards() == 3, "one shard per loop");
+    ::close(first);
+    ::close(second);
+    loop->runInLoop([loop] { loop->quit(); });
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testParser();
+    testTable();
+
+    EventLoop loop;
+    KvServer server(&loop, InetAddress(kPort, true), "RespTest");
+    server.setThreadNum(3);
+    server.start();
+    Thread client([&] { testServer(&loop, &server); });
+    client.start();
+    loop.loop();
+    client.join();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
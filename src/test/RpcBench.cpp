@@ -0,0 +1,176 @@
+#include "src/include/RpcClient.h"
+#include "src/include/RpcServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/EventLoopThread.h"
+#include "src/include/InetAddress.h"
+#include "src/include/TcpConnection.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/Histogram.h"
+#include "base/include/WorkStealingPool.h"
+#include "base/include/fmtlog.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Client loops keep depth "echo" calls in flight on every RpcClient, issuing
+// the next call from the callback of the last, so a loop's calls leave in one
+// send. "loop" answers in the server's loops, "pool" on a WorkStealingPool.
+// Reports calls per second and call latency percentiles.
+// usage: RpcBench [loop|pool] [loops] [connections] [depth] [clients] [seconds] [request bytes]
+
+const uint16_t kPort = 2051;
+
+void runAndWait(EventLoop *loop, const function<void()> &cb) {
+    CountDownLatch latch(1);
+    loop->runInLoop([&] {
+        cb();
+        latch.countDown();
+    });
+    latch.wait();
+}
+
+// The RpcClients of one client loop; everything but the counters in loop.
+struct ClientLoop {
+    EventLoopThread thread;
+    EventLoop *loop = nullptr;
+    vector<unique_ptr<RpcClient>> clients;
+    Histogram latencyUs;
+    atomic<int64_t> completed{0};
+    atomic<int64_t> failed{0};
+};
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    string mode = argc > 1 ? argv[1] : "loop";
+    int numLoops = argc > 2 ? atoi(argv[2]) : 2;
+    int numConnections = argc > 3 ? atoi(argv[3]) : 16;
+    int depth = argc > 4 ? atoi(argv[4]) : 32;
+    int numClients = argc > 5 ? atoi(argv[5]) : 2;
+    int seconds = argc > 6 ? atoi(argv[6]) : 3;
+    size_t requestSize = argc > 7 ? static_cast<size_t>(atoi(argv[7])) : 64;
+
+    WorkStealingPool pool("rpcbench");
+    pool.setThreadNum(2);
+    pool.start();
+
+    EventLoopThread serverThread;
+    EventLoop *serverBase = serverThread.startLoop();
+    unique_ptr<RpcServer> server;
+    runAndWait(serverBase, [&] {
+        server = make_unique<RpcServer>(serverBase, InetAddress(kPort, true), "RpcBench");
+        server->setThreadNum(numLoops);
+        if (mode == "pool") {
+            server->registerOffloaded("echo", &pool, [](string_view request, string *response) {
+                response->assign(request);
+                return RpcStatus::kOk;
+            });
+        } else {
+            server->registerHandler("echo", [](string_view request, const RpcServer::Responder &responder) {
+                responder.reply(request);
+            });
+        }
+        server->start();
+    });
+
+    const string request(requestSize, 'x');
+    atomic<bool> measuring(false);
+    atomic<bool> done(false);
+    vector<unique_ptr<ClientLoop>> clientLoops;
+    CountDownLatch connected(numConnections);
+    for (int c = 0; c < numClients; ++c) {
+        clientLoops.emplace_back(new ClientLoop);
+        ClientLoop *client = clientLoops.back().get();
+        client->loop = client->thread.startLoop();
+        runAndWait(client->loop, [&, client, c] {
+            for (int i = c; i < numConnections; i += numClients) {
+                client->clients.emplace_back(new RpcClient(client->loop, InetAddress(kPort, true),
+                                                           "RpcBenchClient" + to_string(i)));
+                client->clients.back()->setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+                    if (conn->connected()) {
+                        connected.countDown();
+                    }
+                });
+                client->clients.back()->connect();
+            }
+        });
+    }
+    connected.wait();
+
+    // One call; its callback records it and makes the next.
+    function<void(ClientLoop *, RpcClient *)> issue = [&](ClientLoop *client, RpcClient *rpc) {
+        auto start = chrono::steady_clock::now();
+        rpc->call("echo", request, [&, client, rpc, start](RpcStatus status, string_view response) {
+            if (status != RpcStatus::kOk || response.size() != request.size()) {
+                client->failed.fetch_add(1, memory_order_relaxed);
+            } else if (measuring.load(memory_order_relaxed)) {
+                client->latencyUs.record(chrono::duration_cast<chrono::microseconds>(
+                        chrono::steady_clock::now() - start).count());
+                client->completed.fetch_add(1, memory_order_relaxed);
+            }
+            if (!done.load(memory_order_relaxed)) {
+                issue(client, rpc);
+            }
+        });
+    };
+    for (auto &client: clientLoops) {
+        ClientLoop *c = client.get();
+        c->loop->runInLoop([&, c] {
+            for (auto &rpc: c->clients) {
+                for (int i = 0; i < depth; ++i) {
+                    issue(c, rpc.get());
+                }
+            }
+        });
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(500));
+    measuring = true;
+    this_thread::sleep_for(chrono::seconds(seconds));
+    measuring = false;
+    done = true;
+
+    // Let the calls in flight come back before the clients go.
+    for (auto &client: clientLoops) {
+        ClientLoop *c = client.get();
+        bool drained = false;
+        while (!drained) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+            runAndWait(c->loop, [&] {
+                drained = true;
+                for (auto &rpc: c->clients) {
+                    drained = drained && rpc->numPending() == 0;
+                }
+            });
+        }
+    }
+
+    int64_t count = 0;
+    int64_t failed = 0;
+    HistogramSnapshot latency;
+    for (auto &client: clientLoops) {
+        count += client->completed.load();
+        failed += client->failed.load();
+        latency.merge(client->latencyUs.snapshot());
+        runAndWait(client->loop, [&] { client->clients.clear(); });
+    }
+
+    logi("mode = {} loops = {} connections = {} depth = {} clients = {} request = {}B", mode, numLoops,
+         numConnections, depth, numClients, requestSize);
+    logi("{:.0f} calls/s, latency p50 = {}us p99 = {}us p999 = {}us max = {}us, failed = {}",
+         static_cast<double>(count) / seconds, latency.percentile(50), latency.percentile(99),
+         latency.percentile(99.9), latency.max(), failed);
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    runAndWait(serverBase, [&] { server.reset(); });
+    pool.stop();
+    fmtlog::poll();
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include "src/include/RpcClient.h"
+#include "src/include/RpcServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/Thread.h"
+#include "base/include/WorkStealingPool.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// An RpcServer with methods answered in the loop, later from a timer, on a
+// pool, never, or not at all, and an RpcClient calling them from another
+// thread. Checks pipelined answers, answers out of order, typed calls,
+// errors, deadlines and what happens to pending calls on a disconnect.
+
+const uint16_t kPort = 2050;
+
+struct Operands {
+    int64_t a;
+    int64_t b;
+};
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    WorkStealingPool pool("rpc");
+    pool.setThreadNum(2);
+    pool.start();
+    // Never started, so it sheds everything.
+    WorkStealingPool stopped("stopped");
+
+    EventLoop loop;
+    RpcServer server(&loop, InetAddress(kPort, true), "RpcTest");
+    server.setThreadNum(2);
+    server.registerHandler("echo", [](string_view request, const RpcServer::Responder &responder) {
+        responder.reply(request);
+    });
+    server.registerHandler("fail", [](string_view, const RpcServer::Responder &responder) {
+        responder.fail(RpcStatus::kHandlerError, "nope");
+    });
+    server.registerHandler("never", [](string_view, const RpcServer::Responder &) {});
+    server.registerHandler("later", [](string_view, const RpcServer::Responder &responder) {
+        EventLoop::getEventLoopOfCurrentThread()->runAfter(0.05, [responder] {
+            responder.reply("later");
+        });
+    });
+    server.registerOffloaded("sleep", &pool, [](string_view request, string *response) {
+        this_thread::sleep_for(chrono::milliseconds(stoi(string(request))));
+        *response = "slept " + string(request);
+        return RpcStatus::kOk;
+    });
+    server.registerOffloaded("shed", &stopped, [](string_view, string *) { return RpcStatus::kOk; });
+    server.registerMethod<RpcPodSerializer, Operands, int64_t>("add", [](const Operands &operands, int64_t *sum) {
+        *sum = operands.a + operands.b;
+        return RpcStatus::kOk;
+    }, &pool);
+    server.start();
+
+    RpcClient client(&loop, InetAddress(kPort, true), "RpcTestClient");
+    CountDownLatch connected(1);
+    client.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            connected.countDown();
+        }
+    });
+    client.connect();
+
+    Thread driver([&] {
+        connected.wait();
+        const int kCalls = 1000;
+        CountDownLatch echoed(kCalls);
+        atomic<int> matched(0);
+        for (int i = 0; i < kCalls; ++i) {
+            string body = "message " + to_string(i) + string(i % 50, 'x');
+            client.call("echo", body, [&, body](RpcStatus status, string_view response) {
+                if (status == RpcStatus::kOk && response == body) {
+                    ++matched;
+                }
+                echoed.countDown();
+            });
+        }
+        echoed.wait();
+        check(matched == kCalls, "pipelined echo");
+
+        // The slow call is answered last although it went first.
+        vector<string> order;
+        CountDownLatch ordered(2);
+        client.call("sleep", "200", [&](RpcStatus status, string_view response) {
+            order.emplace_back(response);
+            ordered.countDown();
+        });
+        client.call("echo", "fast", [&](RpcStatus status, string_view response) {
+            order.emplace_back(response);
+            ordered.countDown();
+        });
+        ordered.wait();
+        check(order.size() == 2 && order[0] == "fast" && order[1] == "slept 200", "out of order answers");
+
+        struct Outcome {
+            string method;
+            string request;
+            double timeout;
+            RpcStatus status;
+            string response;
+        };
+        vector<Outcome> outcomes = {
+                {"missing", "",    5,   RpcStatus::kNoSuchMethod, "missing"},
+                {"fail",    "",    5,   RpcStatus::kHandlerError, "nope"},
+                {"later",   "",    5,   RpcStatus::kOk,           "later"},
+                {"never",   "",    0.1, RpcStatus::kTimeout,      ""},
+                {"shed",    "",    5,   RpcStatus::kOverloaded,   ""},
+                {"add",     "odd", 5,   RpcStatus::kBadRequest,   ""},
+        };
+        for (auto &outcome: outcomes) {
+            CountDownLatch done(1);
+            auto start = chrono::steady_clock::now();
+            client.call(outcome.method, outcome.request, [&](RpcStatus status, string_view response) {
+                check(status == outcome.status && response == outcome.response,
+                      outcome.method + " got " + rpcStatusName(status));
+                done.countDown();
+            }, outcome.timeout);
+            done.wait();
+            if (outcome.status == RpcStatus::kTimeout) {
+                check(chrono::steady_clock::now() - start >= chrono::milliseconds(90), "deadline too early");
+            }
+        }
+
+        CountDownLatch added(1);
+        client.call<RpcPodSerializer, Operands, int64_t>("add", Operands{7, 35}, [&](RpcStatus status,
+                                                                                   const int64_t &sum) {
+            check(status == RpcStatus::kOk && sum == 42, "typed call");
+            added.countDown();
+        });
+        added.wait();
+
+        // Pending calls fail when the connection goes; later calls at once.
+        CountDownLatch dropped(2);
+        client.call("never", "", [&](RpcStatus status, string_view) {
+            check(status == RpcStatus::kDisconnected, "pending call on disconnect");
+            dropped.countDown();
+        });
+        client.call("sleep", "100", [&](RpcStatus status, string_view) {
+            check(status == RpcStatus::kDisconnected, "offloaded call on disconnect");
+            dropped.countDown();
+        });
+        this_thread::sleep_for(chrono::milliseconds(20));
+        client.disconnect();
+        dropped.wait();
+        while (client.connected()) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        CountDownLatch refused(1);
+        client.call("echo", "x", [&](RpcStatus status, string_view) {
+            check(status == RpcStatus::kDisconnected, "call without a connection");
+            refused.countDown();
+        });
+        refused.wait();
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+    pool.stop();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
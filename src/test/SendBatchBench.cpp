@@ -0,0 +1,163 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "src/include/SendBatch.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Worker threads answer every connection once per round, spread over all IO
+// loops. "single" calls send() per reply, which posts a task per connection;
+// "batch" collects a round in a SendBatch, one task per loop written with
+// writev. A reader thread counts the replies that arrive.
+// usage: SendBatchBench [single|batch] [seconds] [connections] [loops] [workers]
+
+const uint16_t kPort = 2037;
+const size_t kReplySize = 64;
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    bool batched = argc > 1 && strcmp(argv[1], "batch") == 0;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    int numConnections = argc > 3 ? atoi(argv[3]) : 256;
+    int numLoops = argc > 4 ? atoi(argv[4]) : 4;
+    int numWorkers = argc > 5 ? atoi(argv[5]) : 2;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort, true), "SendBatchBench");
+    server.setThreadNum(numLoops);
+    mutex mutex;
+    vector<shared_ptr<TcpConnection>> conns;
+    server.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            lock_guard<std::mutex> lock(mutex);
+            conns.push_back(conn);
+        }
+    });
+    server.start();
+
+    atomic<int64_t> sent(0);
+    atomic<int64_t> received(0);
+    Thread driver([&] {
+        vector<int> fds;
+        int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+        for (int i = 0; i < numConnections; ++i) {
+            fds.push_back(connectTo(kPort));
+            struct epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fds.back();
+            ::epoll_ctl(epfd, EPOLL_CTL_ADD, fds.back(), &event);
+        }
+        while (true) {
+            lock_guard<std::mutex> lock(mutex);
+            if (conns.size() == static_cast<size_t>(numConnections)) {
+                break;
+            }
+        }
+
+        atomic<bool> done(false);
+        Thread reader([&] {
+            struct epoll_event events[64];
+            char buf[65536];
+            int64_t bytes = 0;
+            while (!done) {
+                int n = ::epoll_wait(epfd, events, 64, 10);
+                for (int i = 0; i < n; ++i) {
+                    ssize_t len = ::read(events[i].data.fd, buf, sizeof buf);
+                    if (len > 0) {
+                        bytes += len;
+                    }
+                }
+                received.store(bytes / static_cast<int64_t>(kReplySize), memory_order_relaxed);
+            }
+        });
+        reader.start();
+
+        // Each worker owns a slice of the connections and keeps at most a few
+        // rounds in flight, so queues stay bounded.
+        vector<unique_ptr<Thread>> workers;
+        for (int w = 0; w < numWorkers; ++w) {
+            workers.emplace_back(new Thread([&, w] {
+                vector<shared_ptr<TcpConnection>> mine;
+                for (size_t i = w; i < conns.size(); i += numWorkers) {
+                    mine.push_back(conns[i]);
+                }
+                const string reply(kReplySize - 1, 'x');
+                const int64_t kWindow = 4 * static_cast<int64_t>(conns.size());
+                SendBatch batch;
+                while (!done) {
+                    if (sent.load(memory_order_relaxed) - received.load(memory_order_relaxed) > kWindow) {
+                        this_thread::yield();
+                        continue;
+                    }
+                    for (auto &conn: mine) {
+                        if (batched) {
+                            batch.add(conn, reply + "\n");
+                        } else {
+                            conn->send(reply + "\n");
+                        }
+                    }
+                    if (batched) {
+                        batch.post();
+                    }
+                    sent.fetch_add(static_cast<int64_t>(mine.size()), memory_order_relaxed);
+                }
+            }));
+            workers.back()->start();
+        }
+
+        this_thread::sleep_for(chrono::seconds(1));
+        int64_t start = received.load();
+        this_thread::sleep_for(chrono::seconds(seconds));
+        int64_t count = received.load() - start;
+        done = true;
+        for (auto &t: workers) {
+            t->join();
+        }
+        reader.join();
+        logi("mode = {} connections = {} loops = {} workers = {} replies/s = {:.0f}",
+             batched ? "batch" : "single", numConnections, numLoops, numWorkers,
+             static_cast<double>(count) / seconds);
+        for (int fd: fds) {
+            ::close(fd);
+        }
+        ::close(epfd);
+        {
+            lock_guard<std::mutex> lock(mutex);
+            conns.clear();
+        }
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+    fmtlog::poll();
+    return 0;
+}
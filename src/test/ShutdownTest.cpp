@@ -0,0 +1,182 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Shuts a server down under three kinds of clients: one idle, one reading a
+// large reply slowly, which drains, and one never reading its reply, which
+// has to be force-closed. Checks the phases, the bound on the total time and
+// that the listener is gone. Then shuts down a server with a stalled IO loop,
+// which must not hold up the base loop or the deadlines.
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int size = 4096;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void testPhases() {
+    const double kDrainTimeout = 1.0;
+    const double kCloseTimeout = 0.3;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(0, true), "ShutdownTest");
+    uint16_t port = server.localAddress().port();
+    server.setThreadNum(2);
+    // "big" asks for a reply far larger than the socket buffers.
+    server.setMessageCallback([](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        if (buf->retrieveAllAsString() == "big") {
+            conn->send(string(4 * 1024 * 1024, 'x'));
+        }
+    });
+    server.start();
+
+    vector<TcpServer::ShutdownPhase> phases;
+    int64_t elapsedUs = 0;
+    Thread driver([&] {
+        int idle = connectTo(port);
+        int slow = connectTo(port);
+        int stuck = connectTo(port);
+        ::write(slow, "big", 3);
+        ::write(stuck, "big", 3);
+        while (server.numConnections() != 3) {
+            this_thread::yield();
+        }
+        this_thread::sleep_for(chrono::milliseconds(100));
+
+        atomic<bool> done(false);
+        atomic<size_t> slowBytes(0);
+        Thread reader([&] {
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(slow, buf, sizeof buf)) > 0) {
+                slowBytes += n;
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+        });
+        reader.start();
+
+        auto start = chrono::steady_clock::now();
+        server.shutdown(kDrainTimeout, kCloseTimeout, [&](const vector<TcpServer::ShutdownPhase> &result) {
+            phases = result;
+            elapsedUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            done = true;
+        });
+        // The idle client sees the half-close.
+        char c;
+        bool idleClosed = ::read(idle, &c, 1) == 0;
+        while (!done) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        reader.join();
+        int late = connectTo(port);
+        logi("idle closed = {} slow client read = {} bytes, connect after shutdown = {}", idleClosed,
+             slowBytes.load(), late >= 0);
+        check(idleClosed, "idle client half-closed");
+        check(slowBytes.load() > 0, "slow client drained");
+        check(late < 0, "listener gone");
+        ::close(idle);
+        ::close(slow);
+        ::close(stuck);
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    for (auto &phase: phases) {
+        logi("phase {} {}us connections {} -> {} timed out = {}", phase.name, phase.durationUs,
+             phase.connectionsBefore, phase.connectionsAfter, phase.timedOut);
+    }
+    auto boundUs = static_cast<int64_t>((kDrainTimeout + 2 * kCloseTimeout + 0.5) * 1000 * 1000);
+    logi("shutdown took {}us, bound {}us, connections left {}", elapsedUs, boundUs, server.numConnections());
+    check(phases.size() == 5 && phases[1].timedOut, "phases");
+    check(elapsedUs <= boundUs, "shutdown time bound");
+    check(server.numConnections() == 0, "no connections left");
+}
+
+void testStalledLoop() {
+    const double kStallSeconds = 1.0;
+    const double kDrainTimeout = 0.2;
+    const double kCloseTimeout = 0.1;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(0, true), "StalledShutdownTest");
+    uint16_t port = server.localAddress().port();
+    server.setThreadNum(2);
+    server.setMessageCallback([&](const shared_ptr<TcpConnection> &, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+        this_thread::sleep_for(chrono::duration<double>(kStallSeconds));
+    });
+    server.start();
+
+    atomic<int> ticks(0);
+    loop.runEvery(0.01, [&] { ++ticks; });
+    vector<TcpServer::ShutdownPhase> phases;
+    int ticksDuringShutdown = 0;
+    Thread driver([&] {
+        int fd = connectTo(port);
+        while (server.numConnections() != 1) {
+            this_thread::yield();
+        }
+        ::write(fd, "x", 1);
+        this_thread::sleep_for(chrono::milliseconds(50));
+        int before = ticks;
+        atomic<bool> done(false);
+        server.shutdown(kDrainTimeout, kCloseTimeout, [&](const vector<TcpServer::ShutdownPhase> &result) {
+            phases = result;
+            ticksDuringShutdown = ticks - before;
+            done = true;
+        });
+        while (!done) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        ::close(fd);
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    // The phases before the join keep their deadlines, the join waits out
+    // the stall while the base loop goes on.
+    int64_t phasesUs = 0;
+    for (size_t i = 0; i + 1 < phases.size(); ++i) {
+        phasesUs += phases[i].durationUs;
+    }
+    auto boundUs = static_cast<int64_t>((kDrainTimeout + 2 * kCloseTimeout + 0.2) * 1000 * 1000);
+    logi("stalled loop: phases before the join {}us, bound {}us, base loop ticks meanwhile {}", phasesUs, boundUs,
+         ticksDuringShutdown);
+    check(phases.size() == 5 && phasesUs <= boundUs, "deadlines hold with a stalled loop");
+    check(ticksDuringShutdown >= 50, "base loop stays responsive");
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testPhases();
+    testStalledLoop();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
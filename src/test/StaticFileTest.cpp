@@ -0,0 +1,199 @@
+#include "src/include/StaticFileHandler.h"
+#include "src/include/FileCache.h"
+#include "src/include/HttpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using namespace faliks;
+using namespace std;
+
+// Serves a directory through FileCache and StaticFileHandler: a mapped small
+// file, a large one sent with sendfile behind and ahead of pipelined
+// requests, byte ranges, HEAD, ETag revalidation, paths leaving the root,
+// and a file replaced by rename being picked up through inotify.
+
+const uint16_t kPort = 2046;
+
+void writeFile(const string &path, const string &data) {
+    FILE *file = fopen(path.c_str(), "wb");
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int size = 16 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct Reply {
+    int status = 0;
+    string head;
+    string body;
+
+    [[nodiscard]] string header(const string &field) const {
+        size_t pos = head.find("\r\n" + field + ": ");
+        if (pos == string::npos) {
+            return "";
+        }
+        pos += field.size() + 4;
+        return head.substr(pos, head.find("\r\n", pos) - pos);
+    }
+};
+
+// Reads one response from a keep-alive connection; pending holds bytes
+// read past the previous one. A HEAD response has no body to read.
+Reply readReply(int fd, string *pending, bool head = false) {
+    Reply reply;
+    char buf[65536];
+    size_t end;
+    while ((end = pending->find("\r\n\r\n")) == string::npos) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0) {
+            return reply;
+        }
+        pending->append(buf, n);
+    }
+    reply.head = pending->substr(0, end + 2);
+    pending->erase(0, end + 4);
+    reply.status = atoi(reply.head.c_str() + 9);
+    size_t length = head ? 0 : strtoul(reply.header("Content-Length").c_str(), nullptr, 10);
+    while (pending->size() < length) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0) {
+            break;
+        }
+        pending->append(buf, n);
+    }
+    reply.body = pending->substr(0, length);
+    pending->erase(0, length);
+    return reply;
+}
+
+Reply fetch(int fd, string *pending, const string &target, const string &headers = "", const string &method = "GET") {
+    string request = method + " " + target + " HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n";
+    ::write(fd, request.data(), request.size());
+    return readReply(fd, pending, method == "HEAD");
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    string root = "/tmp/muduo_learn_static_test_" + to_string(getpid());
+    ::mkdir(root.c_str(), 0755);
+    ::mkdir((root + "/css").c_str(), 0755);
+    const string index = "<html>hello</html>";
+    string big(2 * 1024 * 1024, '\0');
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = static_cast<char>('a' + i % 23);
+    }
+    writeFile(root + "/index.html", index);
+    writeFile(root + "/css/site.css", "body{}");
+    writeFile(root + "/big.bin", big);
+
+    EventLoop loop;
+    FileCache cache(&loop, root);
+    cache.setMmap(64 * 1024, 1024 * 1024);
+    StaticFileHandler files(&cache);
+    HttpServer server(&loop, InetAddress(kPort, true), "StaticFileTest");
+    server.setThreadNum(2);
+    server.setHttpCallback([&](const HttpRequest &request, HttpResponse *response) {
+        if (!files.handle(request, response)) {
+            response->setStatus(404);
+        }
+    });
+    server.start();
+
+    Thread client([&] {
+        int fd = connectTo(kPort);
+        string pending;
+        Reply reply = fetch(fd, &pending, "/");
+        check(reply.status == 200 && reply.body == index &&
+              reply.header("Content-Type") == "text/html; charset=utf-8", "index");
+        uint64_t misses = cache.misses();
+        reply = fetch(fd, &pending, "/index.html");
+        check(reply.body == index && cache.misses() == misses && cache.hits() > 0, "served from the cache");
+        check(cache.mappedBytes() == index.size(), "small file mapped");
+
+        reply = fetch(fd, &pending, "/big.bin");
+        check(reply.status == 200 && reply.body == big, "sendfile");
+        check(cache.mappedBytes() == index.size(), "large file not mapped");
+
+        reply = fetch(fd, &pending, "/big.bin", "Range: bytes=1000-1999\r\n");
+        check(reply.status == 206 && reply.body == big.substr(1000, 1000) &&
+              reply.header("Content-Range") == "bytes 1000-1999/" + to_string(big.size()), "range");
+        reply = fetch(fd, &pending, "/big.bin", "Range: bytes=-10\r\n");
+        check(reply.status == 206 && reply.body == big.substr(big.size() - 10), "suffix range");
+        reply = fetch(fd, &pending, "/index.html", "Range: bytes=6-\r\n");
+        check(reply.status == 206 && reply.body == index.substr(6), "range of a mapped file");
+        reply = fetch(fd, &pending, "/big.bin", "Range: bytes=99999999-\r\n");
+        check(reply.status == 416 && reply.header("Content-Range") == "bytes */" + to_string(big.size()), "416");
+
+        reply = fetch(fd, &pending, "/big.bin", "", "HEAD");
+        check(reply.status == 200 && reply.header("Content-Length") == to_string(big.size()), "HEAD");
+        string etag = reply.header("ETag");
+        reply = fetch(fd, &pending, "/big.bin", "If-None-Match: " + etag + "\r\n");
+        check(reply.status == 304 && reply.body.empty() && reply.header("Content-Length").empty(), "304");
+
+        for (const char *target: {"/missing", "/../etc/passwd", "/%2e%2e/etc/passwd", "/css//site.css", "/css"}) {
+            reply = fetch(fd, &pending, target);
+            check(reply.status == 404, string("404 for ") + target);
+        }
+
+        // The big file is only partly written when the next responses are
+        // queued behind it.
+        string pipeline = "GET /css/site.css HTTP/1.1\r\n\r\nGET /big.bin HTTP/1.1\r\n\r\n"
+                          "GET /index.html HTTP/1.1\r\n\r\nGET /css/site.css HTTP/1.1\r\n\r\n";
+        ::write(fd, pipeline.data(), pipeline.size());
+        bool ordered = readReply(fd, &pending).body == "body{}";
+        ordered = readReply(fd, &pending).body == big && ordered;
+        ordered = readReply(fd, &pending).body == index && ordered;
+        ordered = readReply(fd, &pending).body == "body{}" && ordered;
+        check(ordered, "pipelined around sendfile");
+
+        uint64_t invalidations = cache.invalidations();
+        writeFile(root + "/css/site.css.new", "body{color:red}");
+        ::rename((root + "/css/site.css.new").c_str(), (root + "/css/site.css").c_str());
+        for (int i = 0; i < 100 && cache.invalidations() == invalidations; ++i) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        reply = fetch(fd, &pending, "/css/site.css");
+        check(cache.invalidations() > invalidations && reply.body == "body{color:red}", "invalidated by inotify");
+        ::close(fd);
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    client.start();
+    loop.loop();
+    client.join();
+
+    logi("cache hits = {} misses = {} invalidations = {} entries = {}", cache.hits(), cache.misses(),
+         cache.invalidations(), cache.size());
+    for (const char *name: {"/index.html", "/css/site.css", "/big.bin"}) {
+        ::unlink((root + name).c_str());
+    }
+    ::rmdir((root + "/css").c_str());
+    ::rmdir(root.c_str());
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
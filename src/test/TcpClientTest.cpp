@@ -0,0 +1,228 @@
+#include "src/include/TcpClient.h"
+#include "src/include/ConnectionPool.h"
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/EventLoopThread.h"
+#include "src/include/ThreadPool.h"
+#include "src/include/InetAddress.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace faliks;
+using namespace std;
+
+// 1. A client started before its server listens retries with growing delays
+//    and connects once the server is up.
+// 2. With retry enabled, over a unix socket, a connection closed by the
+//    server is reopened.
+// 3. A unix name too long for sun_path gives an invalid address, which a
+//    client gives up on without retrying.
+// 4. Two client loops share a backend through LoopConnectionPools: every
+//    request completes in the loop that issued it and no pool opens more than
+//    its limit.
+
+const char *kPath = "/tmp/muduo_learn_tcp_client_test.sock";
+
+void runAndWait(EventLoop *loop, const function<void()> &cb) {
+    CountDownLatch latch(1);
+    loop->runInLoop([&] {
+        cb();
+        latch.countDown();
+    });
+    latch.wait();
+}
+
+void echo(const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+    string message = buf->retrieveAllAsString();
+    if (message == "bye") {
+        conn->forceClose();
+    } else {
+        conn->send(message);
+    }
+}
+
+void testBackoff() {
+    // Bound at once, so the port is known, but listening only after 300ms.
+    unique_ptr<TcpServer> server;
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    runAndWait(serverLoop, [&] {
+        server = make_unique<TcpServer>(serverLoop, InetAddress(0, true), "BackoffServer");
+        server->setMessageCallback(echo);
+    });
+    serverLoop->runAfter(0.3, [&] { server->start(); });
+
+    EventLoop loop;
+    TcpClient client(&loop, server->localAddress(), "BackoffClient");
+    client.setRetryDelays(0.02, 0.1);
+    int maxRetries = 0;
+    bool echoed = false;
+    client.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected()) {
+            conn->send("hello");
+        }
+    });
+    client.setMessageCallback([&](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        echoed = buf->retrieveAllAsString() == "hello";
+        loop.quit();
+    });
+    loop.runEvery(0.005, [&] { maxRetries = max(maxRetries, client.connectRetries()); });
+    loop.runAfter(5, [&] { loop.quit(); });
+    client.connect();
+    loop.loop();
+
+    client.disconnect();
+    loop.runAfter(0.1, [&] { loop.quit(); });
+    loop.loop();
+
+    logi("backoff: failed attempts before connecting = {} echoed = {}", maxRetries, echoed);
+    // Delays double from 20ms to 100ms, so 300ms fit only a handful.
+    check(echoed, "backoff: echoed");
+    check(maxRetries >= 2 && maxRetries <= 12, "backoff: retries");
+    runAndWait(serverLoop, [&] { server.reset(); });
+}
+
+void testReconnect() {
+    EventLoop loop;
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    unique_ptr<TcpServer> server;
+    runAndWait(serverLoop, [&] {
+        server = make_unique<TcpServer>(serverLoop, InetAddress::unixPath(kPath), "ReconnectServer");
+        server->setMessageCallback(echo);
+        server->start();
+    });
+
+    TcpClient client(&loop, InetAddress::unixPath(kPath), "ReconnectClient");
+    client.setRetryDelays(0.02, 0.1);
+    client.enableRetry();
+    int ups = 0;
+    client.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) {
+        if (conn->connected() && ++ups == 1) {
+            conn->send("bye");
+        } else if (conn->connected()) {
+            conn->send("again");
+        }
+    });
+    string reply;
+    client.setMessageCallback([&](const shared_ptr<TcpConnection> &, Buffer *buf, Timestamp) {
+        reply = buf->retrieveAllAsString();
+        loop.quit();
+    });
+    loop.runAfter(5, [&] { loop.quit(); });
+    client.connect();
+    loop.loop();
+
+    client.disconnect();
+    loop.runAfter(0.1, [&] { loop.quit(); });
+    loop.loop();
+
+    logi("reconnect: connections = {} reply = {}", ups, reply);
+    check(ups == 2 && reply == "again", "reconnect");
+    runAndWait(serverLoop, [&] { server.reset(); });
+}
+
+void testLongUnixName() {
+    InetAddress longPath = InetAddress::unixPath("/tmp/" + string(120, 'p'));
+    InetAddress longName = InetAddress::unixAbstract(string(108, 'n'));
+    InetAddress fits = InetAddress::unixAbstract(string(107, 'n'));
+    check(!longPath.valid() && !longName.valid(), "long unix names invalid");
+    check(fits.valid() && fits.unixName() == "@" + string(107, 'n'), "longest abstract name kept whole");
+
+    EventLoop loop;
+    TcpClient client(&loop, longPath, "LongNameClient");
+    client.setRetryDelays(0.01, 0.01);
+    client.enableRetry();
+    bool connected = false;
+    client.setConnectionCallback([&](const shared_ptr<TcpConnection> &conn) { connected = conn->connected(); });
+    client.connect();
+    loop.runAfter(0.1, [&] { loop.quit(); });
+    loop.loop();
+    logi("long unix name: connected = {} retries = {}", connected, client.connectRetries());
+    check(!connected && client.connectRetries() == 0, "no retries for an invalid address");
+    client.disconnect();
+}
+
+void testPools() {
+    const int kRequestsPerLoop = 200;
+    const size_t kMaxPerLoop = 2;
+    EventLoop baseLoop;
+    TcpServer server(&baseLoop, InetAddress(0, true), "PoolServer");
+    server.setThreadNum(2);
+    server.setMessageCallback(echo);
+    server.start();
+
+    EventLoopThread clientThread;
+    EventLoop *clientBase = clientThread.startLoop();
+    ThreadPool clientLoops(clientBase, "PoolClients");
+    clientLoops.setThreadNum(2);
+    vector<EventLoop *> loops;
+    runAndWait(clientBase, [&] {
+        clientLoops.start();
+        loops = clientLoops.getAllLoops();
+    });
+    auto pools = make_unique<LoopConnectionPools>(loops, server.localAddress(), "Backend", kMaxPerLoop);
+
+    atomic<int> completed(0);
+    atomic<int> wrongThread(0);
+    atomic<size_t> maxConnections(0);
+    for (EventLoop *loop: loops) {
+        loop->runInLoop([&, loop] {
+            ConnectionPool *pool = pools->local();
+            for (int i = 0; i < kRequestsPerLoop; ++i) {
+                pool->acquire([&, pool, i](const shared_ptr<TcpConnection> &conn) {
+                    string request = "request " + to_string(i);
+                    conn->setMessageCallback([&, pool, request](const shared_ptr<TcpConnection> &c, Buffer *buf,
+                                                                Timestamp) {
+                        if (buf->readableBytes() < request.size()) {
+                            return;
+                        }
+                        if (buf->retrieveAsString(request.size()) != request || !c->getLoop()->isInLoopThread()) {
+                            ++wrongThread;
+                        }
+                        size_t n = pool->numConnections();
+                        if (n > maxConnections) {
+                            maxConnections = n;
+                        }
+                        pool->release(c);
+                        ++completed;
+                    });
+                    conn->send(request);
+                });
+            }
+        });
+    }
+    baseLoop.runEvery(0.01, [&] {
+        if (completed == 2 * kRequestsPerLoop) {
+            baseLoop.quit();
+        }
+    });
+    baseLoop.runAfter(5, [&] { baseLoop.quit(); });
+    baseLoop.loop();
+
+    logi("pools: completed = {} wrong replies or threads = {} max connections per pool = {} server saw {}",
+         completed.load(), wrongThread.load(), maxConnections.load(), server.numConnections());
+    check(completed == 2 * kRequestsPerLoop && wrongThread == 0, "pools: replies in the issuing loop");
+    check(maxConnections <= kMaxPerLoop && server.numConnections() <= 2 * kMaxPerLoop, "pools: connection limit");
+    pools.reset();
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testBackoff();
+    testReconnect();
+    testLongUnixName();
+    testPools();
+    ::unlink(kPath);
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}
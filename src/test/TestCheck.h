@@ -0,0 +1,18 @@
+#ifndef MUDUO_LEARN_TESTCHECK_H
+#define MUDUO_LEARN_TESTCHECK_H
+
+#include "base/include/fmtlog.h"
+
+#include <string>
+
+// Cleared by the first failed check; main returns passed ? 0 : 1.
+inline bool passed = true;
+
+inline void check(bool ok, const std::string &what) {
+    if (!ok) {
+        loge("{} failed", what);
+        passed = false;
+    }
+}
+
+#endif //MUDUO_LEARN_TESTCHECK_H
@@ -0,0 +1,154 @@
+#include "src/include/UdpServer.h"
+#include "src/include/UdpSocket.h"
+#include "src/include/EventLoop.h"
+#include "src/include/EventLoopThread.h"
+#include "src/include/InetAddress.h"
+#include "base/include/CountDownLatch.h"
+#include "base/include/fmtlog.h"
+
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Sender loops blast fixed-size datagrams at a UdpServer with a SO_REUSEPORT
+// socket per loop. "sink" only counts them, "echo" answers every one, which
+// the senders count. Reports datagrams per second and per second of server
+// cpu time, so batching and offloads can be compared per core.
+// usage: UdpBench [sink|echo] [batch] [offload 0|1] [loops] [senders] [seconds] [size]
+
+const uint16_t kPort = 2042;
+const int kBurst = 64;
+
+double threadCpuSeconds() {
+    struct timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+void runAndWait(EventLoop *loop, const function<void()> &cb) {
+    CountDownLatch latch(1);
+    loop->runInLoop([&] {
+        cb();
+        latch.countDown();
+    });
+    latch.wait();
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    bool echo = argc > 1 && strcmp(argv[1], "echo") == 0;
+    size_t batch = argc > 2 ? atoi(argv[2]) : 16;
+    bool offload = argc > 3 ? atoi(argv[3]) != 0 : true;
+    int numLoops = argc > 4 ? atoi(argv[4]) : 2;
+    int numSenders = argc > 5 ? atoi(argv[5]) : 4;
+    int seconds = argc > 6 ? atoi(argv[6]) : 3;
+    size_t size = argc > 7 ? atoi(argv[7]) : 100;
+
+    EventLoopThread serverThread;
+    EventLoop *serverBase = serverThread.startLoop();
+    unique_ptr<UdpServer> server;
+    runAndWait(serverBase, [&] {
+        server = make_unique<UdpServer>(serverBase, InetAddress(kPort, true), "UdpBench",
+                                        UdpServer::Option::kReusePortPerLoop);
+        server->setThreadNum(numLoops);
+        server->setReceiveBatch(batch);
+        server->setGro(offload);
+        server->setGso(offload);
+        if (echo) {
+            server->setMessageCallback([](UdpSocket *socket, const char *data, size_t len, const InetAddress &peer,
+                                          Timestamp) {
+                socket->send(peer, data, len);
+            });
+        }
+        server->start();
+    });
+
+    vector<unique_ptr<EventLoopThread>> senderThreads;
+    vector<unique_ptr<UdpSocket>> senders(numSenders);
+    atomic<bool> done(false);
+    const InetAddress serverAddr(kPort, true);
+    const string payload(size, 'u');
+    for (int i = 0; i < numSenders; ++i) {
+        senderThreads.emplace_back(new EventLoopThread);
+        EventLoop *loop = senderThreads.back()->startLoop();
+        unique_ptr<UdpSocket> &socket = senders[i];
+        runAndWait(loop, [&, loop] {
+            socket = make_unique<UdpSocket>(loop, InetAddress(0, true));
+            socket->setReceiveBatch(batch);
+            socket->setGro(offload);
+            socket->setGso(offload && socket->gsoEnabled());
+            // A burst per iteration; it leaves in one sendmmsg at its end.
+            auto burst = make_shared<function<void()>>();
+            *burst = [&, loop, burst] {
+                if (done) {
+                    return;
+                }
+                for (int k = 0; k < kBurst; ++k) {
+                    socket->send(serverAddr, payload);
+                }
+                loop->queueInLoop(*burst);
+            };
+            loop->queueInLoop(*burst);
+        });
+    }
+
+    auto serverPackets = [&] { return server->packetsReceived(); };
+    auto echoedPackets = [&] {
+        uint64_t total = 0;
+        for (auto &socket: senders) {
+            total += socket->packetsReceived();
+        }
+        return total;
+    };
+    auto serverCpu = [&] {
+        double total = 0;
+        for (auto &socket: server->sockets()) {
+            runAndWait(socket->getLoop(), [&] { total += threadCpuSeconds(); });
+        }
+        return total;
+    };
+
+    this_thread::sleep_for(chrono::milliseconds(500));
+    uint64_t received = serverPackets();
+    uint64_t echoed = echoedPackets();
+    double cpu = serverCpu();
+    this_thread::sleep_for(chrono::seconds(seconds));
+    received = serverPackets() - received;
+    echoed = echoedPackets() - echoed;
+    cpu = serverCpu() - cpu;
+    done = true;
+
+    uint64_t recvCalls = 0;
+    for (auto &socket: server->sockets()) {
+        recvCalls += socket->receiveCalls();
+    }
+    uint64_t sendCalls = 0;
+    for (auto &socket: senders) {
+        sendCalls += socket->sendCalls();
+    }
+    logi("mode = {} batch = {} offload = {} gro = {} gso = {} loops = {} senders = {} size = {}B",
+         echo ? "echo" : "sink", batch, offload, server->sockets().front()->groEnabled(),
+         senders.front()->gsoEnabled(), numLoops, numSenders, size);
+    logi("received {:.0f} datagrams/s, echoed {:.0f}/s, server cpu {:.2f} cores, {:.0f} datagrams/s per core",
+         static_cast<double>(received) / seconds, static_cast<double>(echoed) / seconds, cpu / seconds,
+         cpu > 0 ? static_cast<double>(received) / cpu : 0.0);
+    logi("server datagrams per recvmmsg {:.1f}, total sender sendmmsg calls {}",
+         recvCalls ? static_cast<double>(server->packetsReceived()) / static_cast<double>(recvCalls) : 0.0,
+         sendCalls);
+
+    for (size_t i = 0; i < senders.size(); ++i) {
+        runAndWait(senders[i]->getLoop(), [&, i] { senders[i].reset(); });
+    }
+    runAndWait(serverBase, [&] { server.reset(); });
+    fmtlog::poll();
+    return 0;
+}
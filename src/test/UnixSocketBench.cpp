@@ -0,0 +1,138 @@
+#include "src/include/TcpServer.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Histogram.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace faliks;
+using namespace std;
+
+// The same echo server on TCP loopback, on a unix socket path and on an
+// abstract unix name. One client does ping-pong round trips of a small message
+// for the latency percentiles, a second streams 64KiB writes for throughput.
+// usage: UnixSocketBench [tcp|unix|abstract] [seconds] [message size]
+
+const uint16_t kPort = 2040;
+const char *kPath = "/tmp/muduo_learn_unix_socket_bench.sock";
+
+int connectTo(const InetAddress &addr) {
+    int fd = ::socket(addr.family(), SOCK_STREAM, 0);
+    if (::connect(fd, addr.getSockAddr(), addr.getSockLen()) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    if (!addr.isUnix()) {
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    }
+    return fd;
+}
+
+bool readFull(int fd, char *buf, size_t len) {
+    size_t have = 0;
+    while (have < len) {
+        ssize_t n = ::read(fd, buf + have, len - have);
+        if (n <= 0) {
+            return false;
+        }
+        have += n;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    fmtlog::startPollingThread(1e8);
+    string mode = argc > 1 ? argv[1] : "unix";
+    int seconds = argc > 2 ? atoi(argv[2]) : 2;
+    size_t messageSize = argc > 3 ? atoi(argv[3]) : 64;
+
+    InetAddress listenAddr(kPort, true);
+    if (mode == "unix") {
+        listenAddr = InetAddress::unixPath(kPath);
+    } else if (mode == "abstract") {
+        listenAddr = InetAddress::unixAbstract("muduo_learn_unix_socket_bench");
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, listenAddr, "UnixSocketBench");
+    server.setThreadNum(2);
+    server.setMessageCallback([](const shared_ptr<TcpConnection> &conn, Buffer *buf, Timestamp) {
+        conn->send(buf);
+    });
+    server.start();
+
+    Thread driver([&] {
+        int fd = connectTo(listenAddr);
+        if (fd < 0) {
+            loge("connect to {} failed: {}", listenAddr.toIpPort(), strerror(errno));
+            loop.runInLoop([&] { loop.quit(); });
+            return;
+        }
+        string message(messageSize, 'x');
+        string reply(messageSize, '\0');
+        Histogram latencyNs;
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(seconds);
+        while (chrono::steady_clock::now() < deadline) {
+            auto start = chrono::steady_clock::now();
+            if (::write(fd, message.data(), message.size()) != static_cast<ssize_t>(message.size()) ||
+                !readFull(fd, &reply[0], reply.size())) {
+                break;
+            }
+            latencyNs.record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        }
+        ::close(fd);
+        HistogramSnapshot latency = latencyNs.snapshot();
+
+        fd = connectTo(listenAddr);
+        atomic<bool> done(false);
+        atomic<int64_t> received(0);
+        Thread reader([&] {
+            char buf[65536];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof buf)) > 0) {
+                received.fetch_add(n, memory_order_relaxed);
+            }
+        });
+        reader.start();
+        const string chunk(65536, 'y');
+        Thread writer([&] {
+            while (!done && ::write(fd, chunk.data(), chunk.size()) > 0) {
+            }
+        });
+        writer.start();
+        this_thread::sleep_for(chrono::milliseconds(200));
+        int64_t start = received.load();
+        this_thread::sleep_for(chrono::seconds(seconds));
+        int64_t bytes = received.load() - start;
+        done = true;
+        writer.join();
+        ::shutdown(fd, SHUT_RDWR);
+        reader.join();
+        ::close(fd);
+
+        logi("mode = {} message = {}B round trips = {} p50 = {:.1f}us p99 = {:.1f}us max = {:.1f}us",
+             mode, messageSize, latency.count(), latency.percentile(50) / 1000.0,
+             latency.percentile(99) / 1000.0, latency.max() / 1000.0);
+        logi("mode = {} echo throughput = {:.0f}MB/s", mode,
+             static_cast<double>(bytes) / seconds / (1024 * 1024));
+        loop.runAfter(0.2, [&] { loop.quit(); });
+    });
+    driver.start();
+    loop.loop();
+    driver.join();
+    if (mode == "unix") {
+        ::unlink(kPath);
+    }
+    fmtlog::poll();
+    return 0;
+}
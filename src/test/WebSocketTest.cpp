@@ -0,0 +1,291 @@
+#include "src/include/WebSocketServer.h"
+#include "src/include/WebSocketCodec.h"
+#include "src/include/EventLoop.h"
+#include "src/include/InetAddress.h"
+#include "base/include/Thread.h"
+#include "base/include/fmtlog.h"
+#include "src/test/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faliks;
+using namespace std;
+
+// Checks the codec against the RFC handshake example and unmasking and
+// UTF-8 validation at every length around the vector widths, then talks to
+// a WebSocketServer echoing messages: fragmented messages with a ping in
+// between, a large binary message, close handshakes, protocol errors,
+// plain HTTP next to it and a broadcast to a few hundred connections.
+
+const uint16_t kPort = 2047;
+
+using Opcode = WebSocketCodec::Opcode;
+
+void testCodec() {
+    check(WebSocketCodec::acceptKey("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", "accept key");
+
+    const uint32_t key = 0x78563412;
+    const auto *keyBytes = reinterpret_cast<const unsigned char *>(&key);
+    for (size_t len = 0; len < 100; ++len) {
+        string data(len + 3, '\0');
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(i * 7);
+        }
+        // Unaligned on purpose.
+        string masked = data;
+        WebSocketCodec::unmask(&masked[3], len, key);
+        bool ok = masked.substr(0, 3) == data.substr(0, 3);
+        for (size_t i = 0; i < len; ++i) {
+            ok = ok && static_cast<unsigned char>(masked[3 + i]) ==
+                       (static_cast<unsigned char>(data[3 + i]) ^ keyBytes[i % 4]);
+        }
+        check(ok, "unmask " + to_string(len));
+    }
+
+    const vector<string> valid = {"", "hello", "h\xC3\xA9llo", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xED\x9F\xBF",
+                                  "\xF4\x8F\xBF\xBF", "\xEF\xBB\xBF"};
+    const vector<string> invalid = {"\x80", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xED\xA0\x80", "\xF0\x80\x80\x80",
+                                    "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xC3", "\xE2\x82", "\xFF", "\xC3\x28"};
+    // Padded so the sequence lands before, across and after a vector.
+    for (size_t pad = 0; pad < 40; ++pad) {
+        string prefix(pad, 'a');
+        for (auto &text: valid) {
+            check(WebSocketCodec::isValidUtf8(prefix + text + prefix), "valid utf8 " + to_string(pad));
+        }
+        for (auto &text: invalid) {
+            check(!WebSocketCodec::isValidUtf8(prefix + text + prefix), "invalid utf8 " + to_string(pad));
+        }
+    }
+}
+
+int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads up to the end of the response head.
+string readHead(int fd, string *pending) {
+    char buf[4096];
+    size_t end;
+    while ((end = pending->find("\r\n\r\n")) == string::npos) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0) {
+            return "";
+        }
+        pending->append(buf, n);
+    }
+    string head = pending->substr(0, end + 4);
+    pending->erase(0, end + 4);
+    return head;
+}
+
+string handshake(const string &version = "13") {
+    return "GET /ws HTTP/1.1\r\nHost: test\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n"
+           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: " + version + "\r\n\r\n";
+}
+
+int wsConnect(string *pending) {
+    int fd = connectTo(kPort);
+    string request = handshake();
+    ::write(fd, request.data(), request.size());
+    string head = readHead(fd, pending);
+    check(head.compare(0, 12, "HTTP/1.1 101") == 0 &&
+          head.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != string::npos, "handshake");
+    return fd;
+}
+
+void sendFrame(int fd, Opcode opcode, const string &payload, bool fin = true, bool masked = true) {
+    const uint32_t key = 0xA1B2C3D4;
+    string frame;
+    WebSocketCodec::appendFrame(&frame, opcode, payload, fin, masked ? &key : nullptr);
+    ::write(fd, frame.data(), frame.size());
+}
+
+// Returns false at the end of the stream.
+bool readFrame(int fd, string *pending, Opcode *opcode, string *payload) {
+    char buf[65536];
+    while (true) {
+        WebSocketCodec::FrameHeader header{};
+        if (WebSocketCodec::decodeHeader(pending->data(), pending->size(), &header) > 0 &&
+            pending->size() >= header.headerLen + header.payloadLen) {
+            *opcode = header.opcode;
+            *payload = pending->substr(header.headerLen, header.payloadLen);
+            pending->erase(0, header.headerLen + header.payloadLen);
+            return true;
+        }
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0) {
+            return false;
+        }
+        pending->append(buf, n);
+    }
+}
+
+uint16_t closeCode(const string &payload) {
+    return payload.size() < 2 ? 0 : static_cast<uint16_t>((static_cast<uint8_t>(payload[0]) << 8) |
+                                                          static_cast<uint8_t>(payload[1]));
+}
+
+bool atEnd(int fd, string *pending) {
+    Opcode opcode;
+    string payload;
+    return !readFrame(fd, pending, &opcode, &payload);
+}
+
+void testServer() {
+    EventLoop loop;
+    WebSocketServer server(&loop, InetAddress(kPort, true), "WebSocketTest");
+    server.setThreadNum(2);
+    server.setMaxMessageBytes(1024 * 1024);
+    atomic<int> opened(0);
+    atomic<int> closed(0);
+    server.setConnectionCallback([&](const WebSocketServer::WebSocketConnectionPtr &ws) {
+        ++(ws->connected() ? opened : closed);
+    });
+    server.setMessageCallback([](const WebSocketServer::WebSocketConnectionPtr &ws, string_view message,
+                                 bool binary) {
+        if (binary) {
+            ws->sendBinary(message);
+        } else if (message == "bye") {
+            ws->close(4000, "done");
+        } else {
+            ws->send(message);
+        }
+    });
+    server.httpServer()->setHttpCallback([](const HttpRequest &, HttpResponse *response) {
+        response->setBody("plain");
+    });
+    server.start();
+
+    Thread client([&] {
+        string pending;
+        Opcode opcode;
+        string payload;
+        int fd = wsConnect(&pending);
+        sendFrame(fd, Opcode::kText, "hello");
+        check(readFrame(fd, &pending, &opcode, &payload) && opcode == Opcode::kText && payload == "hello", "echo");
+
+        sendFrame(fd, Opcode::kText, "frag", false);
+        sendFrame(fd, Opcode::kPing, "p");
+        sendFrame(fd, Opcode::kContinuation, "men", false);
+        sendFrame(fd, Opcode::kContinuation, "ted \xE2\x82", false);
+        sendFrame(fd, Opcode::kContinuation, "\xAC");
+        check(readFrame(fd, &pending, &opcode, &payload) && opcode == Opcode::kPong && payload == "p", "pong");
+        check(readFrame(fd, &pending, &opcode, &payload) && payload == "fragmented \xE2\x82\xAC",
+              "fragmented message");
+
+        string big(300 * 1000, '\0');
+        for (size_t i = 0; i < big.size(); ++i) {
+            big[i] = static_cast<char>(i * 31);
+        }
+        sendFrame(fd, Opcode::kBinary, big);
+        check(readFrame(fd, &pending, &opcode, &payload) && opcode == Opcode::kBinary && payload == big, "binary");
+
+        sendFrame(fd, Opcode::kClose, string("\x03\xE8", 2));
+        check(readFrame(fd, &pending, &opcode, &payload) && opcode == Opcode::kClose && closeCode(payload) == 1000 &&
+              atEnd(fd, &pending), "close initiated by the client");
+        ::close(fd);
+
+        fd = wsConnect(&pending);
+        sendFrame(fd, Opcode::kText, "bye");
+        check(readFrame(fd, &pending, &opcode, &payload) && opcode == Opcode::kClose && closeCode(payload) == 4000 &&
+              payload.substr(2) == "done", "close initiated by the server");
+        sendFrame(fd, Opcode::kClose, payload);
+        check(atEnd(fd, &pending), "closed after the server's close");
+        ::close(fd);
+
+        struct Bad {
+            string name;
+            function<void(int)> send;
+            uint16_t code;
+        };
+        vector<Bad> bad = {
+                {"invalid utf8",            [](int fd) { sendFrame(fd, Opcode::kText, "\xC0\x80"); },           1007},
+                {"unmasked",                [](int fd) { sendFrame(fd, Opcode::kText, "x", true, false); },     1002},
+                {"continuation first",      [](int fd) { sendFrame(fd, Opcode::kContinuation, "x"); },          1002},
+                {"text inside a message",   [](int fd) {
+                    sendFrame(fd, Opcode::kText, "a", false);
+                    sendFrame(fd, Opcode::kText, "b");
+                },                                                                                              1002},
+                {"fragmented ping",         [](int fd) { sendFrame(fd, Opcode::kPing, "x", false); },           1002},
+                {"reserved opcode",         [](int fd) { sendFrame(fd, static_cast<Opcode>(3), "x"); },         1002},
+                {"too big",                 [](int fd) { sendFrame(fd, Opcode::kBinary, string(2 << 20, 'x')); }, 1009},
+                {"bad close code",          [](int fd) { sendFrame(fd, Opcode::kClose, string("\x03\xED", 2)); }, 1002},
+        };
+        for (auto &entry: bad) {
+            fd = wsConnect(&pending);
+            entry.send(fd);
+            check(readFrame(fd, &pending, &opcode, &payload) && opcode == Opcode::kClose &&
+                  closeCode(payload) == entry.code && atEnd(fd, &pending), entry.name);
+            ::close(fd);
+            pending.clear();
+        }
+
+        fd = connectTo(kPort);
+        string request = "GET / HTTP/1.1\r\n\r\n" + handshake("8");
+        ::write(fd, request.data(), request.size());
+        string head = readHead(fd, &pending);
+        check(head.compare(0, 12, "HTTP/1.1 200") == 0 && pending.substr(0, 5) == "plain", "plain HTTP");
+        pending.erase(0, 5);
+        head = readHead(fd, &pending);
+        check(head.compare(0, 12, "HTTP/1.1 426") == 0, "unsupported version");
+        ::close(fd);
+        pending.clear();
+
+        const int kClients = 300;
+        vector<int> fds;
+        for (int i = 0; i < kClients; ++i) {
+            fds.push_back(wsConnect(&pending));
+            check(pending.empty(), "nothing after the handshake");
+        }
+        while (server.numConnections() != kClients) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        server.broadcast("news");
+        server.broadcast(string(100 * 1000, 'n'));
+        int received = 0;
+        for (int fd: fds) {
+            string mine;
+            if (readFrame(fd, &mine, &opcode, &payload) && payload == "news" &&
+                readFrame(fd, &mine, &opcode, &payload) && payload == string(100 * 1000, 'n')) {
+                ++received;
+            }
+            ::close(fd);
+        }
+        logi("broadcast reached {} of {} connections", received, kClients);
+        check(received == kClients, "broadcast");
+        while (server.numConnections() != 0) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        loop.runInLoop([&] { loop.quit(); });
+    });
+    client.start();
+    loop.loop();
+    client.join();
+    logi("opened {} closed {}", opened.load(), closed.load());
+    check(opened == closed && opened == 2 + 8 + 300, "connection callbacks");
+}
+
+int main() {
+    fmtlog::startPollingThread(1e8);
+    testCodec();
+    testServer();
+    logi("{}", passed ? "passed" : "failed");
+    fmtlog::poll();
+    return passed ? 0 : 1;
+}